@@ -225,6 +225,8 @@ static THD_FUNCTION(packet_process_thread, arg) {
 
 	chRegSetThreadName("uartcomm proc");
 
+	static uint8_t rx_buffer[64];
+
 	event_listener_t el[UART_NUMBER];
 	for(int port_number = 0; port_number < UART_NUMBER; port_number++) {
 		chEvtRegisterMaskWithFlags(&(*serialPortDriverRx[port_number]).event, &el[port_number], EVENT_MASK(0), CHN_INPUT_AVAILABLE);
@@ -238,9 +240,10 @@ static THD_FUNCTION(packet_process_thread, arg) {
 			rx = false;
 			for(int port_number = 0; port_number < UART_NUMBER; port_number++) {
 				if (uart_is_running[port_number]) {
-					msg_t res = sdGetTimeout(serialPortDriverRx[port_number], TIME_IMMEDIATE);
-					if (res != MSG_TIMEOUT) {
-						packet_process_byte(res, &packet_state[port_number]);
+					size_t len = sdReadTimeout(serialPortDriverRx[port_number],
+							rx_buffer, sizeof(rx_buffer), TIME_IMMEDIATE);
+					if (len > 0) {
+						packet_process_buffer(rx_buffer, len, &packet_state[port_number]);
 						rx = true;
 					}
 				}
@@ -0,0 +1,91 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "can_rx_queue.h"
+#include <string.h>
+
+void can_rx_queue_init(can_rx_queue *q) {
+	memset(q, 0, sizeof(can_rx_queue));
+}
+
+/**
+ * Add a frame to the queue. Must only be called from the producer thread.
+ *
+ * @param q
+ * The queue.
+ *
+ * @param frame
+ * The frame to copy into the queue.
+ *
+ * @return
+ * true if the frame was added, false if the queue was full and the frame
+ * was dropped.
+ */
+bool can_rx_queue_push(can_rx_queue *q, const CANRxFrame *frame) {
+	uint32_t write = q->write;
+	uint32_t read = __atomic_load_n(&q->read, __ATOMIC_ACQUIRE);
+
+	if ((write - read) >= CAN_RX_QUEUE_SIZE) {
+		q->drop_cnt++;
+		return false;
+	}
+
+	q->frames[write & (CAN_RX_QUEUE_SIZE - 1)] = *frame;
+	__atomic_store_n(&q->write, write + 1, __ATOMIC_RELEASE);
+
+	q->rx_cnt++;
+	if ((write + 1 - read) > q->high_water) {
+		q->high_water = write + 1 - read;
+	}
+
+	return true;
+}
+
+/**
+ * Take the oldest frame from the queue. Must only be called from the
+ * consumer thread.
+ *
+ * @param q
+ * The queue.
+ *
+ * @param frame
+ * The frame is copied here. The slot is released after the copy, so the
+ * producer cannot overwrite it while it is being read.
+ *
+ * @return
+ * true if a frame was read, false if the queue was empty.
+ */
+bool can_rx_queue_pop(can_rx_queue *q, CANRxFrame *frame) {
+	uint32_t read = q->read;
+	uint32_t write = __atomic_load_n(&q->write, __ATOMIC_ACQUIRE);
+
+	if (read == write) {
+		return false;
+	}
+
+	*frame = q->frames[read & (CAN_RX_QUEUE_SIZE - 1)];
+	__atomic_store_n(&q->read, read + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+unsigned int can_rx_queue_count(can_rx_queue *q) {
+	return __atomic_load_n(&q->write, __ATOMIC_ACQUIRE) -
+			__atomic_load_n(&q->read, __ATOMIC_ACQUIRE);
+}
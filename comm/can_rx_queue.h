@@ -0,0 +1,53 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef COMM_CAN_RX_QUEUE_H_
+#define COMM_CAN_RX_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+
+// Settings
+#ifndef CAN_RX_QUEUE_SIZE
+#define CAN_RX_QUEUE_SIZE		64 // Must be a power of two
+#endif
+
+/*
+ * Single-producer single-consumer queue for received CAN frames. The read
+ * and write counters run freely and are only written by their own side, so
+ * no lock is needed. When the queue is full new frames are dropped and
+ * counted, the frames already in the queue are never overwritten.
+ */
+typedef struct {
+	CANRxFrame frames[CAN_RX_QUEUE_SIZE];
+	volatile uint32_t write;
+	volatile uint32_t read;
+	volatile uint32_t rx_cnt;
+	volatile uint32_t drop_cnt;
+	volatile uint32_t high_water;
+} can_rx_queue;
+
+// Functions
+void can_rx_queue_init(can_rx_queue *q);
+bool can_rx_queue_push(can_rx_queue *q, const CANRxFrame *frame);
+bool can_rx_queue_pop(can_rx_queue *q, CANRxFrame *frame);
+unsigned int can_rx_queue_count(can_rx_queue *q);
+
+#endif /* COMM_CAN_RX_QUEUE_H_ */
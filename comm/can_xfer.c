@@ -0,0 +1,421 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Windowed multi-frame transport for large buffers over CAN.
+ *
+ * The packet ids are not known to older firmware, so the sender only uses
+ * this with receivers that set CAN_PONG_CAP_XFER in their ping reply.
+ *
+ * The sender first sends START with its id, the length, the CRC and the
+ * window size it wants. The receiver answers START_ACK with the window it
+ * grants, or with window 0 when it is busy or the buffer is too large. No
+ * answer means that the receiver does not support the transport after all,
+ * and the caller should use the old FILL_RX_BUFFER protocol.
+ *
+ * Data frames carry 8 payload bytes each. The frame index is put in the
+ * upper bits of the extended id, so that no payload bytes are spent on it.
+ * The sender keeps up to window frames in flight. The receiver sends ACK
+ * with the index of the first missing frame and a bitmap of the 32 frames
+ * after it. An ACK is sent every half window, at the first gap after the
+ * last ACK and when a duplicate arrives. The sender retransmits only the
+ * holes in the bitmap, and everything that is unacknowledged on timeout.
+ * When all frames are in, the receiver checks the CRC and sends DONE.
+ *
+ * START:     [START, sender, commands_send, len_h, len_l, crc_h, crc_l, window]
+ * START_ACK: [START_ACK, receiver, window]
+ * ACK:       [ACK, receiver, next_h, next_l, bitmap (4 bytes, MSB first)]
+ * DONE:      [DONE, receiver, status (0 = OK, 1 = CRC error)]
+ */
+
+#include "can_xfer.h"
+#include "crc.h"
+#include <string.h>
+
+#define BIT_GET(bm, i)		((bm[(i) / 32] >> ((i) % 32)) & 1)
+#define BIT_SET(bm, i)		(bm[(i) / 32] |= (1U << ((i) % 32)))
+#define NO_ACK				0xFFFFFFFF
+
+static unsigned int frame_len(unsigned int len, unsigned int frame) {
+	unsigned int left = len - frame * CAN_XFER_FRAME_BYTES;
+	return left > CAN_XFER_FRAME_BYTES ? CAN_XFER_FRAME_BYTES : left;
+}
+
+static void tx_send_frame(can_xfer_tx *tx, unsigned int frame) {
+	tx->send_data(tx->dest_id, frame, (uint8_t*)tx->data + frame * CAN_XFER_FRAME_BYTES,
+			frame_len(tx->len, frame));
+	tx->frames_sent++;
+}
+
+static void tx_resend_frame(can_xfer_tx *tx, unsigned int frame) {
+	tx_send_frame(tx, frame);
+	tx->frames_resent++;
+}
+
+static void tx_send_start(can_xfer_tx *tx) {
+	uint16_t crc = crc16((unsigned char*)tx->data, tx->len);
+	uint8_t buffer[8];
+	buffer[0] = CAN_XFER_CTRL_START;
+	buffer[1] = tx->own_id;
+	buffer[2] = tx->commands_send;
+	buffer[3] = tx->len >> 8;
+	buffer[4] = tx->len & 0xFF;
+	buffer[5] = crc >> 8;
+	buffer[6] = crc & 0xFF;
+	buffer[7] = tx->window;
+	tx->send_ctrl(tx->dest_id, buffer, 8);
+}
+
+void can_xfer_tx_init(can_xfer_tx *tx, uint8_t own_id,
+		uint32_t timeout_start, uint32_t timeout_ack,
+		void(*send_ctrl)(uint8_t id, uint8_t *data, uint8_t len),
+		void(*send_data)(uint8_t id, unsigned int seq, uint8_t *data, uint8_t len)) {
+	memset(tx, 0, sizeof(can_xfer_tx));
+	tx->own_id = own_id;
+	tx->window = CAN_XFER_WINDOW;
+	tx->timeout_start = timeout_start;
+	tx->timeout_ack = timeout_ack;
+	tx->retries_max = 10;
+	tx->send_ctrl = send_ctrl;
+	tx->send_data = send_data;
+}
+
+/**
+ * Start a transfer. The data must stay valid until can_xfer_tx_update returns
+ * something else than CAN_XFER_NEGOTIATING or CAN_XFER_RUNNING.
+ *
+ * @return
+ * false if the transfer is too long or empty.
+ */
+bool can_xfer_tx_start(can_xfer_tx *tx, uint8_t dest_id, uint8_t commands_send,
+		const uint8_t *data, unsigned int len, uint32_t now) {
+	unsigned int frames = (len + CAN_XFER_FRAME_BYTES - 1) / CAN_XFER_FRAME_BYTES;
+
+	if (len == 0 || len > 0xFFFF || frames > CAN_XFER_MAX_FRAMES) {
+		tx->state = CAN_XFER_FAILED;
+		return false;
+	}
+
+	tx->dest_id = dest_id;
+	tx->commands_send = commands_send;
+	tx->data = data;
+	tx->len = len;
+	tx->frames = frames;
+	tx->base = 0;
+	tx->next = 0;
+	tx->hole_ack = NO_ACK;
+	tx->retries = 0;
+	tx->time_last = now;
+	tx->frames_sent = 0;
+	tx->frames_resent = 0;
+	memset(tx->acked, 0, sizeof(tx->acked));
+
+	tx->state = CAN_XFER_NEGOTIATING;
+	tx_send_start(tx);
+
+	return true;
+}
+
+/**
+ * Process a control frame from the receiver.
+ */
+void can_xfer_tx_process_ctrl(can_xfer_tx *tx, uint8_t *data8, int len, uint32_t now) {
+	if (len < 3 || data8[1] != tx->dest_id) {
+		return;
+	}
+
+	switch (data8[0]) {
+	case CAN_XFER_CTRL_START_ACK:
+		if (tx->state == CAN_XFER_NEGOTIATING) {
+			if (data8[2] == 0) {
+				tx->state = CAN_XFER_BUSY;
+			} else {
+				tx->window_now = data8[2] < tx->window ? data8[2] : tx->window;
+				tx->state = CAN_XFER_RUNNING;
+				tx->retries = 0;
+				tx->time_last = now;
+			}
+		}
+		break;
+
+	case CAN_XFER_CTRL_ACK: {
+		if (tx->state != CAN_XFER_RUNNING || len < 8) {
+			break;
+		}
+
+		unsigned int ack_next = (unsigned int)data8[2] << 8 | (unsigned int)data8[3];
+		uint32_t bitmap = (uint32_t)data8[4] << 24 | (uint32_t)data8[5] << 16 |
+				(uint32_t)data8[6] << 8 | (uint32_t)data8[7];
+
+		if (ack_next > tx->next) {
+			break;
+		}
+
+		bool progress = false;
+		for (unsigned int i = tx->base;i < ack_next;i++) {
+			if (!BIT_GET(tx->acked, i)) {
+				BIT_SET(tx->acked, i);
+				progress = true;
+			}
+		}
+
+		unsigned int highest = ack_next;
+		for (unsigned int i = 0;i < 32;i++) {
+			unsigned int frame = ack_next + 1 + i;
+			if ((bitmap >> i) & 1 && frame < tx->next) {
+				if (!BIT_GET(tx->acked, frame)) {
+					BIT_SET(tx->acked, frame);
+					progress = true;
+				}
+				highest = frame;
+			}
+		}
+
+		while (tx->base < tx->next && BIT_GET(tx->acked, tx->base)) {
+			tx->base++;
+		}
+
+		// Frames before the highest received one are lost, as CAN does not
+		// reorder frames. Send them again once per hole position.
+		if (highest > ack_next && ack_next != tx->hole_ack) {
+			for (unsigned int i = tx->base;i < highest;i++) {
+				if (!BIT_GET(tx->acked, i)) {
+					tx_resend_frame(tx, i);
+				}
+			}
+			tx->hole_ack = ack_next;
+		}
+
+		if (progress) {
+			tx->retries = 0;
+			tx->time_last = now;
+		}
+	} break;
+
+	case CAN_XFER_CTRL_DONE:
+		if (tx->state == CAN_XFER_RUNNING) {
+			tx->state = data8[2] == 0 ? CAN_XFER_DONE : CAN_XFER_FAILED;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/**
+ * Send new frames when the window allows it and handle timeouts. Call this
+ * after every control frame and periodically.
+ *
+ * @return
+ * The state of the transfer.
+ */
+CAN_XFER_STATE can_xfer_tx_update(can_xfer_tx *tx, uint32_t now) {
+	if (tx->state == CAN_XFER_NEGOTIATING) {
+		if ((now - tx->time_last) > tx->timeout_start) {
+			// START or START_ACK can be lost too, so try a few times before
+			// deciding that the receiver does not know this protocol.
+			if (++tx->retries > 2) {
+				tx->state = CAN_XFER_UNSUPPORTED;
+			} else {
+				tx->time_last = now;
+				tx_send_start(tx);
+			}
+		}
+	} else if (tx->state == CAN_XFER_RUNNING) {
+		while (tx->next < tx->frames && tx->next < (tx->base + tx->window_now)) {
+			tx_send_frame(tx, tx->next++);
+		}
+
+		if ((now - tx->time_last) > tx->timeout_ack) {
+			if (++tx->retries > tx->retries_max) {
+				tx->state = CAN_XFER_FAILED;
+			} else {
+				tx->time_last = now;
+				tx->hole_ack = NO_ACK;
+
+				if (tx->base == tx->frames) {
+					// Everything is acknowledged but DONE was lost. The
+					// receiver repeats it when it sees a frame.
+					tx_resend_frame(tx, tx->frames - 1);
+				} else {
+					// Only the first missing frame is sent again. The receiver
+					// answers with an ACK that tells what else is missing.
+					tx_resend_frame(tx, tx->base);
+				}
+			}
+		}
+	}
+
+	return tx->state;
+}
+
+static void rx_send_ack(can_xfer_rx *rx) {
+	uint32_t bitmap = 0;
+	for (unsigned int i = 0;i < 32;i++) {
+		unsigned int frame = rx->next + 1 + i;
+		if (frame < rx->frames && BIT_GET(rx->received, frame)) {
+			bitmap |= 1U << i;
+		}
+	}
+
+	uint8_t buffer[8];
+	buffer[0] = CAN_XFER_CTRL_ACK;
+	buffer[1] = rx->own_id;
+	buffer[2] = rx->next >> 8;
+	buffer[3] = rx->next & 0xFF;
+	buffer[4] = bitmap >> 24;
+	buffer[5] = (bitmap >> 16) & 0xFF;
+	buffer[6] = (bitmap >> 8) & 0xFF;
+	buffer[7] = bitmap & 0xFF;
+	rx->send_ctrl(rx->sender_id, buffer, 8);
+	rx->since_ack = 0;
+}
+
+static void rx_send_start_ack(can_xfer_rx *rx, uint8_t sender, uint8_t window) {
+	uint8_t buffer[3];
+	buffer[0] = CAN_XFER_CTRL_START_ACK;
+	buffer[1] = rx->own_id;
+	buffer[2] = window;
+	rx->send_ctrl(sender, buffer, 3);
+}
+
+static void rx_send_done(can_xfer_rx *rx) {
+	uint8_t buffer[3];
+	buffer[0] = CAN_XFER_CTRL_DONE;
+	buffer[1] = rx->own_id;
+	buffer[2] = rx->done_status;
+	rx->send_ctrl(rx->done_sender, buffer, 3);
+}
+
+void can_xfer_rx_init(can_xfer_rx *rx, uint8_t own_id, uint8_t *buffer,
+		unsigned int buffer_size, uint32_t timeout,
+		void(*send_ctrl)(uint8_t id, uint8_t *data, uint8_t len)) {
+	memset(rx, 0, sizeof(can_xfer_rx));
+	rx->own_id = own_id;
+	rx->window = CAN_XFER_WINDOW;
+	rx->timeout = timeout;
+	rx->buffer = buffer;
+	rx->buffer_size = buffer_size;
+	rx->send_ctrl = send_ctrl;
+}
+
+/**
+ * Process a START frame. Only one transfer is received at a time, other
+ * senders get window 0 until it finishes or times out.
+ */
+void can_xfer_rx_process_ctrl(can_xfer_rx *rx, uint8_t *data8, int len, uint32_t now) {
+	if (len < 8 || data8[0] != CAN_XFER_CTRL_START) {
+		return;
+	}
+
+	uint8_t sender = data8[1];
+	unsigned int xfer_len = (unsigned int)data8[3] << 8 | (unsigned int)data8[4];
+	unsigned int frames = (xfer_len + CAN_XFER_FRAME_BYTES - 1) / CAN_XFER_FRAME_BYTES;
+
+	bool busy = rx->active && sender != rx->sender_id &&
+			(now - rx->time_last) < rx->timeout;
+
+	if (busy || xfer_len == 0 || xfer_len > rx->buffer_size ||
+			frames > CAN_XFER_MAX_FRAMES || data8[7] == 0) {
+		rx_send_start_ack(rx, sender, 0);
+		return;
+	}
+
+	rx->active = true;
+	rx->done_valid = false;
+	rx->sender_id = sender;
+	rx->commands_send = data8[2];
+	rx->len = xfer_len;
+	rx->frames = frames;
+	rx->crc = (uint16_t)data8[5] << 8 | (uint16_t)data8[6];
+	rx->window_now = data8[7] < rx->window ? data8[7] : rx->window;
+	rx->next = 0;
+	rx->since_ack = 0;
+	rx->gap_ack = NO_ACK;
+	rx->time_last = now;
+	memset(rx->received, 0, sizeof(rx->received));
+
+	rx_send_start_ack(rx, sender, rx->window_now);
+}
+
+/**
+ * Process a data frame.
+ *
+ * @return
+ * true when a transfer has been completed with a valid CRC. The data is then
+ * in buffer, and len, sender_id and commands_send describe it.
+ */
+bool can_xfer_rx_process_data(can_xfer_rx *rx, unsigned int seq,
+		uint8_t *data8, int len, uint32_t now) {
+	if (!rx->active) {
+		if (rx->done_valid && (now - rx->done_time) < rx->timeout) {
+			rx_send_done(rx);
+		}
+		return false;
+	}
+
+	if (seq >= rx->frames || len != (int)frame_len(rx->len, seq)) {
+		return false;
+	}
+
+	rx->time_last = now;
+
+	if (BIT_GET(rx->received, seq)) {
+		// The sender timed out, tell it where we are.
+		rx_send_ack(rx);
+		return false;
+	}
+
+	memcpy(rx->buffer + seq * CAN_XFER_FRAME_BYTES, data8, len);
+	BIT_SET(rx->received, seq);
+
+	if (seq == rx->next) {
+		unsigned int next_old = rx->next;
+		while (rx->next < rx->frames && BIT_GET(rx->received, rx->next)) {
+			rx->next++;
+		}
+		rx->since_ack++;
+
+		// A retransmitted frame filled a hole, tell the sender about the
+		// next one right away.
+		if (rx->next != (next_old + 1) && rx->next != rx->frames) {
+			rx_send_ack(rx);
+		}
+	} else if (rx->gap_ack != rx->next) {
+		rx_send_ack(rx);
+		rx->gap_ack = rx->next;
+	}
+
+	if (rx->next == rx->frames) {
+		rx->active = false;
+		rx->done_valid = true;
+		rx->done_sender = rx->sender_id;
+		rx->done_time = now;
+		rx->done_status = crc16(rx->buffer, rx->len) == rx->crc ? 0 : 1;
+		rx_send_done(rx);
+		return rx->done_status == 0;
+	}
+
+	if (rx->since_ack >= (unsigned int)(rx->window_now / 2)) {
+		rx_send_ack(rx);
+	}
+
+	return false;
+}
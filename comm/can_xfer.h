@@ -0,0 +1,129 @@
+/*
+	Copyright 2023 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef COMM_CAN_XFER_H_
+#define COMM_CAN_XFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Settings
+#ifndef CAN_XFER_MAX_FRAMES
+#define CAN_XFER_MAX_FRAMES		512 // 4 kB per transfer
+#endif
+#define CAN_XFER_FRAME_BYTES	8
+#define CAN_XFER_WINDOW			32
+
+// Bit in the third byte of CAN_PACKET_PONG. Senders only use the transport
+// with receivers that set it.
+#define CAN_PONG_CAP_XFER		(1 << 0)
+
+// Control frame types
+#define CAN_XFER_CTRL_START		0
+#define CAN_XFER_CTRL_START_ACK	1
+#define CAN_XFER_CTRL_ACK		2
+#define CAN_XFER_CTRL_DONE		3
+
+typedef enum {
+	CAN_XFER_IDLE = 0,
+	CAN_XFER_NEGOTIATING,
+	CAN_XFER_RUNNING,
+	CAN_XFER_DONE,
+	CAN_XFER_FAILED,
+	CAN_XFER_BUSY,
+	CAN_XFER_UNSUPPORTED
+} CAN_XFER_STATE;
+
+/*
+ * Times are in an arbitrary tick unit, the timeouts just have to use the same
+ * unit as the now arguments.
+ */
+typedef struct {
+	void(*send_ctrl)(uint8_t id, uint8_t *data, uint8_t len);
+	void(*send_data)(uint8_t id, unsigned int seq, uint8_t *data, uint8_t len);
+	uint8_t own_id;
+	uint8_t window;
+	uint32_t timeout_start;
+	uint32_t timeout_ack;
+	int retries_max;
+
+	CAN_XFER_STATE state;
+	uint8_t dest_id;
+	uint8_t commands_send;
+	uint8_t window_now;
+	const uint8_t *data;
+	unsigned int len;
+	unsigned int frames;
+	unsigned int base; // All frames before this one are acknowledged
+	unsigned int next; // Next frame that has not been sent yet
+	unsigned int hole_ack;
+	int retries;
+	uint32_t time_last;
+	uint32_t acked[CAN_XFER_MAX_FRAMES / 32];
+
+	unsigned int frames_sent;
+	unsigned int frames_resent;
+} can_xfer_tx;
+
+typedef struct {
+	void(*send_ctrl)(uint8_t id, uint8_t *data, uint8_t len);
+	uint8_t own_id;
+	uint8_t window;
+	uint32_t timeout;
+	uint8_t *buffer;
+	unsigned int buffer_size;
+
+	bool active;
+	uint8_t sender_id;
+	uint8_t commands_send;
+	uint8_t window_now;
+	unsigned int len;
+	unsigned int frames;
+	unsigned int next; // First frame that has not been received
+	unsigned int since_ack;
+	unsigned int gap_ack;
+	uint16_t crc;
+	uint32_t time_last;
+	uint32_t received[CAN_XFER_MAX_FRAMES / 32];
+
+	// Last finished transfer, so that a lost DONE can be repeated
+	bool done_valid;
+	uint8_t done_sender;
+	uint8_t done_status;
+	uint32_t done_time;
+} can_xfer_rx;
+
+// Functions
+void can_xfer_tx_init(can_xfer_tx *tx, uint8_t own_id,
+		uint32_t timeout_start, uint32_t timeout_ack,
+		void(*send_ctrl)(uint8_t id, uint8_t *data, uint8_t len),
+		void(*send_data)(uint8_t id, unsigned int seq, uint8_t *data, uint8_t len));
+bool can_xfer_tx_start(can_xfer_tx *tx, uint8_t dest_id, uint8_t commands_send,
+		const uint8_t *data, unsigned int len, uint32_t now);
+void can_xfer_tx_process_ctrl(can_xfer_tx *tx, uint8_t *data8, int len, uint32_t now);
+CAN_XFER_STATE can_xfer_tx_update(can_xfer_tx *tx, uint32_t now);
+
+void can_xfer_rx_init(can_xfer_rx *rx, uint8_t own_id, uint8_t *buffer,
+		unsigned int buffer_size, uint32_t timeout,
+		void(*send_ctrl)(uint8_t id, uint8_t *data, uint8_t len));
+void can_xfer_rx_process_ctrl(can_xfer_rx *rx, uint8_t *data8, int len, uint32_t now);
+bool can_xfer_rx_process_data(can_xfer_rx *rx, unsigned int seq,
+		uint8_t *data8, int len, uint32_t now);
+
+#endif /* COMM_CAN_XFER_H_ */
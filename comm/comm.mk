@@ -4,6 +4,8 @@ CSRC += \
 	comm/comm_usb.c \
 	comm/comm_can.c \
 	comm/packet.c \
+	comm/can_rx_queue.c \
+	comm/can_xfer.c \
 	comm/log.c
 
 INCDIR += comm
@@ -43,32 +43,36 @@
 #include "encoder_cfg.h"
 #include "servo_dec.h"
 #include "utils.h"
+#include "terminal.h"
+#include "can_rx_queue.h"
+#include "can_xfer.h"
 #ifdef USE_LISPBM
 #include "lispif.h"
 #endif
 
 // Settings
-#define RX_FRAMES_SIZE	50
 #define RX_BUFFER_NUM	3
 #define RX_BUFFER_SIZE	PACKET_MAX_PL_LEN
+#define XFER_MIN_LEN	128
+#define XFER_CTRL_QUEUE_SIZE	8 // Must be a power of two
+#define XFER_BUSY_WAIT_MS	5
+#define XFER_EVT_START	(1 << 0)
+#define XFER_EVT_CTRL	(1 << 1)
+#define XFER_BIT_GET(bm, i)		((bm[(i) / 32] >> ((i) % 32)) & 1)
 
 #if CAN_ENABLE
 
-typedef struct {
-	CANRxFrame rx_frames[RX_FRAMES_SIZE];
-	int frame_read;
-	int frame_write;
-} rx_state;
-
 // Threads
 __attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_read_thread_wa, 256);
 __attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_process_thread_wa, 2048);
 __attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_status_thread_wa, 512);
 __attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_status_thread_2_wa, 512);
+static THD_WORKING_AREA(cancom_xfer_thread_wa, 512); // Not in .ram4, the lisp heap is sized to fill it
 static THD_FUNCTION(cancom_read_thread, arg);
 static THD_FUNCTION(cancom_status_thread, arg);
 static THD_FUNCTION(cancom_status_thread_2, arg);
 static THD_FUNCTION(cancom_process_thread, arg);
+static THD_FUNCTION(cancom_xfer_thread, arg);
 
 #ifdef HW_HAS_DUAL_MOTORS
 static THD_FUNCTION(cancom_status_internal_thread, arg);
@@ -81,12 +85,43 @@ static uint8_t rx_buffer[RX_BUFFER_NUM][RX_BUFFER_SIZE];
 static int rx_buffer_offset[RX_BUFFER_NUM];
 static volatile unsigned int rx_buffer_last_id;
 static volatile unsigned int rx_buffer_response_type = 1;
-static rx_state m_rx_state;
+static can_rx_queue m_rx_queue;
 #ifdef HW_CAN2_DEV
-static rx_state m_rx_state2;
+static can_rx_queue m_rx_queue2;
 #endif
 
 static thread_t *process_tp = 0;
+
+// Windowed transport. Transfers are copied to xfer_tx_buffer and sent by the
+// xfer thread, so that comm_can_send_buffer does not wait for them. Both
+// buffers hold one packet, as that is all the commands module can process.
+static mutex_t can_xfer_mtx;
+static can_xfer_tx m_xfer_tx;
+static can_xfer_rx m_xfer_rx;
+static uint8_t xfer_tx_buffer[RX_BUFFER_SIZE];
+static uint8_t xfer_rx_buffer[RX_BUFFER_SIZE];
+static unsigned int xfer_tx_len;
+static uint8_t xfer_tx_dest;
+static uint8_t xfer_tx_send;
+static volatile bool xfer_tx_busy = false;
+static thread_t *xfer_tp = 0;
+
+// Peers that answered a ping with CAN_PONG_CAP_XFER, and peers that have
+// been pinged. Only the former get the windowed transport. Updated with
+// xfer_peer_update, as both the process thread and senders change them.
+static uint32_t xfer_supported[256 / 32];
+static uint32_t xfer_probed[256 / 32];
+
+// Control frames for the running transfer, from the read thread to the xfer
+// thread. They bypass the process thread, so that it can wait for a transfer.
+typedef struct {
+	uint8_t len;
+	uint8_t data[8];
+} xfer_ctrl_frame;
+
+static xfer_ctrl_frame xfer_ctrl_queue[XFER_CTRL_QUEUE_SIZE];
+static uint32_t xfer_ctrl_write = 0;
+static uint32_t xfer_ctrl_read = 0;
 static thread_t *ping_tp = 0;
 static volatile HW_TYPE ping_hw_last = HW_TYPE_VESC;
 static volatile int ping_hw_last_id = -1;
@@ -94,12 +129,9 @@ static volatile bool init_done = false;
 #endif
 
 // Variables
-static can_status_msg stat_msgs[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_2 stat_msgs_2[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_3 stat_msgs_3[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_4 stat_msgs_4[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_5 stat_msgs_5[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_6 stat_msgs_6[CAN_STATUS_MSGS_TO_STORE];
+static can_status_node stat_nodes[CAN_STATUS_MSGS_TO_STORE];
+static uint8_t stat_node_ind[256]; // Controller id -> stat_nodes index, 0xFF if none
+static int stat_node_num = 0;
 static io_board_adc_values io_board_adc_1_4[CAN_STATUS_MSGS_TO_STORE];
 static io_board_adc_values io_board_adc_5_8[CAN_STATUS_MSGS_TO_STORE];
 static io_board_digial_inputs io_board_digital_in[CAN_STATUS_MSGS_TO_STORE];
@@ -123,20 +155,33 @@ static void set_timing(int brp, int ts1, int ts2);
 #if CAN_ENABLE
 static void send_packet_wrapper(unsigned char *data, unsigned int len);
 static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced);
+static void terminal_can_rx_stats(int argc, const char **argv);
+static void xfer_send_ctrl(uint8_t id, uint8_t *data, uint8_t len);
+static void xfer_send_data(uint8_t id, unsigned int seq, uint8_t *data, uint8_t len);
+static bool send_buffer_xfer(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send);
+static void xfer_wait_peer(uint8_t controller_id);
+static bool xfer_peer_update(uint32_t *bm, uint8_t id, bool set);
+static bool xfer_route_ctrl(CANRxFrame *rxmsg);
 #endif
+static void send_buffer_fragments(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send);
 
 // Function pointers
 static bool(*sid_callback)(uint32_t id, uint8_t *data, uint8_t len) = 0;
 static bool(*eid_callback)(uint32_t id, uint8_t *data, uint8_t len) = 0;
 
 void comm_can_init(void) {
+	memset(stat_node_ind, 0xFF, sizeof(stat_node_ind));
+	stat_node_num = 0;
+
 	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		stat_msgs[i].id = -1;
-		stat_msgs_2[i].id = -1;
-		stat_msgs_3[i].id = -1;
-		stat_msgs_4[i].id = -1;
-		stat_msgs_5[i].id = -1;
-		stat_msgs_6[i].id = -1;
+		memset(&stat_nodes[i], 0, sizeof(can_status_node));
+		stat_nodes[i].id = -1;
+		stat_nodes[i].msg_1.id = -1;
+		stat_nodes[i].msg_2.id = -1;
+		stat_nodes[i].msg_3.id = -1;
+		stat_nodes[i].msg_4.id = -1;
+		stat_nodes[i].msg_5.id = -1;
+		stat_nodes[i].msg_6.id = -1;
 
 		io_board_adc_1_4[i].id = -1;
 		io_board_adc_5_8[i].id = -1;
@@ -146,10 +191,17 @@ void comm_can_init(void) {
 	}
 
 #if CAN_ENABLE
-	memset(&m_rx_state, 0, sizeof(m_rx_state));
+	can_rx_queue_init(&m_rx_queue);
+#ifdef HW_CAN2_DEV
+	can_rx_queue_init(&m_rx_queue2);
+#endif
 
 	chMtxObjectInit(&can_mtx);
 	chMtxObjectInit(&can_rx_mtx);
+	chMtxObjectInit(&can_xfer_mtx);
+
+	can_xfer_tx_init(&m_xfer_tx, 0, MS2ST(10), MS2ST(30), xfer_send_ctrl, xfer_send_data);
+	can_xfer_rx_init(&m_xfer_rx, 0, xfer_rx_buffer, sizeof(xfer_rx_buffer), MS2ST(100), xfer_send_ctrl);
 
 	palSetPadMode(HW_CANRX_PORT, HW_CANRX_PIN,
 			PAL_MODE_ALTERNATE(HW_CAN_GPIO_AF) |
@@ -194,11 +246,19 @@ void comm_can_init(void) {
 			cancom_status_thread_2, NULL);
 	chThdCreateStatic(cancom_process_thread_wa, sizeof(cancom_process_thread_wa), NORMALPRIO,
 			cancom_process_thread, NULL);
+	xfer_tp = chThdCreateStatic(cancom_xfer_thread_wa, sizeof(cancom_xfer_thread_wa), NORMALPRIO,
+			cancom_xfer_thread, NULL);
 #ifdef HW_HAS_DUAL_MOTORS
 	chThdCreateStatic(cancom_status_internal_thread_wa, sizeof(cancom_status_internal_thread_wa),
 			NORMALPRIO, cancom_status_internal_thread, NULL);
 #endif
 
+	terminal_register_command_callback(
+			"can_rx_stats",
+			"Print the number of received and dropped CAN frames per interface.",
+			0,
+			terminal_can_rx_stats);
+
 	init_done = true;
 
 #endif
@@ -439,8 +499,31 @@ void comm_can_set_eid_rx_callback(bool (*p_func)(uint32_t id, uint8_t *data, uin
  * 2: Packet goes to commands_process and send function is set to null
  *    so that no reply is sent back.
  * 3: Same as 0, but the reply is processed locally and not sent out on the last interface.
+ *
+ * Buffers longer than XFER_MIN_LEN are sent with the windowed transport in
+ * can_xfer.c to receivers that announced support for it in their ping reply.
+ * It uses all 8 bytes of every frame and retransmits lost frames. The buffer
+ * is copied and sent in the background, so this returns right away. Other
+ * receivers, and buffers sent while a transfer to another receiver is
+ * running, get the fragments below. Buffers to a receiver that a transfer is
+ * running to wait for it, so that they arrive in order.
  */
 void comm_can_send_buffer(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
+#if CAN_ENABLE
+	xfer_wait_peer(controller_id);
+
+	if (len > XFER_MIN_LEN && send_buffer_xfer(controller_id, data, len, send)) {
+		return;
+	}
+#endif
+
+	send_buffer_fragments(controller_id, data, len, send);
+}
+
+/*
+ * Send a buffer up to RX_BUFFER_SIZE bytes with the FILL_RX_BUFFER fragments.
+ */
+static void send_buffer_fragments(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
 	uint8_t send_buffer[8];
 
 	if (len <= 6) {
@@ -829,6 +912,82 @@ void comm_can_send_update_baud(int kbits, int delay_msec) {
 				buffer, send_index, false, 0);
 }
 
+/**
+ * Get the status record of a node by index. The records are allocated in the
+ * order the nodes are first heard from.
+ *
+ * @param index
+ * Index in the array
+ *
+ * @return
+ * The record or 0 for an invalid index.
+ */
+can_status_node *comm_can_get_status_node_index(int index) {
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &stat_nodes[index];
+	} else {
+		return 0;
+	}
+}
+
+/**
+ * Get the status record of a node by id. This is a table lookup, so it is
+ * cheap enough to call at a high rate.
+ *
+ * @param id
+ * Id of the controller that sent the status messages.
+ *
+ * @return
+ * The record or 0 if nothing has been received from that id.
+ */
+can_status_node *comm_can_get_status_node_id(int id) {
+	if (id < 0 || id > 255 || stat_node_ind[id] == 0xFF) {
+		return 0;
+	}
+
+	return &stat_nodes[stat_node_ind[id]];
+}
+
+/**
+ * Get the age of the latest status message of any type from a node.
+ *
+ * @param id
+ * Id of the controller that sent the status messages.
+ *
+ * @return
+ * The age in seconds, or -1.0 if nothing has been received from that id.
+ */
+float comm_can_get_status_age(int id) {
+	can_status_node *node = comm_can_get_status_node_id(id);
+
+	if (!node) {
+		return -1.0;
+	}
+
+	return UTILS_AGE_S(node->rx_time);
+}
+
+/**
+ * Get and clear the status messages that were updated since the last call.
+ *
+ * @param id
+ * Id of the controller that sent the status messages.
+ *
+ * @return
+ * Bitmask where CAN_STATUS_BIT(n) is set if status n was updated. 0 if
+ * nothing was updated or nothing has been received from that id.
+ */
+uint8_t comm_can_get_status_changed(int id) {
+	can_status_node *node = comm_can_get_status_node_id(id);
+
+	if (!node) {
+		return 0;
+	}
+
+	// The RX thread sets bits at any time, so read and clear in one step
+	return __atomic_exchange_n(&node->changed, 0, __ATOMIC_ACQ_REL);
+}
+
 /**
  * Get status message by index.
  *
@@ -840,7 +999,7 @@ void comm_can_send_update_baud(int kbits, int delay_msec) {
  */
 can_status_msg *comm_can_get_status_msg_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs[index];
+		return &stat_nodes[index].msg_1;
 	} else {
 		return 0;
 	}
@@ -856,10 +1015,10 @@ can_status_msg *comm_can_get_status_msg_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg *comm_can_get_status_msg_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs[i].id == id) {
-			return &stat_msgs[i];
-		}
+	can_status_node *node = comm_can_get_status_node_id(id);
+
+	if (node && node->msg_1.id >= 0) {
+		return &node->msg_1;
 	}
 
 	return 0;
@@ -876,7 +1035,7 @@ can_status_msg *comm_can_get_status_msg_id(int id) {
  */
 can_status_msg_2 *comm_can_get_status_msg_2_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_2[index];
+		return &stat_nodes[index].msg_2;
 	} else {
 		return 0;
 	}
@@ -892,10 +1051,10 @@ can_status_msg_2 *comm_can_get_status_msg_2_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_2 *comm_can_get_status_msg_2_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_2[i].id == id) {
-			return &stat_msgs_2[i];
-		}
+	can_status_node *node = comm_can_get_status_node_id(id);
+
+	if (node && node->msg_2.id >= 0) {
+		return &node->msg_2;
 	}
 
 	return 0;
@@ -912,7 +1071,7 @@ can_status_msg_2 *comm_can_get_status_msg_2_id(int id) {
  */
 can_status_msg_3 *comm_can_get_status_msg_3_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_3[index];
+		return &stat_nodes[index].msg_3;
 	} else {
 		return 0;
 	}
@@ -928,10 +1087,10 @@ can_status_msg_3 *comm_can_get_status_msg_3_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_3 *comm_can_get_status_msg_3_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_3[i].id == id) {
-			return &stat_msgs_3[i];
-		}
+	can_status_node *node = comm_can_get_status_node_id(id);
+
+	if (node && node->msg_3.id >= 0) {
+		return &node->msg_3;
 	}
 
 	return 0;
@@ -948,7 +1107,7 @@ can_status_msg_3 *comm_can_get_status_msg_3_id(int id) {
  */
 can_status_msg_4 *comm_can_get_status_msg_4_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_4[index];
+		return &stat_nodes[index].msg_4;
 	} else {
 		return 0;
 	}
@@ -964,10 +1123,10 @@ can_status_msg_4 *comm_can_get_status_msg_4_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_4 *comm_can_get_status_msg_4_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_4[i].id == id) {
-			return &stat_msgs_4[i];
-		}
+	can_status_node *node = comm_can_get_status_node_id(id);
+
+	if (node && node->msg_4.id >= 0) {
+		return &node->msg_4;
 	}
 
 	return 0;
@@ -984,7 +1143,7 @@ can_status_msg_4 *comm_can_get_status_msg_4_id(int id) {
  */
 can_status_msg_5 *comm_can_get_status_msg_5_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_5[index];
+		return &stat_nodes[index].msg_5;
 	} else {
 		return 0;
 	}
@@ -1000,10 +1159,10 @@ can_status_msg_5 *comm_can_get_status_msg_5_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_5 *comm_can_get_status_msg_5_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_5[i].id == id) {
-			return &stat_msgs_5[i];
-		}
+	can_status_node *node = comm_can_get_status_node_id(id);
+
+	if (node && node->msg_5.id >= 0) {
+		return &node->msg_5;
 	}
 
 	return 0;
@@ -1020,7 +1179,7 @@ can_status_msg_5 *comm_can_get_status_msg_5_id(int id) {
  */
 can_status_msg_6 *comm_can_get_status_msg_6_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_6[index];
+		return &stat_nodes[index].msg_6;
 	} else {
 		return 0;
 	}
@@ -1036,10 +1195,10 @@ can_status_msg_6 *comm_can_get_status_msg_6_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_6 *comm_can_get_status_msg_6_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_6[i].id == id) {
-			return &stat_msgs_6[i];
-		}
+	can_status_node *node = comm_can_get_status_node_id(id);
+
+	if (node && node->msg_6.id >= 0) {
+		return &node->msg_6;
 	}
 
 	return 0;
@@ -1175,38 +1334,30 @@ void comm_can_update_pid_pos_offset(int id, float angle_now, bool store) {
 }
 
 /*
- * Get frame from RX buffer. Interface is the CAN-interface to read from. If
- * no frames are available NULL is returned.
+ * Get frame from RX queue. Interface is the CAN-interface to read from. The
+ * frame is copied to frame, and false is returned if no frames are available.
  *
  * Interface: 0: Any interface, 1: CAN1, 2: CAN2
+ *
+ * The read thread never takes can_rx_mtx, it only serializes readers in case
+ * the CAN process thread and the UAVCAN thread overlap during a mode change.
  */
-CANRxFrame *comm_can_get_rx_frame(int interface) {
-	CANRxFrame *res = NULL;
+bool comm_can_get_rx_frame(CANRxFrame *frame, int interface) {
+	bool res = false;
 
 #if CAN_ENABLE
 	chMtxLock(&can_rx_mtx);
-	if (!res && interface != 2) {
-		if (m_rx_state.frame_read != m_rx_state.frame_write) {
-			res = &m_rx_state.rx_frames[m_rx_state.frame_read++];
-
-			if (m_rx_state.frame_read == RX_FRAMES_SIZE) {
-				m_rx_state.frame_read = 0;
-			}
-		}
+	if (interface != 2) {
+		res = can_rx_queue_pop(&m_rx_queue, frame);
 	}
 #ifdef HW_CAN2_DEV
 	if (!res && interface != 1) {
-		if (m_rx_state2.frame_read != m_rx_state2.frame_write) {
-			res = &m_rx_state2.rx_frames[m_rx_state2.frame_read++];
-
-			if (m_rx_state2.frame_read == RX_FRAMES_SIZE) {
-				m_rx_state2.frame_read = 0;
-			}
-		}
+		res = can_rx_queue_pop(&m_rx_queue2, frame);
 	}
 #endif
 	chMtxUnlock(&can_rx_mtx);
 #else
+	(void)frame;
 	(void)interface;
 #endif
 
@@ -1295,18 +1446,16 @@ static THD_FUNCTION(cancom_read_thread, arg) {
 			continue;
 		}
 
+		// Drain the mailboxes and wake the process thread once for the
+		// whole batch.
+		bool had_frame = false;
 		msg_t result = canReceive(&HW_CAN_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
 
 		while (result == MSG_OK) {
-			chMtxLock(&can_rx_mtx);
-			m_rx_state.rx_frames[m_rx_state.frame_write++] = rxmsg;
-			if (m_rx_state.frame_write == RX_FRAMES_SIZE) {
-				m_rx_state.frame_write = 0;
+			if (!xfer_route_ctrl(&rxmsg)) {
+				can_rx_queue_push(&m_rx_queue, &rxmsg);
+				had_frame = true;
 			}
-			chMtxUnlock(&can_rx_mtx);
-
-			chEvtSignal(process_tp, (eventmask_t) 1);
-
 			result = canReceive(&HW_CAN_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
 		}
 
@@ -1314,18 +1463,17 @@ static THD_FUNCTION(cancom_read_thread, arg) {
 		result = canReceive(&HW_CAN2_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
 
 		while (result == MSG_OK) {
-			chMtxLock(&can_rx_mtx);
-			m_rx_state2.rx_frames[m_rx_state2.frame_write++] = rxmsg;
-			if (m_rx_state2.frame_write == RX_FRAMES_SIZE) {
-				m_rx_state2.frame_write = 0;
+			if (!xfer_route_ctrl(&rxmsg)) {
+				can_rx_queue_push(&m_rx_queue2, &rxmsg);
+				had_frame = true;
 			}
-			chMtxUnlock(&can_rx_mtx);
-
-			chEvtSignal(process_tp, (eventmask_t) 1);
-
 			result = canReceive(&HW_CAN2_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
 		}
 #endif
+
+		if (had_frame) {
+			chEvtSignal(process_tp, (eventmask_t) 1);
+		}
 	}
 
 	chEvtUnregister(&HW_CAN_DEV.rxfull_event, &el);
@@ -1347,9 +1495,8 @@ static THD_FUNCTION(cancom_process_thread, arg) {
 			continue;
 		} else if (app_get_configuration()->can_mode == CAN_MODE_COMM_BRIDGE ||
 				app_get_configuration()->can_mode == CAN_MODE_UNUSED) {
-			CANRxFrame *rxmsg_tmp;
-			while ((rxmsg_tmp = comm_can_get_rx_frame(0)) != 0) {
-				CANRxFrame rxmsg = *rxmsg_tmp;
+			CANRxFrame rxmsg;
+			while (comm_can_get_rx_frame(&rxmsg, 0)) {
 
 				if (app_get_configuration()->can_mode == CAN_MODE_COMM_BRIDGE) {
 					commands_fwd_can_frame(rxmsg.DLC, rxmsg.data8,
@@ -1386,9 +1533,8 @@ static THD_FUNCTION(cancom_process_thread, arg) {
 			continue;
 		}
 
-		CANRxFrame *rxmsg_tmp;
-		while ((rxmsg_tmp = comm_can_get_rx_frame(0)) != 0) {
-			CANRxFrame rxmsg = *rxmsg_tmp;
+		CANRxFrame rxmsg;
+		while (comm_can_get_rx_frame(&rxmsg, 0)) {
 
 			if (rxmsg.IDE == CAN_IDE_EXT) {
 				bool eid_cb_used = false;
@@ -1553,6 +1699,248 @@ static THD_FUNCTION(cancom_status_thread_2, arg) {
 	}
 }
 
+/*
+ * Get the status record for id, and allocate a new one if this is the first
+ * status message from that id. Returns 0 when all records are in use.
+ */
+static can_status_node *stat_node_get_alloc(uint8_t id) {
+	if (stat_node_ind[id] != 0xFF) {
+		return &stat_nodes[stat_node_ind[id]];
+	}
+
+	if (stat_node_num >= CAN_STATUS_MSGS_TO_STORE) {
+		return 0;
+	}
+
+	can_status_node *node = &stat_nodes[stat_node_num];
+	node->id = id;
+	stat_node_ind[id] = stat_node_num++;
+	return node;
+}
+
+static void stat_node_updated(can_status_node *node, systime_t rx_time, int msg) {
+	node->rx_time = rx_time;
+	node->received |= CAN_STATUS_BIT(msg);
+	__atomic_fetch_or(&node->changed, CAN_STATUS_BIT(msg), __ATOMIC_RELEASE);
+}
+
+static void xfer_send_ctrl(uint8_t id, uint8_t *data, uint8_t len) {
+	comm_can_transmit_eid_replace(id | ((uint32_t)CAN_PACKET_XFER_CTRL << 8), data, len, true, 0);
+}
+
+static void xfer_send_data(uint8_t id, unsigned int seq, uint8_t *data, uint8_t len) {
+	comm_can_transmit_eid_replace(id | ((uint32_t)CAN_PACKET_XFER_DATA << 8) |
+			((uint32_t)seq << 16), data, len, true, 0);
+}
+
+/*
+ * Start sending a buffer with the windowed transport. The buffer is copied
+ * and sent by the xfer thread. If a transfer is running this waits at most
+ * XFER_BUSY_WAIT_MS for it to finish.
+ *
+ * Returns false if the buffer should be sent with the old protocol instead.
+ * The first buffer to an unknown receiver pings it to learn if it supports
+ * the transport, and goes with the old protocol.
+ */
+static bool send_buffer_xfer(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
+	const app_configuration *conf = app_get_configuration();
+
+	if (!init_done || controller_id == 255 || conf->can_mode != CAN_MODE_VESC ||
+			len > RX_BUFFER_SIZE) {
+		return false;
+	}
+
+#ifdef HW_HAS_DUAL_MOTORS
+	// Frames to the own ids are decoded in the calling thread
+	if (controller_id == conf->controller_id || controller_id == utils_second_motor_id()) {
+		return false;
+	}
+#endif
+
+	if (!XFER_BIT_GET(xfer_supported, controller_id)) {
+		if (!xfer_peer_update(xfer_probed, controller_id, true)) {
+			uint8_t buffer[1];
+			buffer[0] = conf->controller_id;
+			comm_can_transmit_eid_replace(controller_id |
+					((uint32_t)CAN_PACKET_PING << 8), buffer, 1, true, 0);
+		}
+		return false;
+	}
+
+	for (int i = 0;;i++) {
+		chMtxLock(&can_xfer_mtx);
+		if (!xfer_tx_busy) {
+			break;
+		}
+		chMtxUnlock(&can_xfer_mtx);
+
+		if (i >= XFER_BUSY_WAIT_MS) {
+			return false;
+		}
+		chThdSleepMilliseconds(1);
+	}
+
+	memcpy(xfer_tx_buffer, data, len);
+	xfer_tx_len = len;
+	xfer_tx_dest = controller_id;
+	xfer_tx_send = send;
+	xfer_tx_busy = true;
+	chMtxUnlock(&can_xfer_mtx);
+
+	chEvtSignal(xfer_tp, XFER_EVT_START);
+	return true;
+}
+
+/*
+ * Wait until no transfer to controller_id is running. Broadcasts wait for
+ * any transfer.
+ */
+static void xfer_wait_peer(uint8_t controller_id) {
+	if (!init_done) {
+		return;
+	}
+
+	for (;;) {
+		chMtxLock(&can_xfer_mtx);
+		bool wait = xfer_tx_busy && (controller_id == 255 || xfer_tx_dest == controller_id);
+		chMtxUnlock(&can_xfer_mtx);
+
+		if (!wait) {
+			break;
+		}
+		chThdSleepMilliseconds(1);
+	}
+}
+
+/*
+ * Set or clear the bit of a peer in xfer_supported or xfer_probed.
+ *
+ * Returns the previous value of the bit.
+ */
+static bool xfer_peer_update(uint32_t *bm, uint8_t id, bool set) {
+	uint32_t mask = 1U << (id % 32);
+
+	utils_sys_lock_cnt();
+	bool was_set = (bm[id / 32] & mask) != 0;
+	if (set) {
+		bm[id / 32] |= mask;
+	} else {
+		bm[id / 32] &= ~mask;
+	}
+	utils_sys_unlock_cnt();
+
+	return was_set;
+}
+
+/*
+ * Called by the read thread. Passes replies to the running transfer straight
+ * to the xfer thread. Frames are dropped when the queue is full, the
+ * transport recovers from that like from a lost frame.
+ *
+ * Returns true if the frame was used.
+ */
+static bool xfer_route_ctrl(CANRxFrame *rxmsg) {
+	if (rxmsg->IDE != CAN_IDE_EXT || ((rxmsg->EID >> 8) & 0xFF) != CAN_PACKET_XFER_CTRL ||
+			rxmsg->DLC < 2 || rxmsg->data8[0] == CAN_XFER_CTRL_START) {
+		return false;
+	}
+
+	if (!xfer_tx_busy || (rxmsg->EID & 0xFF) != app_get_configuration()->controller_id) {
+		return false;
+	}
+
+	uint32_t write = xfer_ctrl_write;
+	if ((write - __atomic_load_n(&xfer_ctrl_read, __ATOMIC_ACQUIRE)) < XFER_CTRL_QUEUE_SIZE) {
+		xfer_ctrl_frame *f = &xfer_ctrl_queue[write & (XFER_CTRL_QUEUE_SIZE - 1)];
+		f->len = rxmsg->DLC;
+		memcpy(f->data, rxmsg->data8, rxmsg->DLC);
+		__atomic_store_n(&xfer_ctrl_write, write + 1, __ATOMIC_RELEASE);
+	}
+	chEvtSignal(xfer_tp, XFER_EVT_CTRL);
+
+	return true;
+}
+
+static THD_FUNCTION(cancom_xfer_thread, arg) {
+	(void)arg;
+
+	chRegSetThreadName("CAN xfer");
+
+	for(;;) {
+		chEvtWaitAny(XFER_EVT_START);
+
+		// Drop control frames that arrived after the previous transfer
+		__atomic_store_n(&xfer_ctrl_read, __atomic_load_n(&xfer_ctrl_write, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+		chEvtGetAndClearEvents(XFER_EVT_CTRL);
+
+		m_xfer_tx.own_id = app_get_configuration()->controller_id;
+		can_xfer_tx_start(&m_xfer_tx, xfer_tx_dest, xfer_tx_send, xfer_tx_buffer,
+				xfer_tx_len, chVTGetSystemTimeX());
+
+		CAN_XFER_STATE state;
+		for (;;) {
+			uint32_t read = xfer_ctrl_read;
+			while (read != __atomic_load_n(&xfer_ctrl_write, __ATOMIC_ACQUIRE)) {
+				xfer_ctrl_frame *f = &xfer_ctrl_queue[read & (XFER_CTRL_QUEUE_SIZE - 1)];
+				can_xfer_tx_process_ctrl(&m_xfer_tx, f->data, f->len, chVTGetSystemTimeX());
+				__atomic_store_n(&xfer_ctrl_read, ++read, __ATOMIC_RELEASE);
+			}
+
+			state = can_xfer_tx_update(&m_xfer_tx, chVTGetSystemTimeX());
+			if (state != CAN_XFER_NEGOTIATING && state != CAN_XFER_RUNNING) {
+				break;
+			}
+
+			chEvtWaitAnyTimeout(XFER_EVT_CTRL, MS2ST(1));
+		}
+
+		if (state == CAN_XFER_UNSUPPORTED) {
+			xfer_peer_update(xfer_supported, xfer_tx_dest, false);
+		}
+
+		// The receiver has not processed anything in these states, so the
+		// buffer can go with the old protocol. After a failed transfer it
+		// might have, so it is dropped like a corrupted fragment transfer.
+		if (state == CAN_XFER_UNSUPPORTED || state == CAN_XFER_BUSY) {
+			send_buffer_fragments(xfer_tx_dest, xfer_tx_buffer, xfer_tx_len, xfer_tx_send);
+		}
+
+		chMtxLock(&can_xfer_mtx);
+		xfer_tx_busy = false;
+		chMtxUnlock(&can_xfer_mtx);
+	}
+}
+
+/*
+ * Pass a buffer that was received completely to the commands module.
+ */
+static void process_rx_buffer(uint8_t *data, unsigned int len, uint8_t commands_send, bool is_replaced) {
+	if (is_replaced) {
+		if (data[0] == COMM_JUMP_TO_BOOTLOADER ||
+				data[0] == COMM_ERASE_NEW_APP ||
+				data[0] == COMM_WRITE_NEW_APP_DATA ||
+				data[0] == COMM_WRITE_NEW_APP_DATA_LZO ||
+				data[0] == COMM_ERASE_BOOTLOADER) {
+			return;
+		}
+	}
+
+	switch (commands_send) {
+	case 0:
+	case 3:
+		commands_process_packet(data, len, send_packet_wrapper);
+		break;
+	case 1:
+		commands_send_packet_can_last(data, len);
+		break;
+	case 2:
+		commands_process_packet(data, len, 0);
+		break;
+	default:
+		break;
+	}
+}
+
 static void send_packet_wrapper(unsigned char *data, unsigned int len) {
 	comm_can_send_buffer(rx_buffer_last_id, data, len, rx_buffer_response_type);
 }
@@ -1565,9 +1953,32 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 
 	uint8_t id = eid & 0xFF;
 	CAN_PACKET_ID cmd = eid >> 8;
+	can_status_node *stat_node;
 
 	int id1 = app_get_configuration()->controller_id;
 
+	// Data frames of the windowed transport have the frame index in the upper
+	// bits of the id.
+	if (((eid >> 8) & 0xFF) == CAN_PACKET_XFER_DATA) {
+		if (id == id1 && can_xfer_rx_process_data(&m_xfer_rx, eid >> 16,
+				data8, len, chVTGetSystemTimeX())) {
+			commands_send = m_xfer_rx.commands_send;
+
+			if (commands_send == 0 || commands_send == 3) {
+				rx_buffer_last_id = m_xfer_rx.sender_id;
+			}
+
+			if (commands_send == 3) {
+				rx_buffer_response_type = 0;
+			} else {
+				rx_buffer_response_type = 1;
+			}
+
+			process_rx_buffer(xfer_rx_buffer, m_xfer_rx.len, commands_send, is_replaced);
+		}
+		return;
+	}
+
 #ifdef HW_HAS_DUAL_MOTORS
 	int motor_last = mc_interface_get_motor_thread();
 	int id2 = utils_second_motor_id();
@@ -1718,31 +2129,22 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 			if (crc16(rx_buffer[buf_ind], rxbuf_len)
 					== ((unsigned short) crc_high << 8
 							| (unsigned short) crc_low)) {
+				process_rx_buffer(rx_buffer[buf_ind], rxbuf_len, commands_send, is_replaced);
+			}
+		} break;
 
-				if (is_replaced) {
-					if (rx_buffer[buf_ind][0] == COMM_JUMP_TO_BOOTLOADER ||
-							rx_buffer[buf_ind][0] == COMM_ERASE_NEW_APP ||
-							rx_buffer[buf_ind][0] == COMM_WRITE_NEW_APP_DATA ||
-							rx_buffer[buf_ind][0] == COMM_WRITE_NEW_APP_DATA_LZO ||
-							rx_buffer[buf_ind][0] == COMM_ERASE_BOOTLOADER) {
-						break;
-					}
-				}
+		case CAN_PACKET_XFER_CTRL: {
+			if (id != id1 || len < 2) {
+				break;
+			}
 
-				switch (commands_send) {
-				case 0:
-				case 3:
-					commands_process_packet(rx_buffer[buf_ind], rxbuf_len, send_packet_wrapper);
-					break;
-				case 1:
-					commands_send_packet_can_last(rx_buffer[buf_ind], rxbuf_len);
-					break;
-				case 2:
-					commands_process_packet(rx_buffer[buf_ind], rxbuf_len, 0);
-					break;
-				default:
-					break;
-				}
+			// Replies to our own transfer are passed to the xfer thread by
+			// the read thread, the ones that get here are stale.
+			if (data8[0] == CAN_XFER_CTRL_START) {
+				xfer_peer_update(xfer_supported, data8[1], true);
+				xfer_peer_update(xfer_probed, data8[1], true);
+				m_xfer_rx.own_id = id1;
+				can_xfer_rx_process_ctrl(&m_xfer_rx, data8, len, chVTGetSystemTimeX());
 			}
 		} break;
 
@@ -1761,30 +2163,7 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 				rx_buffer_response_type = 1;
 			}
 
-			if (is_replaced) {
-				if (data8[ind] == COMM_JUMP_TO_BOOTLOADER ||
-						data8[ind] == COMM_ERASE_NEW_APP ||
-						data8[ind] == COMM_WRITE_NEW_APP_DATA ||
-						data8[ind] == COMM_WRITE_NEW_APP_DATA_LZO ||
-						data8[ind] == COMM_ERASE_BOOTLOADER) {
-					break;
-				}
-			}
-
-			switch (commands_send) {
-			case 0:
-			case 3:
-				commands_process_packet(data8 + ind, len - ind, send_packet_wrapper);
-				break;
-			case 1:
-				commands_send_packet_can_last(data8 + ind, len - ind);
-				break;
-			case 2:
-				commands_process_packet(data8 + ind, len - ind, 0);
-				break;
-			default:
-				break;
-			}
+			process_rx_buffer(data8 + ind, len - ind, commands_send, is_replaced);
 		} break;
 
 		case CAN_PACKET_SET_CURRENT_REL:
@@ -1817,14 +2196,22 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 			break;
 
 		case CAN_PACKET_PING: {
-			uint8_t buffer[2];
+			// The transport only runs on the first id, so the second motor
+			// does not announce it.
+			uint8_t buffer[3];
 			buffer[0] = is_replaced ? utils_second_motor_id() : id;
 			buffer[1] = HW_TYPE_VESC;
+			buffer[2] = is_replaced ? 0 : CAN_PONG_CAP_XFER;
 			comm_can_transmit_eid_replace(data8[0] |
-					((uint32_t)CAN_PACKET_PONG << 8), buffer, 2, true, 0);
+					((uint32_t)CAN_PACKET_PONG << 8), buffer, 3, true, 0);
 		} break;
 
 		case CAN_PACKET_PONG:
+			// Older firmware and other devices send no capability byte
+			xfer_peer_update(xfer_supported, data8[0],
+					len >= 3 && (data8[2] & CAN_PONG_CAP_XFER));
+			xfer_peer_update(xfer_probed, data8[0], true);
+
 			if (ping_tp && ping_hw_last_id == data8[0]) {
 				if (len >= 2) {
 					ping_hw_last = data8[1];
@@ -2013,91 +2400,85 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 
 	switch (cmd) {
 	case CAN_PACKET_STATUS:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg *stat_tmp = &stat_msgs[i];
-			if (stat_tmp->id == id || stat_tmp->id == -1) {
-				ind = 0;
-				stat_tmp->id = id;
-				stat_tmp->rx_time = chVTGetSystemTimeX();
-				stat_tmp->rpm = (float)buffer_get_int32(data8, &ind);
-				stat_tmp->current = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp->duty = (float)buffer_get_int16(data8, &ind) / 1000.0;
-				break;
-			}
+		stat_node = stat_node_get_alloc(id);
+		if (stat_node) {
+			can_status_msg *stat_tmp = &stat_node->msg_1;
+			ind = 0;
+			stat_tmp->id = id;
+			stat_tmp->rx_time = chVTGetSystemTimeX();
+			stat_tmp->rpm = (float)buffer_get_int32(data8, &ind);
+			stat_tmp->current = (float)buffer_get_int16(data8, &ind) / 10.0;
+			stat_tmp->duty = (float)buffer_get_int16(data8, &ind) / 1000.0;
+			stat_node_updated(stat_node, stat_tmp->rx_time, 1);
 		}
 		break;
 
 	case CAN_PACKET_STATUS_2:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_2 *stat_tmp_2 = &stat_msgs_2[i];
-			if (stat_tmp_2->id == id || stat_tmp_2->id == -1) {
-				ind = 0;
-				stat_tmp_2->id = id;
-				stat_tmp_2->rx_time = chVTGetSystemTimeX();
-				stat_tmp_2->amp_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
-				stat_tmp_2->amp_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
-				break;
-			}
+		stat_node = stat_node_get_alloc(id);
+		if (stat_node) {
+			can_status_msg_2 *stat_tmp_2 = &stat_node->msg_2;
+			ind = 0;
+			stat_tmp_2->id = id;
+			stat_tmp_2->rx_time = chVTGetSystemTimeX();
+			stat_tmp_2->amp_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
+			stat_tmp_2->amp_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
+			stat_node_updated(stat_node, stat_tmp_2->rx_time, 2);
 		}
 		break;
 
 	case CAN_PACKET_STATUS_3:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_3 *stat_tmp_3 = &stat_msgs_3[i];
-			if (stat_tmp_3->id == id || stat_tmp_3->id == -1) {
-				ind = 0;
-				stat_tmp_3->id = id;
-				stat_tmp_3->rx_time = chVTGetSystemTimeX();
-				stat_tmp_3->watt_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
-				stat_tmp_3->watt_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
-				break;
-			}
+		stat_node = stat_node_get_alloc(id);
+		if (stat_node) {
+			can_status_msg_3 *stat_tmp_3 = &stat_node->msg_3;
+			ind = 0;
+			stat_tmp_3->id = id;
+			stat_tmp_3->rx_time = chVTGetSystemTimeX();
+			stat_tmp_3->watt_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
+			stat_tmp_3->watt_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
+			stat_node_updated(stat_node, stat_tmp_3->rx_time, 3);
 		}
 		break;
 
 	case CAN_PACKET_STATUS_4:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_4 *stat_tmp_4 = &stat_msgs_4[i];
-			if (stat_tmp_4->id == id || stat_tmp_4->id == -1) {
-				ind = 0;
-				stat_tmp_4->id = id;
-				stat_tmp_4->rx_time = chVTGetSystemTimeX();
-				stat_tmp_4->temp_fet = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->temp_motor = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->current_in = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->pid_pos_now = (float)buffer_get_int16(data8, &ind) / 50.0;
-				break;
-			}
+		stat_node = stat_node_get_alloc(id);
+		if (stat_node) {
+			can_status_msg_4 *stat_tmp_4 = &stat_node->msg_4;
+			ind = 0;
+			stat_tmp_4->id = id;
+			stat_tmp_4->rx_time = chVTGetSystemTimeX();
+			stat_tmp_4->temp_fet = (float)buffer_get_int16(data8, &ind) / 10.0;
+			stat_tmp_4->temp_motor = (float)buffer_get_int16(data8, &ind) / 10.0;
+			stat_tmp_4->current_in = (float)buffer_get_int16(data8, &ind) / 10.0;
+			stat_tmp_4->pid_pos_now = (float)buffer_get_int16(data8, &ind) / 50.0;
+			stat_node_updated(stat_node, stat_tmp_4->rx_time, 4);
 		}
 		break;
 
 	case CAN_PACKET_STATUS_5:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_5 *stat_tmp_5 = &stat_msgs_5[i];
-			if (stat_tmp_5->id == id || stat_tmp_5->id == -1) {
-				ind = 0;
-				stat_tmp_5->id = id;
-				stat_tmp_5->rx_time = chVTGetSystemTimeX();
-				stat_tmp_5->tacho_value = buffer_get_int32(data8, &ind);
-				stat_tmp_5->v_in = (float)buffer_get_int16(data8, &ind) / 1e1;
-				break;
-			}
+		stat_node = stat_node_get_alloc(id);
+		if (stat_node) {
+			can_status_msg_5 *stat_tmp_5 = &stat_node->msg_5;
+			ind = 0;
+			stat_tmp_5->id = id;
+			stat_tmp_5->rx_time = chVTGetSystemTimeX();
+			stat_tmp_5->tacho_value = buffer_get_int32(data8, &ind);
+			stat_tmp_5->v_in = (float)buffer_get_int16(data8, &ind) / 1e1;
+			stat_node_updated(stat_node, stat_tmp_5->rx_time, 5);
 		}
 		break;
 
 	case CAN_PACKET_STATUS_6:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_6 *stat_tmp_6 = &stat_msgs_6[i];
-			if (stat_tmp_6->id == id || stat_tmp_6->id == -1) {
-				ind = 0;
-				stat_tmp_6->id = id;
-				stat_tmp_6->rx_time = chVTGetSystemTimeX();
-				stat_tmp_6->adc_1 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->adc_2 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->adc_3 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->ppm = buffer_get_float16(data8, 1e3, &ind);
-				break;
-			}
+		stat_node = stat_node_get_alloc(id);
+		if (stat_node) {
+			can_status_msg_6 *stat_tmp_6 = &stat_node->msg_6;
+			ind = 0;
+			stat_tmp_6->id = id;
+			stat_tmp_6->rx_time = chVTGetSystemTimeX();
+			stat_tmp_6->adc_1 = buffer_get_float16(data8, 1e3, &ind);
+			stat_tmp_6->adc_2 = buffer_get_float16(data8, 1e3, &ind);
+			stat_tmp_6->adc_3 = buffer_get_float16(data8, 1e3, &ind);
+			stat_tmp_6->ppm = buffer_get_float16(data8, 1e3, &ind);
+			stat_node_updated(stat_node, stat_tmp_6->rx_time, 6);
 		}
 		break;
 
@@ -2242,6 +2623,25 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 #endif
 }
 
+static void print_rx_queue_stats(const char *name, can_rx_queue *q) {
+	commands_printf("%s", name);
+	commands_printf("  Received   : %u", (unsigned int)q->rx_cnt);
+	commands_printf("  Dropped    : %u", (unsigned int)q->drop_cnt);
+	commands_printf("  Queued     : %u / %u", can_rx_queue_count(q), CAN_RX_QUEUE_SIZE);
+	commands_printf("  High water : %u", (unsigned int)q->high_water);
+}
+
+static void terminal_can_rx_stats(int argc, const char **argv) {
+	(void)argc;
+	(void)argv;
+
+	print_rx_queue_stats("CAN1", &m_rx_queue);
+#ifdef HW_CAN2_DEV
+	print_rx_queue_stats("CAN2", &m_rx_queue2);
+#endif
+	commands_printf(" ");
+}
+
 #endif
 
 /**
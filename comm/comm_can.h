@@ -25,6 +25,7 @@
 
 // Settings
 #define CAN_STATUS_MSGS_TO_STORE	10
+#define CAN_STATUS_BIT(n)			(1 << ((n) - 1))
 
 // Functions
 void comm_can_init(void);
@@ -61,6 +62,10 @@ void comm_can_conf_battery_cut(uint8_t controller_id,
 		bool store, float start, float end);
 void comm_can_shutdown(uint8_t controller_id);
 void comm_can_send_update_baud(int kbits, int delay_msec);
+can_status_node *comm_can_get_status_node_index(int index);
+can_status_node *comm_can_get_status_node_id(int id);
+float comm_can_get_status_age(int id);
+uint8_t comm_can_get_status_changed(int id);
 can_status_msg *comm_can_get_status_msg_index(int index);
 can_status_msg *comm_can_get_status_msg_id(int id);
 can_status_msg_2 *comm_can_get_status_msg_2_index(int index);
@@ -88,7 +93,7 @@ psw_status *comm_can_get_psw_status_id(int id);
 void comm_can_psw_switch(int id, bool is_on, bool plot);
 void comm_can_update_pid_pos_offset(int id, float angle_now, bool store);
 
-CANRxFrame *comm_can_get_rx_frame(int interface);
+bool comm_can_get_rx_frame(CANRxFrame *frame, int interface);
 
 void comm_can_send_status1(uint8_t id, bool replace);
 void comm_can_send_status2(uint8_t id, bool replace);
@@ -56,6 +56,8 @@
 #endif
 #include "main.h"
 #include "conf_custom.h"
+#include "telemetry.h"
+#include "foc_prof.h"
 
 #include <math.h>
 #include <string.h>
@@ -1650,6 +1652,60 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		mc_interface_release_motor_override_both();
 	} break;
 
+	case COMM_TELEMETRY_CHANNEL: {
+		int id = len > 0 ? data[0] : 0;
+		const telemetry_channel *ch = telemetry_get_channel(id);
+
+		int32_t ind = 0;
+		uint8_t send_buffer[10 + TELEMETRY_NAME_MAX];
+		send_buffer[ind++] = COMM_TELEMETRY_CHANNEL;
+		send_buffer[ind++] = telemetry_channel_count();
+		send_buffer[ind++] = id;
+		if (ch) {
+			buffer_append_float32_auto(send_buffer, ch->scale, &ind);
+			strcpy((char*)send_buffer + ind, ch->name);
+			ind += strlen(ch->name) + 1;
+		}
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_TELEMETRY_START: {
+		// Decimation, duration and the channel ids. No ids stops the stream.
+		int32_t ind = 0;
+		int decimation = 1;
+		float duration = 0.0;
+		int num = 0;
+		if (len >= 7) {
+			decimation = buffer_get_uint16(data, &ind);
+			duration = buffer_get_float32_auto(data, &ind);
+			num = data[ind++];
+			if (num > ((int)len - ind)) {
+				num = len - ind;
+			}
+		}
+
+		int started = telemetry_start(data + ind, num, decimation, duration,
+				mc_interface_motor_now() == 2, reply_func);
+
+		ind = 0;
+		uint8_t send_buffer[2];
+		send_buffer[ind++] = COMM_TELEMETRY_START;
+		send_buffer[ind++] = started;
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_FOC_PROFILE: {
+		// Motor and reset flag, the motor defaults to the current one
+		int motor = mc_interface_motor_now();
+		bool reset = false;
+		if (len >= 2) {
+			motor = data[0];
+			reset = data[1];
+		}
+
+		foc_prof_send(motor, reset, reply_func);
+	} break;
+
 	// Blocking commands. Only one of them runs at any given time, in their
 	// own thread. If other blocking commands come before the previous one has
 	// finished, they are discarded.
@@ -131,6 +131,79 @@ void packet_process_byte(uint8_t rx_data, PACKET_STATE_t *state) {
 	}
 }
 
+/**
+ * Process a block of received bytes. This gives the same result as calling
+ * packet_process_byte for every byte, but complete packets are decoded
+ * directly from data and handed to process_func without being copied to
+ * the state buffer. Only an unfinished packet at the end of data is copied,
+ * so that it can be completed by the next call.
+ *
+ * @param data
+ * The received bytes. Note that process_func gets a pointer into this
+ * buffer, so it must not be modified until the call returns.
+ *
+ * @param len
+ * Number of bytes in data.
+ *
+ * @param state
+ * The packet state.
+ */
+void packet_process_buffer(const uint8_t *data, unsigned int len, PACKET_STATE_t *state) {
+	unsigned int pos = 0;
+
+	// Finish the packet that is already in the state buffer first. The bytes
+	// that bytes_left says cannot complete anything are copied in one go.
+	while (pos < len && state->rx_write_ptr != state->rx_read_ptr) {
+		if (state->bytes_left > 1 && state->rx_write_ptr < PACKET_BUFFER_LEN) {
+			unsigned int chunk = state->bytes_left - 1;
+
+			if (chunk > (len - pos)) {
+				chunk = len - pos;
+			}
+
+			if (chunk > (PACKET_BUFFER_LEN - state->rx_write_ptr)) {
+				chunk = PACKET_BUFFER_LEN - state->rx_write_ptr;
+			}
+
+			memcpy(state->rx_buffer + state->rx_write_ptr, data + pos, chunk);
+			state->rx_write_ptr += chunk;
+			state->bytes_left -= chunk;
+			pos += chunk;
+
+			if (pos == len) {
+				return;
+			}
+		}
+
+		packet_process_byte(data[pos++], state);
+	}
+
+	// The state buffer is empty now, so decode in place.
+	while (pos < len) {
+		int bytes_left = 0;
+		int res = try_decode_packet((unsigned char*)data + pos, len - pos,
+				state->process_func, &bytes_left);
+
+		if (res > 0) {
+			pos += res;
+		} else if (res == -1) {
+			// Skip ahead to the next possible start byte
+			pos++;
+			while (pos < len && (data[pos] < 2 || data[pos] > 4)) {
+				pos++;
+			}
+		} else {
+			// Keep the tail for the next call. It is shorter than the largest
+			// packet, so it always fits.
+			memcpy(state->rx_buffer, data + pos, len - pos);
+			state->rx_read_ptr = 0;
+			state->rx_write_ptr = len - pos;
+			state->bytes_left = bytes_left;
+			break;
+		}
+	}
+}
+
 /**
  * Try if it is possible to decode a packet from a buffer.
  *
@@ -46,6 +46,7 @@ void packet_init(void (*s_func)(unsigned char *data, unsigned int len),
 		void (*p_func)(unsigned char *data, unsigned int len), PACKET_STATE_t *state);
 void packet_reset(PACKET_STATE_t *state);
 void packet_process_byte(uint8_t rx_data, PACKET_STATE_t *state);
+void packet_process_buffer(const uint8_t *data, unsigned int len, PACKET_STATE_t *state);
 void packet_send_packet(unsigned char *data, unsigned int len, PACKET_STATE_t *state);
 
 #endif /* PACKET_H_ */
@@ -22,6 +22,7 @@
 #include "conf_general.h"
 #include "ch.h"
 #include "eeprom.h"
+#include "eeprom_rec.h"
 #include "mcpwm.h"
 #include "mcpwm_foc.h"
 #include "mc_interface.h"
@@ -46,7 +47,16 @@
 //#define TEST_BAD_MC_CRC
 //#define TEST_BAD_APP_CRC
 
-// EEPROM settings
+// Record ids in the emulated EEPROM
+#define REC_ID_MCCONF			0
+#define REC_ID_MCCONF_2			1
+#define REC_ID_APPCONF			2
+#define REC_ID_BACKUP			3
+#define REC_ID_HW				4
+#define REC_ID_CUSTOM			(REC_ID_HW + EEPROM_VARS_HW)
+
+// Virtual addresses used by EE_WriteVariable in earlier firmware versions. Only
+// used to import that data into the record store.
 #define EEPROM_BASE_MCCONF		1000
 #define EEPROM_BASE_APPCONF		2000
 #define EEPROM_BASE_HW			3000
@@ -60,11 +70,13 @@ bool conf_general_permanent_nrf_found = false;
 __attribute__((section(".ram4"))) volatile backup_data g_backup;
 
 // Private functions
-static bool read_eeprom_var(eeprom_var *v, int address, uint16_t base);
-static bool store_eeprom_var(eeprom_var *v, int address, uint16_t base);
+static bool store_eeprom_var(eeprom_var *v, uint16_t id);
+static void import_ee_data(void);
+static bool import_ee_blob(uint16_t id, uint16_t base, uint8_t *buffer, unsigned int size);
 
 __attribute__((section(".text2"))) void conf_general_init(void) {
-	// First, make sure that all relevant virtual addresses are assigned for page swapping.
+	// The virtual addresses are only needed by EE_Init when importing data stored by
+	// earlier firmware versions, make sure that they are assigned for page swapping.
 	memset(VirtAddVarTab, 0, sizeof(VirtAddVarTab));
 
 	int ind = 0;
@@ -91,27 +103,25 @@ __attribute__((section(".text2"))) void conf_general_init(void) {
 	FLASH_Unlock();
 	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
 			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
-	EE_Init();
+	if (!eeprom_rec_init()) {
+		// No record store yet. Import the variables written by EE_WriteVariable,
+		// the sector they are in is erased afterwards. This is one way: EE_Init
+		// in older firmware does not recognize a record sector and formats or
+		// overwrites it, so downgrading after this resets mcconf, appconf and
+		// the backup data (odometer, runtime).
+		EE_Init();
+		if (eeprom_rec_import_begin()) {
+			import_ee_data();
+			eeprom_rec_import_end();
+		}
+	}
 	FLASH_Lock();
 
 	// Read backup data
-	bool is_ok = true;
 	backup_data backup_tmp;
-	uint8_t *data_addr = (uint8_t*)&backup_tmp;
-	uint16_t var;
-
-	for (unsigned int i = 0;i < (sizeof(backup_data) / 2);i++) {
-		if (EE_ReadVariable(EEPROM_BASE_BACKUP + i, &var) == 0) {
-			data_addr[2 * i] = (var >> 8) & 0xFF;
-			data_addr[2 * i + 1] = var & 0xFF;
-		} else {
-			is_ok = false;
-			break;
-		}
-	}
 
-	if (!is_ok) {
-		memset(data_addr, 0, sizeof(backup_data));
+	if (!eeprom_rec_read(REC_ID_BACKUP, &backup_tmp, sizeof(backup_data))) {
+		memset(&backup_tmp, 0, sizeof(backup_data));
 
 		// If the missing data is a result of programming it might still be in RAM4. Check
 		// and recover the valid values one by one.
@@ -155,24 +165,12 @@ __attribute__((section(".text2"))) bool conf_general_store_backup_data(void) {
 	utils_sys_lock_cnt();
 	timeout_configure_IWDT_slowest();
 
-	bool is_ok = true;
-	uint8_t *data_addr = (uint8_t*)&g_backup;
-	uint16_t var;
+	backup_data backup_tmp = g_backup;
 
 	FLASH_Unlock();
 	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
 			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
-
-	for (unsigned int i = 0;i < (sizeof(backup_data) / 2);i++) {
-		var = (data_addr[2 * i] << 8) & 0xFF00;
-		var |= data_addr[2 * i + 1] & 0xFF;
-
-		if (EE_WriteVariable(EEPROM_BASE_BACKUP + i, var) != FLASH_COMPLETE) {
-			is_ok = false;
-			break;
-		}
-	}
-
+	bool is_ok = eeprom_rec_write(REC_ID_BACKUP, &backup_tmp, sizeof(backup_data));
 	FLASH_Lock();
 	timeout_configure_IWDT();
 	mc_interface_ignore_input_both(100);
@@ -197,7 +195,7 @@ __attribute__((section(".text2"))) bool conf_general_read_eeprom_var_hw(eeprom_v
 	if (address < 0 || address >= EEPROM_VARS_HW) {
 		return false;
 	}
-	return read_eeprom_var(v, address, EEPROM_BASE_HW);
+	return eeprom_rec_read(REC_ID_HW + address, v, sizeof(eeprom_var));
 }
 
 /**
@@ -216,7 +214,7 @@ __attribute__((section(".text2"))) bool conf_general_read_eeprom_var_custom(eepr
 	if (address < 0 || address >= EEPROM_VARS_CUSTOM) {
 		return false;
 	}
-	return read_eeprom_var(v, address, EEPROM_BASE_CUSTOM);
+	return eeprom_rec_read(REC_ID_CUSTOM + address, v, sizeof(eeprom_var));
 }
 
 /**
@@ -235,7 +233,7 @@ __attribute__((section(".text2"))) bool conf_general_store_eeprom_var_hw(eeprom_
 	if (address < 0 || address >= EEPROM_VARS_HW) {
 		return false;
 	}
-	return store_eeprom_var(v, address, EEPROM_BASE_HW);
+	return store_eeprom_var(v, REC_ID_HW + address);
 }
 
 /**
@@ -254,31 +252,10 @@ __attribute__((section(".text2"))) bool conf_general_store_eeprom_var_custom(eep
 	if (address < 0 || address >= EEPROM_VARS_CUSTOM) {
 		return false;
 	}
-	return store_eeprom_var(v, address, EEPROM_BASE_CUSTOM);
+	return store_eeprom_var(v, REC_ID_CUSTOM + address);
 }
 
-__attribute__((section(".text2"))) static bool read_eeprom_var(eeprom_var *v, int address, uint16_t base) {
-	bool is_ok = true;
-	uint16_t var0, var1;
-
-	if (EE_ReadVariable(base + 2 * address, &var0) == 0 &&
-			EE_ReadVariable(base + 2 * address + 1, &var1) == 0) {
-		uint32_t res = ((uint32_t)var0) << 16 | var1;
-		v->as_u32 = res;
-	} else {
-		is_ok = false;
-	}
-
-	return is_ok;
-}
-
-__attribute__((section(".text2"))) static bool store_eeprom_var(eeprom_var *v, int address, uint16_t base) {
-	bool is_ok = true;
-	uint16_t var0, var1;
-
-	var0 = v->as_u32 >> 16;
-	var1 = v->as_u32 & 0xFFFF;
-
+__attribute__((section(".text2"))) static bool store_eeprom_var(eeprom_var *v, uint16_t id) {
 	mc_interface_ignore_input_both(5000);
 	mc_interface_release_motor_override_both();
 
@@ -293,16 +270,7 @@ __attribute__((section(".text2"))) static bool store_eeprom_var(eeprom_var *v, i
 	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
 			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
 
-	if (EE_WriteVariable(base + address * 2, var0) != FLASH_COMPLETE) {
-		is_ok = false;
-	}
-
-	if (is_ok) {
-		if (EE_WriteVariable(base + address * 2 + 1, var1) != FLASH_COMPLETE) {
-			is_ok = false;
-		}
-	}
-
+	bool is_ok = eeprom_rec_write(id, v, sizeof(eeprom_var));
 	FLASH_Lock();
 	timeout_configure_IWDT();
 	mc_interface_ignore_input_both(100);
@@ -318,19 +286,7 @@ __attribute__((section(".text2"))) static bool store_eeprom_var(eeprom_var *v, i
  * A pointer to a app_configuration struct to write the read configuration to.
  */
 __attribute__((section(".text2"))) void conf_general_read_app_configuration(app_configuration *conf) {
-	bool is_ok = true;
-	uint8_t *conf_addr = (uint8_t*)conf;
-	uint16_t var;
-
-	for (unsigned int i = 0;i < (sizeof(app_configuration) / 2);i++) {
-		if (EE_ReadVariable(EEPROM_BASE_APPCONF + i, &var) == 0) {
-			conf_addr[2 * i] = (var >> 8) & 0xFF;
-			conf_addr[2 * i + 1] = var & 0xFF;
-		} else {
-			is_ok = false;
-			break;
-		}
-	}
+	bool is_ok = eeprom_rec_read(REC_ID_APPCONF, conf, sizeof(app_configuration));
 
 	// check CRC
 #ifdef TEST_BAD_APP_CRC
@@ -367,26 +323,12 @@ __attribute__((section(".text2"))) bool conf_general_store_app_configuration(app
 	utils_sys_lock_cnt();
 	timeout_configure_IWDT_slowest();
 
-	bool is_ok = true;
-	uint8_t *conf_addr = (uint8_t*)conf;
-	uint16_t var;
-
 	conf->crc = app_calc_crc(conf);
 
 	FLASH_Unlock();
 	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
 			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
-
-	for (unsigned int i = 0;i < (sizeof(app_configuration) / 2);i++) {
-		var = (conf_addr[2 * i] << 8) & 0xFF00;
-		var |= conf_addr[2 * i + 1] & 0xFF;
-
-		if (EE_WriteVariable(EEPROM_BASE_APPCONF + i, var) != FLASH_COMPLETE) {
-			is_ok = false;
-			break;
-		}
-	}
-
+	bool is_ok = eeprom_rec_write(REC_ID_APPCONF, conf, sizeof(app_configuration));
 	FLASH_Lock();
 	timeout_configure_IWDT();
 	mc_interface_ignore_input_both(100);
@@ -402,20 +344,8 @@ __attribute__((section(".text2"))) bool conf_general_store_app_configuration(app
  * A pointer to a mc_configuration struct to write the read configuration to.
  */
 __attribute__((section(".text2"))) void conf_general_read_mc_configuration(mc_configuration *conf, bool is_motor_2) {
-	bool is_ok = true;
-	uint8_t *conf_addr = (uint8_t*)conf;
-	uint16_t var;
-	unsigned int base = is_motor_2 ? EEPROM_BASE_MCCONF_2 : EEPROM_BASE_MCCONF;
-
-	for (unsigned int i = 0;i < (sizeof(mc_configuration) / 2);i++) {
-		if (EE_ReadVariable(base + i, &var) == 0) {
-			conf_addr[2 * i] = (var >> 8) & 0xFF;
-			conf_addr[2 * i + 1] = var & 0xFF;
-		} else {
-			is_ok = false;
-			break;
-		}
-	}
+	bool is_ok = eeprom_rec_read(is_motor_2 ? REC_ID_MCCONF_2 : REC_ID_MCCONF,
+			conf, sizeof(mc_configuration));
 
 	// check CRC
 #ifdef TEST_BAD_MC_CRC
@@ -451,26 +381,13 @@ __attribute__((section(".text2"))) bool conf_general_store_mc_configuration(mc_c
 	utils_sys_lock_cnt();
 	timeout_configure_IWDT_slowest();
 
-	bool is_ok = true;
-	uint8_t *conf_addr = (uint8_t*)conf;
-	unsigned int base = is_motor_2 ? EEPROM_BASE_MCCONF_2 : EEPROM_BASE_MCCONF;
-
 	conf->crc = mc_interface_calc_crc(conf, is_motor_2);
 
 	FLASH_Unlock();
 	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
 			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
-
-	for (unsigned int i = 0;i < (sizeof(mc_configuration) / 2);i++) {
-		uint16_t var = (conf_addr[2 * i] << 8) & 0xFF00;
-		var |= conf_addr[2 * i + 1] & 0xFF;
-
-		if (EE_WriteVariable(base + i, var) != FLASH_COMPLETE) {
-			is_ok = false;
-			break;
-		}
-	}
-
+	bool is_ok = eeprom_rec_write(is_motor_2 ? REC_ID_MCCONF_2 : REC_ID_MCCONF,
+			conf, sizeof(mc_configuration));
 	FLASH_Lock();
 	timeout_configure_IWDT();
 	mc_interface_ignore_input_both(100);
@@ -479,6 +396,54 @@ __attribute__((section(".text2"))) bool conf_general_store_mc_configuration(mc_c
 	return is_ok;
 }
 
+/*
+ * Import the configurations and variables stored with EE_WriteVariable, where each
+ * half-word is a separate variable. Called with flash unlocked between
+ * eeprom_rec_import_begin and eeprom_rec_import_end.
+ */
+__attribute__((section(".text2"))) static void import_ee_data(void) {
+	mc_configuration *mcconf = mempools_alloc_mcconf();
+	app_configuration *appconf = mempools_alloc_appconf();
+	backup_data backup_tmp;
+
+	import_ee_blob(REC_ID_MCCONF, EEPROM_BASE_MCCONF, (uint8_t*)mcconf, sizeof(mc_configuration));
+	import_ee_blob(REC_ID_MCCONF_2, EEPROM_BASE_MCCONF_2, (uint8_t*)mcconf, sizeof(mc_configuration));
+	import_ee_blob(REC_ID_APPCONF, EEPROM_BASE_APPCONF, (uint8_t*)appconf, sizeof(app_configuration));
+	import_ee_blob(REC_ID_BACKUP, EEPROM_BASE_BACKUP, (uint8_t*)&backup_tmp, sizeof(backup_data));
+
+	for (int i = 0;i < (EEPROM_VARS_HW + EEPROM_VARS_CUSTOM);i++) {
+		uint16_t base = i < EEPROM_VARS_HW ?
+				EEPROM_BASE_HW + 2 * i : EEPROM_BASE_CUSTOM + 2 * (i - EEPROM_VARS_HW);
+		uint16_t var0, var1;
+
+		if (EE_ReadVariable(base, &var0) == 0 && EE_ReadVariable(base + 1, &var1) == 0) {
+			eeprom_var v;
+			v.as_u32 = ((uint32_t)var0) << 16 | var1;
+			eeprom_rec_write(REC_ID_HW + i, &v, sizeof(eeprom_var));
+		}
+	}
+
+	mempools_free_mcconf(mcconf);
+	mempools_free_appconf(appconf);
+}
+
+__attribute__((section(".text2"))) static bool import_ee_blob(uint16_t id, uint16_t base, uint8_t *buffer, unsigned int size) {
+	uint16_t var;
+
+	memset(buffer, 0, size);
+
+	for (unsigned int i = 0;i < (size / 2);i++) {
+		if (EE_ReadVariable(base + i, &var) != 0) {
+			return false;
+		}
+
+		buffer[2 * i] = (var >> 8) & 0xFF;
+		buffer[2 * i + 1] = var & 0xFF;
+	}
+
+	return eeprom_rec_write(id, buffer, size);
+}
+
 __attribute__((section(".text2"))) bool conf_general_detect_motor_param(float current, float min_rpm, float low_duty,
 		float *int_limit, float *bemf_coupling_k, int8_t *hall_table, int *hall_res) {
 
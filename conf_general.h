@@ -166,6 +166,16 @@
 #define FOC_CONTROL_LOOP_FREQ_DIVIDER	1
 #endif
 
+/*
+ *	Measure the stages of the FOC interrupt with the DWT cycle counter. The
+ *	statistics are printed with the foc_prof terminal command and sent with
+ *	COMM_FOC_PROFILE. The marks cost a few cycles each, so leave this off in
+ *	release builds.
+ */
+#ifndef FOC_PROFILE_ENABLE
+#define FOC_PROFILE_ENABLE				0
+#endif
+
 // Global configuration variables
 extern bool conf_general_permanent_nrf_found;
 extern volatile backup_data g_backup;
@@ -1128,6 +1128,12 @@ typedef enum {
 	COMM_CAN_UPDATE_BAUD_ALL				= 158,
 
 	COMM_MOTOR_ESTOP						= 159,
+
+	COMM_TELEMETRY_CHANNEL					= 160,
+	COMM_TELEMETRY_START					= 161,
+	COMM_TELEMETRY_DATA						= 162,
+
+	COMM_FOC_PROFILE						= 163,
 } COMM_PACKET_ID;
 
 // CAN commands
@@ -1201,6 +1207,8 @@ typedef enum {
 	CAN_PACKET_BMS_STATUS_3					= 66,
 	CAN_PACKET_BMS_STATUS_4					= 67,
 	CAN_PACKET_BMS_STATUS_5					= 68,
+	CAN_PACKET_XFER_DATA					= 69,
+	CAN_PACKET_XFER_CTRL					= 70,
 	CAN_PACKET_MAKE_ENUM_32_BITS = 0xFFFFFFFF,
 } CAN_PACKET_ID;
 
@@ -1299,6 +1307,19 @@ typedef struct {
 	float ppm;
 } can_status_msg_6;
 
+typedef struct {
+	int id;
+	systime_t rx_time; // Time of the latest status message of any type
+	uint8_t received; // Bit n - 1 is set when status n has been received
+	volatile uint8_t changed; // Bit n - 1 is set when status n was updated since the last read
+	can_status_msg msg_1;
+	can_status_msg_2 msg_2;
+	can_status_msg_3 msg_3;
+	can_status_msg_4 msg_4;
+	can_status_msg_5 msg_5;
+	can_status_msg_6 msg_6;
+} can_status_node;
+
 typedef struct {
 	int id;
 	systime_t rx_time;
@@ -0,0 +1,407 @@
+/*
+	Copyright 2025 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#pragma GCC optimize ("Os")
+
+#include "eeprom_rec.h"
+#include "flash_helper.h"
+#include "crc.h"
+
+#include <string.h>
+
+/*
+ * Sector layout
+ *
+ * 0: magic (uint32_t), written last when the sector is complete
+ * 4: sequence number (uint32_t), the sector with the highest is active
+ * 8: records
+ *
+ * Record layout, padded to 4 bytes
+ *
+ * 0: id (uint16_t)
+ * 2: data length in bytes (uint16_t)
+ * 4: crc32c of id, length and data (uint32_t), written last
+ * 8: data
+ *
+ * The first half-word of a sector stays erased until the magic is written,
+ * so a sector that is being filled looks erased to EE_Init. The lower
+ * half-word of the magic is neither of the EE page states. The second
+ * half-word is never written in the EE format, so the upper half of the
+ * magic identifies a sector where writing the lower half was interrupted.
+ *
+ * EE_Init in firmware from before the record store does not know the magic.
+ * Depending on the state of the other sector it formats both sectors or
+ * copies variables into the record sector as if it was receiving data, so
+ * the import cannot be undone by a downgrade.
+ */
+
+// Settings
+#define SECTOR_MAGIC			0x56524543
+#define SECTOR_HDR_SIZE			8
+#define REC_HDR_SIZE			8
+#define REC_SIZE(len)			(REC_HDR_SIZE + (((len) + 3) & ~3))
+#define ID_ERASED				0xFFFF
+
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;
+} sector_hdr;
+
+typedef struct {
+	uint16_t id;
+	uint16_t len;
+	uint32_t crc;
+} rec_hdr;
+
+static const uint32_t m_sector_addr[2] = {PAGE0_BASE_ADDRESS, PAGE1_BASE_ADDRESS};
+static const uint32_t m_sector_id[2] = {PAGE0_ID, PAGE1_ID};
+
+// Private variables
+static int m_active = -1;
+static uint32_t m_seq = 0;
+static uint32_t m_write_pos = PAGE_SIZE;
+static uint16_t m_index[EEPROM_REC_IDS]; // Offset of the latest record for each id, 0 if none
+
+// Private functions
+static bool sector_is_erased(int sector);
+static bool erase_sector_if_not_empty(int sector);
+static bool program(uint32_t addr, const uint8_t *data, unsigned int len);
+static void scan_sector(int sector);
+static uint32_t rec_crc(uint16_t id, uint16_t len, const uint8_t *data);
+static bool append(uint16_t id, const uint8_t *data, unsigned int len);
+static bool compact(uint16_t id, const uint8_t *data, unsigned int len);
+static bool write_sector_hdr(int sector, uint32_t seq);
+
+/**
+ * Find the active sector and build the record index. Flash must be unlocked, as
+ * an incomplete sector might be erased.
+ *
+ * @return
+ * true if a record store was found, false otherwise. In the latter case
+ * the sectors may contain data in the EE_ReadVariable format that can be
+ * imported with eeprom_rec_import_begin and eeprom_rec_import_end.
+ */
+bool eeprom_rec_init(void) {
+	m_active = -1;
+	m_seq = 0;
+
+	for (int i = 0;i < 2;i++) {
+		volatile sector_hdr *hdr = (volatile sector_hdr*)m_sector_addr[i];
+		if (hdr->magic == SECTOR_MAGIC && (m_active < 0 || hdr->seq > m_seq)) {
+			m_active = i;
+			m_seq = hdr->seq;
+		}
+	}
+
+	if (m_active < 0) {
+		// A sector where the power was lost while writing the lower half of the
+		// magic must be erased, EE_Init would take it for a page that receives data.
+		for (int i = 0;i < 2;i++) {
+			volatile uint16_t *magic = (volatile uint16_t*)m_sector_addr[i];
+			if (magic[1] == (SECTOR_MAGIC >> 16)) {
+				FLASH_EraseSector(m_sector_id[i], VOLTAGE_RANGE);
+			}
+		}
+
+		return false;
+	}
+
+	scan_sector(m_active);
+	return true;
+}
+
+/**
+ * Start a new record store in an erased sector, while the other sector
+ * still holds the data to import. The data is then written with
+ * eeprom_rec_write.
+ *
+ * @return
+ * true on success, false otherwise.
+ */
+bool eeprom_rec_import_begin(void) {
+	m_active = -1;
+
+	for (int i = 0;i < 2;i++) {
+		if (sector_is_erased(i)) {
+			m_active = i;
+			break;
+		}
+	}
+
+	// Nothing to keep if neither sector is erased
+	if (m_active < 0) {
+		m_active = 0;
+		if (!erase_sector_if_not_empty(0) || !erase_sector_if_not_empty(1)) {
+			m_active = -1;
+			return false;
+		}
+	}
+
+	m_seq = 0;
+	m_write_pos = SECTOR_HDR_SIZE;
+	memset(m_index, 0, sizeof(m_index));
+	return true;
+}
+
+/**
+ * Make the imported records active and erase the sector the data was
+ * imported from.
+ *
+ * @return
+ * true on success, false otherwise.
+ */
+bool eeprom_rec_import_end(void) {
+	if (m_active < 0) {
+		return false;
+	}
+
+	m_seq = 1;
+	if (!write_sector_hdr(m_active, m_seq)) {
+		return false;
+	}
+
+	return erase_sector_if_not_empty(1 - m_active);
+}
+
+/**
+ * Read a record.
+ *
+ * @param id
+ * Record id.
+ *
+ * @param data
+ * Buffer to read the record into.
+ *
+ * @param len
+ * Expected length of the record. Records of a different length are not read.
+ *
+ * @return
+ * true if a valid record with the expected length was found, false otherwise.
+ */
+bool eeprom_rec_read(uint16_t id, void *data, unsigned int len) {
+	if (m_active < 0 || id >= EEPROM_REC_IDS || m_index[id] == 0) {
+		return false;
+	}
+
+	const rec_hdr *hdr = (const rec_hdr*)(m_sector_addr[m_active] + m_index[id]);
+	const uint8_t *rec_data = (const uint8_t*)hdr + REC_HDR_SIZE;
+
+	if (hdr->len != len || hdr->crc != rec_crc(hdr->id, hdr->len, rec_data)) {
+		return false;
+	}
+
+	memcpy(data, rec_data, len);
+	return true;
+}
+
+/**
+ * Write a record. Nothing is written if the latest record with this id
+ * already has the same content.
+ *
+ * @param id
+ * Record id.
+ *
+ * @param data
+ * Record data.
+ *
+ * @param len
+ * Record length in bytes.
+ *
+ * @return
+ * true on success, false otherwise.
+ */
+bool eeprom_rec_write(uint16_t id, const void *data, unsigned int len) {
+	if (m_active < 0 || id >= EEPROM_REC_IDS ||
+			REC_SIZE(len) > (PAGE_SIZE - SECTOR_HDR_SIZE)) {
+		return false;
+	}
+
+	if (m_index[id] != 0) {
+		const rec_hdr *hdr = (const rec_hdr*)(m_sector_addr[m_active] + m_index[id]);
+		if (hdr->len == len && memcmp((const uint8_t*)hdr + REC_HDR_SIZE, data, len) == 0) {
+			return true;
+		}
+	}
+
+	if ((m_write_pos + REC_SIZE(len)) <= PAGE_SIZE) {
+		return append(id, data, len);
+	}
+
+	return compact(id, data, len);
+}
+
+/**
+ * Get the free space in the active sector.
+ *
+ * @return
+ * Number of free bytes.
+ */
+unsigned int eeprom_rec_free_bytes(void) {
+	if (m_active < 0) {
+		return 0;
+	}
+	return PAGE_SIZE - m_write_pos;
+}
+
+static bool sector_is_erased(int sector) {
+	const uint32_t *addr = (const uint32_t*)m_sector_addr[sector];
+
+	for (unsigned int i = 0;i < (PAGE_SIZE / 4);i++) {
+		if (addr[i] != 0xFFFFFFFF) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool erase_sector_if_not_empty(int sector) {
+	if (sector_is_erased(sector)) {
+		return true;
+	}
+	return FLASH_EraseSector(m_sector_id[sector], VOLTAGE_RANGE) == FLASH_COMPLETE;
+}
+
+static bool program(uint32_t addr, const uint8_t *data, unsigned int len) {
+	for (unsigned int i = 0;i < len;i += 2) {
+		uint16_t hw = data[i];
+		hw |= (i + 1) < len ? (uint16_t)data[i + 1] << 8 : 0xFF00;
+
+		if (FLASH_ProgramHalfWord(addr + i, hw) != FLASH_COMPLETE) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void scan_sector(int sector) {
+	uint32_t base = m_sector_addr[sector];
+	uint32_t pos = SECTOR_HDR_SIZE;
+
+	memset(m_index, 0, sizeof(m_index));
+
+	while ((pos + REC_HDR_SIZE) <= PAGE_SIZE) {
+		const rec_hdr *hdr = (const rec_hdr*)(base + pos);
+
+		if (hdr->id == ID_ERASED) {
+			break;
+		}
+
+		// Interrupted write of the header or a length that does not fit. Do
+		// not append after this, the next write will compact the sector.
+		if (hdr->len == 0xFFFF || (pos + REC_SIZE(hdr->len)) > PAGE_SIZE) {
+			pos = PAGE_SIZE;
+			break;
+		}
+
+		if (hdr->id < EEPROM_REC_IDS &&
+				hdr->crc == rec_crc(hdr->id, hdr->len, (const uint8_t*)hdr + REC_HDR_SIZE)) {
+			m_index[hdr->id] = pos;
+		}
+
+		pos += REC_SIZE(hdr->len);
+	}
+
+	m_write_pos = pos;
+}
+
+static uint32_t rec_crc(uint16_t id, uint16_t len, const uint8_t *data) {
+	uint8_t hdr[4] = {id & 0xFF, id >> 8, len & 0xFF, len >> 8};
+	return crc32c_with_init(data, len, crc32c(hdr, 4));
+}
+
+static bool append(uint16_t id, const uint8_t *data, unsigned int len) {
+	uint32_t addr = m_sector_addr[m_active] + m_write_pos;
+	uint32_t crc = rec_crc(id, len, data);
+	uint16_t hdr[2] = {id, len};
+
+	// Move the write position first, so that a failed write is not reused
+	uint32_t pos = m_write_pos;
+	m_write_pos += REC_SIZE(len);
+
+	if (!program(addr, (const uint8_t*)hdr, 4) ||
+			!program(addr + REC_HDR_SIZE, data, len) ||
+			!program(addr + 4, (const uint8_t*)&crc, 4)) {
+		return false;
+	}
+
+	m_index[id] = pos;
+	return true;
+}
+
+static bool compact(uint16_t id, const uint8_t *data, unsigned int len) {
+	int old = m_active;
+	int next = 1 - m_active;
+	uint32_t old_base = m_sector_addr[old];
+
+	// Check that everything fits before writing anything
+	uint32_t size = SECTOR_HDR_SIZE + REC_SIZE(len);
+	for (int i = 0;i < EEPROM_REC_IDS;i++) {
+		if (i != id && m_index[i] != 0) {
+			size += REC_SIZE(((const rec_hdr*)(old_base + m_index[i]))->len);
+		}
+	}
+
+	if (size > PAGE_SIZE || !erase_sector_if_not_empty(next)) {
+		return false;
+	}
+
+	uint16_t index_old[EEPROM_REC_IDS];
+	memcpy(index_old, m_index, sizeof(m_index));
+	memset(m_index, 0, sizeof(m_index));
+	m_active = next;
+	m_write_pos = SECTOR_HDR_SIZE;
+
+	bool ok = true;
+	for (int i = 0;i < EEPROM_REC_IDS && ok;i++) {
+		if (i == id || index_old[i] == 0) {
+			continue;
+		}
+
+		const rec_hdr *hdr = (const rec_hdr*)(old_base + index_old[i]);
+		uint32_t rec_size = REC_SIZE(hdr->len);
+		ok = program(m_sector_addr[next] + m_write_pos, (const uint8_t*)hdr, rec_size);
+		m_index[i] = m_write_pos;
+		m_write_pos += rec_size;
+	}
+
+	ok = ok && append(id, data, len) && write_sector_hdr(next, m_seq + 1);
+
+	// The old sector stays valid until the header of the new one is written
+	if (!ok) {
+		m_active = old;
+		scan_sector(old);
+		return false;
+	}
+
+	m_seq++;
+	return erase_sector_if_not_empty(old);
+}
+
+static bool write_sector_hdr(int sector, uint32_t seq) {
+	uint32_t addr = m_sector_addr[sector];
+	uint32_t magic = SECTOR_MAGIC;
+
+	// Sequence number, then the upper half of the magic and the lower
+	// half, which marks the sector as valid, last.
+	return program(addr + 4, (const uint8_t*)&seq, 4) &&
+			program(addr + 2, (const uint8_t*)&magic + 2, 2) &&
+			program(addr, (const uint8_t*)&magic, 2);
+}
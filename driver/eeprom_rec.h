@@ -0,0 +1,49 @@
+/*
+	Copyright 2025 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef EEPROM_REC_H_
+#define EEPROM_REC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "eeprom.h"
+
+/*
+ * Record based storage in the two flash sectors that are used for the
+ * emulated EEPROM. Each record holds a whole blob, e.g. a configuration,
+ * with a CRC. Records are appended to the active sector and the offset of
+ * the latest valid record for each id is kept in RAM, so reading a blob is
+ * a single copy from flash. When the active sector is full the latest
+ * records are copied to the other sector, which then becomes active.
+ *
+ * Flash must be unlocked around writes, as for EE_WriteVariable.
+ */
+
+// Number of record ids. Ids are assigned in conf_general.c.
+#define EEPROM_REC_IDS			(4 + EEPROM_VARS_HW + EEPROM_VARS_CUSTOM)
+
+// Functions
+bool eeprom_rec_init(void);
+bool eeprom_rec_import_begin(void);
+bool eeprom_rec_import_end(void);
+bool eeprom_rec_read(uint16_t id, void *data, unsigned int len);
+bool eeprom_rec_write(uint16_t id, const void *data, unsigned int len);
+unsigned int eeprom_rec_free_bytes(void);
+
+#endif /* EEPROM_REC_H_ */
@@ -104,8 +104,7 @@ static THD_FUNCTION(packet_process_thread, arg) {
 	for (;;) {
 		erg = SX1278_LoRaRxPacket(&SX1278);
 		if (erg > 0) {
-			for (int i=0; i<SX1278.readBytes; i++)
-				packet_process_byte(SX1278.rxBuffer[i],&packet_state);
+			packet_process_buffer(SX1278.rxBuffer, SX1278.readBytes, &packet_state);
 			erg=SX1278_LoRaEntryRx(&SX1278, 255, 200);
 		}
 		chThdSleepMilliseconds(10);
@@ -49,6 +49,13 @@ float timer_seconds_elapsed_since(uint32_t time) {
 	return (float)diff / (float)TIMER_HZ;
 }
 
+/**
+ * Seconds from start to end, negative if end is before start.
+ */
+float timer_seconds_between(uint32_t start, uint32_t end) {
+	return (float)((int32_t)(end - start)) / (float)TIMER_HZ;
+}
+
 /**
  * Blocking sleep based on timer.
  *
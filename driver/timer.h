@@ -25,6 +25,7 @@
 void timer_init(void);
 uint32_t timer_time_now(void);
 float timer_seconds_elapsed_since(uint32_t time);
+float timer_seconds_between(uint32_t start, uint32_t end);
 void timer_sleep(float seconds);
 
 #endif /* TIMER_H_ */
@@ -79,6 +79,7 @@ void enc_as504x_deinit(AS504x_config_t *cfg) {
 
 void enc_as504x_routine(AS504x_config_t *cfg) {
 	uint16_t pos;
+	uint32_t sample_time;
 
 	float timestep = timer_seconds_elapsed_since(cfg->state.last_update_time);
 	if (timestep > 1.0) {
@@ -94,6 +95,7 @@ void enc_as504x_routine(AS504x_config_t *cfg) {
 
 		long_delay();
 
+		sample_time = timer_time_now();
 		spi_bb_begin(&(cfg->sw_spi));
 		cfg->state.spi_data_err_raised = AS504x_spi_transfer_err_check(&cfg->sw_spi, &pos, 0, 1);
 		spi_bb_end(&(cfg->sw_spi));
@@ -119,6 +121,7 @@ void enc_as504x_routine(AS504x_config_t *cfg) {
 			cfg->state.diag_fetch_now_count = 0;
 		}
 	} else {
+		sample_time = timer_time_now();
 		spi_bb_begin(&(cfg->sw_spi));
 		spi_bb_transfer_16(&(cfg->sw_spi), &pos, 0, 1);
 		spi_bb_end(&(cfg->sw_spi));
@@ -139,7 +142,13 @@ void enc_as504x_routine(AS504x_config_t *cfg) {
 
 	if (spi_bb_check_parity(pos) && !cfg->state.spi_data_err_raised) {
 		pos &= 0x3FFF;
+
+		// The FOC interrupt reads the angle and the sample time together
+		chSysLock();
 		cfg->state.last_enc_angle = ((float) pos * 360.0) / 16384.0;
+		cfg->state.sample_time = sample_time;
+		chSysUnlock();
+
 		UTILS_LP_FAST(cfg->state.spi_error_rate, 0.0, timestep);
 	} else {
 		++cfg->state.spi_error_cnt;
@@ -328,7 +328,13 @@ void enc_as5x47u_routine(AS5x47U_config_t *cfg) {
 static void AS5x47U_process_pos(AS5x47U_config_t *cfg, uint16_t posData) {
 	cfg->state.spi_val = posData;
 	posData &= AS5x47U_SPI_EXCLUDE_PARITY_AND_ERROR_BITMASK;
+
+	// The position is latched when the frame that returns it starts. The FOC
+	// interrupt reads the angle and the sample time together.
+	chSysLockFromISR();
 	cfg->state.last_enc_angle = (float)(posData * 360) / (float)(1 << 14);
+	cfg->state.sample_time = cfg->state.xfer_start_time;
+	chSysUnlockFromISR();
 }
 
 static void AS5x47U_determinate_if_connected(AS5x47U_config_t *cfg, bool was_last_valid) {
@@ -372,6 +378,7 @@ static void AS5x47U_start_spi_exchange_precalc_crc(AS5x47U_config_t *cfg,
 	volatile uint32_t test = cfg->spi_dev->spi->DR;
 	(void)test; // get rid of unused warning
 
+	cfg->state.xfer_start_time = timer_time_now();
 	spiSelectI(cfg->spi_dev);
 	spiStartExchangeI(cfg->spi_dev, 3, cfg->state.tx_buf, cfg->state.rx_buf);
 }
@@ -97,6 +97,7 @@ void enc_bissc_deinit(BISSC_config_t *cfg) {
 
 void enc_bissc_routine(BISSC_config_t *cfg) {
 	if (cfg->spi_dev->state == SPI_READY) {
+		cfg->state.xfer_start_time = timer_time_now();
 		spiSelectI(cfg->spi_dev);
 		spiStartReceiveI(cfg->spi_dev, 8, (void *)cfg->state.decod_buf);
 		UTILS_LP_FAST(encoder_cfg_bissc.state.spi_comm_error_rate, 0.0, 0.0001);
@@ -163,7 +164,13 @@ void compute_bissc_callback(SPIDriver *pspi) {
 			UTILS_LP_FAST(cfg->state.spi_data_error_rate, 1.0, timestep);
 		} else {
 			UTILS_LP_FAST(cfg->state.spi_data_error_rate, 0.0, timestep);
+
+			// The position is latched on the first clock edge of the frame. The FOC
+			// interrupt reads the angle and the sample time together.
+			chSysLockFromISR();
 			cfg->state.last_enc_angle = ((float)cfg->state.spi_val * 360.0) / ((1<<lenghtDataBit) - 1);
+			cfg->state.sample_time = cfg->state.xfer_start_time;
+			chSysUnlockFromISR();
 		}
 
 	}
@@ -51,6 +51,9 @@ bool enc_mt6816_init(MT6816_config_t *cfg) {
 	palSetPadMode(cfg->mosi_gpio, cfg->mosi_pin,
 			PAL_MODE_ALTERNATE(cfg->spi_af) | PAL_STM32_OSPEED_HIGHEST);
 
+	palSetPad(cfg->nss_gpio, cfg->nss_pin);
+
+	cfg->spi_dev->app_arg = (void*)cfg;
 	spiStart(cfg->spi_dev, &(cfg->hw_spi_cfg));
 
 	cfg->state.spi_error_rate = 0.0;
@@ -75,37 +78,47 @@ void enc_mt6816_deinit(MT6816_config_t *cfg) {
 	cfg->state.spi_error_rate = 0.0;
 }
 
+// Start reading the angle. Called from a locked state when the SPI is idle, the
+// rest of the transfer is done from the callback.
 void enc_mt6816_routine(MT6816_config_t *cfg) {
+	// Reading register 0x03 latches the angle, so this is the sample time.
+	cfg->state.xfer_start_time = timer_time_now();
+	cfg->state.spi_seq = 0;
+	cfg->state.tx_buf = 0x8300;
+
+	palClearPad(cfg->nss_gpio, cfg->nss_pin);
+	spi_bb_delay();
+	spiStartExchangeI(cfg->spi_dev, 1, &cfg->state.tx_buf, &cfg->state.rx_buf[0]);
+}
+
+void enc_mt6816_spi_callback(SPIDriver *pspi) {
+	if (pspi == NULL || pspi->app_arg == NULL) {
+		return;
+	}
+
+	MT6816_config_t *cfg = (MT6816_config_t*)pspi->app_arg;
+
+	spi_bb_delay();
+	palSetPad(cfg->nss_gpio, cfg->nss_pin);
+
+	if (cfg->state.spi_seq == 0) {
+		cfg->state.spi_seq = 1;
+		cfg->state.tx_buf = 0x8400;
+
+		spi_bb_delay();
+		palClearPad(cfg->nss_gpio, cfg->nss_pin);
+		spi_bb_delay();
+		spiStartExchangeI(cfg->spi_dev, 1, &cfg->state.tx_buf, &cfg->state.rx_buf[1]);
+		return;
+	}
+
 	float timestep = timer_seconds_elapsed_since(cfg->state.last_update_time);
 	if (timestep > 1.0) {
 		timestep = 1.0;
 	}
 	cfg->state.last_update_time = timer_time_now();
 
-	uint16_t pos;
-	uint16_t reg_data_03;
-	uint16_t reg_data_04;
-	uint16_t reg_addr_03 = 0x8300;
-	uint16_t reg_addr_04 = 0x8400;
-
-#define SPI_BEGIN()		spi_bb_delay(); palClearPad(cfg->nss_gpio, cfg->nss_pin); spi_bb_delay();
-#define SPI_END()		spi_bb_delay(); palSetPad(cfg->nss_gpio, cfg->nss_pin); spi_bb_delay();
-
-	// TODO: The fact that the polled version is used means that it is
-	// more or less pointless to use the hardware SPI as the CPU sits
-	// and wastes cycles waiting for the hardware to finish.
-	//
-	// A better approach would be to use spiStartExchangeI and use a callback
-	// for when the operation finishes and process the data from there.
-	SPI_BEGIN();
-	reg_data_03 = spiPolledExchange(cfg->spi_dev, reg_addr_03);
-	SPI_END();
-	spi_bb_delay();
-	SPI_BEGIN();
-	reg_data_04 = spiPolledExchange(cfg->spi_dev, reg_addr_04);
-	SPI_END();
-
-	pos = (reg_data_03 << 8) | reg_data_04;
+	uint16_t pos = (cfg->state.rx_buf[0] << 8) | cfg->state.rx_buf[1];
 	cfg->state.spi_val = pos;
 
 	if (spi_bb_check_parity(pos)) {
@@ -114,7 +127,13 @@ void enc_mt6816_routine(MT6816_config_t *cfg) {
 			UTILS_LP_FAST(cfg->state.encoder_no_magnet_error_rate, 1.0, timestep);
 		} else {
 			pos = pos >> 2;
+
+			// The FOC interrupt reads the angle and the sample time together
+			chSysLockFromISR();
 			cfg->state.last_enc_angle = ((float) pos * 360.0) / 16384.0;
+			cfg->state.sample_time = cfg->state.xfer_start_time;
+			chSysUnlockFromISR();
+
 			UTILS_LP_FAST(cfg->state.spi_error_rate, 0.0, timestep);
 			UTILS_LP_FAST(cfg->state.encoder_no_magnet_error_rate, 0.0, timestep);
 		}
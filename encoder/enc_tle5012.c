@@ -213,12 +213,18 @@ void enc_tle5012_routine(TLE5012_config_t *cfg) {
 	cfg->state.last_update_time = timer_time_now();
 
 	uint16_t rx_data;
+	uint32_t sample_time = timer_time_now();
 	uint8_t tle_status = enc_tle5012_transfer(cfg, REG_AVAL, &rx_data, SSC_READ, true);  // define register names values?
 	cfg->state.last_status_error = tle_status;
 
 	if (tle_status == NO_ERROR ){
 		uint16_t pos = rx_data & 0x7FFF;
+
+		// The FOC interrupt reads the angle and the sample time together
+		chSysLock();
 		cfg->state.last_enc_angle = (float) pos * (360.0 / 32768.0); // 2^15 = 32768.0
+		cfg->state.sample_time = sample_time;
+		chSysUnlock();
 		UTILS_LP_FAST(cfg->state.spi_error_rate, 0.0, timestep);
 	}else{
 		if (tle_status != CRC_ERROR ) { // if not just a crc error
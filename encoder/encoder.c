@@ -33,6 +33,7 @@
 #include "mempools.h"
 #include "terminal.h"
 #include "app.h"
+#include "timer.h"
 
 #include <math.h>
 
@@ -44,9 +45,18 @@ typedef enum {
 	routine_rate_10k
 } routine_rate_t;
 
+// Transfers started from the FOC interrupt. The routine thread takes over when
+// there have been no triggers for ENC_TRIG_TIMEOUT seconds, e.g. in BLDC mode.
+#define ENC_TRIG_TIMEOUT			0.01
+// BiSS-C frames are long and need the encoder timeout in between, so they
+// are not started more often than this.
+#define ENC_TRIG_BISSC_PERIOD		0.0001
+
 volatile routine_rate_t m_routine_rate = routine_rate_1k;
 static encoder_type_t m_encoder_type_now = ENCODER_TYPE_NONE;
 static float m_enc_custom_pos = 0.0;
+static volatile uint32_t m_trig_last = 0;
+static volatile bool m_trig_active = false;
 
 static THD_WORKING_AREA(routine_thread_wa, 256);
 static THD_FUNCTION(routine_thread, arg);
@@ -56,6 +66,7 @@ static void terminal_encoder(int argc, const char **argv);
 static void terminal_encoder_clear_errors(int argc, const char **argv);
 static void terminal_encoder_clear_multiturn(int argc, const char **argv);
 static void timer_start(routine_rate_t rate);
+static bool spi_dma_start(void);
 
 // Function pointers
 static float (*m_enc_custom_read_deg)(void) = NULL;
@@ -436,6 +447,58 @@ float encoder_read_deg(void) {
 	return 0.0;
 }
 
+/**
+ * Read the angle together with the time it was sampled at.
+ *
+ * @param sample_time
+ * Timer ticks (see timer_time_now) when the encoder sampled the angle. Encoders
+ * that are read directly, such as ABI, return the current time.
+ *
+ * @return
+ * The angle in degrees.
+ */
+float encoder_read_deg_sample(uint32_t *sample_time) {
+	float *angle = 0;
+	uint32_t *time = 0;
+
+	switch (m_encoder_type_now) {
+	case ENCODER_TYPE_AS504x:
+		angle = &encoder_cfg_as504x.state.last_enc_angle;
+		time = &encoder_cfg_as504x.state.sample_time;
+		break;
+	case ENCODER_TYPE_MT6816:
+		angle = &encoder_cfg_mt6816.state.last_enc_angle;
+		time = &encoder_cfg_mt6816.state.sample_time;
+		break;
+	case ENCODER_TYPE_TLE5012:
+		angle = &encoder_cfg_tle5012.state.last_enc_angle;
+		time = &encoder_cfg_tle5012.state.sample_time;
+		break;
+	case ENCODER_TYPE_AS5x47U:
+		angle = &encoder_cfg_as5x47u.state.last_enc_angle;
+		time = &encoder_cfg_as5x47u.state.sample_time;
+		break;
+	case ENCODER_TYPE_BISSC:
+		angle = &encoder_cfg_bissc.state.last_enc_angle;
+		time = &encoder_cfg_bissc.state.sample_time;
+		break;
+	default:
+		break;
+	}
+
+	if (!angle) {
+		*sample_time = timer_time_now();
+		return encoder_read_deg();
+	}
+
+	syssts_t sts = chSysGetStatusAndLockX();
+	float res = *angle;
+	*sample_time = *time;
+	chSysRestoreStatusX(sts);
+
+	return res;
+}
+
 float encoder_read_deg_multiturn(void) {
 	if (m_encoder_type_now == ENCODER_TYPE_TS5700N8501) {
 		float ts_mt = (float)enc_ts5700n8501_get_abm(&encoder_cfg_TS5700N8501);
@@ -505,6 +568,32 @@ void encoder_tim_isr(void) {
 	// Use thread. Maybe use this one for encoders with a higher rate.
 }
 
+/**
+ * Start a transfer of the encoders that are read with hardware SPI and DMA. This
+ * is called from the FOC interrupt once per PWM period, so that the samples are
+ * taken at a fixed point in the period instead of whenever the routine thread
+ * runs. The data is processed in the SPI callback.
+ */
+void encoder_trigger_isr(void) {
+	if (m_encoder_type_now != ENCODER_TYPE_MT6816 &&
+			m_encoder_type_now != ENCODER_TYPE_AS5x47U &&
+			m_encoder_type_now != ENCODER_TYPE_BISSC) {
+		return;
+	}
+
+	if (m_encoder_type_now == ENCODER_TYPE_BISSC && m_trig_active &&
+			timer_seconds_elapsed_since(m_trig_last) < ENC_TRIG_BISSC_PERIOD) {
+		return;
+	}
+
+	chSysLockFromISR();
+	if (spi_dma_start()) {
+		m_trig_last = timer_time_now();
+		m_trig_active = true;
+	}
+	chSysUnlockFromISR();
+}
+
 #pragma GCC optimize ("Os")
 
 float encoder_get_error_rate(void) {
@@ -870,10 +959,6 @@ static THD_FUNCTION(routine_thread, arg) {
 			enc_as504x_routine(&encoder_cfg_as504x);
 			break;
 
-		case ENCODER_TYPE_MT6816:
-			enc_mt6816_routine(&encoder_cfg_mt6816);
-			break;
-
 		case ENCODER_TYPE_TLE5012:
 			enc_tle5012_routine(&encoder_cfg_tle5012);
 			break;
@@ -882,12 +967,18 @@ static THD_FUNCTION(routine_thread, arg) {
 			enc_ad2s1205_routine(&encoder_cfg_ad2s1205);
 			break;
 
+		case ENCODER_TYPE_MT6816:
 		case ENCODER_TYPE_AS5x47U:
-			enc_as5x47u_routine(&encoder_cfg_as5x47u);
-			break;
-
 		case ENCODER_TYPE_BISSC:
-			enc_bissc_routine(&encoder_cfg_bissc);
+			chSysLock();
+			if (m_trig_active && timer_seconds_elapsed_since(m_trig_last) > ENC_TRIG_TIMEOUT) {
+				m_trig_active = false;
+			}
+
+			if (!m_trig_active) {
+				spi_dma_start();
+			}
+			chSysUnlock();
 			break;
 
 		default:
@@ -913,3 +1004,35 @@ static void timer_start(routine_rate_t rate) {
 		chThdCreateStatic(routine_thread_wa, sizeof(routine_thread_wa), NORMALPRIO + 5, routine_thread, NULL);
 	}
 }
+
+/*
+ * Start a transfer of the DMA driven encoders. Must be called from a locked
+ * state. Returns false if the SPI was busy, in which case nothing is done.
+ * BiSS-C counts that as a communication error.
+ */
+static bool spi_dma_start(void) {
+	switch (m_encoder_type_now) {
+	case ENCODER_TYPE_MT6816:
+		if (encoder_cfg_mt6816.spi_dev->state != SPI_READY) {
+			return false;
+		}
+		enc_mt6816_routine(&encoder_cfg_mt6816);
+		return true;
+
+	case ENCODER_TYPE_AS5x47U:
+		if (encoder_cfg_as5x47u.spi_dev->state != SPI_READY) {
+			return false;
+		}
+		enc_as5x47u_routine(&encoder_cfg_as5x47u);
+		return true;
+
+	case ENCODER_TYPE_BISSC: {
+		bool ready = encoder_cfg_bissc.spi_dev->state == SPI_READY;
+		enc_bissc_routine(&encoder_cfg_bissc);
+		return ready;
+	}
+
+	default:
+		return false;
+	}
+}
@@ -46,6 +46,7 @@ void encoder_set_custom_callbacks (
 		char* (*print_info)(void));
 
 float encoder_read_deg(void);
+float encoder_read_deg_sample(uint32_t *sample_time);
 float encoder_read_deg_multiturn(void);
 void encoder_set_deg(float deg);
 encoder_type_t encoder_is_configured(void);
@@ -59,5 +60,6 @@ void encoder_check_faults(volatile mc_configuration *m_conf, bool is_second_moto
 // Interrupt handlers
 void encoder_pin_isr(void);
 void encoder_tim_isr(void);
+void encoder_trigger_isr(void);
 
 #endif /* ENCODER_ENCODER_H_ */
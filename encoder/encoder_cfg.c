@@ -67,11 +67,12 @@ AD2S1205_config_t encoder_cfg_ad2s1205 = {
 		{0},
 };
 
+void enc_mt6816_spi_callback(SPIDriver *pspi);
 MT6816_config_t encoder_cfg_mt6816 = {
 #ifdef HW_SPI_DEV
 		&HW_SPI_DEV, // spi_dev
 		{//HARDWARE SPI CONFIG
-				NULL, HW_HALL_ENC_GPIO3, HW_HALL_ENC_PIN3, SPI_BaudRatePrescaler_4 |
+				enc_mt6816_spi_callback, HW_HALL_ENC_GPIO3, HW_HALL_ENC_PIN3, SPI_BaudRatePrescaler_4 |
 				SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_DATASIZE_16BIT
 		},
 
@@ -80,7 +81,7 @@ MT6816_config_t encoder_cfg_mt6816 = {
 		/*SCK*/HW_SPI_PORT_SCK, HW_SPI_PIN_SCK,
 		/*MOSI*/HW_SPI_PORT_MOSI, HW_SPI_PIN_MOSI,
 		/*MISO*/HW_SPI_PORT_MISO, HW_SPI_PIN_MISO,
-		{0, 0, 0, 0, 0, 0, 0},
+		{0}, // State
 #else
 		0,
 		{0},
@@ -89,7 +90,7 @@ MT6816_config_t encoder_cfg_mt6816 = {
 		0, 0,
 		0, 0,
 		0, 0,
-		{0, 0, 0, 0, 0, 0, 0},
+		{0}, // State
 #endif
 };
 
@@ -191,7 +192,7 @@ BISSC_config_t encoder_cfg_bissc = {
 		/*MISO*/HW_SPI_PORT_MISO, HW_SPI_PIN_MISO,
 		22,   // enc_res
 		{0}, // crc
-		{0.0, 0, 0.0, 0, 0.0, 0, 0, {0}}
+		{0.0, 0, 0.0, 0, 0.0, 0, 0, 0, 0, {0}}
 #else
 		0,
 		{0},
@@ -202,6 +203,6 @@ BISSC_config_t encoder_cfg_bissc = {
 		0, 0,
 		22,   // enc_res
 		{0}, // crc
-		{0.0, 0, 0.0, 0, 0.0, 0, 0, {0}}
+		{0.0, 0, 0.0, 0, 0.0, 0, 0, 0, 0, {0}}
 #endif
 };
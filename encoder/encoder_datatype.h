@@ -80,6 +80,11 @@ typedef struct {
 	uint32_t spi_error_cnt;
 	uint32_t spi_val;
 	uint32_t last_update_time;
+	uint32_t sample_time;
+	uint32_t xfer_start_time;
+	uint8_t spi_seq;
+	uint16_t tx_buf;
+	uint16_t rx_buf[2];
 } MT6816_state;
 
 typedef struct {
@@ -107,6 +112,7 @@ typedef struct {
 	uint8_t last_status_error;
 	uint32_t spi_val;
 	uint32_t last_update_time;
+	uint32_t sample_time;
 } TLE5012_state;
 
 typedef struct { // sw ssc
@@ -222,6 +228,7 @@ typedef struct {
 	uint32_t spi_error_cnt;
 	float spi_error_rate;
 	uint32_t last_update_time;
+	uint32_t sample_time;
 } AS504x_state;
 
 typedef struct {
@@ -256,6 +263,8 @@ typedef struct {
 	uint32_t spi_error_cnt;
 	float spi_error_rate;
 	uint32_t last_update_time;
+	uint32_t sample_time;
+	uint32_t xfer_start_time;
 	uint8_t rx_buf[4];
 	uint8_t tx_buf[4];
 } AS5x47U_state;
@@ -283,6 +292,8 @@ typedef struct {
 	float last_enc_angle;
 	uint32_t spi_val;
 	uint32_t last_update_time;
+	uint32_t sample_time;
+	uint32_t xfer_start_time;
 	uint8_t decod_buf[8];
 } BISSC_state;
 
@@ -1357,18 +1357,18 @@ static THD_FUNCTION(canard_thread, arg) {
 		canardSetLocalNodeID(&canard_ins_if2, conf->controller_id);
 #endif
 
-		CANRxFrame *rxmsg;
-		while ((rxmsg = comm_can_get_rx_frame(1)) != 0) {
+		CANRxFrame rxmsg;
+		while (comm_can_get_rx_frame(&rxmsg, 1)) {
 			CanardCANFrame rx_frame;
 
-			if (rxmsg->IDE == CAN_IDE_EXT) {
-				rx_frame.id = rxmsg->EID | CANARD_CAN_FRAME_EFF;
+			if (rxmsg.IDE == CAN_IDE_EXT) {
+				rx_frame.id = rxmsg.EID | CANARD_CAN_FRAME_EFF;
 			} else {
-				rx_frame.id = rxmsg->SID;
+				rx_frame.id = rxmsg.SID;
 			}
 
-			rx_frame.data_len = rxmsg->DLC;
-			memcpy(rx_frame.data, rxmsg->data8, rxmsg->DLC);
+			rx_frame.data_len = rxmsg.DLC;
+			memcpy(rx_frame.data, rxmsg.data8, rxmsg.DLC);
 
 			canardHandleRxFrame(&canard_ins, &rx_frame, ST2US(chVTGetSystemTimeX()));
 		}
@@ -1379,17 +1379,17 @@ static THD_FUNCTION(canard_thread, arg) {
 		}
 
 #ifdef HW_CAN2_DEV
-		while ((rxmsg = comm_can_get_rx_frame(2)) != 0) {
+		while (comm_can_get_rx_frame(&rxmsg, 2)) {
 			CanardCANFrame rx_frame;
 
-			if (rxmsg->IDE == CAN_IDE_EXT) {
-				rx_frame.id = rxmsg->EID | CANARD_CAN_FRAME_EFF;
+			if (rxmsg.IDE == CAN_IDE_EXT) {
+				rx_frame.id = rxmsg.EID | CANARD_CAN_FRAME_EFF;
 			} else {
-				rx_frame.id = rxmsg->SID;
+				rx_frame.id = rxmsg.SID;
 			}
 
-			rx_frame.data_len = rxmsg->DLC;
-			memcpy(rx_frame.data, rxmsg->data8, rxmsg->DLC);
+			rx_frame.data_len = rxmsg.DLC;
+			memcpy(rx_frame.data, rxmsg.data8, rxmsg.DLC);
 
 			canardHandleRxFrame(&canard_ins_if2, &rx_frame, ST2US(chVTGetSystemTimeX()));
 		}
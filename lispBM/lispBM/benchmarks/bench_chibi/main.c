@@ -322,7 +322,7 @@ int main(void) {
       memset(outbuf,0, 1024);
     } else if (strncmp(str, ":env", 4) == 0) {
       lbm_value *glob_env = lbm_get_global_env();
-      for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+      for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
         lbm_value curr = glob_env[i];
         chprintf(chp,"Global Environment [%d]:\r\n", i);
         while (lbm_type_of(curr) == LBM_TYPE_CONS) {
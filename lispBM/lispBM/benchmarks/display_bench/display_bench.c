@@ -0,0 +1,239 @@
+/*
+    Copyright 2025 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark for the display extensions.
+
+   Calls the img-* extensions directly, without the evaluator, to time
+   the rasterizers, and runs a dashboard-like animation through
+   disp-render with a render callback that only counts the bytes it
+   would have sent to a display. A checksum of every image is printed
+   so that the output of different rasterizer versions can be compared.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "lispbm.h"
+#include "lbm_image.h"
+#include "extensions/display_extensions.h"
+
+#define GC_STACK_SIZE 96
+#define PRINT_STACK_SIZE 256
+#define HEAP_SIZE 8192
+#define EXTENSION_STORAGE_SIZE 100
+#define IMAGE_STORAGE_SIZE (32 * 1024)
+
+#define WIDTH  320
+#define HEIGHT 240
+#define FRAMES 200
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory_array[LBM_MEMORY_SIZE_1M];
+static lbm_uint bitmap_array[LBM_MEMORY_BITMAP_SIZE_1M];
+static lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
+static uint32_t image_storage[IMAGE_STORAGE_SIZE] __attribute__ ((aligned (8)));
+
+static uint64_t render_calls = 0;
+static uint64_t render_bytes = 0;
+
+static bool count_render_image(image_buffer_t *img, uint16_t x, uint16_t y, color_t *colors) {
+  (void)x;
+  (void)y;
+  (void)colors;
+  render_calls ++;
+  render_bytes += image_dims_to_size_bytes(img->fmt, img->width, img->height);
+  return true;
+}
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  if (image_storage[ix] != 0xffffffff && image_storage[ix] != w) return false;
+  image_storage[ix] = w;
+  return true;
+}
+
+static double now_s(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static lbm_value call(char *name, int argn, ...) {
+  lbm_uint sym;
+  lbm_value args[16];
+  if (!lbm_get_symbol_by_name(name, &sym)) return ENC_SYM_NIL;
+  extension_fptr f = lbm_get_extension(sym);
+  if (!f) return ENC_SYM_NIL;
+
+  va_list ap;
+  va_start(ap, argn);
+  for (int i = 0; i < argn; i ++) {
+    args[i] = va_arg(ap, lbm_value);
+  }
+  va_end(ap);
+  return f(args, (lbm_uint)argn);
+}
+
+static lbm_value sym(char *name) {
+  lbm_uint s = 0;
+  lbm_get_symbol_by_name(name, &s);
+  return lbm_enc_sym(s);
+}
+
+#define I(x) lbm_enc_i(x)
+
+static uint32_t checksum(lbm_value img) {
+  lbm_array_header_t *arr = lbm_dec_array_r(img);
+  uint8_t *d = (uint8_t*)arr->data;
+  uint32_t h = 2166136261u;
+  for (lbm_uint i = 0; i < arr->size; i ++) {
+    h = (h ^ d[i]) * 16777619u;
+  }
+  return h;
+}
+
+static lbm_value filled = ENC_SYM_NIL;
+
+static void bench_primitives(char *fmt_name, uint32_t color) {
+  lbm_value img = call("img-buffer", 3, sym(fmt_name), I(WIDTH), I(HEIGHT));
+  if (lbm_is_symbol(img)) {
+    printf("could not allocate %s image\n", fmt_name);
+    return;
+  }
+  lbm_value c = lbm_enc_u32(color);
+  srand(1);
+
+  double t0 = now_s();
+  for (int i = 0; i < 2000; i ++) {
+    int x = rand() % WIDTH;
+    int y = rand() % HEIGHT;
+    call("img-circle", 6, img, I(x), I(y), I(5 + rand() % 60), c, filled);
+  }
+  double t1 = now_s();
+  for (int i = 0; i < 2000; i ++) {
+    int x = rand() % WIDTH - 20;
+    int y = rand() % HEIGHT - 20;
+    call("img-rectangle", 7, img, I(x), I(y), I(10 + rand() % 150), I(10 + rand() % 100), c, filled);
+  }
+  double t2 = now_s();
+  for (int i = 0; i < 2000; i ++) {
+    call("img-triangle", 9, img,
+         I(rand() % WIDTH), I(rand() % HEIGHT),
+         I(rand() % WIDTH), I(rand() % HEIGHT),
+         I(rand() % WIDTH), I(rand() % HEIGHT),
+         c, filled);
+  }
+  double t3 = now_s();
+  for (int i = 0; i < 20000; i ++) {
+    int y = rand() % HEIGHT;
+    call("img-line", 6, img, I(0), I(y), I(WIDTH - 1), I(y), c);
+  }
+  double t4 = now_s();
+
+  printf("%-10s circle %7.2f us  rect %7.2f us  triangle %7.2f us  h-line %6.2f us  checksum %08x\n",
+         fmt_name,
+         (t1 - t0) * 1e6 / 2000.0,
+         (t2 - t1) * 1e6 / 2000.0,
+         (t3 - t2) * 1e6 / 2000.0,
+         (t4 - t3) * 1e6 / 20000.0,
+         checksum(img));
+}
+
+// A gauge with a needle that moves a little every frame. The needle is
+// erased by drawing it in the background color and then drawn at the
+// new angle.
+static void bench_dashboard(bool track) {
+  lbm_value img = call("img-buffer", 3, sym("rgb565"), I(WIDTH), I(HEIGHT));
+  if (lbm_is_symbol(img)) return;
+  lbm_value bg = lbm_enc_u32(0x102030);
+  lbm_value fg = lbm_enc_u32(0xF0A000);
+
+  call("img-clear", 2, img, bg);
+  call("img-circle", 6, img, I(160), I(120), I(100), lbm_enc_u32(0x303030), filled);
+
+  bool tracking = false;
+  if (track) {
+    tracking = call("img-track-dirty", 1, img) == ENC_SYM_TRUE;
+    if (!tracking) {
+      printf("dashboard: img-track-dirty not available\n");
+      return;
+    }
+  }
+
+  render_calls = 0;
+  render_bytes = 0;
+  double ang = 0.0;
+  int nx = 160, ny = 40;
+  double t0 = now_s();
+  for (int f = 0; f < FRAMES; f ++) {
+    call("img-triangle", 9, img, I(155), I(120), I(165), I(120), I(nx), I(ny), lbm_enc_u32(0x303030), filled);
+    ang += 0.02;
+    nx = 160 + (int)(80.0 * sin(ang));
+    ny = 120 - (int)(80.0 * cos(ang));
+    call("img-triangle", 9, img, I(155), I(120), I(165), I(120), I(nx), I(ny), fg, filled);
+    call("img-circle", 6, img, I(160), I(120), I(8), fg, filled);
+    call("disp-render", 3, img, I(0), I(0));
+  }
+  double t1 = now_s();
+
+  printf("dashboard %-9s %7.2f us/frame  %8.0f bytes rendered/frame  %3.1f renders/frame  checksum %08x\n",
+         tracking ? "tracked" : "full",
+         (t1 - t0) * 1e6 / FRAMES,
+         (double)render_bytes / FRAMES,
+         (double)render_calls / FRAMES,
+         checksum(img));
+}
+
+int main(void) {
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory_array, LBM_MEMORY_SIZE_1M,
+                bitmap_array, LBM_MEMORY_BITMAP_SIZE_1M,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSION_STORAGE_SIZE)) {
+    printf("Failed to initialize LispBM\n");
+    return 1;
+  }
+  memset(image_storage, 0xff, sizeof(image_storage));
+  lbm_image_init(image_storage, sizeof(image_storage) / sizeof(lbm_uint), image_write);
+  lbm_image_create("display-bench");
+  if (!lbm_image_boot()) {
+    printf("Failed to boot image\n");
+    return 1;
+  }
+  lbm_display_extensions_init();
+  lbm_display_extensions_set_callbacks(count_render_image, NULL, NULL);
+
+  filled = lbm_cons(sym("filled"), ENC_SYM_NIL);
+
+  bench_primitives("indexed2", 1);
+  bench_primitives("indexed4", 2);
+  bench_primitives("indexed16", 9);
+  bench_primitives("rgb332", 0x30A0F0);
+  bench_primitives("rgb565", 0x30A0F0);
+  bench_primitives("rgb888", 0x30A0F0);
+
+  bench_dashboard(false);
+  bench_dashboard(true);
+  return 0;
+}
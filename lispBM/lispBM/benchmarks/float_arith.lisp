@@ -0,0 +1,7 @@
+
+(define filt (lambda (n y)
+  (if (= n 0)
+      y
+    (filt (- n 1) (+ (* 0.95 y) (* 0.05 (* 1.5 (to-float n))))))))
+
+(filt 100000 0.0)
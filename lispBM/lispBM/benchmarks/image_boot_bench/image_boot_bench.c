@@ -0,0 +1,271 @@
+/*
+    Copyright 2025 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark for booting from an image.
+
+   Times a cold start, lbm_init up to the first call of the
+   control-out extension from (main), in three ways:
+
+   source  - the program is parsed and evaluated, then (main) is run.
+   flat    - an image saved by lbm_image_save_global_env is booted,
+             the bindings are unflattened onto the heap.
+   const   - an image saved by lbm_image_save_global_env_const is booted,
+             the bindings refer to the constant heap in the image.
+
+   The value that main outputs is printed for each, so that the
+   results of the different ways can be compared.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "lbm_image.h"
+#include "extensions/array_extensions.h"
+#include "extensions/math_extensions.h"
+#include "extensions/runtime_extensions.h"
+#include "extensions/lbm_dyn_lib.h"
+
+#define GC_STACK_SIZE 96
+#define PRINT_STACK_SIZE 256
+#define HEAP_SIZE 4096
+#define EXTENSION_STORAGE_SIZE 200
+#define IMAGE_STORAGE_SIZE (32 * 1024)
+
+#define ITERATIONS 200
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory_array[LBM_MEMORY_SIZE_32K];
+static lbm_uint bitmap_array[LBM_MEMORY_BITMAP_SIZE_32K];
+static lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
+
+static uint32_t flat_image[IMAGE_STORAGE_SIZE] __attribute__ ((aligned (8)));
+static uint32_t const_image[IMAGE_STORAGE_SIZE] __attribute__ ((aligned (8)));
+static uint32_t scratch_image[IMAGE_STORAGE_SIZE] __attribute__ ((aligned (8)));
+static uint32_t *image_storage = NULL;
+
+static pthread_t lispbm_thd;
+
+static lbm_char_channel_t string_tok;
+static lbm_string_channel_state_t string_tok_state;
+
+static volatile lbm_cid wait_cid = -1;
+static volatile bool output_done = false;
+static double output_time = 0.0;
+static float output_value = 0.0f;
+
+// A small motor control script. The tables are computed when the
+// program is evaluated.
+static char *program =
+  "(define pole-pairs 7)\n"
+  "(define gains '(0.12 0.03 0.001))\n"
+  "(define sin-table (map (lambda (i) (sin (* i 0.0245436926))) (range 256)))\n"
+  "(define sin-arr (list-to-array sin-table))\n"
+  "(define temp-derate (map (lambda (c) (if (< c 80) 1.0 (- 1.0 (* (- c 80) 0.025)))) (range 120)))\n"
+  "(define limits (list (cons 'current 60.0) (cons 'erpm 50000.0) (cons 'duty 0.95) (cons 'watt 1500.0)))\n"
+  "(define name \"motor-ctrl\")\n"
+  "(defun clamp (x lo hi) (if (< x lo) lo (if (> x hi) hi x)))\n"
+  "(defun limit (k) (assoc limits k))\n"
+  "(defun fast-sin (ang) (ix sin-arr (mod (to-i (* ang 40.7436654)) 256)))\n"
+  "(defun fast-cos (ang) (fast-sin (+ ang 1.5707963)))\n"
+  "(defun derate (temp) (ix temp-derate (clamp (to-i temp) 0 119)))\n"
+  "(defun pid (err integ deriv)\n"
+  "  (+ (* (ix gains 0) err) (* (ix gains 1) integ) (* (ix gains 2) deriv)))\n"
+  "(defun park (a b ang)\n"
+  "  (list (+ (* a (fast-cos ang)) (* b (fast-sin ang)))\n"
+  "        (- (* b (fast-cos ang)) (* a (fast-sin ang)))))\n"
+  "(defun current-cmd (erpm temp)\n"
+  "  (* (clamp (pid (- 3000.0 erpm) 10.0 0.0) 0.0 (limit 'current)) (derate temp)))\n"
+  "(defun main ()\n"
+  "  (let ((dq (park 1.0 0.5 0.3)))\n"
+  "    (control-out (+ (current-cmd 2500.0 85.0) (ix dq 0)))))\n";
+
+static char program_and_main[4096];
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  if (image_storage[ix] != 0xffffffff && image_storage[ix] != w) return false;
+  image_storage[ix] = w;
+  return true;
+}
+
+static double now_s(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static uint32_t timestamp_callback(void) {
+  return (uint32_t)(now_s() * 1e6);
+}
+
+static void sleep_callback(uint32_t us) {
+  struct timespec s;
+  struct timespec r;
+  s.tv_sec = 0;
+  s.tv_nsec = (long)us * 1000;
+  nanosleep(&s, &r);
+}
+
+static void done_callback(eval_context_t *ctx) {
+  if (ctx->id == wait_cid) {
+    wait_cid = -1;
+  }
+}
+
+static void *eval_thd_wrapper(void *v) {
+  (void)v;
+  lbm_run_eval();
+  return NULL;
+}
+
+static lbm_value ext_control_out(lbm_value *args, lbm_uint argn) {
+  if (argn != 1 || !lbm_is_number(args[0])) return ENC_SYM_TERROR;
+  if (!output_done) {
+    output_time = now_s();
+    output_value = lbm_dec_as_float(args[0]);
+    output_done = true;
+  }
+  return ENC_SYM_TRUE;
+}
+
+// Everything up to starting the evaluator thread. With create set, a
+// fresh image is created, otherwise the image in storage is booted.
+static bool start(uint32_t *storage, bool create) {
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory_array, LBM_MEMORY_SIZE_32K,
+                bitmap_array, LBM_MEMORY_BITMAP_SIZE_32K,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSION_STORAGE_SIZE)) {
+    return false;
+  }
+  lbm_set_timestamp_us_callback(timestamp_callback);
+  lbm_set_usleep_callback(sleep_callback);
+  lbm_set_ctx_done_callback(done_callback);
+  lbm_set_dynamic_load_callback(lbm_dyn_lib_find);
+
+  image_storage = storage;
+  lbm_image_init(storage, IMAGE_STORAGE_SIZE, image_write);
+  if (create) {
+    lbm_image_create("image-boot-bench");
+  }
+  if (!lbm_image_boot()) return false;
+  lbm_add_eval_symbols();
+  if (!lbm_image_has_extensions()) {
+    lbm_math_extensions_init();
+    lbm_runtime_extensions_init();
+    lbm_array_extensions_init();
+    lbm_dyn_lib_init();
+    lbm_add_extension("control-out", ext_control_out);
+  }
+  return true;
+}
+
+static bool load(char *str) {
+  lbm_create_string_char_channel(&string_tok_state, &string_tok, str);
+  wait_cid = lbm_load_and_eval_program_incremental(&string_tok, NULL);
+  return wait_cid != -1;
+}
+
+static void run(void) {
+  pthread_create(&lispbm_thd, NULL, eval_thd_wrapper, NULL);
+}
+
+static void wait_done(void) {
+  while (wait_cid != -1) {
+    sleep_callback(10);
+  }
+}
+
+static void stop(void) {
+  lbm_kill_eval();
+  pthread_join(lispbm_thd, NULL);
+}
+
+static bool build_image(uint32_t *storage, bool const_env) {
+  memset(storage, 0xff, IMAGE_STORAGE_SIZE * sizeof(uint32_t));
+  if (!start(storage, true)) return false;
+  if (!load(program)) return false;
+  run();
+  wait_done();
+  stop();
+  bool r = const_env ? lbm_image_save_global_env_const() : lbm_image_save_global_env();
+  r = r && lbm_image_save_extensions();
+  r = r && lbm_image_save_constant_heap_ix();
+  if (r) {
+    printf("%-6s image: %5u words used\n",
+           const_env ? "const" : "flat",
+           (unsigned int)(lbm_flash_memory_usage() +
+                          (lbm_uint)(IMAGE_STORAGE_SIZE - 1 - lbm_image_get_write_index())));
+  }
+  return r;
+}
+
+static void bench_cold_start(char *label, uint32_t *storage) {
+  double total = 0.0;
+  double total_init = 0.0;
+  double best = 1e9;
+  for (int i = 0; i < ITERATIONS; i ++) {
+    if (!storage) {
+      memset(scratch_image, 0xff, sizeof(scratch_image));
+    }
+    output_done = false;
+    double t0 = now_s();
+    bool ok = storage ? start(storage, false) : start(scratch_image, true);
+    total_init += now_s() - t0;
+    ok = ok && load(storage ? "(main)" : program_and_main);
+    if (!ok) {
+      printf("%s: failed to start\n", label);
+      return;
+    }
+    run();
+    wait_done();
+    stop();
+    if (!output_done) {
+      printf("%s: no control output\n", label);
+      return;
+    }
+    double t = output_time - t0;
+    total += t;
+    if (t < best) best = t;
+  }
+  printf("%-6s init+boot %7.1f us  cold start to first output: mean %7.1f us  min %7.1f us  output %f\n",
+         label,
+         total_init * 1e6 / ITERATIONS,
+         total * 1e6 / ITERATIONS,
+         best * 1e6,
+         (double)output_value);
+}
+
+int main(void) {
+  snprintf(program_and_main, sizeof(program_and_main), "%s(main)\n", program);
+  if (!build_image(flat_image, false) ||
+      !build_image(const_image, true)) {
+    printf("Failed to build images\n");
+    return 1;
+  }
+  bench_cold_start("source", NULL);
+  bench_cold_start("flat", flat_image);
+  bench_cold_start("const", const_image);
+  return 0;
+}
@@ -0,0 +1,248 @@
+/*
+    Copyright 2025 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark for the reader.
+
+   A script of about 30 kB is read with read-program and bound to a
+   symbol, nothing is evaluated. The time is measured in two ways:
+
+   string  - a string channel, the tokenizer scans the string directly.
+   peek    - the same string channel with direct access disabled, so
+             that every character goes through the channel interface
+             as for streaming channels.
+
+   A file name can be given as argument to read that file instead of
+   the generated script.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "lbm_image.h"
+
+#define GC_STACK_SIZE 256
+#define PRINT_STACK_SIZE 256
+#define HEAP_SIZE 65536
+#define EXTENSION_STORAGE_SIZE 200
+#define IMAGE_STORAGE_SIZE (32 * 1024)
+
+#define SCRIPT_SIZE 30000
+#define ITERATIONS 200
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory_array[LBM_MEMORY_SIZE_32K];
+static lbm_uint bitmap_array[LBM_MEMORY_BITMAP_SIZE_32K];
+static lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
+static uint32_t image_storage[IMAGE_STORAGE_SIZE] __attribute__ ((aligned (8)));
+
+static pthread_t lispbm_thd;
+
+static lbm_char_channel_t string_tok;
+static lbm_string_channel_state_t string_tok_state;
+
+static volatile lbm_cid wait_cid = -1;
+
+static char *script = NULL;
+
+// A chunk of a typical script, %d is replaced by the chunk number so
+// that the script defines different names.
+static const char *chunk =
+  "; Current limit for channel %d\n"
+  "(define lim-%d '(60.0 -60.0 0.95 1500.0))\n"
+  "(define name-%d \"motor channel\")\n"
+  "(defun ramp-%d (x target step) ; move towards target\n"
+  "  (if (> (abs (- target x)) step)\n"
+  "      (if (> target x) (+ x step) (- x step))\n"
+  "      target))\n"
+  "(defun filter-%d (acc sample)\n"
+  "  (+ (* acc 0.95) (* sample 0.05)))\n"
+  "(defun status-%d (erpm temp)\n"
+  "  (cond ((> temp 85.0) 'overtemp)\n"
+  "        ((< erpm -100000) 'reverse)\n"
+  "        (t 'ok)))\n"
+  "(define mask-%d 0xFF00u32)\n"
+  "(define table-%d (list 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16))\n";
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  if (image_storage[ix] != 0xffffffff && image_storage[ix] != w) return false;
+  image_storage[ix] = w;
+  return true;
+}
+
+static double now_s(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static uint32_t timestamp_callback(void) {
+  return (uint32_t)(now_s() * 1e6);
+}
+
+static void sleep_callback(uint32_t us) {
+  struct timespec s;
+  struct timespec r;
+  s.tv_sec = 0;
+  s.tv_nsec = (long)us * 1000;
+  nanosleep(&s, &r);
+}
+
+static void done_callback(eval_context_t *ctx) {
+  if (ctx->id == wait_cid) {
+    wait_cid = -1;
+  }
+}
+
+static void *eval_thd_wrapper(void *v) {
+  (void)v;
+  lbm_run_eval();
+  return NULL;
+}
+
+static char *no_contiguous_data(lbm_char_channel_t *chan, unsigned int *len) {
+  (void)chan;
+  *len = 0;
+  return NULL;
+}
+
+static char *make_script(void) {
+  size_t chunk_len = strlen(chunk) + 64;
+  char *s = malloc(SCRIPT_SIZE + chunk_len);
+  if (!s) return NULL;
+  size_t n = 0;
+  int i = 0;
+  while (n < SCRIPT_SIZE) {
+    n += (size_t)snprintf(s + n, chunk_len, chunk, i, i, i, i, i, i, i, i);
+    i ++;
+  }
+  return s;
+}
+
+static char *read_file(char *file_name) {
+  FILE *fp = fopen(file_name, "r");
+  if (!fp) return NULL;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  rewind(fp);
+  char *s = malloc((size_t)size + 1);
+  if (s) {
+    size_t n = fread(s, 1, (size_t)size, fp);
+    s[n] = 0;
+  }
+  fclose(fp);
+  return s;
+}
+
+static bool read_script(bool direct) {
+  lbm_pause_eval();
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_callback(10);
+  }
+  lbm_create_string_char_channel(&string_tok_state, &string_tok, script);
+  if (!direct) {
+    string_tok.contiguous_data = no_contiguous_data;
+  }
+  wait_cid = lbm_load_and_define_program(&string_tok, "prg");
+  lbm_continue_eval();
+  if (wait_cid == -1) return false;
+  while (wait_cid != -1) {
+    sleep_callback(10);
+  }
+  return true;
+}
+
+static void bench_read(char *label, bool direct) {
+  double total = 0.0;
+  double best = 1e9;
+  for (int i = 0; i < ITERATIONS; i ++) {
+    double t0 = now_s();
+    if (!read_script(direct)) {
+      printf("%s: failed to read\n", label);
+      return;
+    }
+    double t = now_s() - t0;
+    total += t;
+    if (t < best) best = t;
+  }
+  double kb = (double)strlen(script) / 1024.0;
+  printf("%-6s mean %8.1f us  min %8.1f us  %8.1f kB/s\n",
+         label,
+         total * 1e6 / ITERATIONS,
+         best * 1e6,
+         kb / best);
+}
+
+int main(int argc, char **argv) {
+  script = argc > 1 ? read_file(argv[1]) : make_script();
+  if (!script) {
+    printf("No script to read\n");
+    return 1;
+  }
+
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory_array, LBM_MEMORY_SIZE_32K,
+                bitmap_array, LBM_MEMORY_BITMAP_SIZE_32K,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSION_STORAGE_SIZE)) {
+    printf("Failed to initialize LispBM\n");
+    return 1;
+  }
+  lbm_set_timestamp_us_callback(timestamp_callback);
+  lbm_set_usleep_callback(sleep_callback);
+  lbm_set_ctx_done_callback(done_callback);
+
+  memset(image_storage, 0xff, sizeof(image_storage));
+  lbm_image_init(image_storage, IMAGE_STORAGE_SIZE, image_write);
+  lbm_image_create("parse-bench");
+  if (!lbm_image_boot()) {
+    printf("Failed to boot image\n");
+    return 1;
+  }
+  lbm_add_eval_symbols();
+
+  pthread_create(&lispbm_thd, NULL, eval_thd_wrapper, NULL);
+
+  // Warm up, this also adds the symbols of the script.
+  if (!read_script(true)) {
+    printf("Failed to read script\n");
+    return 1;
+  }
+  lbm_uint prg_sym;
+  lbm_value prg;
+  if (lbm_get_symbol_by_name("prg", &prg_sym) &&
+      lbm_global_env_lookup(&prg, lbm_enc_sym(prg_sym))) {
+    printf("Script: %u bytes, %u expressions\n",
+           (unsigned int)strlen(script),
+           (unsigned int)lbm_list_length(prg));
+  }
+
+  bench_read("string", true);
+  bench_read("peek", false);
+
+  lbm_kill_eval();
+  pthread_join(lispbm_thd, NULL);
+  free(script);
+  return 0;
+}
@@ -0,0 +1,20 @@
+;; Reader heavy benchmark. Every symbol the reader sees is looked up by
+;; name, so this mostly measures lbm_get_symbol_by_name.
+
+(define src "(define apa (lambda (x y) (if (< x y) (let ((a (car x)) (b (cdr y))) (cons a b)) (progn (setq x (+ x 1)) (list x y 'bepa 'cepa 'depa)))))")
+
+(define names '("str-join" "str-from-n" "bufcreate" "sym2str" "str2sym" "first" "rest" "undefine" "loopwhile" "trap" "x_1" "x_2" "x_3"))
+
+(define x_1 0)
+(define x_2 0)
+(define x_3 0)
+
+(define f (lambda (n acc)
+  (if (= n 0)
+      acc
+    (progn
+      (read src)
+      (map str2sym names)
+      (f (- n 1) (+ acc 1))))))
+
+(f 20000 0)
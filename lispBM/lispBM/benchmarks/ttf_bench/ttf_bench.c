@@ -0,0 +1,219 @@
+/*
+    Copyright 2025 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark for the TTF extensions.
+
+   Prepares a font binary with ttf-prepare and then times ttf-text and
+   ttf-text-dims on a paragraph, rendered into an in-memory image. The
+   extensions are called directly, without the evaluator. A checksum
+   of the image is printed so that the output of different versions
+   can be compared.
+
+   Usage: ttf_bench [font.ttf]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lispbm.h"
+#include "lbm_image.h"
+#include "extensions/display_extensions.h"
+#include "extensions/ttf_extensions.h"
+
+#define GC_STACK_SIZE 96
+#define PRINT_STACK_SIZE 256
+#define HEAP_SIZE 8192
+#define EXTENSION_STORAGE_SIZE 100
+#define IMAGE_STORAGE_SIZE (32 * 1024)
+
+#define WIDTH  480
+#define HEIGHT 320
+#define ITERATIONS 200
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory_array[LBM_MEMORY_SIZE_1M];
+static lbm_uint bitmap_array[LBM_MEMORY_BITMAP_SIZE_1M];
+static lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
+static uint32_t image_storage[IMAGE_STORAGE_SIZE] __attribute__ ((aligned (8)));
+
+static char *paragraph =
+  "The quick brown fox jumps over the lazy dog. AVATAR Yo To Wa\n"
+  "Pack my box with five dozen liquor jugs! LT Ty Vo \"quoted\"\n"
+  "Sphinx of black quartz, judge my vow. 0123456789 (+-*/=)\n"
+  "How vexingly quick daft zebras jump; WAVE Tj Fe Ke Pa.\n"
+  "Motor temp 42.5 C, battery 87 %, speed 31 km/h, range 12 km\n"
+  "Jackdaws love my big sphinx of quartz? [x] {y} <z> #@&_~\n"
+  "The five boxing wizards jump quickly. Vy Wo Ya AT LV PA\n"
+  "Bright vixens jump; dozy fowl quack. `tick' |pipe| ^caret^\n";
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  if (image_storage[ix] != 0xffffffff && image_storage[ix] != w) return false;
+  image_storage[ix] = w;
+  return true;
+}
+
+static double now_s(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static lbm_value call(char *name, int argn, ...) {
+  lbm_uint sym;
+  lbm_value args[16];
+  if (!lbm_get_symbol_by_name(name, &sym)) return ENC_SYM_NIL;
+  extension_fptr f = lbm_get_extension(sym);
+  if (!f) return ENC_SYM_NIL;
+
+  va_list ap;
+  va_start(ap, argn);
+  for (int i = 0; i < argn; i ++) {
+    args[i] = va_arg(ap, lbm_value);
+  }
+  va_end(ap);
+  return f(args, (lbm_uint)argn);
+}
+
+static lbm_value sym(char *name) {
+  lbm_uint s = 0;
+  lbm_get_symbol_by_name(name, &s);
+  return lbm_enc_sym(s);
+}
+
+static lbm_value mk_array(char *data, size_t size) {
+  lbm_value arr;
+  if (!lbm_create_array(&arr, (lbm_uint)size)) return ENC_SYM_NIL;
+  memcpy(lbm_dec_array_r(arr)->data, data, size);
+  return arr;
+}
+
+static lbm_value mk_string(char *str) {
+  return mk_array(str, strlen(str) + 1);
+}
+
+static uint32_t checksum(lbm_value img) {
+  lbm_array_header_t *arr = lbm_dec_array_r(img);
+  uint8_t *d = (uint8_t*)arr->data;
+  uint32_t h = 2166136261u;
+  for (lbm_uint i = 0; i < arr->size; i ++) {
+    h = (h ^ d[i]) * 16777619u;
+  }
+  return h;
+}
+
+static lbm_value load_file(char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) return ENC_SYM_NIL;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  char *data = malloc((size_t)size);
+  lbm_value arr = ENC_SYM_NIL;
+  if (data && fread(data, 1, (size_t)size, fp) == (size_t)size) {
+    arr = mk_array(data, (size_t)size);
+  }
+  free(data);
+  fclose(fp);
+  return arr;
+}
+
+static void bench_text(lbm_value font, char *fmt_name, float scale, lbm_value colors) {
+  lbm_value chars = mk_string(paragraph);
+  lbm_value text = mk_string(paragraph);
+  lbm_value img = call("img-buffer", 3, sym("rgb565"), lbm_enc_i(WIDTH), lbm_enc_i(HEIGHT));
+  if (lbm_is_symbol(img)) {
+    printf("could not allocate image\n");
+    return;
+  }
+
+  double t0 = now_s();
+  lbm_value bin = call("ttf-prepare", 4, font, lbm_enc_float(scale), sym(fmt_name), chars);
+  double t1 = now_s();
+  if (!lbm_is_array_r(bin)) {
+    printf("ttf-prepare failed\n");
+    return;
+  }
+
+  lbm_value dims = ENC_SYM_NIL;
+  for (int i = 0; i < ITERATIONS; i ++) {
+    dims = call("ttf-text-dims", 2, bin, text);
+  }
+  double t2 = now_s();
+  for (int i = 0; i < ITERATIONS; i ++) {
+    if (call("ttf-text", 6, img, lbm_enc_i(4), lbm_enc_i(4), colors, bin, text) != ENC_SYM_TRUE) {
+      printf("ttf-text failed\n");
+      return;
+    }
+  }
+  double t3 = now_s();
+
+  printf("%-9s %4.1f  prepare %8.0f us  text-dims %7.1f us  text %8.1f us  (%ux%u)  checksum %08x\n",
+         fmt_name, (double)scale,
+         (t1 - t0) * 1e6,
+         (t2 - t1) * 1e6 / ITERATIONS,
+         (t3 - t2) * 1e6 / ITERATIONS,
+         lbm_dec_as_u32(lbm_car(dims)),
+         lbm_dec_as_u32(lbm_car(lbm_cdr(dims))),
+         checksum(img));
+}
+
+int main(int argc, char **argv) {
+  char *font_file = argc > 1 ? argv[1] : "../../doc/Roboto-Regular.ttf";
+
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory_array, LBM_MEMORY_SIZE_1M,
+                bitmap_array, LBM_MEMORY_BITMAP_SIZE_1M,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSION_STORAGE_SIZE)) {
+    printf("Failed to initialize LispBM\n");
+    return 1;
+  }
+  memset(image_storage, 0xff, sizeof(image_storage));
+  lbm_image_init(image_storage, sizeof(image_storage) / sizeof(lbm_uint), image_write);
+  lbm_image_create("ttf-bench");
+  if (!lbm_image_boot()) {
+    printf("Failed to boot image\n");
+    return 1;
+  }
+  lbm_display_extensions_init();
+  lbm_ttf_extensions_init();
+
+  lbm_value font = load_file(font_file);
+  if (!lbm_is_array_r(font)) {
+    printf("Could not load %s\n", font_file);
+    return 1;
+  }
+
+  lbm_value colors2 = lbm_heap_allocate_list_init(2, lbm_enc_u32(0), lbm_enc_u32(0xFFFFFF));
+  lbm_value colors4 = lbm_heap_allocate_list_init(4,
+                                                  lbm_enc_u32(0),
+                                                  lbm_enc_u32(0x555555),
+                                                  lbm_enc_u32(0xAAAAAA),
+                                                  lbm_enc_u32(0xFFFFFF));
+
+  bench_text(font, "indexed2", 12.0f, colors2);
+  bench_text(font, "indexed4", 12.0f, colors4);
+  bench_text(font, "indexed4", 24.0f, colors4);
+  return 0;
+}
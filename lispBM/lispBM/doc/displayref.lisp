@@ -153,6 +153,21 @@
               end)))
 
 
+(define dirty-tracking
+  (ref-entry "img-track-dirty"
+             (list
+              (para (list "```clj\n (img-track-dirty img ..enable)\n (img-dirty img)\n```"))
+              (para (list "`img-track-dirty` starts recording the bounding box of the pixels"
+                          "that the drawing functions change in `img`. While an image is tracked"
+                          "`disp-render` only sends the changed area to the display and then"
+                          "resets it. Tracking starts with the whole image marked as changed"
+                          "so that the first render is complete. Pass `nil` as `enable` to stop tracking."
+                          "If too many images are tracked already, the one that was rendered"
+                          "the longest ago stops being tracked."))
+              (para (list "`img-dirty` returns the changed area as a list `(x y w h)`, or `nil` if"
+                          "nothing has changed since the last render."))
+              end)))
+
 (define blitting
   (ref-entry "img-blit"
              (list
@@ -347,6 +362,7 @@
                   setpixel
                   texts
                   triangles
+                  dirty-tracking
                   )
             )
    (section 1 "Examples"
@@ -25,8 +25,17 @@
 extern "C" {
 #endif
 
-#define GLOBAL_ENV_ROOTS 32
-#define GLOBAL_ENV_MASK  0x1F
+// The global environment is a hash table of association lists indexed
+// by symbol id. It starts with GLOBAL_ENV_ROOTS_MIN lists and doubles
+// in size, up to GLOBAL_ENV_ROOTS_MAX, as bindings are added.
+#define GLOBAL_ENV_ROOTS_MIN 32
+#ifndef GLOBAL_ENV_ROOTS_MAX
+#define GLOBAL_ENV_ROOTS_MAX 512
+#endif
+// Number of entries in the global lookup cache, must be a power of two.
+#ifndef GLOBAL_ENV_CACHE_SIZE
+#define GLOBAL_ENV_CACHE_SIZE 64
+#endif
 
 //environment interface
 /** Initialize the global environment. This sets the global environment to NIL
@@ -36,9 +45,21 @@ extern "C" {
 int lbm_init_env(void);
 /**
  *
- * \return the global environment
+ * \return the global environment. The array is reallocated when the
+ *  environment grows, so do not keep the pointer across a define.
+ *  Calling this clears the global lookup cache, as the caller may
+ *  remove bindings through the returned pointer.
  */
 lbm_value *lbm_get_global_env(void);
+/**
+ * \return the number of association lists (roots) in the global environment.
+ */
+lbm_uint lbm_get_global_env_roots(void);
+/** Get the index of the global environment root that holds the binding of a symbol.
+ * \param sym_id Id of the symbol (not encoded).
+ * \return Root index.
+ */
+lbm_uint lbm_global_env_ix(lbm_uint sym_id);
 /**
  * \return the size of the global env in number of heap cells.
  */
@@ -65,6 +86,14 @@ bool lbm_env_lookup_b(lbm_value *res, lbm_value sym, lbm_value env);
  * \return True on success or false otherwise.
  */
 bool lbm_global_env_lookup(lbm_value *res, lbm_value sym);
+/** Add or update a binding in the global environment. The global
+ *  environment is grown if the association list the binding ends up in
+ *  is getting long.
+ * \param key A symbol to associate with a value.
+ * \param val The value.
+ * \return ENC_SYM_TRUE on success or ENC_SYM_MERROR if GC needs to be run.
+ */
+lbm_value lbm_global_env_set(lbm_value key, lbm_value val);
 /** Create a new binding on the environment or replace an old binding.
  *
  * \param env Environment to modify.
@@ -91,6 +120,12 @@ lbm_value lbm_env_set_functional(lbm_value env, lbm_value key, lbm_value val);
  * \return The modified environment of Success and lbm_enc_sym(SYM_NOT_FOUND) if the key does not exist.
  */
 lbm_value lbm_env_modify_binding(lbm_value env, lbm_value key, lbm_value val);
+/** Modify an existing binding in the global environment.
+ * \param key A symbol that is bound in the global environment.
+ * \param val The new value.
+ * \return The association list holding the binding or ENC_SYM_NOT_FOUND.
+ */
+lbm_value lbm_global_env_modify_binding(lbm_value key, lbm_value val);
 /** Removes a binding (destructively) from the input environment.
  * \param env Environment to modify.
  * \param key Key to remove from environment.
@@ -144,6 +144,20 @@ void lbm_set_eval_time_quota(uint32_t quota);
  */
 void lbm_set_eval_step_quota(uint32_t quota);
 #endif
+#ifdef LBM_USE_GC_INCREMENTAL
+/** Configure the incremental garbage collector. A collection cycle is
+ *  started by the scheduler when fewer than free_threshold cells are free,
+ *  and the sweep is then spread out over scheduler rounds with at most
+ *  sweep_budget cells swept per round.
+ *
+ *  Only the sweep is incremental. Marking is still done in one pause,
+ *  and that pause grows with the amount of live data. An incremental
+ *  mark would need a write barrier on every heap and stack store.
+ *  \param free_threshold Number of free cells that starts a cycle. 0 uses a quarter of the heap.
+ *  \param sweep_budget Max number of cells to sweep per scheduler round.
+ */
+void lbm_set_gc_incremental(lbm_uint free_threshold, lbm_uint sweep_budget);
+#endif
 /** Initialize events
  * \param num_events The maximum number of unprocessed events.
  * \return true on success, false otherwise.
@@ -384,6 +398,16 @@ lbm_cid lbm_get_current_cid(void);
  * a guarantee that a context is running
  */
 eval_context_t *lbm_get_current_context(void);
+/** Get the function call frames recorded on the stack of a context.
+ *  Frames are only recorded when built with LBM_USE_PROF_STACK.
+ *  Intended for the sampling profiler, that may call this on a running
+ *  context, so the result is best effort.
+ * \param ctx Context to inspect.
+ * \param syms Array to store symbol ids of the called functions in, outermost first.
+ * \param max Size of syms. The innermost max frames are kept.
+ * \return Number of frames stored in syms.
+ */
+lbm_uint lbm_get_prof_stack(eval_context_t *ctx, lbm_uint *syms, lbm_uint max);
 /** Surrenders remaining eval quota.
  *  Call this from extensions that takes non-trivial amounts of time.
  */
@@ -44,12 +44,34 @@ typedef enum {
   COLOR_PRE_Y,
 } COLOR_TYPE;
 
+// Area of an image buffer that has changed since it was last rendered
+// with disp-render. Only kept for images that are tracked with
+// img-track-dirty.
+typedef struct {
+  uint8_t *mem_base; // Tracked image, NULL when the slot is free.
+  uint16_t width;    // Size and format of the tracked image. The slot is
+  uint16_t height;   // stale if the memory now holds a different image.
+  color_format_t fmt;
+  int x0;            // Changed area, inclusive. Empty when x1 < 0.
+  int y0;
+  int x1;
+  int y1;
+  bool rendered;     // Last render, the changed area is relative to it.
+  uint16_t x;
+  uint16_t y;
+  uint32_t palette_hash;
+  uint32_t last_use; // For reusing the least recently rendered slot.
+} image_dirty_t;
+
+#define IMAGE_DIRTY_NUM 4 // Number of images that can be tracked at the same time.
+
 typedef struct {
   color_format_t fmt;
   uint16_t width;
   uint16_t height;
   uint8_t  *data;
   uint8_t  *mem_base;
+  image_dirty_t *dirty; // NULL if changes are not tracked.
 } image_buffer_t;
 
 
@@ -176,6 +198,8 @@ bool display_is_symbol_down(lbm_value v);
 color_format_t sym_to_color_format(lbm_value v);
 uint32_t image_dims_to_size_bytes(color_format_t fmt, uint16_t width, uint16_t height);
 
+image_dirty_t *image_buffer_dirty(uint8_t *mem_base);
+
 void putpixel(image_buffer_t* img, int x_i, int y_i, uint32_t c);
 uint32_t getpixel(image_buffer_t* img, int x_i, int y_i);
 
@@ -0,0 +1,44 @@
+/*
+    Copyright 2025 Joel Svensson        svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The vector extensions operate on whole byte arrays holding f32 or
+   i16 elements in native byte order, so that reductions, elementwise
+   arithmetic and filters over a buffer of samples are one extension
+   call instead of one evaluator step per element. */
+
+#ifndef VECTOR_EXTENSIONS_H_
+#define VECTOR_EXTENSIONS_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of floats in the biquad array used by vec-biquad-f32:
+// a0 a1 a2 b1 b2 z1 z2.
+#define LBM_VEC_BIQUAD_SIZE 7
+
+/** Add the vector extensions.
+ * \return true if all of them were added, false if the extension table is full.
+ */
+bool lbm_vector_extensions_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
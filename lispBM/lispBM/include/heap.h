@@ -226,6 +226,11 @@ typedef struct {
   lbm_uint gc_least_free;      // The smallest length of the freelist.
   lbm_uint gc_last_free;       // Number of elements on the freelist
                                // after most recent GC.
+#ifdef LBM_USE_GC_INCREMENTAL
+  lbm_uint *gc_bitmap;         // One mark bit per cell.
+  lbm_uint gc_sweep_ix;        // Next cell to sweep.
+  bool     gc_sweeping;        // A sweep is in progress.
+#endif
 } lbm_heap_state_t;
 
 extern lbm_heap_state_t lbm_heap_state;
@@ -605,11 +610,36 @@ void lbm_gc_mark_aux(lbm_uint *data, lbm_uint n);
  * \param num_roots size of array of roots.
  */
 void lbm_gc_mark_roots(lbm_uint *roots, lbm_uint num_roots);
+/** Check if a value survives the collection in progress. Only valid
+ *  after all roots are marked and before the sweep.
+ * \param x Value to check.
+ * \return true if x is marked or is not a pointer into the heap.
+ */
+bool lbm_gc_is_marked(lbm_value x);
 /** Sweep up all non marked heap cells and place them on the free list.
  *
  * \return 1
  */
 int lbm_gc_sweep_phase(void);
+#ifdef LBM_USE_GC_INCREMENTAL
+/** Start an incremental sweep. Call after marking all roots, instead of
+ *  lbm_gc_sweep_phase. The freelist is kept and its cells are marked so
+ *  that allocation can continue while the sweep is in progress.
+ */
+void lbm_gc_sweep_begin(void);
+/** Sweep at most n cells of an incremental sweep.
+ * \param n Maximum number of cells to sweep.
+ * \return true if the sweep is finished.
+ */
+bool lbm_gc_sweep_step(lbm_uint n);
+/** Sweep all remaining cells of an incremental sweep, if there is one.
+ */
+void lbm_gc_sweep_finish(void);
+/** Check if an incremental sweep is in progress.
+ * \return true if sweeping.
+ */
+bool lbm_gc_sweep_pending(void);
+#endif
 
 // Array functionality
 /** Allocate an bytearray in symbols and arrays memory (lispbm_memory.h)
@@ -829,12 +859,15 @@ extern int64_t lbm_dec_i64(lbm_value x);
  * \return true if x is a pointer to a heap cell, false otherwise.
  */
 static inline bool lbm_is_ptr(lbm_value x) {
+#if defined(LBM_USE_IMMEDIATE_FLOAT) && !defined(LBM64)
+  return (x & LBM_PTR_BIT) && ((x & LBM_PTR_TYPE_MASK) != LBM_TYPE_FLOAT);
+#else
   return (x & LBM_PTR_BIT);
+#endif
 }
 
 static inline bool lbm_is_constant(lbm_value x) {
-  return ((x & LBM_PTR_BIT && x & LBM_PTR_TO_CONSTANT_BIT) ||
-          (!(x & LBM_PTR_BIT)));
+  return (!lbm_is_ptr(x) || (x & LBM_PTR_TO_CONSTANT_BIT));
 }
 
 /**
@@ -0,0 +1,156 @@
+/*
+    Copyright 2025 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** \file lbm_bytecode.h
+ *  Optional bytecode tier for closures (LBM_USE_BYTECODE).
+ *
+ *  A closure whose body only uses a pure subset of the language is
+ *  compiled to a compact direct-threaded bytecode the first time it
+ *  is applied. Parameters and let-bindings are resolved to slots in a
+ *  frame, calls to fundamentals are made directly and calls between
+ *  compiled closures do not go through the continuation stack.
+ *
+ *  The subset is: constants, variables, quote, if, cond, progn, let,
+ *  loop, and, or, setq of a local variable, pure fundamentals and
+ *  calls of closures that are also in the subset. The subset has no
+ *  side effects, so whenever the bytecode runs into something it
+ *  cannot handle, such as an extension call, a run time error or a
+ *  too deep recursion, the whole application is redone by the CPS
+ *  evaluator. A closure that fails like that is not tried again, but
+ *  the compiled closures it calls still are.
+ *
+ *  The GC never runs inside the bytecode. When a fundamental runs out
+ *  of memory the application stops and the evaluator collects garbage
+ *  and continues it, as it does for fundamentals in CPS.
+ *
+ *  An application that runs out of its call budget is suspended. Its
+ *  state is saved in a lisp array that the evaluator keeps on the
+ *  continuation stack while other contexts run, and it is resumed
+ *  from there.
+ */
+#ifndef LBM_BYTECODE_H_
+#define LBM_BYTECODE_H_
+
+#include "lbm_types.h"
+#include "eval_cps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef LBM_USE_BYTECODE
+
+// Static RAM use is (CODE_SIZE + STACK_SIZE) words plus 20 bytes per
+// cache entry on 32 bit platforms. The tier is off in the firmware
+// build.
+#ifndef LBM_BYTECODE_CACHE_SIZE
+#define LBM_BYTECODE_CACHE_SIZE 32 // Must be a power of two.
+#endif
+#ifndef LBM_BYTECODE_STACK_SIZE
+#define LBM_BYTECODE_STACK_SIZE 256
+#endif
+#ifndef LBM_BYTECODE_MAX_CODE
+#define LBM_BYTECODE_MAX_CODE   256  // Words of code for one closure.
+#endif
+#ifndef LBM_BYTECODE_CODE_SIZE
+#define LBM_BYTECODE_CODE_SIZE  1024 // Words of code for all closures.
+#endif
+// Number of calls and loop iterations a compiled application may
+// perform before it is suspended to let other contexts run.
+#ifndef LBM_BYTECODE_CALL_BUDGET
+#define LBM_BYTECODE_CALL_BUDGET 1000
+#endif
+
+typedef enum {
+  LBM_BYTECODE_CPS,       // Evaluate the application with the CPS evaluator.
+  LBM_BYTECODE_DONE,      // The result has been produced.
+  LBM_BYTECODE_SUSPENDED, // Out of budget, resume with lbm_bytecode_resume.
+  LBM_BYTECODE_NO_MEM,    // Out of memory, collect garbage and call
+                          // lbm_bytecode_continue.
+  LBM_BYTECODE_ERROR,     // The application failed with the error in res.
+} lbm_bytecode_status_t;
+
+/** Clear the bytecode cache. Called from lbm_eval_init.
+ */
+void lbm_bytecode_init(void);
+/** Compile a closure, unless it is already in the cache or is known
+ *  not to compile. Called when a closure application starts.
+ * \param params Parameter list of the closure.
+ * \param body Body of the closure.
+ */
+void lbm_bytecode_prepare(lbm_value params, lbm_value body);
+/** Run the compiled code for a closure body.
+ * \param ctx Context performing the application.
+ * \param body Body of the closure.
+ * \param env Closure environment extended with the parameter bindings.
+ * \param res The result of the application or, if suspended, the saved
+ *            state is stored here.
+ * \return LBM_BYTECODE_DONE, LBM_BYTECODE_SUSPENDED, LBM_BYTECODE_NO_MEM
+ *         or, if the body should be evaluated in env by the CPS
+ *         evaluator, LBM_BYTECODE_CPS.
+ */
+lbm_bytecode_status_t lbm_bytecode_apply(eval_context_t *ctx, lbm_value body, lbm_value env, lbm_value *res);
+/** Continue a suspended application. The saved state must be kept
+ *  reachable by the GC while suspended.
+ * \param ctx Context performing the application.
+ * \param body Body of the closure that was applied.
+ * \param state Saved state from lbm_bytecode_apply or
+ *              lbm_bytecode_resume. Replaced by the result, or by the
+ *              new state if suspended again.
+ * \return As for lbm_bytecode_apply. On LBM_BYTECODE_CPS the whole
+ *         application is redone by the CPS evaluator.
+ */
+lbm_bytecode_status_t lbm_bytecode_resume(eval_context_t *ctx, lbm_value body, lbm_value *state);
+/** Continue an application after LBM_BYTECODE_NO_MEM. Must be called
+ *  after garbage has been collected and before any other application.
+ * \param ctx Context performing the application.
+ * \param body Body of the closure that was applied.
+ * \param res As for lbm_bytecode_apply, or the saved state if it was
+ *            continued from lbm_bytecode_resume.
+ * \return As for lbm_bytecode_apply. LBM_BYTECODE_NO_MEM is only
+ *         returned if the application got further than the last time.
+ *         Running out of memory again at the same point gives
+ *         LBM_BYTECODE_ERROR with res set to out of memory.
+ */
+lbm_bytecode_status_t lbm_bytecode_continue(eval_context_t *ctx, lbm_value body, lbm_value *res);
+/** Mark the values referenced by an application that ran out of
+ *  memory, and by the cache while there is one. Called from the GC.
+ */
+void lbm_bytecode_gc_mark(void);
+/** Drop cache entries of closures that were not marked. Called from
+ *  the GC after all roots are marked.
+ */
+void lbm_bytecode_gc_clear(void);
+
+typedef struct {
+  lbm_uint compiled;    // Closures compiled.
+  lbm_uint rejected;    // Closures outside of the supported subset.
+  lbm_uint applied;     // Applications completed in bytecode.
+  lbm_uint fallbacks;   // Applications handed back to the CPS evaluator.
+  lbm_uint suspended;   // Times an application ran out of budget.
+} lbm_bytecode_stats_t;
+
+/** Get bytecode statistics.
+ * \param stats Statistics are copied here.
+ */
+void lbm_bytecode_get_stats(lbm_bytecode_stats_t *stats);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
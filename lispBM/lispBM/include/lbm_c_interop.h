@@ -143,7 +143,7 @@ void lbm_clear_env(void);
  * of data and size should be performed before unpausing the evaluator.
  * Unpausing the evaluator enables reclamation of data by GC.
  *
- * \param index Value between 0 and GLOBAL_ENV_ROOTS-1
+ * \param index Value between 0 and lbm_get_global_env_roots()-1
  * \param data Result data pointer is returned here.
  * \param size Result size is returned here.
  */
@@ -93,6 +93,9 @@ typedef struct lbm_char_channel_s {
 
   bool (*may_block)(struct lbm_char_channel_s *chan);
 
+  /* Direct access to channels backed by memory */
+  char *(*contiguous_data)(struct lbm_char_channel_s *chan, unsigned int *len);
+
 } lbm_char_channel_t;
 
 
@@ -202,6 +205,16 @@ unsigned int lbm_channel_column(lbm_char_channel_t *chan);
  */
 bool lbm_channel_may_block(lbm_char_channel_t *chan);
 
+/** Get direct access to the unread contents of a channel that is backed
+ *  by contiguous memory, such as a string channel. The data is valid
+ *  until the next read or drop on the channel. Streaming channels return NULL
+ *  and must be accessed through peek.
+ * \param chan The channel to query.
+ * \param len The number of unread characters is stored here.
+ * \return Pointer to the next unread character or NULL.
+ */
+char *lbm_channel_contiguous_data(lbm_char_channel_t *chan, unsigned int *len);
+
 /* Interface */
 /** Create a channel from a string. This channel can be read from but not
  *  written to.
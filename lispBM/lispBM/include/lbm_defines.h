@@ -83,6 +83,14 @@
 #define LBM_TYPE_U                       0x0000000Cu // 11  0   0
 #define LBM_LOW_RESERVED_BITS            0x0000000Fu // 11  1   1
 
+/* With LBM_USE_IMMEDIATE_FLOAT a float is not boxed in a heap cell.
+   The value has the PTR bit and the LBM_TYPE_FLOAT type bits set and
+   the 24 most significant bits of the IEEE 754 single, rounded to
+   nearest, are stored in place of the cell address. That leaves 15
+   mantissa bits, about 5 significant decimal digits, but float
+   arithmetic no longer allocates. lbm_is_ptr is false for these
+   values. */
+
 #else /* 64 bit Version */
 
 #define LBM_ADDRESS_SHIFT                2
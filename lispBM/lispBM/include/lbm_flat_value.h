@@ -58,10 +58,12 @@ typedef struct {
 #define FLATTEN_VALUE_ERROR_MAXIMUM_DEPTH       -5
 #define FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY   -6
 #define FLATTEN_VALUE_ERROR_FATAL               -7
+#define FLATTEN_VALUE_ERROR_SINK                -8
 
 #define UNFLATTEN_MALFORMED     -2
 #define UNFLATTEN_GC_RETRY      -1
 #define UNFLATTEN_OK             0
+#define UNFLATTEN_MORE           1
 
 
 bool lbm_start_flatten(lbm_flat_value_t *v, size_t buffer_size);
@@ -92,4 +94,99 @@ int lbm_get_max_flatten_depth(void);
  *  \return True on success and false otherwise.
  */
 bool lbm_unflatten_value(lbm_flat_value_t *v, lbm_value *res);
+
+// ------------------------------------------------------------
+// Streaming
+
+/** Sink that receives the output of a streaming flatten, one chunk
+ *  at a time. Returns false to abort the flatten.
+ */
+typedef bool (*lbm_flat_sink_t)(uint8_t *data, lbm_uint len, void *arg);
+
+typedef struct {
+  lbm_flat_value_t chunk; // Caller provided buffer, filled before each call to sink.
+  lbm_flat_sink_t sink;
+  void *arg;
+  lbm_uint total;         // Number of bytes passed to sink.
+} lbm_flat_stream_t;
+
+/** Set up a streaming flatten into a caller provided buffer.
+ *
+ *  \param s Stream to initialize.
+ *  \param buf Buffer that output is collected in. Can be a packet buffer
+ *         or a CAN frame payload.
+ *  \param buf_size Size of buf.
+ *  \param sink Called with the contents of buf whenever it is full and once
+ *         more with the remaining bytes at the end.
+ *  \param arg Passed on to sink.
+ */
+void lbm_flat_stream_init(lbm_flat_stream_t *s, uint8_t *buf, lbm_uint buf_size, lbm_flat_sink_t sink, void *arg);
+/** Flatten a value in a single traversal, without allocating from
+ *  lbm_memory. The output is the same as that of flatten_value. Large
+ *  byte arrays are passed to sink directly from the array, without
+ *  being copied to the buffer.
+ *
+ *  On error, the bytes that have already been passed to sink do not form
+ *  a complete flat value and the receiver has to be told to drop them.
+ *
+ *  \param s Stream initialized with lbm_flat_stream_init.
+ *  \param v Value to flatten.
+ *  \return FLATTEN_VALUE_OK on success, otherwise one of the
+ *          FLATTEN_VALUE_ERROR codes.
+ */
+int lbm_flatten_value_stream(lbm_flat_stream_t *s, lbm_value v);
+
+// Room for a tag and the longest symbol name, including the 0.
+#define LBM_UNFLATTEN_STREAM_ATOM_SIZE (1 + 256 + 1)
+
+/** State of an incremental unflatten. The value under construction is
+ *  kept on the heap and is marked by the GC until lbm_unflatten_stream_end
+ *  is called, or until the context that started it finishes. Must only be
+ *  used where heap allocation is allowed, that is from extensions or while
+ *  the evaluator is paused.
+ */
+typedef struct lbm_unflatten_stream_s {
+  lbm_value stack;   // Conses and arrays that are not complete yet.
+  lbm_value array;   // Byte array being filled.
+  lbm_value result;
+  lbm_uint  array_pos;
+  lbm_uint  atom_len;
+  lbm_uint  atom_need;
+  uint8_t   atom[LBM_UNFLATTEN_STREAM_ATOM_SIZE];
+  lbm_cid   owner;   // Context that started the unflatten, -1 if none.
+  struct lbm_unflatten_stream_s *next;
+} lbm_unflatten_stream_t;
+
+/** Start an incremental unflatten.
+ *  \param s Stream state.
+ */
+void lbm_unflatten_stream_init(lbm_unflatten_stream_t *s);
+/** Feed the next part of a flat value to an incremental unflatten.
+ *
+ *  \param s Stream state.
+ *  \param data Next part of the flat value.
+ *  \param len Number of bytes in data.
+ *  \param consumed Number of bytes of data used is stored here.
+ *  \return UNFLATTEN_MORE if the value is not complete yet and all data was
+ *          used. UNFLATTEN_OK when the value is complete, *res then holds
+ *          the value and bytes after the end of the value are not used.
+ *          UNFLATTEN_GC_RETRY if the heap is full, in that case run the GC
+ *          and feed the bytes that were not consumed again.
+ *          UNFLATTEN_MALFORMED if data is not a flat value.
+ */
+int lbm_unflatten_stream_feed(lbm_unflatten_stream_t *s, uint8_t *data, lbm_uint len, lbm_uint *consumed, lbm_value *res);
+/** End an incremental unflatten, complete or not. The partially
+ *  constructed value is left to the GC.
+ *  \param s Stream state.
+ */
+void lbm_unflatten_stream_end(lbm_unflatten_stream_t *s);
+/** Stop marking the incremental unflattens started by a context. Called
+ *  by the evaluator when the context finishes, as the stream state is
+ *  usually owned by it.
+ *  \param cid Context that finished.
+ */
+void lbm_unflatten_stream_ctx_done(lbm_cid cid);
+/** Mark the values held by incremental unflattens. Called from the GC.
+ */
+void lbm_unflatten_stream_gc_mark(void);
 #endif
@@ -63,6 +63,17 @@ bool lbm_image_has_extensions(void);
  */
 bool lbm_image_save_global_env(void);
 
+/**
+ * Save the global environment to the image with the values copied
+ * into the constant heap of the image. Such bindings are restored by
+ * boot without unflattening, the values are used in place from the image.
+ * Values that cannot live on the constant heap (channels, custom values,
+ * cyclic structures) are stored flattened as by lbm_image_save_global_env.
+ * The constant heap index must be saved after this.
+ * \return true on success otherwise false.
+ */
+bool lbm_image_save_global_env_const(void);
+
 /**
  * Save the extension table to the image.
  * \return true on success otherwise false.
@@ -113,6 +113,18 @@ extern "C" {
 #define LBM_MEMORY_BITMAP_SIZE_32K LBM_MEMORY_BITMAP_SIZE(512)
 #define LBM_MEMORY_BITMAP_SIZE_1M  LBM_MEMORY_BITMAP_SIZE(16384)
 
+/** Freed blocks of up to LBM_MEMORY_NUM_SIZE_CLASSES words are kept on
+ *  per size free lists, holding at most LBM_MEMORY_SIZE_CLASS_BLOCKS
+ *  blocks each, and are reused without searching the bitmap. Set
+ *  LBM_MEMORY_NUM_SIZE_CLASSES to 0 to disable.
+ */
+#ifndef LBM_MEMORY_NUM_SIZE_CLASSES
+#define LBM_MEMORY_NUM_SIZE_CLASSES 8
+#endif
+#ifndef LBM_MEMORY_SIZE_CLASS_BLOCKS
+#define LBM_MEMORY_SIZE_CLASS_BLOCKS 4
+#endif
+
 /** Initialize the symbols and arrays memory
  *
  * \param data Pointer to an array of uint32_t for data storage.
@@ -22,6 +22,13 @@
 #include "eval_cps.h"
 
 #define LBM_PROF_MAX_NAME_SIZE 20
+// GC pause histogram. Bucket 0 counts pauses shorter than 2us and
+// bucket n > 0 pauses of 2^n to 2^(n+1) - 1 us. The last bucket
+// also counts everything longer.
+#define LBM_PROF_GC_PAUSE_BUCKETS 16
+// Number of function frames kept per call-stack sample. Deeper stacks
+// keep the innermost frames.
+#define LBM_PROF_STACK_DEPTH 8
 
 typedef struct {
   lbm_cid cid;
@@ -31,6 +38,18 @@ typedef struct {
   lbm_uint gc_count;
 } lbm_prof_t;
 
+/** A call-stack sample aggregated by the profiler. The function frames
+ * are recorded by the evaluator when built with LBM_USE_PROF_STACK,
+ * otherwise only the leaf is available.
+ */
+typedef struct {
+  lbm_cid cid;
+  char name[LBM_PROF_MAX_NAME_SIZE];
+  lbm_uint depth;
+  lbm_uint stack[LBM_PROF_STACK_DEPTH]; // symbol ids, outermost first.
+  lbm_uint count;
+} lbm_prof_stack_t;
+
 bool lbm_prof_init(lbm_prof_t *prof_data_buf,
                    lbm_uint    prof_data_buf_num);
 lbm_uint lbm_prof_get_num_samples(void);
@@ -38,5 +57,37 @@ lbm_uint lbm_prof_get_num_system_samples(void);
 lbm_uint lbm_prof_get_num_sleep_samples(void);
 lbm_uint lbm_prof_stop(void);
 void lbm_prof_sample(void);
+/** Record the duration of a GC pause. Called by the evaluator.
+ * \param us Pause duration in microseconds.
+ */
+void lbm_prof_gc_pause(uint32_t us);
+/** Get the GC pause histogram.
+ * \param hist Array of LBM_PROF_GC_PAUSE_BUCKETS elements to copy the histogram to.
+ */
+void lbm_prof_get_gc_pause_hist(lbm_uint *hist);
+/** Get the longest recorded GC pause.
+ * \return Longest pause in microseconds.
+ */
+uint32_t lbm_prof_get_gc_pause_max(void);
+/** Set up storage for call-stack samples. Each sample records the
+ * function frames of the running context and, as leaf, the symbol
+ * being applied. Identical stacks are aggregated into one entry.
+ * \param stack_buf Array of entries, or NULL to stop recording stacks.
+ * \param stack_buf_num Number of entries in stack_buf.
+ */
+void lbm_prof_init_stacks(lbm_prof_stack_t *stack_buf,
+                          lbm_uint stack_buf_num);
+/** Get the number of stack samples that did not fit in the stack buffer.
+ * \return Number of dropped stack samples.
+ */
+lbm_uint lbm_prof_get_num_dropped_stacks(void);
+/** Format an aggregated stack in folded format, "thread;f;g count",
+ * as used by flamegraph tools.
+ * \param s Stack entry.
+ * \param buf Buffer to write the line to. The line has no newline.
+ * \param buf_size Size of buf.
+ * \return Length of the line, or -1 if it did not fit in buf.
+ */
+int lbm_prof_stack_folded(lbm_prof_stack_t *s, char *buf, lbm_uint buf_size);
 
 #endif
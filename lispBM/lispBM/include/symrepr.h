@@ -45,6 +45,28 @@ typedef void (*symrepr_name_iterator_fun)(const char *);
  */
 void lbm_symrepr_set_symlist(lbm_uint *ls);
 
+/** Give the symbol table storage for a name to symbol hash index. The
+ *  index holds one word per symbol and is kept at most 3/4 full. When it
+ *  is full, or when no storage is given, lookups of names that are not in
+ *  it scan all symbols. Can be called before or after lbm_init.
+ * \param storage Array of size words, or NULL to not use an index.
+ * \param size Number of words in storage. Must be a power of two.
+ * \return 1 on success, 0 if size is not a power of two.
+ */
+int lbm_symrepr_init_index(lbm_uint *storage, lbm_uint size);
+
+/** Mark the name to symbol index as stale. It is rebuilt from the special
+ *  symbols, the extension table and the symlist on the next lookup. Call
+ *  this after changing the extension table or symlist without going
+ *  through lbm_add_extension or lbm_add_symbol.
+ */
+void lbm_symrepr_invalidate_index(void);
+
+/** Add an extension table entry to the name to symbol index.
+ * \param ext_ix Index of the entry in the extension table.
+ */
+void lbm_symrepr_index_extension(lbm_uint ext_ix);
+
 /** Get the next to be assigned symbol id.
  * \return id;
  */
@@ -19,8 +19,10 @@ LISPBM_SRC = $(LISPBM)/src/env.c \
              $(LISPBM)/src/lbm_prof.c\
              $(LISPBM)/src/lbm_defrag_mem.c\
              $(LISPBM)/src/lbm_image.c\
+             $(LISPBM)/src/lbm_bytecode.c\
              $(LISPBM)/src/buffer.c \
              $(LISPBM)/src/extensions/array_extensions.c \
+             $(LISPBM)/src/extensions/vector_extensions.c \
              $(LISPBM)/src/extensions/string_extensions.c \
              $(LISPBM)/src/extensions/math_extensions.c \
              $(LISPBM)/src/extensions/runtime_extensions.c \
@@ -54,6 +56,7 @@ LISPBM_H = $(LISPBM)/include/env.h \
            $(LISPBM)/include/lbm_utils.h \
            $(LISPBM)/include/lbm_version.h \
            $(LISPBM)/include/lbm_image.h \
+           $(LISPBM)/include/lbm_bytecode.h \
            $(LISPBM)/include/lispbm.h \
            $(LISPBM)/include/print.h \
            $(LISPBM)/include/stack.h \
@@ -68,7 +71,8 @@ LISPBM_H = $(LISPBM)/include/env.h \
            $(LISPBM)/include/extensions/runtime_extensions.h \
            $(LISPBM)/include/extensions/set_extensions.h \
            $(LISPBM)/include/extensions/string_extensions.h \
-           $(LISPBM)/include/extensions/ttf_extensions.h
+           $(LISPBM)/include/extensions/ttf_extensions.h \
+           $(LISPBM)/include/extensions/vector_extensions.h
 
 
 LISPBM_INC = -I$(LISPBM)/include \
@@ -118,12 +118,16 @@ static size_t constants_memory_size = 4096;  // size words
 #define GC_STACK_SIZE 256
 #define PRINT_STACK_SIZE 256
 #define EXTENSION_STORAGE_SIZE 1024
+#define SYMBOL_INDEX_SIZE 1024
 #define WAIT_TIMEOUT 2500
 #define STR_SIZE 1024
 #define PROF_DATA_NUM 100
+#define PROF_STACK_NUM 512
 
 lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
+lbm_uint symbol_index[SYMBOL_INDEX_SIZE];
 lbm_prof_t prof_data[100];
+lbm_prof_stack_t prof_stacks[PROF_STACK_NUM];
 
 static char *env_input_file = NULL;
 static char *env_output_file = NULL;
@@ -270,36 +274,52 @@ void critical(void) {
   terminate_repl(REPL_EXIT_CRITICAL_ERROR);
 }
 
+static bool file_sink(uint8_t *data, lbm_uint len, void *arg) {
+  return fwrite(data, 1, len, (FILE*)arg) == len;
+}
+
+// Write a flat value preceded by its size as an int32. The value is
+// flattened straight into the file through a small buffer and the size
+// is filled in afterwards, so no buffer for the whole value is needed.
+static int fwrite_flat_value(FILE *fp, lbm_value v) {
+  long size_pos = ftell(fp);
+  int32_t fv_size = 0;
+  if (size_pos < 0 ||
+      fwrite(&fv_size, 1, sizeof(int32_t), fp) != sizeof(int32_t)) {
+    return FLATTEN_VALUE_ERROR_SINK;
+  }
+
+  uint8_t buf[256];
+  lbm_flat_stream_t fs;
+  lbm_flat_stream_init(&fs, buf, sizeof(buf), file_sink, fp);
+  int r = lbm_flatten_value_stream(&fs, v);
+  if (r != FLATTEN_VALUE_OK) return r;
+
+  fv_size = (int32_t)fs.total;
+  if (fseek(fp, size_pos, SEEK_SET) != 0 ||
+      fwrite(&fv_size, 1, sizeof(int32_t), fp) != sizeof(int32_t) ||
+      fseek(fp, 0, SEEK_END) != 0) {
+    return FLATTEN_VALUE_ERROR_SINK;
+  }
+  return FLATTEN_VALUE_OK;
+}
+
 void done_callback(eval_context_t *ctx) {
 
   // fails silently if unable to generate result file.
   // TODO: report failure in some way.
   if (res_output_file && store_result_cid == ctx->id) {
     store_result_cid = -1;
-    int32_t fv_size = flatten_value_size(ctx->r, 0);
-    if (fv_size > 0) {
-      lbm_flat_value_t fv;
-      fv.buf = malloc((uint32_t)fv_size);
-      if (fv.buf) {
-        fv.buf_size = (uint32_t)fv_size;
-        fv.buf_pos = 0;
-        if (flatten_value_c(&fv, ctx->r) == FLATTEN_VALUE_OK) {
-          FILE *fp = fopen((const char *)res_output_file, "w");
-          if (fp) {
-            fwrite(&fv_size, 1, sizeof(int32_t), fp);
-            fwrite(fv.buf, 1, (size_t)fv_size, fp);
-            fclose(fp);
-          } else {
-            printf("ALERT: Cannot open result file\n");
-          }
-        } else {
-          printf("ALERT: Unable to flatten result value\n");
-        }
-      } else {
-        printf("ALERT: Out of memory to allocate result buffer\n");
+    FILE *fp = fopen((const char *)res_output_file, "w");
+    if (fp) {
+      int r = fwrite_flat_value(fp, ctx->r);
+      fclose(fp);
+      if (r != FLATTEN_VALUE_OK) {
+        remove((const char *)res_output_file);
+        printf("ALERT: Unable to flatten result value\n");
       }
     } else {
-      printf("ALERT: Unable to flatten result value\n");
+      printf("ALERT: Cannot open result file\n");
     }
   }
   char output[1024];
@@ -791,15 +811,8 @@ bool load_flat_library(unsigned char *lib, unsigned int size) {
 
     pos += val_size;
 
-    lbm_uint ix_key  = sym_id & GLOBAL_ENV_MASK;
-    lbm_value *global_env = lbm_get_global_env();
-    lbm_uint orig_env = global_env[ix_key];
-    lbm_value new_env;
-
     // All of this should just succeed with no GC needed.
-    new_env = lbm_env_set(orig_env,sym,val);
-
-    global_env[ix_key] = new_env;
+    lbm_global_env_set(sym, val);
   }
   return true;
 }
@@ -829,6 +842,8 @@ int init_repl(void) {
 
   if (memory == NULL || bitmap == NULL) return 0;
 
+  lbm_symrepr_init_index(symbol_index, SYMBOL_INDEX_SIZE);
+
   if (!lbm_init(heap_storage, heap_size,
                 memory, lbm_memory_size,
                 bitmap, lbm_memory_bitmap_size,
@@ -1111,56 +1126,31 @@ int store_env(char *filename) {
       terminate_repl(REPL_EXIT_UNABLE_TO_OPEN_ENV_FILE);
     }
     lbm_value* env = lbm_get_global_env();
-    for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+    for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
       lbm_value curr = env[i];
       while(lbm_is_cons(curr)) {
         lbm_value name_field = lbm_caar(curr);
         lbm_value val_field  = lbm_cdr(lbm_car(curr));
         char *name = (char*)lbm_get_name_by_symbol(lbm_dec_sym(name_field));
         if (!name) return REPL_EXIT_UNABLE_TO_ACCESS_SYMBOL_STRING;
-        int32_t fv_size = flatten_value_size(val_field, 0);
-        if (fv_size > 0) {
-          lbm_flat_value_t fv;
-          fv.buf = malloc((uint32_t)fv_size);
-          if (!fv.buf) {
-            return REPL_EXIT_ERROR_FLATTEN_NO_MEM;
+        long entry_pos = ftell(fp);
+        size_t name_len = strlen(name);
+        fwrite(&name_len, 1, sizeof(int32_t),fp);
+        fwrite(name, 1, name_len, fp);
+        int r = fwrite_flat_value(fp, val_field);
+        if (r == FLATTEN_VALUE_ERROR_SINK) {
+          return REPL_EXIT_CRITICAL_ERROR;
+        } else if (r != FLATTEN_VALUE_OK) {
+          // Bindings that cannot be flattened are left out. Drop what
+          // was written of the entry.
+          fflush(fp);
+          if (entry_pos < 0 ||
+              ftruncate(fileno(fp), entry_pos) != 0 ||
+              fseek(fp, entry_pos, SEEK_SET) != 0) {
+            return REPL_EXIT_CRITICAL_ERROR;
           }
-          fv.buf_size = (uint32_t)fv_size;
-          fv.buf_pos = 0;
-          int r = flatten_value_c(&fv, val_field);
-          if (r == FLATTEN_VALUE_OK) {
-            size_t name_len = strlen(name);
-            if (name_len > 0) {
-              fwrite(&name_len, 1, sizeof(int32_t),fp);
-              fwrite(name, 1, strlen(name), fp);
-              fwrite(&fv_size, 1, sizeof(int32_t),fp);
-              fwrite(fv.buf,1,(size_t)fv_size,fp);
-            } else {
-              return REPL_EXIT_INVALID_KEY_IN_ENVIRONMENT;
-            }
-          } else {
-            switch (r) {
-            case FLATTEN_VALUE_ERROR_CANNOT_BE_FLATTENED:
-              return REPL_EXIT_VALUE_CANNOT_BE_FLATTENED;
-              break;
-            case FLATTEN_VALUE_ERROR_BUFFER_TOO_SMALL:
-              return REPL_EXIT_FLAT_VALUE_BUFFER_TOO_SMALL;
-              break;
-            case FLATTEN_VALUE_ERROR_FATAL:
-              return REPL_EXIT_FATAL_ERROR_WHILE_FLATTENING;
-              break;
-            case FLATTEN_VALUE_ERROR_CIRCULAR:
-              return REPL_EXIT_CIRCULAR_VALUE;
-              break;
-            case FLATTEN_VALUE_ERROR_MAXIMUM_DEPTH:
-              return REPL_EXIT_FLATTENING_MAXIMUM_DEPTH;
-              break;
-            case FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY:
-              return REPL_EXIT_OUT_OF_MEMORY_WHILE_FLATTENING;
-              break;
-            }
-          }
-          free(fv.buf);
+        } else if (name_len == 0) {
+          return REPL_EXIT_INVALID_KEY_IN_ENVIRONMENT;
         }
         curr = lbm_cdr(curr);
       }
@@ -1366,6 +1356,8 @@ bool vescif_restart(bool print, bool load_code, bool load_imports) {
   heap_storage = (lbm_cons_t*)malloc(sizeof(lbm_cons_t) * heap_size);
   if (heap_storage == NULL) return 0;
 
+  lbm_symrepr_init_index(symbol_index, SYMBOL_INDEX_SIZE);
+
   if (!lbm_init(heap_storage, heap_size,
                 memory, lbm_memory_size,
                 bitmap, lbm_memory_bitmap_size,
@@ -1647,7 +1639,7 @@ void repl_process_cmd(unsigned char *data, unsigned int len,
     send_buffer_global[ind++] = '\0';
 
     lbm_value *glob_env = lbm_get_global_env();
-    for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+    for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
       if (ind > 300) {
         break;
       }
@@ -1708,6 +1700,9 @@ void repl_process_cmd(unsigned char *data, unsigned int len,
         commands_printf_lisp(
                              ":prof report\n"
                              "  Print profiler report");
+        commands_printf_lisp(
+                             ":prof folded\n"
+                             "  Print profiled call stacks in folded format for flamegraph tools");
         commands_printf_lisp(
                              ":env\n"
                              "  Print current environment and variables");
@@ -1772,6 +1767,7 @@ void repl_process_cmd(unsigned char *data, unsigned int len,
           pthread_join(prof_thread,&a);
         }
         lbm_prof_init(prof_data, PROF_DATA_NUM);
+        lbm_prof_init_stacks(prof_stacks, PROF_STACK_NUM);
         prof_running = true;
         if (pthread_create(&prof_thread, NULL, prof_thd, NULL)) {
           commands_printf_lisp("Error creating profiler thread\n");
@@ -1807,10 +1803,27 @@ void repl_process_cmd(unsigned char *data, unsigned int len,
         commands_printf_lisp("System:\t%u\t%f%%\n", num_system, (double)(100.0 * ((float)num_system / (float)tot_samples)));
         commands_printf_lisp("Sleep:\t%u\t%f%%\n", num_sleep, (double)(100.0 * ((float)num_sleep / (float)tot_samples)));
         commands_printf_lisp("Total:\t%u samples\n", tot_samples);
+        lbm_uint gc_hist[LBM_PROF_GC_PAUSE_BUCKETS];
+        lbm_prof_get_gc_pause_hist(gc_hist);
+        commands_printf_lisp("GC pauses (us)\tCount");
+        for (int i = 0; i < LBM_PROF_GC_PAUSE_BUCKETS; i ++) {
+          if (gc_hist[i] == 0) continue;
+          commands_printf_lisp("%u-%u\t%"PRI_UINT, i == 0 ? 0u : 1u << i, (2u << i) - 1, gc_hist[i]);
+        }
+        commands_printf_lisp("Max:\t%u us\n", (unsigned int)lbm_prof_get_gc_pause_max());
+      } else if (strncmp(str, ":prof folded", 12) == 0) {
+        char line[256];
+        for (int i = 0; i < PROF_STACK_NUM; i ++) {
+          if (prof_stacks[i].cid == -1) break;
+          if (lbm_prof_stack_folded(&prof_stacks[i], line, sizeof(line)) > 0) {
+            commands_printf_lisp("%s", line);
+          }
+        }
+        commands_printf_lisp("Dropped:\t%u stacks\n", (unsigned int)lbm_prof_get_num_dropped_stacks());
       } else if (strncmp(str, ":env", 4) == 0) {
         lbm_value *glob_env = lbm_get_global_env();
         char output[128];
-        for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+        for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
           lbm_value curr = glob_env[i];
           while (lbm_type_of(curr) == LBM_TYPE_CONS) {
             lbm_print_value(output, sizeof(output), lbm_car(curr));
@@ -2347,6 +2360,8 @@ int main(int argc, char **argv) {
       } else if (strncmp(str, ":prof start", 11) == 0) {
         lbm_prof_init(prof_data,
                       PROF_DATA_NUM);
+        lbm_prof_init_stacks(prof_stacks,
+                             PROF_STACK_NUM);
         pthread_t thd; // just forget this id.
         prof_running = true;
         if (pthread_create(&thd, NULL, prof_thd, NULL)) {
@@ -2381,12 +2396,42 @@ int main(int argc, char **argv) {
         printf("System:\t%"PRI_UINT"\t%f%%\n", num_system, 100.0 * ((float)num_system / (float)tot_samples));
         printf("Sleep:\t%"PRI_UINT"\t%f%%\n", num_sleep, 100.0 * ((float)num_sleep / (float)tot_samples));
         printf("Total:\t%"PRI_UINT" samples\n", tot_samples);
+        lbm_uint gc_hist[LBM_PROF_GC_PAUSE_BUCKETS];
+        lbm_prof_get_gc_pause_hist(gc_hist);
+        printf("GC pauses (us)\tCount\n");
+        for (int i = 0; i < LBM_PROF_GC_PAUSE_BUCKETS; i ++) {
+          if (gc_hist[i] == 0) continue;
+          printf("%u-%u\t%"PRI_UINT"\n", i == 0 ? 0u : 1u << i, (2u << i) - 1, gc_hist[i]);
+        }
+        printf("Max:\t%u us\n", (unsigned int)lbm_prof_get_gc_pause_max());
+        free(str);
+      } else if (strncmp(str, ":prof folded", 12) == 0) {
+        FILE *fp = stdout;
+        char *file_name = str + 12;
+        while (*file_name == ' ') file_name ++;
+        if (*file_name) {
+          fp = fopen(file_name, "w");
+          if (!fp) {
+            printf("Error opening file: %s\n", file_name);
+            free(str);
+            continue;
+          }
+        }
+        char line[256];
+        for (int i = 0; i < PROF_STACK_NUM; i ++) {
+          if (prof_stacks[i].cid == -1) break;
+          if (lbm_prof_stack_folded(&prof_stacks[i], line, sizeof(line)) > 0) {
+            fprintf(fp, "%s\n", line);
+          }
+        }
+        if (fp != stdout) fclose(fp);
+        printf("Dropped:\t%"PRI_UINT" stacks\n", lbm_prof_get_num_dropped_stacks());
         free(str);
       } else if (strncmp(str, ":env", 4) == 0) {
-        for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+        for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
           lbm_value *env = lbm_get_global_env();
           lbm_value curr = env[i];
-          printf("Environment [%d]:\r\n", i);
+          printf("Environment [%"PRI_UINT"]:\r\n", i);
           while (lbm_type_of(curr) == LBM_TYPE_CONS) {
             lbm_print_value(output,1024, lbm_car(curr));
             curr = lbm_cdr(curr);
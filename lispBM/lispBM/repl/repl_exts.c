@@ -24,6 +24,7 @@
 #include <sys/time.h>
 #include <sys/wait.h>
 #include "extensions/array_extensions.h"
+#include "extensions/vector_extensions.h"
 #include "extensions/string_extensions.h"
 #include "extensions/math_extensions.h"
 #include "extensions/runtime_extensions.h"
@@ -321,6 +322,10 @@ static lbm_value ext_fwrite_str(lbm_value *args, lbm_uint argn) {
   return res;
 }
 
+static bool file_sink(uint8_t *data, lbm_uint len, void *arg) {
+  return fwrite(data, 1, len, (FILE*)arg) == len;
+}
+
 static lbm_value ext_fwrite_value(lbm_value *args, lbm_uint argn) {
   lbm_value res = ENC_SYM_TERROR;
   if (argn == 2 &&
@@ -329,26 +334,16 @@ static lbm_value ext_fwrite_value(lbm_value *args, lbm_uint argn) {
     lbm_file_handle_t *h = (lbm_file_handle_t*)lbm_get_custom_value(args[0]);
 
     lbm_set_max_flatten_depth(10000);
-    int32_t fv_size = flatten_value_size(args[1], 0);
-    if (fv_size > 0) {
-      lbm_flat_value_t fv;
-      fv.buf = malloc((uint32_t)fv_size);
-      if (fv.buf) {
-        fv.buf_size = (uint32_t)fv_size;
-        fv.buf_pos = 0;
-        if (flatten_value_c(&fv, args[1]) == FLATTEN_VALUE_OK) {
-          fwrite(fv.buf, 1, (size_t)fv_size, h->fp);
-          fflush(h->fp);
-          res = ENC_SYM_TRUE;
-        } else {
-          printf("ALERT: Unable to flatten result value\n");
-        }
-      } else {
-        printf("ALERT: Out of memory to allocate result buffer\n");
-      }
+    // Flattened straight into the file, through a small buffer.
+    uint8_t buf[256];
+    lbm_flat_stream_t fs;
+    lbm_flat_stream_init(&fs, buf, sizeof(buf), file_sink, h->fp);
+    if (lbm_flatten_value_stream(&fs, args[1]) == FLATTEN_VALUE_OK) {
+      res = ENC_SYM_TRUE;
     } else {
-      printf("ALERT: Incorrect FV size: %d \n", fv_size);
+      printf("ALERT: Unable to flatten value\n");
     }
+    fflush(h->fp);
   }
   return res;
 }
@@ -687,6 +682,7 @@ static void image_renderer_clear(uint32_t color) {
     img.width = image_buffer_width((uint8_t*)arr->data);
     img.height = image_buffer_height((uint8_t*)arr->data);
     img.data = image_buffer_data((uint8_t*)arr->data);
+    img.dirty = NULL;
     image_buffer_clear(&img, color);
   }
 }
@@ -708,11 +704,9 @@ static lbm_value ext_display_to_image(lbm_value *args, lbm_uint argn) {
 }
 // boot images, snapshots, workspaces....
 
-lbm_value ext_image_save(lbm_value *args, lbm_uint argn) {
-  (void) args;
-  (void) argn;
+static lbm_value image_save(bool const_env) {
 
-  bool r = lbm_image_save_global_env();
+  bool r = const_env ? lbm_image_save_global_env_const() : lbm_image_save_global_env();
 
   lbm_uint main_sym = ENC_SYM_NIL;
   if (lbm_get_symbol_by_name("main", &main_sym)) {
@@ -731,6 +725,20 @@ lbm_value ext_image_save(lbm_value *args, lbm_uint argn) {
   return r ? ENC_SYM_TRUE : ENC_SYM_NIL;
 }
 
+lbm_value ext_image_save(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  return image_save(false);
+}
+
+// Bindings are copied to the constant heap of the image and
+// are used in place after boot.
+lbm_value ext_image_save_const(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  return image_save(true);
+}
+
 lbm_value ext_image_save_const_heap_ix(lbm_value *args, lbm_uint argn) {
   (void) args;
   (void) argn;
@@ -761,6 +769,7 @@ lbm_value ext_rt(lbm_value *args, lbm_uint argn) {
 int init_exts(void) {
 
   lbm_array_extensions_init();
+  lbm_vector_extensions_init();
   lbm_string_extensions_init();
   lbm_math_extensions_init();
   lbm_runtime_extensions_init();
@@ -788,6 +797,7 @@ int init_exts(void) {
   // boot images, snapshots, workspaces.... 
   lbm_add_extension("image-save-const-heap-ix", ext_image_save_const_heap_ix);
   lbm_add_extension("image-save", ext_image_save);
+  lbm_add_extension("image-save-const", ext_image_save_const);
   // Math
   lbm_add_extension("rand", ext_rand);
   lbm_add_extension("rand-max", ext_rand_max);
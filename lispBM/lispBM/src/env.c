@@ -24,18 +24,44 @@
 #include "env.h"
 #include "lbm_memory.h"
 
-static lbm_value env_global[GLOBAL_ENV_ROOTS];
+// Grow when an association list gets longer than this.
+#define GLOBAL_ENV_MAX_CHAIN 4
+
+static lbm_value env_global_min[GLOBAL_ENV_ROOTS_MIN];
+static lbm_value *env_global = env_global_min;
+static lbm_uint env_global_roots = GLOBAL_ENV_ROOTS_MIN;
+
+// Direct mapped cache from symbol to its (key . val) binding cell in
+// the global environment. A binding cell stays the same for as long
+// as the binding exists, only its cdr is updated on redefinition.
+// Bindings are only removed by code that gets hold of the environment
+// via lbm_get_global_env, and GC goes through there as well, so the
+// cache is cleared there.
+#define ENV_CACHE_EMPTY ((lbm_value)LBM_TYPE_U) // Encoded u 0, never a symbol.
+static lbm_value env_cache_key[GLOBAL_ENV_CACHE_SIZE];
+static lbm_value env_cache_binding[GLOBAL_ENV_CACHE_SIZE];
+
+static void global_env_cache_clear(void) {
+  for (lbm_uint i = 0; i < GLOBAL_ENV_CACHE_SIZE; i ++) {
+    env_cache_key[i] = ENV_CACHE_EMPTY;
+  }
+}
 
 int lbm_init_env(void) {
-  for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+  // lbm_memory is reinitialized together with the environment so
+  // a grown table does not need to be freed.
+  env_global = env_global_min;
+  env_global_roots = GLOBAL_ENV_ROOTS_MIN;
+  for (lbm_uint i = 0; i < env_global_roots; i ++) {
     env_global[i] = ENC_SYM_NIL;
   }
+  global_env_cache_clear();
   return 1;
 }
 
 lbm_uint lbm_get_global_env_size(void) {
   lbm_uint n = 0;
-  for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+  for (lbm_uint i = 0; i < env_global_roots; i ++) {
     lbm_value curr = env_global[i];
     while (lbm_is_cons(curr)) {
       n++;
@@ -46,9 +72,58 @@ lbm_uint lbm_get_global_env_size(void) {
 }
 
 lbm_value *lbm_get_global_env(void) {
+  global_env_cache_clear();
   return env_global;
 }
 
+lbm_uint lbm_get_global_env_roots(void) {
+  return env_global_roots;
+}
+
+lbm_uint lbm_global_env_ix(lbm_uint sym_id) {
+  return sym_id & (env_global_roots - 1);
+}
+
+// Double the number of roots. The spine cells are relinked into the
+// new lists, so no heap cells are needed. Does nothing if the spine
+// is (partly) in constant memory or if lbm_memory is full.
+static void global_env_grow(void) {
+  lbm_uint new_roots = env_global_roots * 2;
+  if (new_roots > GLOBAL_ENV_ROOTS_MAX) return;
+
+  for (lbm_uint i = 0; i < env_global_roots; i ++) {
+    lbm_value curr = env_global[i];
+    while (lbm_is_ptr(curr)) {
+      if (!lbm_is_cons_rw(curr)) return;
+      curr = lbm_ref_cell(curr)->cdr;
+    }
+  }
+
+  lbm_value *new_env = (lbm_value*)lbm_malloc(new_roots * sizeof(lbm_value));
+  if (!new_env) return;
+  for (lbm_uint i = 0; i < new_roots; i ++) {
+    new_env[i] = ENC_SYM_NIL;
+  }
+
+  for (lbm_uint i = 0; i < env_global_roots; i ++) {
+    lbm_value curr = env_global[i];
+    while (lbm_is_ptr(curr)) {
+      lbm_cons_t *cell = lbm_ref_cell(curr);
+      lbm_value next = cell->cdr;
+      lbm_uint ix = lbm_dec_sym(lbm_ref_cell(cell->car)->car) & (new_roots - 1);
+      cell->cdr = new_env[ix];
+      new_env[ix] = curr;
+      curr = next;
+    }
+  }
+
+  if (env_global != env_global_min) {
+    lbm_free(env_global);
+  }
+  env_global = new_env;
+  env_global_roots = new_roots;
+}
+
 // Copy the list structure of an environment.
 lbm_value lbm_env_copy_spine(lbm_value env) {
 
@@ -87,12 +162,19 @@ bool lbm_env_lookup_b(lbm_value *res, lbm_value sym, lbm_value env) {
 
 bool lbm_global_env_lookup(lbm_value *res, lbm_value sym) {
   lbm_uint dec_sym = lbm_dec_sym(sym);
-  lbm_uint ix = dec_sym & GLOBAL_ENV_MASK;
+  lbm_uint cache_ix = dec_sym & (GLOBAL_ENV_CACHE_SIZE - 1);
+  if (env_cache_key[cache_ix] == sym) {
+    *res = lbm_ref_cell(env_cache_binding[cache_ix])->cdr;
+    return true;
+  }
+  lbm_uint ix = dec_sym & (env_global_roots - 1);
   lbm_value curr = env_global[ix];
 
   while (lbm_is_ptr(curr)) {
     lbm_value c = lbm_ref_cell(curr)->car;
     if ((lbm_ref_cell(c)->car) == sym) {
+      env_cache_key[cache_ix] = sym;
+      env_cache_binding[cache_ix] = c;
       *res = lbm_ref_cell(c)->cdr;
       return true;
     }
@@ -101,6 +183,38 @@ bool lbm_global_env_lookup(lbm_value *res, lbm_value sym) {
   return false;
 }
 
+lbm_value lbm_global_env_set(lbm_value key, lbm_value val) {
+  lbm_uint ix = lbm_dec_sym(key) & (env_global_roots - 1);
+  lbm_value curr = env_global[ix];
+  lbm_uint n = 0;
+
+  while (lbm_is_cons(curr)) {
+    lbm_value car_val = lbm_car(curr);
+    if (lbm_car(car_val) == key) {
+      lbm_set_cdr(car_val, val);
+      return ENC_SYM_TRUE;
+    }
+    n ++;
+    curr = lbm_cdr(curr);
+  }
+
+  lbm_value keyval = lbm_cons(key, val);
+  if (lbm_is_symbol(keyval)) return keyval;
+  lbm_value new_env = lbm_cons(keyval, env_global[ix]);
+  if (lbm_is_symbol(new_env)) return new_env;
+  env_global[ix] = new_env;
+
+  if (n >= GLOBAL_ENV_MAX_CHAIN) {
+    global_env_grow();
+  }
+  return ENC_SYM_TRUE;
+}
+
+lbm_value lbm_global_env_modify_binding(lbm_value key, lbm_value val) {
+  lbm_uint ix = lbm_dec_sym(key) & (env_global_roots - 1);
+  return lbm_env_modify_binding(env_global[ix], key, val);
+}
+
 // TODO: env set should ideally copy environment if it has to update
 // in place. This has never come up as an issue, the rest of the code
 // must be very well behaved.
@@ -31,6 +31,8 @@
 #include "platform_mutex.h"
 #include "lbm_flat_value.h"
 #include "lbm_flags.h"
+#include "lbm_prof.h"
+#include "lbm_bytecode.h"
 
 #ifdef VISUALIZE_HEAP
 #include "heap_vis.h"
@@ -106,7 +108,9 @@ static jmp_buf critical_error_jmp_buf;
 #define RECV_TO_RETRY              CONTINUATION(48)
 #define READ_START_ARRAY           CONTINUATION(49)
 #define READ_APPEND_ARRAY          CONTINUATION(50)
-#define NUM_CONTINUATIONS          51
+#define PROF_RETURN                CONTINUATION(51)
+#define BYTECODE_RESUME            CONTINUATION(52)
+#define NUM_CONTINUATIONS          53
 
 #define FM_NEED_GC       -1
 #define FM_NO_MATCH      -2
@@ -236,6 +240,19 @@ void lbm_request_gc(void) {
   gc_requested = true;
 }
 
+#ifdef LBM_USE_GC_INCREMENTAL
+#define GC_INC_DEFAULT_SWEEP_BUDGET 128
+
+static lbm_uint gc_inc_sweep_budget = GC_INC_DEFAULT_SWEEP_BUDGET;
+static lbm_uint gc_inc_threshold = 0; // 0 means a quarter of the heap.
+static lbm_uint gc_inc_last_free = (lbm_uint)-1; // Free cells after the last cycle.
+
+void lbm_set_gc_incremental(lbm_uint free_threshold, lbm_uint sweep_budget) {
+  gc_inc_threshold = free_threshold;
+  gc_inc_sweep_budget = sweep_budget > 0 ? sweep_budget : GC_INC_DEFAULT_SWEEP_BUDGET;
+}
+#endif
+
 /*
    On ChibiOs the CH_CFG_ST_FREQUENCY setting in chconf.h sets the
    resolution of the timer used for sleep operations.  If this is set
@@ -486,6 +503,32 @@ eval_context_t *lbm_get_current_context(void) {
   return ctx_running;
 }
 
+lbm_uint lbm_get_prof_stack(eval_context_t *ctx, lbm_uint *syms, lbm_uint max) {
+  lbm_uint n = 0;
+  lbm_uint *data = ctx->K.data;
+  lbm_uint sp = ctx->K.sp;
+  if (sp > ctx->K.size) return 0;
+  // Innermost frames first.
+  lbm_uint i = sp;
+  while (i >= 2 && n < max) {
+    if (data[i-1] == PROF_RETURN &&
+        lbm_is_symbol(data[i-2]) &&
+        lbm_dec_sym(data[i-2]) >= RUNTIME_SYMBOLS_START) {
+      syms[n++] = lbm_dec_sym(data[i-2]);
+      i -= 2;
+    } else {
+      i --;
+    }
+  }
+  // Reverse to outermost first.
+  for (lbm_uint k = 0; k < n / 2; k ++) {
+    lbm_uint t = syms[k];
+    syms[k] = syms[n - 1 - k];
+    syms[n - 1 - k] = t;
+  }
+  return n;
+}
+
 #ifdef LBM_USE_TIME_QUOTA
 void lbm_surrender_quota(void) {
   // dummy;
@@ -782,7 +825,7 @@ void print_environments(char *buf, unsigned int size) {
   printf_callback("\tCurrent global environment:\n");
   lbm_value *glob_env = lbm_get_global_env();
 
-  for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+  for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
     lbm_value curr_g = glob_env[i];;
     while (lbm_type_of(curr_g) == LBM_TYPE_CONS) {
 
@@ -1058,6 +1101,7 @@ static void finish_ctx(void) {
   lbm_memory_free((lbm_uint*)ctx_running->error_reason); //free error_reason if in LBM_MEM
 
   lbm_memory_free((lbm_uint*)ctx_running->mailbox);
+  lbm_unflatten_stream_ctx_done(ctx_running->id);
   lbm_memory_free((lbm_uint*)ctx_running);
   ctx_running = NULL;
 }
@@ -1682,18 +1726,9 @@ static void mark_context(eval_context_t *ctx, void *arg1, void *arg2) {
   lbm_gc_mark_aux(ctx->K.data, ctx->K.sp);
 }
 
-static int gc(void) {
-  if (ctx_running) {
-    ctx_running->state = ctx_running->state | LBM_THREAD_STATE_GC_BIT;
-  }
-
-  gc_requested = false;
-  lbm_gc_state_inc();
-
-  // The freelist should generally be NIL when GC runs.
-  lbm_nil_freelist();
+static void gc_mark_all(void) {
   lbm_value *env = lbm_get_global_env();
-  for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+  for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
     lbm_gc_mark_env(env[i]);
   }
 
@@ -1707,6 +1742,32 @@ static int gc(void) {
     mark_context(ctx_running, NULL, NULL);
   }
   mutex_unlock(&qmutex);
+#ifdef LBM_USE_BYTECODE
+  lbm_bytecode_gc_mark();
+#endif
+  lbm_unflatten_stream_gc_mark();
+#ifdef LBM_USE_BYTECODE
+  lbm_bytecode_gc_clear();
+#endif
+}
+
+static int gc(void) {
+  uint32_t t_start = timestamp_us_callback();
+  if (ctx_running) {
+    ctx_running->state = ctx_running->state | LBM_THREAD_STATE_GC_BIT;
+  }
+
+  gc_requested = false;
+#ifdef LBM_USE_GC_INCREMENTAL
+  // Complete an unfinished incremental cycle so that no mark bits
+  // are left over when marking from scratch.
+  lbm_gc_sweep_finish();
+#endif
+  lbm_gc_state_inc();
+
+  // The freelist should generally be NIL when GC runs.
+  lbm_nil_freelist();
+  gc_mark_all();
 
 #ifdef ZE_HEAP
   heap_vis_gen_image();
@@ -1715,13 +1776,54 @@ static int gc(void) {
   int r = lbm_gc_sweep_phase();
   lbm_heap_new_freelist_length();
   lbm_memory_update_min_free();
+#ifdef LBM_USE_GC_INCREMENTAL
+  gc_inc_last_free = lbm_heap_num_free();
+#endif
 
   if (ctx_running) {
     ctx_running->state = ctx_running->state & ~LBM_THREAD_STATE_GC_BIT;
   }
+  lbm_prof_gc_pause(timestamp_us_callback() - t_start);
   return r;
 }
 
+#ifdef LBM_USE_GC_INCREMENTAL
+// Called from the scheduler. Starts a cycle when the heap is running
+// low and otherwise sweeps a bounded number of cells. Only the sweep
+// steps are bounded: starting a cycle marks all live data in one pause,
+// just like gc(). If the freelist runs out before the sweep is done,
+// gc() completes it.
+static void gc_incremental_step(void) {
+  uint32_t t_start = timestamp_us_callback();
+
+  if (lbm_gc_sweep_pending()) {
+    if (lbm_gc_sweep_step(gc_inc_sweep_budget)) {
+      lbm_heap_new_freelist_length();
+      lbm_memory_update_min_free();
+      gc_inc_last_free = lbm_heap_num_free();
+    }
+  } else {
+    lbm_uint threshold = gc_inc_threshold ? gc_inc_threshold : lbm_heap_size() / 4;
+    lbm_uint num_free = lbm_heap_num_free();
+    // Do not start over and over if the last cycle did not
+    // recover anything and nothing has been allocated since.
+    if (num_free >= threshold || num_free >= gc_inc_last_free) {
+      return;
+    }
+    if (ctx_running) {
+      ctx_running->state = ctx_running->state | LBM_THREAD_STATE_GC_BIT;
+    }
+    lbm_gc_state_inc();
+    gc_mark_all();
+    lbm_gc_sweep_begin();
+    if (ctx_running) {
+      ctx_running->state = ctx_running->state & ~LBM_THREAD_STATE_GC_BIT;
+    }
+  }
+  lbm_prof_gc_pause(timestamp_us_callback() - t_start);
+}
+#endif
+
 int lbm_perform_gc(void) {
   return gc();
 }
@@ -2324,15 +2426,10 @@ static void cont_set_global_env(eval_context_t *ctx){
   lbm_value val = ctx->r;
 
   lbm_pop(&ctx->K, &key);
-  lbm_uint dec_key = lbm_dec_sym(key);
-  lbm_uint ix_key  = dec_key & GLOBAL_ENV_MASK;
-  lbm_value *global_env = lbm_get_global_env();
-  lbm_uint orig_env = global_env[ix_key];
-  lbm_value new_env;
+  lbm_value r;
   // A key is a symbol and should not need to be remembered.
-  WITH_GC(new_env, lbm_env_set(orig_env,key,val));
-
-  global_env[ix_key] = new_env;
+  WITH_GC(r, lbm_global_env_set(key, val));
+  (void)r;
   ctx->r = val;
 
   ctx->app_cont = true;
@@ -2561,10 +2658,7 @@ static lbm_value perform_setvar(lbm_value key, lbm_value val, lbm_value env) {
   if (s >= RUNTIME_SYMBOLS_START) {
     lbm_value new_env = lbm_env_modify_binding(env, key, val);
     if (lbm_is_symbol(new_env) && new_env == ENC_SYM_NOT_FOUND) {
-      lbm_uint ix_key = lbm_dec_sym(key) & GLOBAL_ENV_MASK;
-      lbm_value *glob_env = lbm_get_global_env();
-      new_env = lbm_env_modify_binding(glob_env[ix_key], key, val);
-      glob_env[ix_key] = new_env;
+      new_env = lbm_global_env_modify_binding(key, val);
     }
     if (lbm_is_symbol(new_env) && new_env == ENC_SYM_NOT_FOUND) {
       lbm_set_error_reason((char*)lbm_error_str_variable_not_bound);
@@ -3001,18 +3095,39 @@ static void apply_flatten(lbm_value *args, lbm_uint nargs, eval_context_t *ctx)
   ERROR_AT_CTX(ENC_SYM_TERROR, ENC_SYM_FLATTEN);
 }
 
+// Unflatten a whole buffer through an incremental unflatten. When the
+// heap runs full, GC runs and the unflatten continues where it stopped
+// instead of starting over. Gives up if no more of the buffer can be
+// used after a GC.
+static lbm_unflatten_stream_t unflatten_buffer_stream;
+
+static bool unflatten_buffer(uint8_t *data, lbm_uint len, lbm_value *res) {
+  lbm_unflatten_stream_t *s = &unflatten_buffer_stream;
+  lbm_unflatten_stream_init(s);
+  bool after_gc = false;
+  int r;
+  while (true) {
+    lbm_uint consumed = 0;
+    r = lbm_unflatten_stream_feed(s, data, len, &consumed, res);
+    data += consumed;
+    len -= consumed;
+    if (r != UNFLATTEN_GC_RETRY || (after_gc && consumed == 0)) break;
+    gc();
+    after_gc = true;
+  }
+  lbm_unflatten_stream_end(s);
+  if (r == UNFLATTEN_OK) return true;
+  *res = (r == UNFLATTEN_GC_RETRY) ? ENC_SYM_MERROR : ENC_SYM_EERROR;
+  return false;
+}
+
 static void apply_unflatten(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   lbm_array_header_t *array;
   if(nargs == 1 && (array = lbm_dec_array_r(args[0]))) {
-    lbm_flat_value_t fv;
-    fv.buf = (uint8_t*)array->data;
-    fv.buf_size = array->size;
-    fv.buf_pos = 0;
-
     lbm_value res;
 
     ctx->r = ENC_SYM_NIL;
-    if (lbm_unflatten_value(&fv, &res)) {
+    if (unflatten_buffer((uint8_t*)array->data, array->size, &res)) {
       ctx->r =  res;
     }
     lbm_stack_drop(&ctx->K, 2);
@@ -3379,6 +3494,40 @@ static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_c
   }
 }
 
+#ifdef LBM_USE_BYTECODE
+// Try to apply a closure body in bytecode. curr_exp and curr_env must
+// already be set up for evaluating the body in CPS, which is what
+// happens if the bytecode cannot do it.
+static void bytecode_apply(eval_context_t *ctx, lbm_value body, lbm_value env) {
+  lbm_value r = ENC_SYM_NIL;
+  lbm_bytecode_status_t s = lbm_bytecode_apply(ctx, body, env, &r);
+  while (s == LBM_BYTECODE_NO_MEM) {
+    gc();
+    s = lbm_bytecode_continue(ctx, body, &r);
+  }
+  switch (s) {
+  case LBM_BYTECODE_DONE:
+    ctx->r = r;
+    ctx->app_cont = true;
+    break;
+  case LBM_BYTECODE_ERROR:
+    ERROR_CTX(r);
+    break;
+  case LBM_BYTECODE_SUSPENDED: {
+    lbm_value *reserved = stack_reserve(ctx, 4);
+    reserved[0] = body;
+    reserved[1] = env;
+    reserved[2] = r;
+    reserved[3] = BYTECODE_RESUME;
+    ctx->app_cont = true;
+    lbm_surrender_quota();
+  } break;
+  default:
+    break;
+  }
+}
+#endif
+
 static void cont_closure_application_args(eval_context_t *ctx) {
   lbm_uint* sptr = get_stack_ptr(ctx, 5);
 
@@ -3410,6 +3559,9 @@ static void cont_closure_application_args(eval_context_t *ctx) {
     lbm_stack_drop(&ctx->K, 5);
     ctx->curr_env = binder;
     ctx->curr_exp = exp;
+#ifdef LBM_USE_BYTECODE
+    bytecode_apply(ctx, exp, binder);
+#endif
   } else if (p_nil) {
     lbm_value rest_binder = allocate_binding(ENC_SYM_REST_ARGS, ENC_SYM_NIL, binder);
     sptr[2] = rest_binder;
@@ -4750,6 +4902,9 @@ static void cont_application_start(eval_context_t *ctx) {
     case ENC_SYM_CLOSURE: {
       lbm_value cl[3];
       extract_n(get_cdr(ctx->r), cl, 3);
+#ifdef LBM_USE_BYTECODE
+      lbm_bytecode_prepare(cl[CLO_PARAMS], cl[CLO_BODY]);
+#endif
       lbm_value arg_env = (lbm_value)sptr[0];
       lbm_value arg0, arg_rest;
       get_car_and_cdr(args, &arg0, &arg_rest);
@@ -4770,6 +4925,9 @@ static void cont_application_start(eval_context_t *ctx) {
         lbm_stack_drop(&ctx->K, 6);
         ctx->curr_exp = cl[CLO_BODY];
         ctx->curr_env = cl[CLO_ENV];
+#ifdef LBM_USE_BYTECODE
+        bytecode_apply(ctx, cl[CLO_BODY], cl[CLO_ENV]);
+#endif
       } else if (p_nil) {
         reserved[1] = get_cdr(args);      // protect cdr(args) from allocate_binding
         ctx->curr_exp = get_car(args);    // protect car(args) from allocate binding
@@ -5359,6 +5517,55 @@ static void cont_recv_to_retry(eval_context_t *ctx) {
   reblock_current_ctx(LBM_THREAD_STATE_RECV_TO,true);
 }
 
+// Profiler call frame, [fun_sym, PROF_RETURN], pushed by eval_application
+// when built with LBM_USE_PROF_STACK. Only marks the frame for the sampler.
+#define PROF_STACK_HEADROOM 32
+static void cont_prof_return(eval_context_t *ctx) {
+  lbm_stack_drop(&ctx->K, 1);
+  ctx->app_cont = true;
+}
+
+// cont_bytecode_resume:
+//
+// s[sp-3] = Closure body
+// s[sp-2] = Environment of the body
+// s[sp-1] = Saved state of the suspended bytecode
+//
+// ctx->r = Irrelevant.
+static void cont_bytecode_resume(eval_context_t *ctx) {
+#ifdef LBM_USE_BYTECODE
+  lbm_value *sptr = get_stack_ptr(ctx, 3);
+  lbm_bytecode_status_t s = lbm_bytecode_resume(ctx, sptr[0], &sptr[2]);
+  while (s == LBM_BYTECODE_NO_MEM) {
+    gc();
+    s = lbm_bytecode_continue(ctx, sptr[0], &sptr[2]);
+  }
+  switch (s) {
+  case LBM_BYTECODE_DONE:
+    ctx->r = sptr[2];
+    lbm_stack_drop(&ctx->K, 3);
+    ctx->app_cont = true;
+    break;
+  case LBM_BYTECODE_SUSPENDED:
+    stack_reserve(ctx, 1)[0] = BYTECODE_RESUME;
+    ctx->app_cont = true;
+    lbm_surrender_quota();
+    break;
+  case LBM_BYTECODE_ERROR:
+    ERROR_CTX(sptr[2]);
+    break;
+  default:
+    ctx->curr_exp = sptr[0];
+    ctx->curr_env = sptr[1];
+    lbm_stack_drop(&ctx->K, 3);
+    break;
+  }
+#else
+  (void)ctx;
+  ERROR_CTX(ENC_SYM_FATAL_ERROR);
+#endif
+}
+
 
 /*********************************************************/
 /* Continuations table                                   */
@@ -5416,6 +5623,8 @@ static const cont_fun continuations[NUM_CONTINUATIONS] =
     cont_recv_to_retry,
     cont_read_start_array,
     cont_read_append_array,
+    cont_prof_return,
+    cont_bytecode_resume,
   };
 
 /*********************************************************/
@@ -5492,6 +5701,22 @@ static void evaluation_step(void){
      * At this point head can be anything. It should evaluate
      * into a form that can be applied (closure, symbol, ...) though.
      */
+#ifdef LBM_USE_PROF_STACK
+    // Mark the application of a named function for the sampling profiler.
+    // In tail position the caller's frame is on top and is replaced, so
+    // tail calls do not grow the stack. Frames are not marked when the
+    // stack is close to full so small stacks behave as without profiling.
+    if (lbm_is_symbol(h) && lbm_dec_sym(h) >= RUNTIME_SYMBOLS_START) {
+      lbm_uint sp = ctx->K.sp;
+      if (sp >= 2 && ctx->K.data[sp-1] == PROF_RETURN) {
+        ctx->K.data[sp-2] = h;
+      } else if (ctx->K.size - sp > PROF_STACK_HEADROOM) {
+        lbm_value *pptr = stack_reserve(ctx, 2);
+        pptr[0] = h;
+        pptr[1] = PROF_RETURN;
+      }
+    }
+#endif
     lbm_value *reserved = stack_reserve(ctx, 3);
     reserved[0] = ctx->curr_env; // INFER: stack_reserve aborts context if error.
     reserved[1] = cell->cdr;
@@ -5680,30 +5905,21 @@ static void handle_event_unblock_ctx(lbm_cid cid, lbm_value v) {
 }
 
 static void handle_event_define(lbm_value key, lbm_value val) {
-  lbm_uint dec_key = lbm_dec_sym(key);
-  lbm_uint ix_key  = dec_key & GLOBAL_ENV_MASK;
-  lbm_value *global_env = lbm_get_global_env();
-  lbm_uint orig_env = global_env[ix_key];
-  lbm_value new_env;
+  lbm_value r;
   // A key is a symbol and should not need to be remembered.
-  WITH_GC(new_env, lbm_env_set(orig_env,key,val));
-
-  global_env[ix_key] = new_env;
+  WITH_GC(r, lbm_global_env_set(key, val));
+  (void)r;
 }
 
 static lbm_value get_event_value(lbm_event_t *e) {
   lbm_value v;
   if (e->buf_len > 0) {
-    lbm_flat_value_t fv;
-    fv.buf = (uint8_t*)e->buf_ptr;
-    fv.buf_size = e->buf_len;
-    fv.buf_pos = 0;
-    if (!lbm_unflatten_value(&fv, &v)) {
+    if (!unflatten_buffer((uint8_t*)e->buf_ptr, e->buf_len, &v)) {
       lbm_set_flags(LBM_FLAG_HANDLER_EVENT_DELIVERY_FAILED);
       v = ENC_SYM_EERROR;
     }
     // Free the flat value buffer. GC is unaware of its existence.
-    lbm_free(fv.buf);
+    lbm_free((void*)e->buf_ptr);
   } else {
     v = (lbm_value)e->buf_ptr;
   }
@@ -5822,6 +6038,11 @@ void lbm_run_eval(void){
           if (gc_requested) {
             gc();
           }
+#ifdef LBM_USE_GC_INCREMENTAL
+          else {
+            gc_incremental_step();
+          }
+#endif
           process_events();
           mutex_lock(&qmutex);
           if (ctx_running) {
@@ -5850,6 +6071,11 @@ void lbm_run_eval(void){
           if (gc_requested) {
             gc();
           }
+#ifdef LBM_USE_GC_INCREMENTAL
+          else {
+            gc_incremental_step();
+          }
+#endif
           process_events();
           mutex_lock(&qmutex);
           if (ctx_running) {
@@ -5909,6 +6135,9 @@ int lbm_eval_init(void) {
   mutex_unlock(&qmutex);
 
   if (!lbm_init_env()) return 0;
+#ifdef LBM_USE_BYTECODE
+  lbm_bytecode_init();
+#endif
   eval_running = true;
   return 1;
 }
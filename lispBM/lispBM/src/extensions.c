@@ -33,6 +33,8 @@ lbm_extension_t *extension_table = NULL;
 
 void lbm_extensions_set_next(lbm_uint i) {
   next_extension_ix = i;
+  // Names may have been written straight into the table.
+  lbm_symrepr_invalidate_index();
 }
 
 lbm_value lbm_extensions_default(lbm_value *args, lbm_uint argn) {
@@ -53,6 +55,7 @@ int lbm_extensions_init(lbm_extension_t *extension_storage, lbm_uint extension_s
 
   next_extension_ix = 0;
   ext_max = (lbm_uint)extension_storage_size;
+  lbm_symrepr_invalidate_index();
 
   return 1;
 }
@@ -117,6 +120,7 @@ bool lbm_add_extension(char *sym_str, extension_fptr ext) {
     lbm_uint sym_ix = next_extension_ix ++;
     extension_table[sym_ix].name = sym_str;
     extension_table[sym_ix].fptr = ext;
+    lbm_symrepr_index_extension(sym_ix);
     return true;
   }
   return false;
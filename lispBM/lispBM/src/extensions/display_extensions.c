@@ -187,6 +187,81 @@ uint32_t image_dims_to_size_bytes(color_format_t fmt, uint16_t width, uint16_t h
   }
 }
 
+// Dirty area tracking
+
+static image_dirty_t image_dirty[IMAGE_DIRTY_NUM];
+static uint32_t dirty_use_count = 0;
+
+static inline void dirty_clear(image_dirty_t *d) {
+  d->x0 = INT32_MAX;
+  d->y0 = INT32_MAX;
+  d->x1 = -1;
+  d->y1 = -1;
+}
+
+static inline void dirty_add(image_dirty_t *d, int x0, int y0, int x1, int y1) {
+  if (x0 < d->x0) d->x0 = x0;
+  if (y0 < d->y0) d->y0 = y0;
+  if (x1 > d->x1) d->x1 = x1;
+  if (y1 > d->y1) d->y1 = y1;
+}
+
+static inline void dirty_add_all(image_dirty_t *d) {
+  dirty_add(d, 0, 0,
+            image_buffer_width(d->mem_base) - 1,
+            image_buffer_height(d->mem_base) - 1);
+}
+
+// Nothing tells the slot when a tracked image is freed. If the memory
+// holds an image of another size or format now, the slot is stale and
+// is released.
+image_dirty_t *image_buffer_dirty(uint8_t *mem_base) {
+  if (mem_base) {
+    for (int i = 0; i < IMAGE_DIRTY_NUM; i ++) {
+      image_dirty_t *d = &image_dirty[i];
+      if (d->mem_base == mem_base) {
+        if (image_buffer_width(mem_base) != d->width ||
+            image_buffer_height(mem_base) != d->height ||
+            image_buffer_format(mem_base) != d->fmt) {
+          d->mem_base = NULL;
+          return NULL;
+        }
+        return d;
+      }
+    }
+  }
+  return NULL;
+}
+
+// A new image buffer may reuse the memory of a tracked image that is
+// gone. Stop tracking it so that the new image is not rendered partially.
+static void dirty_forget(uint8_t *mem_base) {
+  for (int i = 0; i < IMAGE_DIRTY_NUM; i ++) {
+    if (image_dirty[i].mem_base == mem_base) {
+      image_dirty[i].mem_base = NULL;
+    }
+  }
+}
+
+// FNV-1a over the palette passed to disp-render.
+static uint32_t dirty_palette_hash(color_t *colors) {
+  const uint8_t *p = (const uint8_t*)colors;
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < 16 * sizeof(color_t); i ++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+static void image_buffer_from_array(image_buffer_t *img, lbm_array_header_t *arr) {
+  img->width = image_buffer_width((uint8_t*)arr->data);
+  img->height = image_buffer_height((uint8_t*)arr->data);
+  img->fmt = image_buffer_format((uint8_t*)arr->data);
+  img->mem_base = (uint8_t*)arr->data;
+  img->data = image_buffer_data((uint8_t*)arr->data);
+  img->dirty = image_buffer_dirty(img->mem_base);
+}
+
 static lbm_value image_buffer_lift(uint8_t *buf, color_format_t fmt, uint16_t width, uint16_t height) {
   lbm_value res = ENC_SYM_MERROR;
   lbm_uint size = image_dims_to_size_bytes(fmt, width, height);
@@ -276,6 +351,7 @@ static lbm_value image_buffer_allocate(color_format_t fmt, uint16_t width, uint1
     return ENC_SYM_MERROR;
   }
   memset(buf, 0, size_bytes + IMAGE_BUFFER_HEADER_SIZE);
+  dirty_forget(buf);
   lbm_value res = image_buffer_lift(buf, fmt, width, height);
   if (lbm_is_symbol(res)) { /* something is wrong, free */
     lbm_free(buf);
@@ -290,6 +366,7 @@ static lbm_value image_buffer_allocate_dm(lbm_uint *dm, color_format_t fmt, uint
   lbm_array_header_t *arr = lbm_dec_array_r(res);
   if (arr) {
     uint8_t *buf = (uint8_t*)arr->data;
+    dirty_forget(buf);
     buf[0] = (uint8_t)(width >> 8);
     buf[1] = (uint8_t)width;
     buf[2] = (uint8_t)(height >> 8);
@@ -493,6 +570,9 @@ void image_buffer_clear(image_buffer_t *img, uint32_t cc) {
   uint32_t h = img->height;
   uint32_t img_size = w * h;
   uint8_t *data = img->data;
+  if (img->dirty) {
+    dirty_add(img->dirty, 0, 0, (int)w - 1, (int)h - 1);
+  }
   switch (fmt) {
   case indexed2: {
     uint32_t bytes = (img_size / 8) + (img_size % 8 ? 1 : 0);
@@ -521,7 +601,7 @@ void image_buffer_clear(image_buffer_t *img, uint32_t cc) {
   case rgb565: {
     uint16_t c = rgb888to565(cc);
     uint8_t *dp = (uint8_t*)data;
-    for (unsigned int i = 0; i < img_size/2; i +=2) {
+    for (unsigned int i = 0; i < img_size * 2; i +=2) {
       dp[i] = (uint8_t)(c >> 8);
       dp[i+1] = (uint8_t)c;
     }
@@ -554,6 +634,9 @@ void putpixel(image_buffer_t* img, int x_i, int y_i, uint32_t c) {
   uint16_t y = (uint16_t)y_i;
 
   if (x < w && y < h) {
+    if (img->dirty) {
+      dirty_add(img->dirty, x, y, x, y);
+    }
     color_format_t fmt = img->fmt;
     uint8_t *data = img->data;
     switch(fmt) {
@@ -658,9 +741,137 @@ uint32_t getpixel(image_buffer_t* img, int x_i, int y_i) {
   return 0;
 }
 
+// Write pixels [pos, pos + n) of an indexed image. Whole bytes in the
+// middle are written with memset, using a byte holding the color in
+// every pixel.
+static void fill_indexed(uint8_t *data, uint32_t pos, uint32_t n, uint32_t bits, uint32_t c) {
+  uint32_t ppb = 8 / bits;
+  uint32_t mask = (1u << bits) - 1;
+  c &= mask;
+  uint32_t end = pos + n;
+
+  while (pos < end && (pos % ppb) != 0) {
+    uint32_t shift = (ppb - 1 - (pos % ppb)) * bits;
+    data[pos / ppb] = (uint8_t)((data[pos / ppb] & ~(mask << shift)) | (c << shift));
+    pos ++;
+  }
+  if (end - pos >= ppb) {
+    uint8_t fill = 0;
+    for (uint32_t i = 0; i < ppb; i ++) {
+      fill = (uint8_t)(fill | (c << (i * bits)));
+    }
+    uint32_t bytes = (end - pos) / ppb;
+    memset(data + pos / ppb, fill, bytes);
+    pos += bytes * ppb;
+  }
+  while (pos < end) {
+    uint32_t shift = (ppb - 1 - (pos % ppb)) * bits;
+    data[pos / ppb] = (uint8_t)((data[pos / ppb] & ~(mask << shift)) | (c << shift));
+    pos ++;
+  }
+}
+
+// Fill a horizontal span. Clips once and then fills with a loop
+// specialized for the color format, rather than going through
+// putpixel for every pixel.
+static void fill_span(image_buffer_t* img, int x, int y, int len, uint32_t c) {
+  int w = img->width;
+  if (y < 0 || y >= img->height) return;
+  int x0 = x < 0 ? 0 : x;
+  int x1 = (len > w - x) ? w : x + len;
+  if (x0 >= x1) return;
+
+  if (img->dirty) {
+    dirty_add(img->dirty, x0, y, x1 - 1, y);
+  }
+
+  uint32_t n = (uint32_t)(x1 - x0);
+  uint32_t pos = (uint32_t)y * (uint32_t)w + (uint32_t)x0;
+  uint8_t *data = img->data;
+  switch (img->fmt) {
+  case indexed2:
+    fill_indexed(data, pos, n, 1, c ? 1 : 0);
+    break;
+  case indexed4:
+    fill_indexed(data, pos, n, 2, c);
+    break;
+  case indexed16:
+    fill_indexed(data, pos, n, 4, c);
+    break;
+  case rgb332:
+    memset(data + pos, rgb888to332(c), n);
+    break;
+  case rgb565: {
+    uint16_t color = rgb888to565(c);
+    uint8_t hi = (uint8_t)(color >> 8);
+    uint8_t lo = (uint8_t)color;
+    uint8_t *dp = data + pos * 2;
+    for (uint32_t i = 0; i < n; i ++) {
+      dp[0] = hi;
+      dp[1] = lo;
+      dp += 2;
+    }
+  } break;
+  case rgb888: {
+    uint8_t r = (uint8_t)(c >> 16);
+    uint8_t g = (uint8_t)(c >> 8);
+    uint8_t b = (uint8_t)c;
+    uint8_t *dp = data + pos * 3;
+    for (uint32_t i = 0; i < n; i ++) {
+      dp[0] = r;
+      dp[1] = g;
+      dp[2] = b;
+      dp += 3;
+    }
+  } break;
+  default:
+    break;
+  }
+}
+
 static void h_line(image_buffer_t* img, int x, int y, int len, uint32_t c) {
-  for (int i = 0; i < len; i ++) {
-    putpixel(img, x+i, y, c);
+  fill_span(img, x, y, len, c);
+}
+
+// Fill a rectangle. For the byte aligned formats only the first row is
+// filled pixel by pixel, the other rows are copies of it.
+static void fill_rect(image_buffer_t *img, int x, int y, int width, int height, uint32_t c) {
+  int y0 = y < 0 ? 0 : y;
+  int y1 = (height > img->height - y) ? img->height : y + height;
+  if (y0 >= y1) return;
+
+  fill_span(img, x, y0, width, c);
+
+  uint32_t bytes_pp = 0;
+  switch (img->fmt) {
+  case rgb332: bytes_pp = 1; break;
+  case rgb565: bytes_pp = 2; break;
+  case rgb888: bytes_pp = 3; break;
+  default: break;
+  }
+
+  if (bytes_pp == 0) {
+    for (int i = y0 + 1; i < y1; i ++) {
+      fill_span(img, x, i, width, c);
+    }
+    return;
+  }
+
+  int w = img->width;
+  int x0 = x < 0 ? 0 : x;
+  int x1 = (width > w - x) ? w : x + width;
+  if (x0 >= x1) return;
+
+  if (img->dirty) {
+    dirty_add(img->dirty, x0, y0, x1 - 1, y1 - 1);
+  }
+
+  size_t row_bytes = (size_t)(x1 - x0) * bytes_pp;
+  uint8_t *first = img->data + ((uint32_t)y0 * (uint32_t)w + (uint32_t)x0) * bytes_pp;
+  uint8_t *dp = first;
+  for (int i = y0 + 1; i < y1; i ++) {
+    dp += (uint32_t)w * bytes_pp;
+    memcpy(dp, first, row_bytes);
   }
 }
 
@@ -710,25 +921,15 @@ static void fill_circle(image_buffer_t *img, int x, int y, int radius, uint32_t
     break;
 
   default: {
+    // For each row, draw the span -x_ext .. x_ext where x_ext is the
+    // largest x with x^2 + y1^2 <= r^2.
     int r_sq = radius * radius;
     for (int y1 = -radius; y1 <= radius; y1++) {
-      for (int x1 = -radius; x1 <= radius; x1++) {
-        if (x1 * x1 + y1 * y1 <= r_sq) {
-          // Compute the start and end position for x axis
-          int x_left = x1;
-          while ((x1 + 1) <= radius && ((x1 + 1) * (x1 + 1) + y1 * y1) <= r_sq) {
-            x1++;
-          }
-          int x_right = x1;
-
-          // Draw line at this level y
-          int length = x_right - x_left + 1;
-          h_line(img, x + x_left, y + y1, length, color);
-
-          // Break out of innter loop for this level y
-          break;
-        }
-      }
+      int rem = r_sq - y1 * y1;
+      int x_ext = (int)sqrtf((float)rem);
+      while ((x_ext + 1) * (x_ext + 1) <= rem) x_ext++;
+      while (x_ext * x_ext > rem) x_ext--;
+      h_line(img, x - x_ext, y + y1, 2 * x_ext + 1, color);
     }
   } break;
   }
@@ -921,9 +1122,7 @@ static void rectangle(image_buffer_t *img, int x, int y, int width, int height,
   thickness /= 2;
 
   if (fill) {
-    for (int i = y; i < (y + height);i++) {
-      h_line(img, x, i, width, color);
-    }
+    fill_rect(img, x, y, width, height, color);
   } else {
     if (thickness <= 0 && dot1 == 0) {
       h_line(img, x, y, width, color);
@@ -950,6 +1149,27 @@ static void rectangle(image_buffer_t *img, int x, int y, int width, int height,
 #define NMIN(a, b) ((a) < (b) ? (a) : (b))
 #define NMAX(a, b) ((a) > (b) ? (a) : (b))
 
+static int floor_div(int a, int b) { // b > 0
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Narrow [*lo, *hi] to the x where a * x + b >= 0.
+static void clip_half_plane(int a, int b, int *lo, int *hi) {
+  if (a > 0) {
+    int l = -floor_div(b, a); // ceil(-b / a)
+    if (l > *lo) *lo = l;
+  } else if (a < 0) {
+    int h = floor_div(b, -a);
+    if (h < *hi) *hi = h;
+  } else if (b < 0) {
+    *hi = *lo - 1;
+  }
+}
+
+// Fills the same pixels as testing every pixel in the bounding box with
+// point_past_line, but as one span per row. For a fixed y the value
+// point_past_line takes the sign of is linear in x, so the pixels where
+// it is >= 0 (or <= 0) for all three edges form an interval.
 static void fill_triangle(image_buffer_t *img, int x0, int y0,
                           int x1, int y1, int x2, int y2, uint32_t color) {
   int x_min = NMIN(x0, NMIN(x1, x2));
@@ -957,16 +1177,30 @@ static void fill_triangle(image_buffer_t *img, int x0, int y0,
   int y_min = NMIN(y0, NMIN(y1, y2));
   int y_max = NMAX(y0, NMAX(y1, y2));
 
+  if (y_min < 0) y_min = 0;
+  if (y_max >= img->height) y_max = img->height - 1;
+
+  const int ex[3][4] = {
+    {x1, y1, x2, y2},
+    {x2, y2, x0, y0},
+    {x0, y0, x1, y1},
+  };
+
   for (int y = y_min;y <= y_max;y++) {
-    for (int x = x_min;x <= x_max;x++) {
-      int w0 = point_past_line(x, y, x1, y1, x2, y2);
-      int w1 = point_past_line(x, y, x2, y2, x0, y0);
-      int w2 = point_past_line(x, y, x0, y0, x1, y1);
-
-      if ((w0 >= 0 && w1 >= 0 && w2 >= 0)
-          || (w0 <= 0 && w1 <= 0 && w2 <= 0)) {
-        putpixel(img, x, y, color);
-      }
+    int pos_lo = x_min, pos_hi = x_max;
+    int neg_lo = x_min, neg_hi = x_max;
+    for (int i = 0; i < 3; i ++) {
+      // (x - sx) * (ey - sy) - (y - sy) * (ex - sx) = a * x + b
+      int a = ex[i][3] - ex[i][1];
+      int b = -ex[i][0] * a - (y - ex[i][1]) * (ex[i][2] - ex[i][0]);
+      clip_half_plane(a, b, &pos_lo, &pos_hi);
+      clip_half_plane(-a, -b, &neg_lo, &neg_hi);
+    }
+    if (pos_lo <= pos_hi) {
+      h_line(img, pos_lo, y, pos_hi - pos_lo + 1, color);
+    }
+    if (neg_lo <= neg_hi) {
+      h_line(img, neg_lo, y, neg_hi - neg_lo + 1, color);
     }
   }
 }
@@ -1947,11 +2181,7 @@ static img_args_t decode_args(lbm_value *args, lbm_uint argn, int num_expected)
   lbm_array_header_t *arr;
   if (argn >= 1 && (arr = get_image_buffer(args[0]))) {
     // at least one argument which is an image buffer.
-    res.img.width = image_buffer_width((uint8_t*)arr->data);
-    res.img.height = image_buffer_height((uint8_t*)arr->data);
-    res.img.fmt = image_buffer_format((uint8_t*)arr->data);
-    res.img.mem_base = (uint8_t*)arr->data;
-    res.img.data = image_buffer_data((uint8_t*)arr->data);
+    image_buffer_from_array(&res.img, arr);
 
 
     int num_dec = 0;
@@ -2328,11 +2558,7 @@ static lbm_value ext_clear(lbm_value *args, lbm_uint argn) {
       (arr = get_image_buffer(args[0])) &&   // assignment
       (argn != 2 || lbm_is_number(args[1]))) { // ( argn == 2 -> lbm_is_number(args[1]))
     image_buffer_t img_buf;
-    img_buf.width = image_buffer_width((uint8_t*)arr->data);
-    img_buf.height = image_buffer_height((uint8_t*)arr->data);
-    img_buf.fmt = image_buffer_format((uint8_t*)arr->data);
-    img_buf.mem_base = (uint8_t*)arr->data;
-    img_buf.data = image_buffer_data((uint8_t*)arr->data);
+    image_buffer_from_array(&img_buf, arr);
 
     uint32_t color = 0;
     if (argn == 2) {
@@ -2652,11 +2878,7 @@ static lbm_value ext_text(lbm_value *args, lbm_uint argn) {
   }
   lbm_array_header_t *arr = (lbm_array_header_t *)lbm_car(args[0]);
   image_buffer_t img_buf;
-  img_buf.width = image_buffer_width((uint8_t*)arr->data);
-  img_buf.height = image_buffer_height((uint8_t*)arr->data);
-  img_buf.fmt = image_buffer_format((uint8_t*)arr->data);
-  img_buf.mem_base = (uint8_t*)arr->data;
-  img_buf.data = image_buffer_data((uint8_t*)arr->data);
+  image_buffer_from_array(&img_buf, arr);
 
   lbm_array_header_t *font = 0;
   // Allow both const and non-const fonts.
@@ -2701,6 +2923,77 @@ static lbm_value ext_text(lbm_value *args, lbm_uint argn) {
   return ENC_SYM_TRUE;
 }
 
+// lisp args: img opt-enable
+static lbm_value ext_track_dirty(lbm_value *args, lbm_uint argn) {
+  lbm_array_header_t *arr;
+  if ((argn != 1 && argn != 2) ||
+      !(arr = get_image_buffer(args[0]))) {
+    return ENC_SYM_TERROR;
+  }
+
+  uint8_t *mem_base = (uint8_t*)arr->data;
+  image_dirty_t *d = image_buffer_dirty(mem_base);
+
+  if (argn == 2 && lbm_is_symbol_nil(args[1])) {
+    if (d) {
+      d->mem_base = NULL;
+    }
+    return ENC_SYM_TRUE;
+  }
+
+  if (!d) {
+    // Take a free slot, or the one that was rendered the longest ago.
+    // That is where slots of images that were freed end up.
+    d = &image_dirty[0];
+    for (int i = 0; i < IMAGE_DIRTY_NUM; i ++) {
+      if (!image_dirty[i].mem_base) {
+        d = &image_dirty[i];
+        break;
+      }
+      if (image_dirty[i].last_use < d->last_use) {
+        d = &image_dirty[i];
+      }
+    }
+    d->mem_base = mem_base;
+    d->width = image_buffer_width(mem_base);
+    d->height = image_buffer_height(mem_base);
+    d->fmt = image_buffer_format(mem_base);
+  }
+  // Nothing is known about what is on the display.
+  dirty_clear(d);
+  dirty_add_all(d);
+  d->rendered = false;
+  d->last_use = ++dirty_use_count;
+  return ENC_SYM_TRUE;
+}
+
+// lisp args: img
+static lbm_value ext_dirty(lbm_value *args, lbm_uint argn) {
+  lbm_array_header_t *arr;
+  if (argn != 1 || !(arr = get_image_buffer(args[0]))) {
+    return ENC_SYM_TERROR;
+  }
+
+  image_dirty_t *d = image_buffer_dirty((uint8_t*)arr->data);
+  if (!d || d->x1 < 0) {
+    return ENC_SYM_NIL;
+  }
+
+  lbm_value area = lbm_heap_allocate_list(4);
+  if (lbm_is_symbol(area)) {
+    return area;
+  }
+  lbm_value curr = area;
+  lbm_set_car(curr, lbm_enc_i(d->x0));
+  curr = lbm_cdr(curr);
+  lbm_set_car(curr, lbm_enc_i(d->y0));
+  curr = lbm_cdr(curr);
+  lbm_set_car(curr, lbm_enc_i(d->x1 - d->x0 + 1));
+  curr = lbm_cdr(curr);
+  lbm_set_car(curr, lbm_enc_i(d->y1 - d->y0 + 1));
+  return area;
+}
+
 static lbm_value ext_blit(lbm_value *args, lbm_uint argn) {
   img_args_t arg_dec = decode_args(args + 1, argn - 1, 3);
 
@@ -2708,11 +3001,7 @@ static lbm_value ext_blit(lbm_value *args, lbm_uint argn) {
   lbm_array_header_t *arr;
   if (arg_dec.is_valid && (arr = get_image_buffer(args[0]))) { //assignment
     image_buffer_t dest_buf;
-    dest_buf.width = image_buffer_width((uint8_t*)arr->data);
-    dest_buf.height = image_buffer_height((uint8_t*)arr->data);
-    dest_buf.fmt = image_buffer_format((uint8_t*)arr->data);
-    dest_buf.mem_base = (uint8_t*)arr->data;
-    dest_buf.data = image_buffer_data((uint8_t*)arr->data);
+    image_buffer_from_array(&dest_buf, arr);
 
     float scale = 1.0;
     if (arg_dec.attr_scale.is_valid) {
@@ -2799,9 +3088,89 @@ static lbm_value ext_disp_clear(lbm_value *args, lbm_uint argn) {
 
   disp_clear(clear_color);
 
+  // What was shown of the tracked images is gone.
+  for (int i = 0; i < IMAGE_DIRTY_NUM; i ++) {
+    if (image_dirty[i].mem_base) {
+      dirty_add_all(&image_dirty[i]);
+    }
+  }
+
   return ENC_SYM_TRUE;
 }
 
+// Render only the changed area of a tracked image. The area is copied
+// into a temporary image buffer with a header of its own, as the render
+// callbacks expect. Returns false if the whole image should be rendered
+// instead: when it is not tracked, when it was last rendered at another
+// position or with another palette, when everything has changed, when
+// there is no memory for the copy, or when the image is indexed and
+// uses gradient colors that depend on the position in the image.
+static bool render_dirty(image_buffer_t *img, uint16_t x, uint16_t y, color_t *colors, uint32_t palette_hash, bool *render_res) {
+  image_dirty_t *d = img->dirty;
+  if (!d) return false;
+  if (!d->rendered || d->x != x || d->y != y || d->palette_hash != palette_hash) {
+    return false;
+  }
+
+  if (d->x1 < 0) {
+    *render_res = true; // Nothing has changed.
+    return true;
+  }
+
+  int x0 = d->x0 < 0 ? 0 : d->x0;
+  int y0 = d->y0 < 0 ? 0 : d->y0;
+  int x1 = d->x1 >= img->width ? img->width - 1 : d->x1;
+  int y1 = d->y1 >= img->height ? img->height - 1 : d->y1;
+  uint16_t w = (uint16_t)(x1 - x0 + 1);
+  uint16_t h = (uint16_t)(y1 - y0 + 1);
+  if (w == img->width && h == img->height) return false;
+
+  uint32_t bytes_pp = 0;
+  switch (img->fmt) {
+  case rgb332: bytes_pp = 1; break;
+  case rgb565: bytes_pp = 2; break;
+  case rgb888: bytes_pp = 3; break;
+  default:
+    for (int i = 0; i < 16; i ++) {
+      if (colors[i].type != COLOR_REGULAR) return false;
+    }
+    break;
+  }
+
+  uint32_t size = image_dims_to_size_bytes(img->fmt, w, h);
+  uint8_t *buf = lbm_malloc(IMAGE_BUFFER_HEADER_SIZE + size);
+  if (!buf) return false;
+  image_buffer_set_width(buf, w);
+  image_buffer_set_height(buf, h);
+  image_buffer_set_format(buf, img->fmt);
+
+  image_buffer_t sub;
+  sub.fmt = img->fmt;
+  sub.width = w;
+  sub.height = h;
+  sub.mem_base = buf;
+  sub.data = image_buffer_data(buf);
+  sub.dirty = NULL;
+
+  if (bytes_pp) {
+    for (int r = 0; r < h; r ++) {
+      memcpy(sub.data + (uint32_t)r * w * bytes_pp,
+             img->data + ((uint32_t)(y0 + r) * img->width + (uint32_t)x0) * bytes_pp,
+             (size_t)w * bytes_pp);
+    }
+  } else {
+    for (int r = 0; r < h; r ++) {
+      for (int c = 0; c < w; c ++) {
+        putpixel(&sub, c, r, getpixel(img, x0 + c, y0 + r));
+      }
+    }
+  }
+
+  *render_res = disp_render_image(&sub, (uint16_t)(x + x0), (uint16_t)(y + y0), colors);
+  lbm_free(buf);
+  return true;
+}
+
 static lbm_value ext_disp_render(lbm_value *args, lbm_uint argn) {
   if (disp_render_image == NULL) {
     lbm_set_error_reason(msg_not_supported);
@@ -2815,11 +3184,7 @@ static lbm_value ext_disp_render(lbm_value *args, lbm_uint argn) {
       lbm_is_number(args[1]) &&
       lbm_is_number(args[2])) {
     image_buffer_t img_buf;
-    img_buf.fmt = image_buffer_format((uint8_t*)arr->data);
-    img_buf.width = image_buffer_width((uint8_t*)arr->data);
-    img_buf.height = image_buffer_height((uint8_t*)arr->data);
-    img_buf.mem_base = (uint8_t*)arr->data;
-    img_buf.data = image_buffer_data((uint8_t*)arr->data);
+    image_buffer_from_array(&img_buf, arr);
 
     color_t colors[16];
     memset(colors, 0, sizeof(color_t) * 16);
@@ -2843,8 +3208,23 @@ static lbm_value ext_disp_render(lbm_value *args, lbm_uint argn) {
       }
     }
 
-    // img_buf is a stack allocated image_buffer_t.
-    bool render_res = disp_render_image(&img_buf, (uint16_t)lbm_dec_as_u32(args[1]), (uint16_t)lbm_dec_as_u32(args[2]), colors);
+    uint16_t x = (uint16_t)lbm_dec_as_u32(args[1]);
+    uint16_t y = (uint16_t)lbm_dec_as_u32(args[2]);
+    uint32_t palette_hash = img_buf.dirty ? dirty_palette_hash(colors) : 0;
+    bool render_res;
+    if (!render_dirty(&img_buf, x, y, colors, palette_hash, &render_res)) {
+      // img_buf is a stack allocated image_buffer_t.
+      render_res = disp_render_image(&img_buf, x, y, colors);
+    }
+    if (render_res && img_buf.dirty) {
+      image_dirty_t *d = img_buf.dirty;
+      dirty_clear(d);
+      d->rendered = true;
+      d->x = x;
+      d->y = y;
+      d->palette_hash = palette_hash;
+      d->last_use = ++dirty_use_count;
+    }
     if (!render_res) {
       lbm_set_error_reason("Could not render image. Check if the format and location is compatible with the display.");
       return ENC_SYM_EERROR;
@@ -2891,6 +3271,7 @@ int jpg_output_func (	/* 1:Ok, 0:Aborted */
   img.width = (uint16_t)(rect->right - rect->left + 1);
   img.height = (uint16_t)(rect->bottom - rect->top + 1);
   img.fmt = rgb888;
+  img.dirty = NULL;
 
   disp_render_image(&img, (uint16_t)(rect->left + dev->ofs_x), (uint16_t)(rect->top + dev->ofs_y), 0);
 
@@ -2936,6 +3317,9 @@ static lbm_value ext_disp_render_jpg(lbm_value *args, lbm_uint argn) {
 void lbm_display_extensions_init(void) {
   register_symbols();
 
+  memset(image_dirty, 0, sizeof(image_dirty));
+  dirty_use_count = 0;
+
   disp_render_image = NULL;
   disp_clear = NULL;
   disp_reset = NULL;
@@ -2959,6 +3343,8 @@ void lbm_display_extensions_init(void) {
   lbm_add_extension("img-rectangle", ext_rectangle);
   lbm_add_extension("img-triangle", ext_triangle);
   lbm_add_extension("img-blit", ext_blit);
+  lbm_add_extension("img-track-dirty", ext_track_dirty);
+  lbm_add_extension("img-dirty", ext_dirty);
 
   lbm_add_extension("disp-reset", ext_disp_reset);
   lbm_add_extension("disp-clear", ext_disp_clear);
@@ -53,7 +53,8 @@ static SFT mk_sft(SFT_Font *ft, float x_scale, float y_scale) {
   return sft;
 }
 
-// If we are not bin searching then sorting the UTF32 codes is not needed.
+// The UTF32 codes are sorted so that the glyph and kerning tables can
+// be binary searched through a font index.
 
 #define FONT_MAX_ID_STRING_LENGTH   10
 #define FONT_VERSION                0
@@ -260,6 +261,7 @@ static int buffer_append_glyph(uint8_t *buffer, SFT *sft, color_format_t fmt, ui
   img.fmt = fmt;
   img.mem_base = &buffer[*index];
   img.data = &buffer[*index];
+  img.dirty = NULL;
 
   int r = sft_render(sft, gid, &img);
   *index += (int32_t)image_dims_to_size_bytes(fmt, (uint16_t)gmtx.minWidth, (uint16_t)gmtx.minHeight);
@@ -481,6 +483,217 @@ static bool font_get_glyphs_table_index(uint8_t *buffer, int32_t buffer_size, in
   return false;
 }
 
+// Index of the glyph and kerning tables of a prepared font.
+//
+// Glyph records and kerning rows have different sizes, so finding one
+// in the font binary means walking the table from the start. The index
+// holds the position of every glyph record and kerning row, sorted on
+// code, so that a lookup is a binary search. The kerning pairs within
+// a row have a fixed size and are searched in place.
+//
+// Indices are kept for the FONT_INDEX_NUM most recently used fonts,
+// in a static pool of FONT_INDEX_POOL_SIZE entries, so that no memory
+// outlives a font that is freed. A font with more glyphs and kerning
+// rows than fit in the pool is not indexed. The array holding a font
+// can be freed and its memory reused, so the code found at an indexed
+// position is checked on every lookup and an index that does not match
+// is dropped.
+
+#define FONT_INDEX_NUM 4
+
+#ifndef FONT_INDEX_POOL_SIZE
+#define FONT_INDEX_POOL_SIZE 512
+#endif
+
+typedef struct {
+  uint32_t code;
+  int32_t  index; // Glyph record, or first pair of a kerning row.
+  uint32_t len;   // Number of pairs in a kerning row.
+} font_index_entry_t;
+
+typedef struct {
+  uint8_t  *buffer;
+  lbm_uint size;
+  int32_t  glyphs_index;
+  uint32_t num_glyphs;
+  uint32_t num_rows;
+  bool     pairs_sorted;
+  uint32_t last_use;
+  uint32_t pool_ix;
+  uint32_t pool_len;
+  font_index_entry_t *glyphs; // NULL if the slot is free.
+  font_index_entry_t *rows;   // Follows glyphs in the pool.
+} font_index_t;
+
+static font_index_t font_index[FONT_INDEX_NUM];
+static font_index_entry_t font_index_pool[FONT_INDEX_POOL_SIZE];
+static uint32_t font_index_clock = 0;
+
+static void font_index_drop(font_index_t *fi) {
+  memset(fi, 0, sizeof(font_index_t));
+}
+
+// Returns the position of n free entries at the end of the pool. The
+// indices in use are first moved to the start of the pool, and the
+// least recently used are dropped until there is room.
+static bool font_index_alloc(uint32_t n, uint32_t *pool_ix) {
+  if (n == 0 || n > FONT_INDEX_POOL_SIZE) return false;
+  for (;;) {
+    uint32_t used = 0;
+    for (;;) {
+      font_index_t *next = NULL;
+      for (int i = 0; i < FONT_INDEX_NUM; i ++) {
+        font_index_t *fi = &font_index[i];
+        if (fi->glyphs && fi->pool_ix >= used &&
+            (!next || fi->pool_ix < next->pool_ix)) {
+          next = fi;
+        }
+      }
+      if (!next) break;
+      if (next->pool_ix != used) {
+        memmove(&font_index_pool[used], &font_index_pool[next->pool_ix],
+                next->pool_len * sizeof(font_index_entry_t));
+        next->pool_ix = used;
+        next->glyphs = &font_index_pool[used];
+        next->rows = &font_index_pool[used + next->num_glyphs];
+      }
+      used += next->pool_len;
+    }
+    if (FONT_INDEX_POOL_SIZE - used >= n) {
+      *pool_ix = used;
+      return true;
+    }
+    font_index_t *lru = NULL;
+    for (int i = 0; i < FONT_INDEX_NUM; i ++) {
+      font_index_t *fi = &font_index[i];
+      if (fi->glyphs && (!lru || fi->last_use < lru->last_use)) {
+        lru = fi;
+      }
+    }
+    if (!lru) return false;
+    font_index_drop(lru);
+  }
+}
+
+static void font_index_sort(font_index_entry_t *e, uint32_t n) {
+  // Tables written by ttf-prepare are already sorted.
+  for (uint32_t i = 1; i < n; i ++) {
+    font_index_entry_t t = e[i];
+    uint32_t j = i;
+    while (j > 0 && e[j-1].code > t.code) {
+      e[j] = e[j-1];
+      j --;
+    }
+    e[j] = t;
+  }
+}
+
+static font_index_entry_t *font_index_find(font_index_entry_t *e, uint32_t n, uint32_t code) {
+  uint32_t lo = 0;
+  uint32_t hi = n;
+  while (lo < hi) {
+    uint32_t mid = lo + ((hi - lo) >> 1);
+    if (e[mid].code < code) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (lo < n && e[lo].code == code) ? &e[lo] : NULL;
+}
+
+static bool font_index_build(font_index_t *fi,
+                             uint8_t *buffer,
+                             lbm_uint size,
+                             int32_t kern_index,
+                             int32_t glyphs_index,
+                             uint32_t num_codes,
+                             color_format_t fmt) {
+  int32_t index = kern_index;
+  uint32_t num_rows = buffer_get_uint32(buffer, &index);
+  if (num_codes > size / FONT_GLYPH_SIZE ||
+      num_rows > size / FONT_KERN_ROW_SIZE) {
+    return false;
+  }
+
+  uint32_t pool_ix;
+  if (!font_index_alloc(num_codes + num_rows, &pool_ix)) return false;
+  font_index_entry_t *e = &font_index_pool[pool_ix];
+  font_index_entry_t *rows = &e[num_codes];
+
+  bool pairs_sorted = true;
+  for (uint32_t r = 0; r < num_rows; r ++) {
+    if ((lbm_uint)index + FONT_KERN_ROW_SIZE > size) return false;
+    rows[r].code = buffer_get_uint32(buffer, &index);
+    rows[r].len = buffer_get_uint32(buffer, &index);
+    rows[r].index = index;
+    if (rows[r].len > (size - (lbm_uint)index) / FONT_KERN_PAIR_SIZE) return false;
+    uint32_t prev = 0;
+    for (uint32_t p = 0; p < rows[r].len; p ++) {
+      int32_t i = index + (int32_t)(p * FONT_KERN_PAIR_SIZE);
+      uint32_t c = buffer_get_uint32(buffer, &i);
+      if (p > 0 && c <= prev) pairs_sorted = false;
+      prev = c;
+    }
+    index += (int32_t)(rows[r].len * FONT_KERN_PAIR_SIZE);
+  }
+
+  index = glyphs_index;
+  for (uint32_t g = 0; g < num_codes; g ++) {
+    if ((lbm_uint)index + FONT_GLYPH_SIZE > size) return false;
+    e[g].index = index;
+    e[g].code = buffer_get_uint32(buffer, &index);
+    e[g].len = 0;
+    index += 12;
+    int32_t w = buffer_get_int32(buffer, &index);
+    int32_t h = buffer_get_int32(buffer, &index);
+    index += (int32_t)image_dims_to_size_bytes(fmt, (uint16_t)w, (uint16_t)h);
+  }
+
+  font_index_sort(e, num_codes);
+  font_index_sort(rows, num_rows);
+
+  fi->buffer = buffer;
+  fi->size = size;
+  fi->glyphs_index = glyphs_index;
+  fi->num_glyphs = num_codes;
+  fi->num_rows = num_rows;
+  fi->pairs_sorted = pairs_sorted;
+  fi->pool_ix = pool_ix;
+  fi->pool_len = num_codes + num_rows;
+  fi->glyphs = e;
+  fi->rows = rows;
+  return true;
+}
+
+// Returns NULL if there is no index and none could be built. The
+// callers then fall back to walking the tables.
+static font_index_t *font_index_get(uint8_t *buffer,
+                                    lbm_uint size,
+                                    int32_t kern_index,
+                                    int32_t glyphs_index,
+                                    uint32_t num_codes,
+                                    color_format_t fmt) {
+  font_index_t *lru = &font_index[0];
+  for (int i = 0; i < FONT_INDEX_NUM; i ++) {
+    font_index_t *fi = &font_index[i];
+    if (fi->buffer == buffer &&
+        fi->size == size &&
+        fi->glyphs_index == glyphs_index &&
+        fi->num_glyphs == num_codes) {
+      fi->last_use = ++font_index_clock;
+      return fi;
+    }
+    if (fi->last_use < lru->last_use) lru = fi;
+  }
+  font_index_drop(lru);
+  if (!font_index_build(lru, buffer, size, kern_index, glyphs_index, num_codes, fmt)) {
+    return NULL;
+  }
+  lru->last_use = ++font_index_clock;
+  return lru;
+}
+
 static bool font_get_glyph(uint8_t *buffer,
                            float *advance_width,
                            float *left_side_bearing,
@@ -491,7 +704,25 @@ static bool font_get_glyph(uint8_t *buffer,
                            uint32_t utf32,
                            uint32_t num_codes,
                            color_format_t fmt,
-                           int32_t index) {
+                           int32_t index,
+                           font_index_t *fi) {
+
+  if (fi && fi->glyphs) {
+    font_index_entry_t *e = font_index_find(fi->glyphs, fi->num_glyphs, utf32);
+    if (!e) return false;
+    int32_t i = e->index;
+    if (buffer_get_uint32(buffer, &i) == utf32) {
+      *advance_width = buffer_get_float32_auto(buffer, &i);
+      *left_side_bearing = buffer_get_float32_auto(buffer, &i);
+      *y_offset = buffer_get_int32(buffer, &i);
+      *width = buffer_get_int32(buffer, &i);
+      *height = buffer_get_int32(buffer,&i);
+      *gfx = &buffer[i];
+      return true;
+    }
+    // The font array has been replaced since the index was built.
+    font_index_drop(fi);
+  }
 
   uint32_t i = 0;
   while (i < num_codes) {
@@ -515,7 +746,45 @@ static bool font_get_glyph(uint8_t *buffer,
   return false;
 }
 
-bool font_get_kerning(uint8_t *buffer, uint32_t left, uint32_t right, float *x_shift, float *y_shift, int32_t index) {
+static bool font_get_kerning(uint8_t *buffer, uint32_t left, uint32_t right, float *x_shift, float *y_shift, int32_t index, font_index_t *fi) {
+
+  if (fi && fi->glyphs) {
+    font_index_entry_t *row = font_index_find(fi->rows, fi->num_rows, left);
+    if (!row) return false;
+    int32_t i = row->index - 8;
+    if (buffer_get_uint32(buffer, &i) != left) {
+      font_index_drop(fi);
+      return font_get_kerning(buffer, left, right, x_shift, y_shift, index, NULL);
+    }
+    uint32_t lo = 0;
+    uint32_t hi = row->len;
+    if (!fi->pairs_sorted) {
+      // Not written by ttf-prepare, search the row from the start.
+      for (lo = 0; lo < hi; lo ++) {
+        i = row->index + (int32_t)(lo * FONT_KERN_PAIR_SIZE);
+        if (buffer_get_uint32(buffer, &i) == right) break;
+      }
+    } else {
+      while (lo < hi) {
+        uint32_t mid = lo + ((hi - lo) >> 1);
+        i = row->index + (int32_t)(mid * FONT_KERN_PAIR_SIZE);
+        if (buffer_get_uint32(buffer, &i) < right) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+    }
+    if (lo < row->len) {
+      i = row->index + (int32_t)(lo * FONT_KERN_PAIR_SIZE);
+      if (buffer_get_uint32(buffer, &i) == right) {
+        *x_shift = buffer_get_float32_auto(buffer, &i);
+        *y_shift = buffer_get_float32_auto(buffer, &i);
+        return true;
+      }
+    }
+    return false;
+  }
 
   uint32_t num_rows = buffer_get_uint32(buffer, &index);
 
@@ -618,6 +887,7 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
   }
 
   color_format_t fmt = (color_format_t)color_fmt;
+  font_index_t *fi = font_index_get((uint8_t*)font_arr->data, font_arr->size, kern_index, glyphs_index, num_codes, fmt);
   float x = 0.0;
   float y = 0.0;
 
@@ -627,6 +897,7 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
   tgt.fmt = image_buffer_format((uint8_t*)img_arr->data);
   tgt.mem_base = (uint8_t*)img_arr->data;
   tgt.data = image_buffer_data((uint8_t*)img_arr->data);
+  tgt.dirty = image_buffer_dirty(tgt.mem_base);
 
   uint32_t utf32;
   uint32_t prev;
@@ -661,7 +932,8 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
                        utf32,
                        num_codes,
                        fmt,
-                       glyphs_index)) {
+                       glyphs_index,
+                       fi)) {
 
       float x_shift = 0;
       float y_shift = 0;
@@ -671,7 +943,8 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
                          utf32,
                          &x_shift,
                          &y_shift,
-                         kern_index);
+                         kern_index,
+                         fi);
       }
       x_n += x_shift;
       y_n += y_shift;
@@ -683,6 +956,7 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
       src.fmt = fmt;
       //src.mem_base = gfx;
       src.data = gfx;
+      src.dirty = NULL;
 
       uint32_t num_colors = 1 << src.fmt;
       for (int j = 0; j < src.height; j++) {
@@ -776,6 +1050,7 @@ lbm_value ext_ttf_wh(lbm_value *args, lbm_uint argn) {
     return ENC_SYM_EERROR;
   }
 
+  font_index_t *fi = font_index_get((uint8_t*)font_arr->data, font_arr->size, kern_index, glyphs_index, num_codes, (color_format_t)color_fmt);
   float x = 0.0;
   float y = 0.0;
   float max_x = 0.0;
@@ -813,7 +1088,8 @@ lbm_value ext_ttf_wh(lbm_value *args, lbm_uint argn) {
                        utf32,
                        num_codes,
                        (color_format_t)color_fmt,
-                       glyphs_index)) {
+                       glyphs_index,
+                       fi)) {
 
       float x_shift = 0;
       float y_shift = 0;
@@ -823,7 +1099,8 @@ lbm_value ext_ttf_wh(lbm_value *args, lbm_uint argn) {
                          utf32,
                          &x_shift,
                          &y_shift,
-                         kern_index);
+                         kern_index,
+                         fi);
       }
       x_n += x_shift;
     } else {
@@ -894,7 +1171,8 @@ lbm_value ext_ttf_glyph_dims(lbm_value *args, lbm_uint argn) {
                        utf32,
                        num_codes,
                        (color_format_t)color_fmt,
-                       glyphs_index)) {
+                       glyphs_index,
+                       NULL)) {
 
       return lbm_heap_allocate_list_init(2,
                                         lbm_enc_u((uint32_t)(width)),
@@ -1022,6 +1300,10 @@ lbm_value ext_ttf_line_gap(lbm_value *args, lbm_uint argn) {
 
 void lbm_ttf_extensions_init(void) {
 
+  // The fonts of the indices went away with a restart.
+  memset(font_index, 0, sizeof(font_index));
+  font_index_clock = 0;
+
   // metrics
   lbm_add_extension("ttf-line-height", ext_ttf_line_height);
   lbm_add_extension("ttf-ascender", ext_ttf_ascender);
@@ -0,0 +1,543 @@
+/*
+    Copyright 2025 Joel Svensson        svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "extensions/vector_extensions.h"
+
+#include "extensions.h"
+#include "lbm_memory.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef LBM_OPT_VECTOR_EXTENSIONS_SIZE
+#pragma GCC optimize ("-Os")
+#endif
+#ifdef LBM_OPT_VECTOR_EXTENSIONS_SIZE_AGGRESSIVE
+#pragma GCC optimize ("-Oz")
+#endif
+
+// Vectors are byte arrays. Array data is allocated word aligned, so
+// the data can be accessed directly as float or int16_t. Arrays shared
+// from a code image with lbm_share_array_const may not be aligned and
+// are rejected with a type error. Elements are
+// in native byte order, which is little-endian on the VESC targets, so
+// pass 'little-endian to bufget-f32 and friends to look at them.
+// Trailing bytes that do not make up a whole element are ignored.
+//
+// Operations that take several vectors process as many elements as
+// the shortest of them holds.
+
+typedef struct {
+  void *data;
+  lbm_uint n;
+} vec_t;
+
+static bool get_vec(lbm_value v, lbm_uint elem_size, bool rw, vec_t *vec) {
+  lbm_array_header_t *arr = rw ? lbm_dec_array_rw(v) : lbm_dec_array_r(v);
+  if (!arr) return false;
+  if ((uintptr_t)arr->data % elem_size != 0) return false;
+  vec->data = arr->data;
+  vec->n = arr->size / elem_size;
+  return true;
+}
+
+static inline lbm_uint min_n(lbm_uint a, lbm_uint b) {
+  return a < b ? a : b;
+}
+
+static inline int16_t sat_i16(float x) {
+  if (x >= 32767.0f) return 32767;
+  if (x <= -32768.0f) return -32768;
+  if (isnan(x)) return 0;
+  return (int16_t)lroundf(x);
+}
+
+static inline int16_t sat_i16_i32(int32_t x) {
+  if (x > 32767) return 32767;
+  if (x < -32768) return -32768;
+  return (int16_t)x;
+}
+
+// ////////////////////////////////////////////////////////////
+// Kernels
+//
+// The reductions use four independent accumulators so that the
+// loads and multiply-adds of consecutive elements can overlap on an
+// FPU with a multi-cycle latency.
+
+static float sum_f32(const float *x, lbm_uint n) {
+  float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+  lbm_uint i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += x[i];
+    s1 += x[i + 1];
+    s2 += x[i + 2];
+    s3 += x[i + 3];
+  }
+  for (; i < n; i ++) {
+    s0 += x[i];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+static float dot_f32(const float *a, const float *b, lbm_uint n) {
+  float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+  lbm_uint i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  for (; i < n; i ++) {
+    s0 += a[i] * b[i];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+static int64_t sum_i16(const int16_t *x, lbm_uint n) {
+  int64_t s = 0;
+  for (lbm_uint i = 0; i < n; i ++) {
+    s += x[i];
+  }
+  return s;
+}
+
+static int64_t dot_i16(const int16_t *a, const int16_t *b, lbm_uint n) {
+  int64_t s = 0;
+  for (lbm_uint i = 0; i < n; i ++) {
+    s += (int32_t)a[i] * (int32_t)b[i];
+  }
+  return s;
+}
+
+// ////////////////////////////////////////////////////////////
+// Reductions
+
+static lbm_value ext_vec_sum_f32(lbm_value *args, lbm_uint argn) {
+  vec_t v;
+  if (argn != 1 || !get_vec(args[0], sizeof(float), false, &v)) return ENC_SYM_TERROR;
+  return lbm_enc_float(sum_f32((float*)v.data, v.n));
+}
+
+static lbm_value ext_vec_mean_f32(lbm_value *args, lbm_uint argn) {
+  vec_t v;
+  if (argn != 1 || !get_vec(args[0], sizeof(float), false, &v)) return ENC_SYM_TERROR;
+  if (v.n == 0) return ENC_SYM_NIL;
+  return lbm_enc_float(sum_f32((float*)v.data, v.n) / (float)v.n);
+}
+
+static lbm_value vec_min_max_f32(lbm_value *args, lbm_uint argn, bool max) {
+  vec_t v;
+  if (argn != 1 || !get_vec(args[0], sizeof(float), false, &v)) return ENC_SYM_TERROR;
+  if (v.n == 0) return ENC_SYM_NIL;
+  float *x = (float*)v.data;
+  float r = x[0];
+  for (lbm_uint i = 1; i < v.n; i ++) {
+    if (max ? x[i] > r : x[i] < r) r = x[i];
+  }
+  return lbm_enc_float(r);
+}
+
+static lbm_value ext_vec_min_f32(lbm_value *args, lbm_uint argn) {
+  return vec_min_max_f32(args, argn, false);
+}
+
+static lbm_value ext_vec_max_f32(lbm_value *args, lbm_uint argn) {
+  return vec_min_max_f32(args, argn, true);
+}
+
+static lbm_value ext_vec_dot_f32(lbm_value *args, lbm_uint argn) {
+  vec_t a, b;
+  if (argn != 2 ||
+      !get_vec(args[0], sizeof(float), false, &a) ||
+      !get_vec(args[1], sizeof(float), false, &b)) {
+    return ENC_SYM_TERROR;
+  }
+  return lbm_enc_float(dot_f32((float*)a.data, (float*)b.data, min_n(a.n, b.n)));
+}
+
+static lbm_value ext_vec_sum_i16(lbm_value *args, lbm_uint argn) {
+  vec_t v;
+  if (argn != 1 || !get_vec(args[0], sizeof(int16_t), false, &v)) return ENC_SYM_TERROR;
+  return lbm_enc_i64(sum_i16((int16_t*)v.data, v.n));
+}
+
+static lbm_value ext_vec_mean_i16(lbm_value *args, lbm_uint argn) {
+  vec_t v;
+  if (argn != 1 || !get_vec(args[0], sizeof(int16_t), false, &v)) return ENC_SYM_TERROR;
+  if (v.n == 0) return ENC_SYM_NIL;
+  return lbm_enc_float((float)sum_i16((int16_t*)v.data, v.n) / (float)v.n);
+}
+
+static lbm_value vec_min_max_i16(lbm_value *args, lbm_uint argn, bool max) {
+  vec_t v;
+  if (argn != 1 || !get_vec(args[0], sizeof(int16_t), false, &v)) return ENC_SYM_TERROR;
+  if (v.n == 0) return ENC_SYM_NIL;
+  int16_t *x = (int16_t*)v.data;
+  int16_t r = x[0];
+  for (lbm_uint i = 1; i < v.n; i ++) {
+    if (max ? x[i] > r : x[i] < r) r = x[i];
+  }
+  return lbm_enc_i(r);
+}
+
+static lbm_value ext_vec_min_i16(lbm_value *args, lbm_uint argn) {
+  return vec_min_max_i16(args, argn, false);
+}
+
+static lbm_value ext_vec_max_i16(lbm_value *args, lbm_uint argn) {
+  return vec_min_max_i16(args, argn, true);
+}
+
+static lbm_value ext_vec_dot_i16(lbm_value *args, lbm_uint argn) {
+  vec_t a, b;
+  if (argn != 2 ||
+      !get_vec(args[0], sizeof(int16_t), false, &a) ||
+      !get_vec(args[1], sizeof(int16_t), false, &b)) {
+    return ENC_SYM_TERROR;
+  }
+  return lbm_enc_i64(dot_i16((int16_t*)a.data, (int16_t*)b.data, min_n(a.n, b.n)));
+}
+
+// ////////////////////////////////////////////////////////////
+// Elementwise operations
+//
+// (vec-add-f32 dst a b) and friends. b is either a vector or a
+// number that is used for every element. dst may be a or b.
+
+typedef enum {
+  VEC_ADD,
+  VEC_SUB,
+  VEC_MUL,
+} vec_op_t;
+
+static lbm_value vec_elementwise_f32(lbm_value *args, lbm_uint argn, vec_op_t op) {
+  vec_t d, a, b;
+  if (argn != 3 ||
+      !get_vec(args[0], sizeof(float), true, &d) ||
+      !get_vec(args[1], sizeof(float), false, &a)) {
+    return ENC_SYM_TERROR;
+  }
+  float *dst = (float*)d.data;
+  float *x = (float*)a.data;
+  lbm_uint n = min_n(d.n, a.n);
+
+  if (lbm_is_number(args[2])) {
+    float k = lbm_dec_as_float(args[2]);
+    switch (op) {
+    case VEC_ADD: for (lbm_uint i = 0; i < n; i ++) dst[i] = x[i] + k; break;
+    case VEC_SUB: for (lbm_uint i = 0; i < n; i ++) dst[i] = x[i] - k; break;
+    case VEC_MUL: for (lbm_uint i = 0; i < n; i ++) dst[i] = x[i] * k; break;
+    }
+  } else if (get_vec(args[2], sizeof(float), false, &b)) {
+    float *y = (float*)b.data;
+    n = min_n(n, b.n);
+    switch (op) {
+    case VEC_ADD: for (lbm_uint i = 0; i < n; i ++) dst[i] = x[i] + y[i]; break;
+    case VEC_SUB: for (lbm_uint i = 0; i < n; i ++) dst[i] = x[i] - y[i]; break;
+    case VEC_MUL: for (lbm_uint i = 0; i < n; i ++) dst[i] = x[i] * y[i]; break;
+    }
+  } else {
+    return ENC_SYM_TERROR;
+  }
+  return args[0];
+}
+
+static inline int16_t op_i16(vec_op_t op, int16_t x, int16_t y) {
+  switch (op) {
+  case VEC_ADD: return sat_i16_i32((int32_t)x + (int32_t)y);
+  case VEC_SUB: return sat_i16_i32((int32_t)x - (int32_t)y);
+  default:      return sat_i16_i32((int32_t)x * (int32_t)y);
+  }
+}
+
+static lbm_value vec_elementwise_i16(lbm_value *args, lbm_uint argn, vec_op_t op) {
+  vec_t d, a, b;
+  if (argn != 3 ||
+      !get_vec(args[0], sizeof(int16_t), true, &d) ||
+      !get_vec(args[1], sizeof(int16_t), false, &a)) {
+    return ENC_SYM_TERROR;
+  }
+  int16_t *dst = (int16_t*)d.data;
+  int16_t *x = (int16_t*)a.data;
+  lbm_uint n = min_n(d.n, a.n);
+
+  if (lbm_is_number(args[2])) {
+    int16_t k = sat_i16_i32(lbm_dec_as_i32(args[2]));
+    for (lbm_uint i = 0; i < n; i ++) dst[i] = op_i16(op, x[i], k);
+  } else if (get_vec(args[2], sizeof(int16_t), false, &b)) {
+    int16_t *y = (int16_t*)b.data;
+    n = min_n(n, b.n);
+    for (lbm_uint i = 0; i < n; i ++) dst[i] = op_i16(op, x[i], y[i]);
+  } else {
+    return ENC_SYM_TERROR;
+  }
+  return args[0];
+}
+
+static lbm_value ext_vec_add_f32(lbm_value *args, lbm_uint argn) {
+  return vec_elementwise_f32(args, argn, VEC_ADD);
+}
+
+static lbm_value ext_vec_sub_f32(lbm_value *args, lbm_uint argn) {
+  return vec_elementwise_f32(args, argn, VEC_SUB);
+}
+
+static lbm_value ext_vec_mul_f32(lbm_value *args, lbm_uint argn) {
+  return vec_elementwise_f32(args, argn, VEC_MUL);
+}
+
+static lbm_value ext_vec_add_i16(lbm_value *args, lbm_uint argn) {
+  return vec_elementwise_i16(args, argn, VEC_ADD);
+}
+
+static lbm_value ext_vec_sub_i16(lbm_value *args, lbm_uint argn) {
+  return vec_elementwise_i16(args, argn, VEC_SUB);
+}
+
+static lbm_value ext_vec_mul_i16(lbm_value *args, lbm_uint argn) {
+  return vec_elementwise_i16(args, argn, VEC_MUL);
+}
+
+// ////////////////////////////////////////////////////////////
+// Scale and offset
+//
+// (vec-scale-offset-x dst src scale offset) computes
+// dst = src * scale + offset. vec-i16-to-f32 and vec-f32-to-i16 do
+// the same while converting, for example from raw ADC samples to
+// currents. scale defaults to 1 and offset to 0. Results that do not
+// fit in an i16 saturate.
+
+static bool decode_scale_offset(lbm_value *args, lbm_uint argn, float *scale, float *offset) {
+  *scale = 1.0f;
+  *offset = 0.0f;
+  switch (argn) {
+  case 4:
+    if (!lbm_is_number(args[3])) return false;
+    *offset = lbm_dec_as_float(args[3]);
+    /* fall through */
+  case 3:
+    if (!lbm_is_number(args[2])) return false;
+    *scale = lbm_dec_as_float(args[2]);
+    /* fall through */
+  case 2:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static lbm_value ext_vec_scale_offset_f32(lbm_value *args, lbm_uint argn) {
+  vec_t d, s;
+  float scale, offset;
+  if (!decode_scale_offset(args, argn, &scale, &offset) ||
+      !get_vec(args[0], sizeof(float), true, &d) ||
+      !get_vec(args[1], sizeof(float), false, &s)) {
+    return ENC_SYM_TERROR;
+  }
+  float *dst = (float*)d.data;
+  float *src = (float*)s.data;
+  lbm_uint n = min_n(d.n, s.n);
+  for (lbm_uint i = 0; i < n; i ++) {
+    dst[i] = src[i] * scale + offset;
+  }
+  return args[0];
+}
+
+static lbm_value ext_vec_scale_offset_i16(lbm_value *args, lbm_uint argn) {
+  vec_t d, s;
+  float scale, offset;
+  if (!decode_scale_offset(args, argn, &scale, &offset) ||
+      !get_vec(args[0], sizeof(int16_t), true, &d) ||
+      !get_vec(args[1], sizeof(int16_t), false, &s)) {
+    return ENC_SYM_TERROR;
+  }
+  int16_t *dst = (int16_t*)d.data;
+  int16_t *src = (int16_t*)s.data;
+  lbm_uint n = min_n(d.n, s.n);
+  for (lbm_uint i = 0; i < n; i ++) {
+    dst[i] = sat_i16((float)src[i] * scale + offset);
+  }
+  return args[0];
+}
+
+static lbm_value ext_vec_i16_to_f32(lbm_value *args, lbm_uint argn) {
+  vec_t d, s;
+  float scale, offset;
+  if (!decode_scale_offset(args, argn, &scale, &offset) ||
+      !get_vec(args[0], sizeof(float), true, &d) ||
+      !get_vec(args[1], sizeof(int16_t), false, &s)) {
+    return ENC_SYM_TERROR;
+  }
+  if (d.data == s.data) return ENC_SYM_EERROR;
+  float *dst = (float*)d.data;
+  int16_t *src = (int16_t*)s.data;
+  lbm_uint n = min_n(d.n, s.n);
+  for (lbm_uint i = 0; i < n; i ++) {
+    dst[i] = (float)src[i] * scale + offset;
+  }
+  return args[0];
+}
+
+static lbm_value ext_vec_f32_to_i16(lbm_value *args, lbm_uint argn) {
+  vec_t d, s;
+  float scale, offset;
+  if (!decode_scale_offset(args, argn, &scale, &offset) ||
+      !get_vec(args[0], sizeof(int16_t), true, &d) ||
+      !get_vec(args[1], sizeof(float), false, &s)) {
+    return ENC_SYM_TERROR;
+  }
+  // Each i16 written is behind the float it came from, so converting
+  // in place is fine.
+  int16_t *dst = (int16_t*)d.data;
+  float *src = (float*)s.data;
+  lbm_uint n = min_n(d.n, s.n);
+  for (lbm_uint i = 0; i < n; i ++) {
+    dst[i] = sat_i16(src[i] * scale + offset);
+  }
+  return args[0];
+}
+
+// ////////////////////////////////////////////////////////////
+// Filters
+
+// (vec-fir-f32 dst src taps opt-hist)
+// dst[i] = sum over k of taps[k] * src[i - k]. Samples before the
+// start of src are taken from opt-hist, which holds at least
+// (length taps) - 1 floats with the most recent sample last, and is
+// updated with the last samples of src so that consecutive blocks can
+// be filtered. Without opt-hist those samples are zero. dst and src
+// must be different arrays.
+static lbm_value ext_vec_fir_f32(lbm_value *args, lbm_uint argn) {
+  vec_t d, s, t, h;
+  if ((argn != 3 && argn != 4) ||
+      !get_vec(args[0], sizeof(float), true, &d) ||
+      !get_vec(args[1], sizeof(float), false, &s) ||
+      !get_vec(args[2], sizeof(float), false, &t)) {
+    return ENC_SYM_TERROR;
+  }
+  if (t.n == 0 || d.data == s.data) return ENC_SYM_EERROR;
+  lbm_uint m = t.n - 1;
+  float *hist = NULL;
+  if (argn == 4) {
+    if (!get_vec(args[3], sizeof(float), true, &h)) return ENC_SYM_TERROR;
+    if (h.n < m) return ENC_SYM_EERROR;
+    hist = (float*)h.data + (h.n - m);
+  }
+
+  float *dst = (float*)d.data;
+  float *src = (float*)s.data;
+  float *taps = (float*)t.data;
+  lbm_uint n = min_n(d.n, s.n);
+
+  lbm_uint head = min_n(m, n);
+  for (lbm_uint i = 0; i < head; i ++) {
+    float acc = 0.0f;
+    for (lbm_uint k = 0; k <= i; k ++) {
+      acc += taps[k] * src[i - k];
+    }
+    if (hist) {
+      for (lbm_uint k = i + 1; k <= m; k ++) {
+        acc += taps[k] * hist[m + i - k];
+      }
+    }
+    dst[i] = acc;
+  }
+  for (lbm_uint i = head; i < n; i ++) {
+    float acc = 0.0f;
+    for (lbm_uint k = 0; k <= m; k ++) {
+      acc += taps[k] * src[i - k];
+    }
+    dst[i] = acc;
+  }
+
+  if (hist && m > 0) {
+    if (n >= m) {
+      memcpy(hist, src + (n - m), m * sizeof(float));
+    } else {
+      memmove(hist, hist + n, (m - n) * sizeof(float));
+      memcpy(hist + (m - n), src, n * sizeof(float));
+    }
+  }
+  return args[0];
+}
+
+// (vec-biquad-f32 dst src bq)
+// bq is an array of LBM_VEC_BIQUAD_SIZE floats: a0 a1 a2 b1 b2 z1 z2,
+// with the same meaning as the Biquad struct in the VESC firmware
+// (a feed forward, b feedback, transposed direct form II). The state
+// z1 z2 is updated. dst may be src.
+static lbm_value ext_vec_biquad_f32(lbm_value *args, lbm_uint argn) {
+  vec_t d, s, q;
+  if (argn != 3 ||
+      !get_vec(args[0], sizeof(float), true, &d) ||
+      !get_vec(args[1], sizeof(float), false, &s) ||
+      !get_vec(args[2], sizeof(float), true, &q)) {
+    return ENC_SYM_TERROR;
+  }
+  if (q.n < LBM_VEC_BIQUAD_SIZE) return ENC_SYM_EERROR;
+
+  float *bq = (float*)q.data;
+  const float a0 = bq[0], a1 = bq[1], a2 = bq[2], b1 = bq[3], b2 = bq[4];
+  float z1 = bq[5], z2 = bq[6];
+
+  float *dst = (float*)d.data;
+  float *src = (float*)s.data;
+  lbm_uint n = min_n(d.n, s.n);
+  for (lbm_uint i = 0; i < n; i ++) {
+    float in = src[i];
+    float out = in * a0 + z1;
+    z1 = in * a1 + z2 - b1 * out;
+    z2 = in * a2 - b2 * out;
+    dst[i] = out;
+  }
+  bq[5] = z1;
+  bq[6] = z2;
+  return args[0];
+}
+
+bool lbm_vector_extensions_init(void) {
+  bool res = true;
+  res = res && lbm_add_extension("vec-sum-f32", ext_vec_sum_f32);
+  res = res && lbm_add_extension("vec-mean-f32", ext_vec_mean_f32);
+  res = res && lbm_add_extension("vec-min-f32", ext_vec_min_f32);
+  res = res && lbm_add_extension("vec-max-f32", ext_vec_max_f32);
+  res = res && lbm_add_extension("vec-dot-f32", ext_vec_dot_f32);
+  res = res && lbm_add_extension("vec-sum-i16", ext_vec_sum_i16);
+  res = res && lbm_add_extension("vec-mean-i16", ext_vec_mean_i16);
+  res = res && lbm_add_extension("vec-min-i16", ext_vec_min_i16);
+  res = res && lbm_add_extension("vec-max-i16", ext_vec_max_i16);
+  res = res && lbm_add_extension("vec-dot-i16", ext_vec_dot_i16);
+
+  res = res && lbm_add_extension("vec-add-f32", ext_vec_add_f32);
+  res = res && lbm_add_extension("vec-sub-f32", ext_vec_sub_f32);
+  res = res && lbm_add_extension("vec-mul-f32", ext_vec_mul_f32);
+  res = res && lbm_add_extension("vec-add-i16", ext_vec_add_i16);
+  res = res && lbm_add_extension("vec-sub-i16", ext_vec_sub_i16);
+  res = res && lbm_add_extension("vec-mul-i16", ext_vec_mul_i16);
+
+  res = res && lbm_add_extension("vec-scale-offset-f32", ext_vec_scale_offset_f32);
+  res = res && lbm_add_extension("vec-scale-offset-i16", ext_vec_scale_offset_i16);
+  res = res && lbm_add_extension("vec-i16-to-f32", ext_vec_i16_to_f32);
+  res = res && lbm_add_extension("vec-f32-to-i16", ext_vec_f32_to_i16);
+
+  res = res && lbm_add_extension("vec-fir-f32", ext_vec_fir_f32);
+  res = res && lbm_add_extension("vec-biquad-f32", ext_vec_biquad_f32);
+  return res;
+}
@@ -729,7 +729,7 @@ static lbm_value fundamental_undefine(lbm_value *args, lbm_uint nargs, eval_cont
   lbm_value *global_env = lbm_get_global_env();
   if (nargs == 1 && lbm_is_symbol(args[0])) {
     lbm_value key = args[0];
-    lbm_uint ix_key = lbm_dec_sym(key) & GLOBAL_ENV_MASK;
+    lbm_uint ix_key = lbm_global_env_ix(lbm_dec_sym(key));
     lbm_value env = global_env[ix_key];
     lbm_value res = lbm_env_drop_binding(env, key);
     if (res == ENC_SYM_NOT_FOUND) {
@@ -741,7 +741,7 @@ static lbm_value fundamental_undefine(lbm_value *args, lbm_uint nargs, eval_cont
     lbm_value curr = args[0];
     while (lbm_type_of(curr) == LBM_TYPE_CONS) {
       lbm_value key = lbm_car(curr);
-      lbm_uint ix_key = lbm_dec_sym(key) & GLOBAL_ENV_MASK;
+      lbm_uint ix_key = lbm_global_env_ix(lbm_dec_sym(key));
       lbm_value env = global_env[ix_key];
       lbm_value res = lbm_env_drop_binding(env, key);
       if (res != ENC_SYM_NOT_FOUND) {
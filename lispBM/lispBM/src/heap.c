@@ -78,6 +78,41 @@ static inline lbm_value lbm_clr_gc_flag(lbm_value x) {
   return x & ~LBM_GC_MASK;
 }
 
+// Mark bits as seen by the collector, indexed by heap cell.
+// The incremental collector keeps the mark bits in a separate bitmap
+// as the evaluator runs between sweep steps and must not see marks
+// in the cdr fields of unswept cells.
+#ifdef LBM_USE_GC_INCREMENTAL
+#ifdef LBM_USE_GC_PTR_REV
+#error "LBM_USE_GC_INCREMENTAL is not supported together with LBM_USE_GC_PTR_REV"
+#endif
+#define GC_BITMAP_BITS (sizeof(lbm_uint) * 8)
+
+static inline bool gc_cell_marked(lbm_uint ix) {
+  return (lbm_heap_state.gc_bitmap[ix / GC_BITMAP_BITS] >> (ix % GC_BITMAP_BITS)) & 1;
+}
+
+static inline void gc_cell_set_mark(lbm_uint ix) {
+  lbm_heap_state.gc_bitmap[ix / GC_BITMAP_BITS] |= (lbm_uint)1 << (ix % GC_BITMAP_BITS);
+}
+
+static inline void gc_cell_clr_mark(lbm_uint ix) {
+  lbm_heap_state.gc_bitmap[ix / GC_BITMAP_BITS] &= ~((lbm_uint)1 << (ix % GC_BITMAP_BITS));
+}
+#else
+static inline bool gc_cell_marked(lbm_uint ix) {
+  return lbm_get_gc_mark(lbm_heap_state.heap[ix].cdr);
+}
+
+static inline void gc_cell_set_mark(lbm_uint ix) {
+  lbm_heap_state.heap[ix].cdr = lbm_set_gc_mark(lbm_heap_state.heap[ix].cdr);
+}
+
+static inline void gc_cell_clr_mark(lbm_uint ix) {
+  lbm_heap_state.heap[ix].cdr = lbm_clr_gc_mark(lbm_heap_state.heap[ix].cdr);
+}
+#endif
+
 
 lbm_heap_state_t lbm_heap_state;
 
@@ -129,7 +164,16 @@ lbm_value lbm_enc_u32(uint32_t x) {
 }
 
 lbm_value lbm_enc_float(float x) {
-#ifndef LBM64
+#if defined(LBM_USE_IMMEDIATE_FLOAT) && !defined(LBM64)
+  uint32_t t;
+  memcpy(&t, &x, sizeof(float));
+  if ((t & 0x7F800000u) == 0x7F800000u && (t & 0x007FFFFFu)) {
+    t |= 0x00400000u; // Keep NaN a NaN when the low mantissa bits are dropped.
+  } else {
+    t += 0x7Fu + ((t >> 8) & 1u); // Round to nearest, ties to even.
+  }
+  return ((lbm_value)(t >> 8) << LBM_ADDRESS_SHIFT) | LBM_TYPE_FLOAT | LBM_PTR_BIT;
+#elif !defined(LBM64)
   lbm_uint t;
   memcpy(&t, &x, sizeof(lbm_float));
   lbm_value f = lbm_cons(t, ENC_SYM_RAW_F_TYPE);
@@ -196,7 +240,12 @@ lbm_value lbm_enc_double(double x) {
 // that the decoder decodes.
 
 float lbm_dec_float(lbm_value x) {
-#ifndef LBM64
+#if defined(LBM_USE_IMMEDIATE_FLOAT) && !defined(LBM64)
+  uint32_t tmp = (uint32_t)((x & LBM_PTR_VAL_MASK) >> LBM_ADDRESS_SHIFT) << 8;
+  float f_tmp;
+  memcpy(&f_tmp, &tmp, sizeof(float));
+  return f_tmp;
+#elif !defined(LBM64)
   float f_tmp;
   lbm_uint tmp = lbm_car(x);
   memcpy(&f_tmp, &tmp, sizeof(float));
@@ -604,6 +653,15 @@ int lbm_heap_init(lbm_cons_t *addr, lbm_uint num_cells,
   heap_init_state(addr, num_cells,
                   gc_stack_storage, gc_stack_size);
 
+#ifdef LBM_USE_GC_INCREMENTAL
+  lbm_uint bitmap_words = (num_cells + GC_BITMAP_BITS - 1) / GC_BITMAP_BITS;
+  lbm_heap_state.gc_bitmap = (lbm_uint*)lbm_malloc(bitmap_words * sizeof(lbm_uint));
+  if (lbm_heap_state.gc_bitmap == NULL) return 0;
+  memset(lbm_heap_state.gc_bitmap, 0, bitmap_words * sizeof(lbm_uint));
+  lbm_heap_state.gc_sweep_ix = 0;
+  lbm_heap_state.gc_sweeping = false;
+#endif
+
   lbm_heaps[0] = addr;
 
   return generate_freelist(num_cells);
@@ -821,6 +879,10 @@ extern eval_context_t *ctx_running;
 void lbm_gc_mark_phase(lbm_value root) {
   lbm_value t_ptr;
   lbm_stack_t *s = &lbm_heap_state.gc_stack;
+#ifdef LBM_USE_GC_INCREMENTAL
+  // Marks from a previous cycle must be gone before marking.
+  lbm_gc_sweep_finish();
+#endif
   s->data[s->sp++] = root;
 
   while (!lbm_stack_is_empty(s)) {
@@ -834,9 +896,10 @@ void lbm_gc_mark_phase(lbm_value root) {
       continue;
     }
 
-    lbm_cons_t *cell = &lbm_heap_state.heap[lbm_dec_ptr(curr)];
+    lbm_uint cell_ix = lbm_dec_ptr(curr);
+    lbm_cons_t *cell = &lbm_heap_state.heap[cell_ix];
 
-    if (lbm_get_gc_mark(cell->cdr)) {
+    if (gc_cell_marked(cell_ix)) {
       continue;
     }
 
@@ -856,8 +919,7 @@ void lbm_gc_mark_phase(lbm_value root) {
         // 2. Any other ptr is marked immediately and index is increased.
         if (lbm_is_ptr(arrdata[index]) && ((arrdata[index] & LBM_PTR_TO_CONSTANT_BIT) == 0) &&
             !((arrdata[index] & LBM_CONTINUATION_INTERNAL) == LBM_CONTINUATION_INTERNAL)) {
-          lbm_cons_t *elt = &lbm_heap_state.heap[lbm_dec_ptr(arrdata[index])];
-          if (!lbm_get_gc_mark(elt->cdr)) {
+          if (!gc_cell_marked(lbm_dec_ptr(arrdata[index]))) {
             curr = arrdata[index];
             goto mark_shortcut;
           }
@@ -869,11 +931,11 @@ void lbm_gc_mark_phase(lbm_value root) {
         arr->index = 0;
         lbm_pop(s, &curr); // Remove array from GC stack as we are done marking it.
       }
-      cell->cdr = lbm_set_gc_mark(cell->cdr);
+      gc_cell_set_mark(cell_ix);
       lbm_heap_state.gc_marked ++;
       continue;
     } else if (t_ptr == LBM_TYPE_CHANNEL) {
-      cell->cdr = lbm_set_gc_mark(cell->cdr);
+      gc_cell_set_mark(cell_ix);
       lbm_heap_state.gc_marked ++;
       // TODO: Can channels be explicitly freed ?
       if (cell->car != ENC_SYM_NIL) {
@@ -884,7 +946,7 @@ void lbm_gc_mark_phase(lbm_value root) {
       continue;
     }
 
-    cell->cdr = lbm_set_gc_mark(cell->cdr);
+    gc_cell_set_mark(cell_ix);
     lbm_heap_state.gc_marked ++;
 
     if (t_ptr == LBM_TYPE_CONS) {
@@ -906,12 +968,15 @@ void lbm_gc_mark_env(lbm_value env) {
   lbm_value curr = env;
   lbm_cons_t *c;
 
+#ifdef LBM_USE_GC_INCREMENTAL
+  lbm_gc_sweep_finish();
+#endif
   while (lbm_is_ptr(curr)) {
     c = lbm_ref_cell(curr);
-    c->cdr = lbm_set_gc_mark(c->cdr); // mark the environent list structure.
+    gc_cell_set_mark(lbm_dec_ptr(curr));   // mark the environent list structure.
     lbm_cons_t *b = lbm_ref_cell(c->car);
-    b->cdr = lbm_set_gc_mark(b->cdr); // mark the binding list head cell.
-    lbm_gc_mark_phase(b->cdr);        // mark the bound object.
+    gc_cell_set_mark(lbm_dec_ptr(c->car)); // mark the binding list head cell.
+    lbm_gc_mark_phase(b->cdr);             // mark the bound object.
     lbm_heap_state.gc_marked +=2;
     curr = c->cdr;
   }
@@ -938,14 +1003,18 @@ void lbm_gc_mark_roots(lbm_uint *roots, lbm_uint num_roots) {
   }
 }
 
+bool lbm_gc_is_marked(lbm_value x) {
+  if (!lbm_is_ptr(x) || (x & LBM_PTR_TO_CONSTANT_BIT)) return true;
+  return gc_cell_marked(lbm_dec_ptr(x));
+}
+
 // Sweep moves non-marked heap objects to the free list.
-int lbm_gc_sweep_phase(void) {
-  unsigned int i = 0;
+static void gc_sweep_range(lbm_uint from, lbm_uint to) {
   lbm_cons_t *heap = (lbm_cons_t *)lbm_heap_state.heap;
 
-  for (i = 0; i < lbm_heap_state.heap_size; i ++) {
-    if ( lbm_get_gc_mark(heap[i].cdr)) {
-      heap[i].cdr = lbm_clr_gc_mark(heap[i].cdr);
+  for (lbm_uint i = from; i < to; i ++) {
+    if (gc_cell_marked(i)) {
+      gc_cell_clr_mark(i);
     } else {
       // Check if this cell is a pointer to an array
       // and free it.
@@ -997,9 +1066,54 @@ int lbm_gc_sweep_phase(void) {
       lbm_heap_state.gc_recovered ++;
     }
   }
+}
+
+int lbm_gc_sweep_phase(void) {
+  gc_sweep_range(0, lbm_heap_state.heap_size);
   return 1;
 }
 
+#ifdef LBM_USE_GC_INCREMENTAL
+// The cells on the freelist are not reachable from any root. They are
+// marked so that the sweep leaves them on the freelist, and that way
+// cells that are allocated from it before the sweep reaches them stay
+// alive as well. Cells recovered by the sweep are behind the sweep
+// index and are never looked at again during the same cycle.
+void lbm_gc_sweep_begin(void) {
+  lbm_value curr = lbm_heap_state.freelist;
+  while (lbm_is_ptr(curr)) {
+    lbm_uint ix = lbm_dec_ptr(curr);
+    gc_cell_set_mark(ix);
+    curr = lbm_heap_state.heap[ix].cdr;
+  }
+  lbm_heap_state.gc_sweep_ix = 0;
+  lbm_heap_state.gc_sweeping = true;
+}
+
+bool lbm_gc_sweep_step(lbm_uint n) {
+  if (!lbm_heap_state.gc_sweeping) return true;
+  lbm_uint from = lbm_heap_state.gc_sweep_ix;
+  lbm_uint to = from + n;
+  if (to >= lbm_heap_state.heap_size) {
+    to = lbm_heap_state.heap_size;
+    lbm_heap_state.gc_sweeping = false;
+  }
+  gc_sweep_range(from, to);
+  lbm_heap_state.gc_sweep_ix = to;
+  return !lbm_heap_state.gc_sweeping;
+}
+
+void lbm_gc_sweep_finish(void) {
+  if (lbm_heap_state.gc_sweeping) {
+    lbm_gc_sweep_step(lbm_heap_state.heap_size);
+  }
+}
+
+bool lbm_gc_sweep_pending(void) {
+  return lbm_heap_state.gc_sweeping;
+}
+#endif
+
 void lbm_gc_state_inc(void) {
   lbm_heap_state.gc_num ++;
   lbm_heap_state.gc_recovered = 0;
@@ -0,0 +1,1018 @@
+/*
+    Copyright 2025 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lbm_bytecode.h"
+
+#ifdef LBM_USE_BYTECODE
+
+#include <string.h>
+#include <stdint.h>
+
+#include "lbm_defines.h"
+#include "heap.h"
+#include "env.h"
+
+#if !defined(__GNUC__)
+#error "LBM_USE_BYTECODE requires a compiler with computed goto (GCC or clang)"
+#endif
+
+/* Instructions
+   ------------
+   Code is an array of lbm_uint. Each instruction is the address of its
+   handler in bc_run (direct threading) followed by its operands.
+   Jump targets are addresses into the code array.
+
+   Frame layout on the VM stack, fp indexes the first word:
+     fp + 0      : return address (NULL when returning to the caller of bc_run)
+     fp + 1      : caller fp (encoded as lbm_u)
+     fp + 2      : closure environment, for free variables
+     fp + 3 ...  : parameters followed by let and loop variables
+   and the evaluation stack of the function after that.
+
+   Suspended applications
+   ----------------------
+   When an application runs out of budget, the VM stack is saved in a
+   lisp array that the evaluator keeps on the continuation stack, and
+   the application is resumed from there later. The array only holds
+   values, so return addresses and pc are saved as offsets into
+   code_area. Saved state refers to code that is only valid until the
+   next cache flush or eviction, which is detected with code_gen.
+
+   An application that runs out of memory stops at the instruction
+   that failed and stays on vm_stack, as there may not be room for a
+   saved state. The evaluator collects garbage and continues it with
+   what is left of the budget.
+*/
+
+typedef enum {
+  OP_CONST = 0,  // v     : push v
+  OP_LOCAL,      // i     : push local i
+  OP_SET_LOCAL,  // i     : local i = top
+  OP_FREE,       // sym   : push value of sym in closure or global env
+  OP_POP,        //       : drop top
+  OP_JMP,        // addr
+  OP_JMP_NIL,    // addr  : pop, jump if nil
+  OP_AND,        // addr  : jump if top is nil, otherwise pop
+  OP_OR,         // addr  : jump if top is not nil, otherwise pop
+  OP_ADD,        //       : two argument fundamentals with a fast path
+  OP_SUB,        //         for lbm_i operands.
+  OP_NUMEQ,
+  OP_LT,
+  OP_GT,
+  OP_LEQ,
+  OP_GEQ,
+  OP_FUND,       // ix n  : call fundamental ix on the top n values
+  OP_CALL,       // n     : call function below the top n values
+  OP_TAIL_CALL,  // n     : as OP_CALL but replaces the current frame
+  OP_RET,        //       : return top to the caller
+  OP_NUM
+} bc_op_t;
+
+static const uint8_t op_num_operands[OP_NUM] =
+  {1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 0};
+
+#define FRAME_HEADER 3
+
+typedef struct {
+  lbm_value params;
+  lbm_value body;
+  lbm_uint *code;       // NULL if the closure cannot be compiled.
+  uint16_t num_params;
+  uint16_t num_locals;  // Including the parameters.
+  uint16_t max_stack;   // Evaluation stack depth needed.
+  bool     failed;      // Has been handed back to CPS and should not be tried again.
+} bc_entry_t;
+
+static bc_entry_t cache[LBM_BYTECODE_CACHE_SIZE];
+// Compiled code is bump allocated from code_area. When it is full the
+// whole cache is flushed. Keeping code out of lbm_memory means that
+// compilation does not show up as lbm_memory use in programs.
+static lbm_uint code_area[LBM_BYTECODE_CODE_SIZE];
+static lbm_uint code_used = 0;
+static lbm_bytecode_stats_t stats;
+
+// The GC never runs while bc_run is active. The values on vm_stack
+// are only marked while an application that ran out of memory is
+// parked, waiting for the evaluator to collect garbage.
+static lbm_value vm_stack[LBM_BYTECODE_STACK_SIZE];
+static bool      vm_running = false;
+static bool      vm_parked = false;
+
+static const void *const *op_addr = NULL;
+
+typedef enum {
+  BC_DONE,
+  BC_FAILED,     // Hand back to CPS and do not try this closure again.
+  BC_NO_MEM,     // Out of memory, can be continued at susp_pc after GC.
+  BC_SUSPENDED,  // Out of budget, can be resumed at susp_pc.
+} bc_result_t;
+
+static lbm_uint code_gen = 0;  // Incremented when suspended code may no longer be resumed.
+
+// Where bc_run stopped when it returned BC_SUSPENDED or BC_NO_MEM.
+static lbm_uint *susp_pc;
+static lbm_uint susp_sp;
+static lbm_uint susp_fp;
+static lbm_uint susp_budget;
+
+// Saved state: code_gen, pc, fp, sp and then the VM stack.
+#define STATE_HEADER 4
+
+static bc_result_t bc_run(lbm_uint *pc, lbm_uint sp, lbm_uint fp, lbm_uint budget, eval_context_t *ctx, lbm_value *res);
+
+static bool is_pure_fundamental(lbm_uint sym) {
+  switch (sym) {
+  case SYM_ADD: case SYM_SUB: case SYM_MUL: case SYM_DIV: case SYM_MOD:
+  case SYM_EQ: case SYM_NOT_EQ: case SYM_NUMEQ: case SYM_NUM_NOT_EQ:
+  case SYM_LT: case SYM_GT: case SYM_LEQ: case SYM_GEQ: case SYM_NOT:
+  case SYM_CONS: case SYM_CAR: case SYM_CDR: case SYM_LIST: case SYM_APPEND:
+  case SYM_ASSOC: case SYM_ACONS: case SYM_COSSA: case SYM_IX:
+  case SYM_TO_I: case SYM_TO_I32: case SYM_TO_U: case SYM_TO_U32:
+  case SYM_TO_FLOAT: case SYM_TO_I64: case SYM_TO_U64: case SYM_TO_DOUBLE:
+  case SYM_TO_BYTE: case SYM_SHL: case SYM_SHR: case SYM_BITWISE_AND:
+  case SYM_BITWISE_OR: case SYM_BITWISE_XOR: case SYM_BITWISE_NOT:
+  case SYM_TYPE_OF: case SYM_LIST_LENGTH: case SYM_RANGE: case SYM_TAKE:
+  case SYM_DROP: case SYM_IS_LIST: case SYM_IS_NUMBER: case SYM_INT_DIV:
+  case SYM_IDENTITY: case SYM_IS_STRING:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/****************************************************/
+/* Compiler                                         */
+
+#define MAX_LOCALS 32
+
+// Code is emitted directly into the free part of code_area.
+typedef struct {
+  lbm_uint  *code;
+  lbm_uint  size;              // Room for code at code.
+  bool      full;              // Ran out of room.
+  lbm_uint  pos;
+  lbm_value scope[MAX_LOCALS]; // Symbol of each slot, innermost last.
+  lbm_uint  num_scope;
+  lbm_uint  max_locals;
+  lbm_uint  depth;
+  lbm_uint  max_depth;
+} compiler_t;
+
+static compiler_t comp;
+
+static bool emit(lbm_uint w) {
+  if (comp.pos >= comp.size) {
+    comp.full = true;
+    return false;
+  }
+  comp.code[comp.pos++] = w;
+  return true;
+}
+
+static bool emit_op(bc_op_t op, int depth_change) {
+  comp.depth = (lbm_uint)((int)comp.depth + depth_change);
+  if (comp.depth > comp.max_depth) comp.max_depth = comp.depth;
+  return emit(op);
+}
+
+static bool emit_op1(bc_op_t op, lbm_uint a, int depth_change) {
+  return emit_op(op, depth_change) && emit(a);
+}
+
+static void patch(lbm_uint at, lbm_uint target) {
+  comp.code[at] = target;
+}
+
+static int find_local(lbm_value sym) {
+  for (int i = (int)comp.num_scope - 1; i >= 0; i --) {
+    if (comp.scope[i] == sym) return i;
+  }
+  return -1;
+}
+
+static bool push_local(lbm_value sym) {
+  if (!lbm_is_symbol(sym) || sym == ENC_SYM_NIL || sym == ENC_SYM_DONTCARE) return false;
+  if (comp.num_scope >= MAX_LOCALS) return false;
+  comp.scope[comp.num_scope++] = sym;
+  if (comp.num_scope > comp.max_locals) comp.max_locals = comp.num_scope;
+  return true;
+}
+
+static bool compile_exp(lbm_value exp, bool tail);
+
+static bool compile_ret(bool tail) {
+  return !tail || emit_op(OP_RET, 0);
+}
+
+// Compile a list of expressions and push their values. Returns the
+// number of values or -1.
+static int compile_args(lbm_value args) {
+  int n = 0;
+  while (lbm_is_cons(args)) {
+    if (!compile_exp(lbm_car(args), false)) return -1;
+    n ++;
+    args = lbm_cdr(args);
+  }
+  return lbm_is_symbol_nil(args) ? n : -1;
+}
+
+static bool compile_progn(lbm_value exps, bool tail) {
+  if (lbm_is_symbol_nil(exps)) {
+    return emit_op1(OP_CONST, ENC_SYM_NIL, 1) && compile_ret(tail);
+  }
+  while (lbm_is_cons(exps)) {
+    lbm_value rest = lbm_cdr(exps);
+    if (lbm_is_cons(rest)) {
+      if (!compile_exp(lbm_car(exps), false) ||
+          !emit_op(OP_POP, -1)) return false;
+    } else {
+      return compile_exp(lbm_car(exps), tail);
+    }
+    exps = rest;
+  }
+  return false;
+}
+
+static bool compile_if(lbm_value cond, lbm_value then_exp, lbm_value else_exp, bool tail) {
+  if (!compile_exp(cond, false) ||
+      !emit_op1(OP_JMP_NIL, 0, -1)) return false;
+  lbm_uint else_patch = comp.pos - 1;
+  if (!compile_exp(then_exp, tail)) return false;
+  lbm_uint end_patch = 0;
+  if (!tail) {
+    if (!emit_op1(OP_JMP, 0, 0)) return false;
+    end_patch = comp.pos - 1;
+    comp.depth --; // Only one of the branches pushes a value.
+  }
+  patch(else_patch, comp.pos);
+  if (!compile_exp(else_exp, tail)) return false;
+  if (!tail) patch(end_patch, comp.pos);
+  return true;
+}
+
+static bool compile_cond(lbm_value clauses, bool tail) {
+  if (lbm_is_symbol_nil(clauses)) {
+    return emit_op1(OP_CONST, ENC_SYM_NIL, 1) && compile_ret(tail);
+  }
+  lbm_value clause = lbm_car(clauses);
+  if (lbm_list_length(clause) != 2) return false;
+  if (!compile_exp(lbm_car(clause), false) ||
+      !emit_op1(OP_JMP_NIL, 0, -1)) return false;
+  lbm_uint else_patch = comp.pos - 1;
+  if (!compile_exp(lbm_cadr(clause), tail)) return false;
+  lbm_uint end_patch = 0;
+  if (!tail) {
+    if (!emit_op1(OP_JMP, 0, 0)) return false;
+    end_patch = comp.pos - 1;
+    comp.depth --;
+  }
+  patch(else_patch, comp.pos);
+  if (!compile_cond(lbm_cdr(clauses), tail)) return false;
+  if (!tail) patch(end_patch, comp.pos);
+  return true;
+}
+
+// Bindings are added to the scope one at a time, so a binding
+// expression sees the bindings before it. This is what the CPS
+// evaluator does for everything except closures, which are not
+// supported here.
+static bool compile_bindings(lbm_value binds) {
+  while (lbm_is_cons(binds)) {
+    lbm_value b = lbm_car(binds);
+    if (lbm_list_length(b) != 2) return false;
+    if (!compile_exp(lbm_cadr(b), false)) return false;
+    if (!push_local(lbm_car(b))) return false;
+    if (!emit_op1(OP_SET_LOCAL, comp.num_scope - 1, 0) ||
+        !emit_op(OP_POP, -1)) return false;
+    binds = lbm_cdr(binds);
+  }
+  return lbm_is_symbol_nil(binds);
+}
+
+static bool compile_let(lbm_value binds, lbm_value body, bool tail) {
+  lbm_uint scope = comp.num_scope;
+  bool r = compile_bindings(binds) && compile_exp(body, tail);
+  comp.num_scope = scope;
+  return r;
+}
+
+// (loop binds cond body) evaluates to nil.
+static bool compile_loop(lbm_value binds, lbm_value cond, lbm_value body, bool tail) {
+  lbm_uint scope = comp.num_scope;
+  if (!compile_bindings(binds)) return false;
+  lbm_uint top = comp.pos;
+  if (!compile_exp(cond, false) ||
+      !emit_op1(OP_JMP_NIL, 0, -1)) return false;
+  lbm_uint exit_patch = comp.pos - 1;
+  if (!compile_exp(body, false) ||
+      !emit_op(OP_POP, -1) ||
+      !emit_op1(OP_JMP, top, 0)) return false;
+  patch(exit_patch, comp.pos);
+  comp.num_scope = scope;
+  return emit_op1(OP_CONST, ENC_SYM_NIL, 1) && compile_ret(tail);
+}
+
+static bool compile_and_or(bc_op_t op, lbm_value exps, bool tail) {
+  if (lbm_is_symbol_nil(exps)) {
+    return emit_op1(OP_CONST, op == OP_AND ? ENC_SYM_TRUE : ENC_SYM_NIL, 1) &&
+      compile_ret(tail);
+  }
+  lbm_uint patches[16];
+  lbm_uint num_patches = 0;
+  while (lbm_is_cons(exps)) {
+    if (!compile_exp(lbm_car(exps), false)) return false;
+    exps = lbm_cdr(exps);
+    if (lbm_is_cons(exps)) {
+      if (num_patches >= 16 || !emit_op1(op, 0, -1)) return false;
+      patches[num_patches++] = comp.pos - 1;
+    }
+  }
+  for (lbm_uint i = 0; i < num_patches; i ++) {
+    patch(patches[i], comp.pos);
+  }
+  return compile_ret(tail);
+}
+
+static bool compile_special(lbm_value exp, lbm_uint sym, bool tail) {
+  lbm_value args = lbm_cdr(exp);
+  switch (sym) {
+  case SYM_QUOTE:
+    return emit_op1(OP_CONST, lbm_car(args), 1) && compile_ret(tail);
+  case SYM_PROGN:
+    return compile_progn(args, tail);
+  case SYM_IF:
+    return compile_if(lbm_car(args), lbm_cadr(args), lbm_car(lbm_cdr(lbm_cdr(args))), tail);
+  case SYM_COND:
+    return compile_cond(args, tail);
+  case SYM_LET:
+    return compile_let(lbm_car(args), lbm_cadr(args), tail);
+  case SYM_LOOP:
+    return compile_loop(lbm_car(args), lbm_cadr(args), lbm_car(lbm_cdr(lbm_cdr(args))), tail);
+  case SYM_AND:
+    return compile_and_or(OP_AND, args, tail);
+  case SYM_OR:
+    return compile_and_or(OP_OR, args, tail);
+  case SYM_SETQ: {
+    int slot = find_local(lbm_car(args));
+    if (slot < 0) return false; // Only local variables can be set.
+    return compile_exp(lbm_cadr(args), false) &&
+      emit_op1(OP_SET_LOCAL, (lbm_uint)slot, 0) &&
+      compile_ret(tail);
+  }
+  default:
+    return false;
+  }
+}
+
+static bool compile_fundamental_app(lbm_uint sym, lbm_value args, bool tail) {
+  if (!is_pure_fundamental(sym)) return false;
+  int n = compile_args(args);
+  if (n < 0) return false;
+  bc_op_t op = OP_NUM;
+  if (n == 2) {
+    switch (sym) {
+    case SYM_ADD:   op = OP_ADD; break;
+    case SYM_SUB:   op = OP_SUB; break;
+    case SYM_NUMEQ: op = OP_NUMEQ; break;
+    case SYM_LT:    op = OP_LT; break;
+    case SYM_GT:    op = OP_GT; break;
+    case SYM_LEQ:   op = OP_LEQ; break;
+    case SYM_GEQ:   op = OP_GEQ; break;
+    default: break;
+    }
+  }
+  bool r;
+  if (op != OP_NUM) {
+    r = emit_op(op, -1);
+  } else {
+    r = emit_op(OP_FUND, 1 - n) &&
+      emit(SYMBOL_IX(sym)) &&
+      emit((lbm_uint)n);
+  }
+  return r && compile_ret(tail);
+}
+
+static bool compile_exp(lbm_value exp, bool tail) {
+  if (lbm_is_symbol(exp)) {
+    if (lbm_dec_sym(exp) < RUNTIME_SYMBOLS_START) {
+      return emit_op1(OP_CONST, exp, 1) && compile_ret(tail);
+    }
+    int slot = find_local(exp);
+    if (slot >= 0) {
+      return emit_op1(OP_LOCAL, (lbm_uint)slot, 1) && compile_ret(tail);
+    }
+    return emit_op1(OP_FREE, exp, 1) && compile_ret(tail);
+  }
+  if (!lbm_is_cons(exp)) {
+    return emit_op1(OP_CONST, exp, 1) && compile_ret(tail);
+  }
+
+  lbm_value head = lbm_car(exp);
+  lbm_value args = lbm_cdr(exp);
+  if (lbm_is_symbol(head)) {
+    lbm_uint sym = lbm_dec_sym(head);
+    if ((head & ENC_SPECIAL_FORMS_MASK) == ENC_SPECIAL_FORMS_BIT) {
+      return compile_special(exp, sym, tail);
+    }
+    if (SYMBOL_KIND(sym) == SYMBOL_KIND_FUNDAMENTAL) {
+      return compile_fundamental_app(sym, args, tail);
+    }
+    if (sym < RUNTIME_SYMBOLS_START) {
+      return false; // Extensions and apply funs.
+    }
+  } else if (lbm_is_cons(head)) {
+    return false; // ((lambda ...) ...) and such.
+  }
+
+  if (!compile_exp(head, false)) return false;
+  int n = compile_args(args);
+  if (n < 0) return false;
+  if (tail) {
+    return emit_op1(OP_TAIL_CALL, (lbm_uint)n, -n);
+  }
+  return emit_op1(OP_CALL, (lbm_uint)n, -n);
+}
+
+// Replace opcodes with handler addresses and jump targets with code
+// addresses.
+static void link(lbm_uint *code, lbm_uint size) {
+  lbm_uint i = 0;
+  while (i < size) {
+    lbm_uint op = code[i];
+    code[i] = (lbm_uint)(uintptr_t)op_addr[op];
+    switch (op) {
+    case OP_JMP: case OP_JMP_NIL: case OP_AND: case OP_OR:
+      code[i+1] = (lbm_uint)(uintptr_t)&code[code[i+1]];
+      break;
+    default:
+      break;
+    }
+    i += 1 + op_num_operands[op];
+  }
+}
+
+static void cache_flush(bc_entry_t *keep) {
+  for (int i = 0; i < LBM_BYTECODE_CACHE_SIZE; i ++) {
+    if (&cache[i] != keep) {
+      memset(&cache[i], 0, sizeof(bc_entry_t));
+    }
+  }
+  code_used = 0;
+  code_gen ++;
+}
+
+static bool compile_at(bc_entry_t *e, lbm_uint *code, lbm_uint size) {
+  memset(&comp, 0, sizeof(compiler_t));
+  comp.code = code;
+  comp.size = size;
+  lbm_value p = e->params;
+  while (lbm_is_cons(p)) {
+    if (!push_local(lbm_car(p))) return false;
+    p = lbm_cdr(p);
+  }
+  if (!lbm_is_symbol_nil(p)) return false;
+  e->num_params = (uint16_t)comp.num_scope;
+  return compile_exp(e->body, true);
+}
+
+static bool compile(bc_entry_t *e) {
+  lbm_uint size = LBM_BYTECODE_CODE_SIZE - code_used;
+  if (size > LBM_BYTECODE_MAX_CODE) size = LBM_BYTECODE_MAX_CODE;
+  bool r = compile_at(e, &code_area[code_used], size);
+  if (!r && comp.full && size < LBM_BYTECODE_MAX_CODE && code_used > 0) {
+    // Out of room in code_area rather than too large. The code of
+    // other entries may be in use while running.
+    if (vm_running) return false;
+    cache_flush(e);
+    size = LBM_BYTECODE_MAX_CODE;
+    if (size > LBM_BYTECODE_CODE_SIZE) size = LBM_BYTECODE_CODE_SIZE;
+    r = compile_at(e, code_area, size);
+  }
+  if (!r) return false;
+
+  lbm_uint *code = &code_area[code_used];
+  code_used += comp.pos;
+  link(code, comp.pos);
+  e->code = code;
+  e->num_locals = (uint16_t)comp.max_locals;
+  e->max_stack = (uint16_t)comp.max_depth;
+  return true;
+}
+
+/****************************************************/
+/* Cache                                            */
+
+static inline lbm_uint cache_ix(lbm_value body) {
+  return (body >> LBM_ADDRESS_SHIFT) & (LBM_BYTECODE_CACHE_SIZE - 1);
+}
+
+#define CACHE_PROBES 4
+
+static bc_entry_t *cache_lookup(lbm_value body) {
+  lbm_uint ix = cache_ix(body);
+  for (int i = 0; i < CACHE_PROBES; i ++) {
+    bc_entry_t *e = &cache[(ix + (lbm_uint)i) & (LBM_BYTECODE_CACHE_SIZE - 1)];
+    if (e->body == body) return e;
+  }
+  return NULL;
+}
+
+// Find an entry for a closure, compiling it if needed. Entries are
+// only evicted outside of bc_run, as the code of an entry may be in
+// use there.
+static bc_entry_t *cache_get(lbm_value params, lbm_value body) {
+  bc_entry_t *e = cache_lookup(body);
+  if (e) {
+    return (e->params == params) ? e : NULL;
+  }
+  lbm_uint ix = cache_ix(body);
+  for (int i = 0; i < CACHE_PROBES; i ++) {
+    bc_entry_t *f = &cache[(ix + (lbm_uint)i) & (LBM_BYTECODE_CACHE_SIZE - 1)];
+    if (f->body == ENC_SYM_NIL) {
+      e = f;
+      break;
+    }
+  }
+  if (!e) {
+    if (vm_running) return NULL;
+    // The body of the evicted entry is no longer marked, which makes
+    // its code unsafe to resume.
+    e = &cache[ix];
+    code_gen ++;
+  }
+  memset(e, 0, sizeof(bc_entry_t));
+  e->params = params;
+  e->body = body;
+  if (compile(e)) {
+    stats.compiled ++;
+  } else {
+    stats.rejected ++;
+    e->failed = true;
+  }
+  return e;
+}
+
+void lbm_bytecode_init(void) {
+  memset(cache, 0, sizeof(cache));
+  code_used = 0;
+  code_gen ++;
+  memset(&stats, 0, sizeof(stats));
+  vm_running = false;
+  vm_parked = false;
+  if (!op_addr) {
+    lbm_value dummy;
+    bc_run(NULL, 0, 0, 0, NULL, &dummy);
+  }
+}
+
+void lbm_bytecode_prepare(lbm_value params, lbm_value body) {
+  cache_get(params, body);
+}
+
+// The cache is weak, entries are dropped when their closure is
+// garbage. While an application is parked or running, code of any
+// entry may be in use and all of them are kept.
+void lbm_bytecode_gc_mark(void) {
+  if (vm_parked || vm_running) {
+    for (int i = 0; i < LBM_BYTECODE_CACHE_SIZE; i ++) {
+      lbm_gc_mark_phase(cache[i].params);
+      lbm_gc_mark_phase(cache[i].body);
+    }
+  }
+  if (vm_parked) {
+    lbm_gc_mark_aux(vm_stack, susp_sp);
+  }
+}
+
+void lbm_bytecode_gc_clear(void) {
+  if (vm_parked || vm_running) return;
+  bool dropped = false;
+  for (int i = 0; i < LBM_BYTECODE_CACHE_SIZE; i ++) {
+    if (cache[i].body != ENC_SYM_NIL &&
+        (!lbm_gc_is_marked(cache[i].body) ||
+         !lbm_gc_is_marked(cache[i].params))) {
+      memset(&cache[i], 0, sizeof(bc_entry_t));
+      dropped = true;
+    }
+  }
+  // As for eviction, saved state may refer to the dropped code.
+  if (dropped) code_gen ++;
+}
+
+void lbm_bytecode_get_stats(lbm_bytecode_stats_t *s) {
+  *s = stats;
+}
+
+/****************************************************/
+/* Interpreter                                      */
+
+#define SUSPEND(res, at)                        \
+  {                                             \
+    susp_pc = (at);                             \
+    susp_sp = sp;                               \
+    susp_fp = fp;                               \
+    susp_budget = budget;                       \
+    return res;                                 \
+  }
+
+// A fundamental that runs out of memory is not retried here. The
+// instruction is redone when the application is continued after GC.
+#define CALL_FUNDAMENTAL(r, ix, args, n)                        \
+  r = fundamental_table[ix](args, n, ctx);                      \
+  if (lbm_is_error(r)) {                                        \
+    if (lbm_is_symbol_merror(r)) SUSPEND(BC_NO_MEM, pc);        \
+    return BC_FAILED;                                           \
+  }
+
+// Resolve a closure value to its entry. The environment of the
+// closure is returned in env.
+static bc_entry_t *closure_entry(lbm_value fun, lbm_value *env) {
+  if (!lbm_is_cons(fun) || lbm_car(fun) != ENC_SYM_CLOSURE) return NULL;
+  lbm_value rest = lbm_cdr(fun);
+  lbm_value params = lbm_car(rest);
+  rest = lbm_cdr(rest);
+  lbm_value body = lbm_car(rest);
+  *env = lbm_cadr(rest);
+  bc_entry_t *e = cache_get(params, body);
+  if (e && e->failed) return NULL;
+  return e;
+}
+
+#define NEXT() __extension__ ({ goto *(const void *)(*pc); })
+
+#define ARITH_I(OP)                                                     \
+  {                                                                     \
+    lbm_value a = vm_stack[sp-2];                                       \
+    lbm_value b = vm_stack[sp-1];                                       \
+    lbm_value r;                                                        \
+    if (lbm_type_of(a) == LBM_TYPE_I && lbm_type_of(b) == LBM_TYPE_I) { \
+      r = lbm_enc_i(lbm_dec_i(a) OP lbm_dec_i(b));                      \
+    } else {                                                            \
+      CALL_FUNDAMENTAL(r, SYMBOL_IX(fsym), &vm_stack[sp-2], 2);         \
+    }                                                                   \
+    vm_stack[sp-2] = r;                                                 \
+    sp --;                                                              \
+    pc ++;                                                              \
+    NEXT();                                                             \
+  }
+
+#define COMPARE_I(OP)                                                   \
+  {                                                                     \
+    lbm_value a = vm_stack[sp-2];                                       \
+    lbm_value b = vm_stack[sp-1];                                       \
+    lbm_value r;                                                        \
+    if (lbm_type_of(a) == LBM_TYPE_I && lbm_type_of(b) == LBM_TYPE_I) { \
+      r = (lbm_dec_i(a) OP lbm_dec_i(b)) ? ENC_SYM_TRUE : ENC_SYM_NIL;  \
+    } else {                                                            \
+      CALL_FUNDAMENTAL(r, SYMBOL_IX(fsym), &vm_stack[sp-2], 2);         \
+    }                                                                   \
+    vm_stack[sp-2] = r;                                                 \
+    sp --;                                                              \
+    pc ++;                                                              \
+    NEXT();                                                             \
+  }
+
+// Runs until the frame at the bottom of the stack returns or the
+// budget runs out. Called with pc == NULL once to publish the handler
+// addresses.
+static bc_result_t bc_run(lbm_uint *pc, lbm_uint sp, lbm_uint fp, lbm_uint budget, eval_context_t *ctx, lbm_value *res) {
+  static const void *const labels[OP_NUM] = {
+    __extension__ &&op_const,
+    __extension__ &&op_local,
+    __extension__ &&op_set_local,
+    __extension__ &&op_free,
+    __extension__ &&op_pop,
+    __extension__ &&op_jmp,
+    __extension__ &&op_jmp_nil,
+    __extension__ &&op_and,
+    __extension__ &&op_or,
+    __extension__ &&op_add,
+    __extension__ &&op_sub,
+    __extension__ &&op_numeq,
+    __extension__ &&op_lt,
+    __extension__ &&op_gt,
+    __extension__ &&op_leq,
+    __extension__ &&op_geq,
+    __extension__ &&op_fund,
+    __extension__ &&op_call,
+    __extension__ &&op_tail_call,
+    __extension__ &&op_ret,
+  };
+
+  if (!pc) {
+    op_addr = labels;
+    return BC_DONE;
+  }
+
+  lbm_uint fsym;
+  bool tail;
+  NEXT();
+
+ op_const:
+  vm_stack[sp++] = pc[1];
+  pc += 2;
+  NEXT();
+
+ op_local:
+  vm_stack[sp++] = vm_stack[fp + FRAME_HEADER + pc[1]];
+  pc += 2;
+  NEXT();
+
+ op_set_local:
+  vm_stack[fp + FRAME_HEADER + pc[1]] = vm_stack[sp-1];
+  pc += 2;
+  NEXT();
+
+ op_free: {
+    lbm_value v;
+    if (!lbm_env_lookup_b(&v, pc[1], vm_stack[fp + 2]) &&
+        !lbm_global_env_lookup(&v, pc[1])) {
+      return BC_FAILED;
+    }
+    vm_stack[sp++] = v;
+    pc += 2;
+    NEXT();
+  }
+
+ op_pop:
+  sp --;
+  pc ++;
+  NEXT();
+
+ op_jmp: {
+    lbm_uint *target = (lbm_uint*)(uintptr_t)pc[1];
+    if (target < pc && --budget == 0) SUSPEND(BC_SUSPENDED, target);
+    pc = target;
+    NEXT();
+  }
+
+ op_jmp_nil:
+  sp --;
+  pc = lbm_is_symbol_nil(vm_stack[sp]) ? (lbm_uint*)(uintptr_t)pc[1] : pc + 2;
+  NEXT();
+
+ op_and:
+  if (lbm_is_symbol_nil(vm_stack[sp-1])) {
+    pc = (lbm_uint*)(uintptr_t)pc[1];
+  } else {
+    sp --;
+    pc += 2;
+  }
+  NEXT();
+
+ op_or:
+  if (!lbm_is_symbol_nil(vm_stack[sp-1])) {
+    pc = (lbm_uint*)(uintptr_t)pc[1];
+  } else {
+    sp --;
+    pc += 2;
+  }
+  NEXT();
+
+ op_add:
+  fsym = SYM_ADD;
+  ARITH_I(+);
+ op_sub:
+  fsym = SYM_SUB;
+  ARITH_I(-);
+ op_numeq:
+  fsym = SYM_NUMEQ;
+  COMPARE_I(==);
+ op_lt:
+  fsym = SYM_LT;
+  COMPARE_I(<);
+ op_gt:
+  fsym = SYM_GT;
+  COMPARE_I(>);
+ op_leq:
+  fsym = SYM_LEQ;
+  COMPARE_I(<=);
+ op_geq:
+  fsym = SYM_GEQ;
+  COMPARE_I(>=);
+
+ op_fund: {
+    lbm_uint n = pc[2];
+    lbm_value r;
+    CALL_FUNDAMENTAL(r, pc[1], &vm_stack[sp-n], n);
+    sp -= n;
+    vm_stack[sp++] = r;
+    pc += 3;
+    NEXT();
+  }
+
+ op_call:
+  tail = false;
+  goto call;
+ op_tail_call:
+  tail = true;
+ call: {
+    lbm_uint n = pc[1];
+    lbm_uint base = sp - n - 1;
+    lbm_value fun = vm_stack[base];
+
+    if (lbm_is_symbol(fun)) {
+      // A fundamental passed around as a value.
+      lbm_uint s = lbm_dec_sym(fun);
+      if (!is_pure_fundamental(s)) return BC_FAILED;
+      lbm_value r;
+      CALL_FUNDAMENTAL(r, SYMBOL_IX(s), &vm_stack[base+1], n);
+      vm_stack[base] = r;
+      sp = base + 1;
+      if (tail) goto op_ret;
+      pc += 2;
+      NEXT();
+    }
+
+    if (--budget == 0) SUSPEND(BC_SUSPENDED, pc);
+    lbm_value env;
+    bc_entry_t *e = closure_entry(fun, &env);
+    if (!e || e->num_params != n) return BC_FAILED;
+
+    lbm_uint new_fp = tail ? fp : base;
+    if (new_fp + FRAME_HEADER + e->num_locals + e->max_stack > LBM_BYTECODE_STACK_SIZE) {
+      return BC_FAILED;
+    }
+    if (tail) {
+      for (lbm_uint i = 0; i < n; i ++) {
+        vm_stack[fp + FRAME_HEADER + i] = vm_stack[base + 1 + i];
+      }
+    } else {
+      for (lbm_uint i = n; i > 0; i --) {
+        vm_stack[base + FRAME_HEADER + i - 1] = vm_stack[base + i];
+      }
+      vm_stack[base] = (lbm_value)(uintptr_t)(pc + 2);
+      vm_stack[base + 1] = lbm_enc_u(fp);
+    }
+    sp = new_fp + FRAME_HEADER + e->num_locals;
+    vm_stack[new_fp + 2] = env;
+    for (lbm_uint i = new_fp + FRAME_HEADER + n; i < sp; i ++) {
+      vm_stack[i] = ENC_SYM_NIL;
+    }
+    fp = new_fp;
+    pc = e->code;
+    NEXT();
+  }
+
+ op_ret: {
+    lbm_value r = vm_stack[sp-1];
+    lbm_uint *ret = (lbm_uint*)(uintptr_t)vm_stack[fp];
+    lbm_uint old_fp = lbm_dec_u(vm_stack[fp + 1]);
+    sp = fp;
+    vm_stack[sp++] = r;
+    if (!ret) {
+      *res = r;
+      return BC_DONE;
+    }
+    fp = old_fp;
+    pc = ret;
+    NEXT();
+  }
+}
+
+// Save the VM stack where bc_run was suspended. The array in state
+// is reused if it is large enough.
+static bool save_state(lbm_value *state) {
+  lbm_array_header_t *arr = lbm_dec_lisp_array_rw(*state);
+  if (!arr || arr->size < (STATE_HEADER + susp_sp) * sizeof(lbm_value)) {
+    if (!lbm_heap_allocate_lisp_array(state, STATE_HEADER + susp_sp)) {
+      return false;
+    }
+    arr = lbm_dec_lisp_array_rw(*state);
+  }
+  lbm_uint fp = susp_fp;
+  while (fp != 0) {
+    lbm_uint *ret = (lbm_uint*)(uintptr_t)vm_stack[fp];
+    vm_stack[fp] = lbm_enc_u((lbm_uint)(ret - code_area));
+    fp = lbm_dec_u(vm_stack[fp + 1]);
+  }
+  lbm_value *data = (lbm_value*)arr->data;
+  data[0] = lbm_enc_u(code_gen);
+  data[1] = lbm_enc_u((lbm_uint)(susp_pc - code_area));
+  data[2] = lbm_enc_u(susp_fp);
+  data[3] = lbm_enc_u(susp_sp);
+  memcpy(&data[STATE_HEADER], vm_stack, susp_sp * sizeof(lbm_value));
+  return true;
+}
+
+static lbm_bytecode_status_t run(bc_entry_t *e, lbm_uint *pc, lbm_uint sp, lbm_uint fp,
+                                 lbm_uint budget, eval_context_t *ctx, lbm_value *res) {
+  vm_running = true;
+  bc_result_t r = bc_run(pc, sp, fp, budget, ctx, res);
+  vm_running = false;
+
+  switch (r) {
+  case BC_DONE:
+    stats.applied ++;
+    return LBM_BYTECODE_DONE;
+  case BC_SUSPENDED:
+    if (save_state(res)) {
+      stats.suspended ++;
+      return LBM_BYTECODE_SUSPENDED;
+    }
+    // No room for the state, continue from vm_stack after GC and
+    // suspend again right away.
+    susp_budget = 1;
+    vm_parked = true;
+    return LBM_BYTECODE_NO_MEM;
+  case BC_NO_MEM:
+    vm_parked = true;
+    return LBM_BYTECODE_NO_MEM;
+  case BC_FAILED:
+    if (e) e->failed = true;
+    break;
+  default:
+    break;
+  }
+  stats.fallbacks ++;
+  return LBM_BYTECODE_CPS;
+}
+
+lbm_bytecode_status_t lbm_bytecode_apply(eval_context_t *ctx, lbm_value body, lbm_value env, lbm_value *res) {
+  bc_entry_t *e = cache_lookup(body);
+  if (!e || e->failed) return LBM_BYTECODE_CPS;
+
+  lbm_uint n = e->num_params;
+  lbm_uint sp = FRAME_HEADER + e->num_locals;
+  if (sp + e->max_stack > LBM_BYTECODE_STACK_SIZE) return LBM_BYTECODE_CPS;
+
+  // env is the closure environment extended with one binding per
+  // parameter, last parameter first.
+  lbm_value p = e->params;
+  for (lbm_uint i = 0; i < n; i ++) {
+    vm_stack[FRAME_HEADER + i] = lbm_car(p);
+    p = lbm_cdr(p);
+  }
+  for (lbm_uint i = n; i > 0; i --) {
+    lbm_value binding = lbm_car(env);
+    if (lbm_car(binding) != vm_stack[FRAME_HEADER + i - 1]) {
+      return LBM_BYTECODE_CPS; // Not the bindings of this closure.
+    }
+    vm_stack[FRAME_HEADER + i - 1] = lbm_cdr(binding);
+    env = lbm_cdr(env);
+  }
+  vm_stack[0] = (lbm_value)(uintptr_t)NULL;
+  vm_stack[1] = lbm_enc_u(0);
+  vm_stack[2] = env;
+  for (lbm_uint i = FRAME_HEADER + n; i < sp; i ++) {
+    vm_stack[i] = ENC_SYM_NIL;
+  }
+
+  *res = ENC_SYM_NIL;
+  return run(e, e->code, sp, 0, LBM_BYTECODE_CALL_BUDGET, ctx, res);
+}
+
+lbm_bytecode_status_t lbm_bytecode_resume(eval_context_t *ctx, lbm_value body, lbm_value *state) {
+  lbm_array_header_t *arr = lbm_dec_lisp_array_r(*state);
+  if (!arr) return LBM_BYTECODE_CPS;
+  lbm_value *data = (lbm_value*)arr->data;
+  if (data[0] != lbm_enc_u(code_gen)) {
+    // The code was flushed while suspended.
+    stats.fallbacks ++;
+    return LBM_BYTECODE_CPS;
+  }
+  lbm_uint sp = lbm_dec_u(data[3]);
+  lbm_uint fp = lbm_dec_u(data[2]);
+  memcpy(vm_stack, &data[STATE_HEADER], sp * sizeof(lbm_value));
+  lbm_uint f = fp;
+  while (f != 0) {
+    vm_stack[f] = (lbm_value)(uintptr_t)(code_area + lbm_dec_u(vm_stack[f]));
+    f = lbm_dec_u(vm_stack[f + 1]);
+  }
+  return run(cache_lookup(body), code_area + lbm_dec_u(data[1]), sp, fp,
+             LBM_BYTECODE_CALL_BUDGET, ctx, state);
+}
+
+lbm_bytecode_status_t lbm_bytecode_continue(eval_context_t *ctx, lbm_value body, lbm_value *res) {
+  if (!vm_parked) return LBM_BYTECODE_CPS;
+  vm_parked = false;
+  lbm_uint *pc = susp_pc;
+  lbm_uint sp = susp_sp;
+  lbm_uint budget = susp_budget;
+  lbm_bytecode_status_t r = run(cache_lookup(body), pc, sp, susp_fp, budget, ctx, res);
+  if (r == LBM_BYTECODE_NO_MEM &&
+      susp_pc == pc && susp_sp == sp && susp_budget == budget) {
+    // Still out of memory after GC. Redoing the application in CPS
+    // would run out of memory as well, only later.
+    vm_parked = false;
+    *res = ENC_SYM_MERROR;
+    r = LBM_BYTECODE_ERROR;
+  }
+  return r;
+}
+
+#endif
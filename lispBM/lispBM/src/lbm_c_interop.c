@@ -198,9 +198,7 @@ int lbm_define(char *symbol, lbm_value value) {
         return 0;
       }
     }
-    lbm_uint ix_key = sym_id & GLOBAL_ENV_MASK;
-    lbm_value *glob_env = lbm_get_global_env();
-    glob_env[ix_key] = lbm_env_set(glob_env[ix_key], lbm_enc_sym(sym_id), value);
+    lbm_global_env_set(lbm_enc_sym(sym_id), value);
   }
   return res;
 }
@@ -211,7 +209,7 @@ int lbm_undefine(char *symbol) {
     return 0;
 
   lbm_value *glob_env = lbm_get_global_env();
-  lbm_uint ix_key = sym_id & GLOBAL_ENV_MASK;
+  lbm_uint ix_key = lbm_global_env_ix(sym_id);
   lbm_value new_env = lbm_env_drop_binding(glob_env[ix_key], lbm_enc_sym(sym_id));
 
   if (new_env == ENC_SYM_NOT_FOUND) return 0;
@@ -260,7 +258,7 @@ int lbm_create_array(lbm_value *value, lbm_uint num_elt) {
 void lbm_clear_env(void) {
 
   lbm_value *env = lbm_get_global_env();
-  for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+  for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
     env[i] = ENC_SYM_NIL;
   }
   lbm_perform_gc();
@@ -269,7 +267,7 @@ void lbm_clear_env(void) {
 // Evaluator should be paused when running this.
 // Running gc will reclaim the fv storage.
 bool lbm_flatten_env(int index, lbm_uint** data, lbm_uint *size) {
-  if (index < 0 || index >= GLOBAL_ENV_ROOTS) return false;
+  if (index < 0 || (lbm_uint)index >= lbm_get_global_env_roots()) return false;
   lbm_value *env = lbm_get_global_env();
 
   lbm_value fv = flatten_value(env[index]);
@@ -82,6 +82,10 @@ bool lbm_channel_may_block(lbm_char_channel_t *chan) {
   return chan->may_block(chan);
 }
 
+char *lbm_channel_contiguous_data(lbm_char_channel_t *chan, unsigned int *len) {
+  return chan->contiguous_data(chan, len);
+}
+
 /* ------------------------------------------------------------
    Implementation buffered channel
    ------------------------------------------------------------ */
@@ -90,6 +94,12 @@ bool buffered_may_block(lbm_char_channel_t *chan) {
   return true;
 }
 
+char *buffered_contiguous_data(lbm_char_channel_t *chan, unsigned int *len) {
+  (void) chan;
+  *len = 0;
+  return NULL;
+}
+
 bool buffered_more(lbm_char_channel_t *chan) {
   lbm_buffered_channel_state_t *st = (lbm_buffered_channel_state_t*)chan->state;
   return st->more;
@@ -251,6 +261,7 @@ void lbm_create_buffered_char_channel(lbm_buffered_channel_state_t *st,
   chan->row = buffered_row;
   chan->column = buffered_column;
   chan->may_block = buffered_may_block;
+  chan->contiguous_data = buffered_contiguous_data;
 }
 
 /* ------------------------------------------------------------
@@ -262,6 +273,12 @@ bool string_may_block(lbm_char_channel_t *chan) {
   return false;
 }
 
+char *string_contiguous_data(lbm_char_channel_t *chan, unsigned int *len) {
+  lbm_string_channel_state_t *st = (lbm_string_channel_state_t*)chan->state;
+  *len = st->length - st->read_pos;
+  return st->str + st->read_pos;
+}
+
 bool string_more(lbm_char_channel_t *chan) {
   lbm_string_channel_state_t *st = (lbm_string_channel_state_t*)chan->state;
   return st->more;
@@ -333,16 +350,27 @@ bool string_read(lbm_char_channel_t *chan, char *res) {
 }
 
 bool string_drop(lbm_char_channel_t *chan, unsigned int n) {
-  bool r = true;
-  char c;
+  lbm_string_channel_state_t *st = (lbm_string_channel_state_t*)chan->state;
+  char *str = st->str;
 
-  if (n > 0) {
-    do {
-      r = string_read(chan, &c);
-      n--;
-    } while (n > 0 && r);
+  // Same as n calls to string_read.
+  for (unsigned int i = 0; i < n; i ++) {
+    if (st->read_pos >= st->length) {
+      st->more = false;
+      break;
+    }
+    char c = str[st->read_pos];
+    if (c == '\n') {
+      st->row ++;
+      st->column = 1;
+    } else if (c == 0) {
+      st->more = false;
+    } else {
+      st->column++;
+    }
+    st->read_pos = st->read_pos + 1;
   }
-  return r;
+  return true;
 }
 
 int string_write(lbm_char_channel_t *chan, char c) {
@@ -408,6 +436,7 @@ void lbm_create_string_char_channel(lbm_string_channel_state_t *st,
   chan->row = string_row;
   chan->column = string_column;
   chan->may_block = string_may_block;
+  chan->contiguous_data = string_contiguous_data;
 }
 
 void lbm_create_string_char_channel_size(lbm_string_channel_state_t *st,
@@ -440,6 +469,7 @@ void lbm_create_string_char_channel_size(lbm_string_channel_state_t *st,
   chan->row = string_row;
   chan->column = string_column;
   chan->may_block = string_may_block;
+  chan->contiguous_data = string_contiguous_data;
 }
 
 void lbm_char_channel_set_dependency(lbm_char_channel_t *chan, lbm_value dep) {
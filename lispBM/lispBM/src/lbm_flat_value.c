@@ -460,6 +460,7 @@ lbm_value handle_flatten_error(int err_val) {
     return ENC_SYM_FATAL_ERROR;
   case FLATTEN_VALUE_ERROR_CIRCULAR: /* fall through */
   case FLATTEN_VALUE_ERROR_MAXIMUM_DEPTH:
+  case FLATTEN_VALUE_ERROR_SINK:
     return ENC_SYM_EERROR;
   case FLATTEN_VALUE_ERROR_ARRAY: /* fall through */
   case FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY:
@@ -929,3 +930,396 @@ bool lbm_unflatten_value(lbm_flat_value_t *v, lbm_value *res) {
   // 2: unflatten called from event processing -> event processor frees buffer.
   return b;
 }
+
+// ------------------------------------------------------------
+// Streaming flatten
+//
+// Writes the same bytes as flatten_value_c, in a single traversal,
+// into a caller provided buffer that is handed to a sink whenever it
+// fills up.
+
+void lbm_flat_stream_init(lbm_flat_stream_t *s, uint8_t *buf, lbm_uint buf_size, lbm_flat_sink_t sink, void *arg) {
+  s->chunk.buf = buf;
+  s->chunk.buf_size = buf_size;
+  s->chunk.buf_pos = 0;
+  s->sink = sink;
+  s->arg = arg;
+  s->total = 0;
+}
+
+static bool stream_sink(lbm_flat_stream_t *s, uint8_t *data, lbm_uint n) {
+  if (!s->sink(data, n, s->arg)) return false;
+  s->total += n;
+  return true;
+}
+
+static bool stream_flush(lbm_flat_stream_t *s) {
+  if (s->chunk.buf_pos == 0) return true;
+  if (!stream_sink(s, s->chunk.buf, s->chunk.buf_pos)) return false;
+  s->chunk.buf_pos = 0;
+  return true;
+}
+
+static bool stream_write(lbm_flat_stream_t *s, uint8_t *data, lbm_uint n) {
+  lbm_uint size = s->chunk.buf_size;
+  while (n > 0) {
+    if (s->chunk.buf_pos == size) {
+      if (!stream_flush(s)) return false;
+    }
+    if (s->chunk.buf_pos == 0 && n >= size) {
+      // Whole chunks are passed on without copying.
+      if (!stream_sink(s, data, size)) return false;
+      data += size;
+      n -= size;
+      continue;
+    }
+    lbm_uint m = size - s->chunk.buf_pos;
+    if (m > n) m = n;
+    memcpy(s->chunk.buf + s->chunk.buf_pos, data, m);
+    s->chunk.buf_pos += m;
+    data += m;
+    n -= m;
+  }
+  return true;
+}
+
+static bool stream_write_header(lbm_flat_stream_t *s, uint8_t tag, uint32_t w) {
+  uint8_t hdr[5];
+  hdr[0] = tag;
+  hdr[1] = (uint8_t)(w >> 24);
+  hdr[2] = (uint8_t)(w >> 16);
+  hdr[3] = (uint8_t)(w >> 8);
+  hdr[4] = (uint8_t)w;
+  return stream_write(s, hdr, 5);
+}
+
+static int flatten_value_stream_internal(lbm_flat_stream_t *s, lbm_value v, int depth) {
+  while (true) {
+    if (depth > flatten_maximum_depth) {
+      return FLATTEN_VALUE_ERROR_MAXIMUM_DEPTH;
+    }
+
+    lbm_uint t = lbm_type_of(v);
+    if (t >= LBM_POINTER_TYPE_FIRST && t < LBM_POINTER_TYPE_LAST) {
+      t = t & ~(LBM_PTR_TO_CONSTANT_BIT);
+    }
+
+    switch (t) {
+    case LBM_TYPE_CONS: {
+      uint8_t tag = S_CONS;
+      if (!stream_write(s, &tag, 1)) return FLATTEN_VALUE_ERROR_SINK;
+      int r = flatten_value_stream_internal(s, lbm_car(v), depth + 1);
+      if (r != FLATTEN_VALUE_OK) return r;
+      // The cdr is done in this frame so that long lists do not use up
+      // the C stack. It still counts as a level, as in
+      // flatten_value_size, so that circular lists are caught.
+      v = lbm_cdr(v);
+      depth ++;
+    } break;
+    case LBM_TYPE_LISPARRAY: {
+      lbm_array_header_t *header = (lbm_array_header_t*)lbm_car(v);
+      if (!header) return FLATTEN_VALUE_ERROR_ARRAY;
+      lbm_value *arrdata = (lbm_value*)header->data;
+      uint32_t size = (uint32_t)(header->size / sizeof(lbm_value));
+      if (!stream_write_header(s, S_LBM_LISP_ARRAY, size)) return FLATTEN_VALUE_ERROR_SINK;
+      for (uint32_t i = 0; i < size; i ++) {
+        int r = flatten_value_stream_internal(s, arrdata[i], depth + 1);
+        if (r != FLATTEN_VALUE_OK) return r;
+      }
+      return FLATTEN_VALUE_OK;
+    }
+    case LBM_TYPE_SYMBOL: {
+      char *sym_str = (char*)lbm_get_name_by_symbol(lbm_dec_sym(v));
+      if (!sym_str) return FLATTEN_VALUE_ERROR_FATAL;
+      uint8_t tag = S_SYM_STRING;
+      if (!stream_write(s, &tag, 1) ||
+          !stream_write(s, (uint8_t*)sym_str, strlen(sym_str) + 1)) {
+        return FLATTEN_VALUE_ERROR_SINK;
+      }
+      return FLATTEN_VALUE_OK;
+    }
+    case LBM_TYPE_ARRAY: {
+      lbm_int n = lbm_heap_array_get_size(v);
+      const uint8_t *d = lbm_heap_array_get_data_ro(v);
+      if (n <= 0 || d == NULL) return FLATTEN_VALUE_ERROR_ARRAY;
+      if (!stream_write_header(s, S_LBM_ARRAY, (uint32_t)n) ||
+          !stream_write(s, (uint8_t*)d, (lbm_uint)n)) {
+        return FLATTEN_VALUE_ERROR_SINK;
+      }
+      return FLATTEN_VALUE_OK;
+    }
+    default: {
+      // Numbers and characters, at most a tag and 8 bytes.
+      uint8_t buf[16];
+      lbm_flat_value_t atom;
+      atom.buf = buf;
+      atom.buf_size = sizeof(buf);
+      atom.buf_pos = 0;
+      int r = flatten_value_c(&atom, v);
+      if (r != FLATTEN_VALUE_OK) return r;
+      if (!stream_write(s, buf, atom.buf_pos)) return FLATTEN_VALUE_ERROR_SINK;
+      return FLATTEN_VALUE_OK;
+    }
+    }
+  }
+}
+
+int lbm_flatten_value_stream(lbm_flat_stream_t *s, lbm_value v) {
+  if (s->chunk.buf_size == 0) return FLATTEN_VALUE_ERROR_BUFFER_TOO_SMALL;
+  int r = flatten_value_stream_internal(s, v, 0);
+  if (r == FLATTEN_VALUE_OK && !stream_flush(s)) {
+    r = FLATTEN_VALUE_ERROR_SINK;
+  }
+  return r;
+}
+
+// ------------------------------------------------------------
+// Incremental unflatten
+//
+// The value under construction is kept in a stack of frames on the
+// heap, one for each cons or lisp array that is not complete yet. A
+// frame is (node tail . pos). For an array, pos is the next element to
+// fill in. For conses, tail is the cons being filled in and pos tells
+// if its car or cdr is next. A list is built in a single frame by
+// linking every new cons in its cdr position directly onto tail, so
+// long lists do not grow the stack.
+//
+// Atoms are collected in a small buffer until complete, so they can
+// be split over any number of calls. Byte arrays are allocated when
+// their header is complete and then filled in place.
+
+static lbm_unflatten_stream_t *unflatten_streams = NULL;
+
+void lbm_unflatten_stream_init(lbm_unflatten_stream_t *s) {
+  s->stack = ENC_SYM_NIL;
+  s->array = ENC_SYM_NIL;
+  s->array_pos = 0;
+  s->atom_len = 0;
+  s->owner = lbm_get_current_cid();
+  s->next = unflatten_streams;
+  unflatten_streams = s;
+}
+
+void lbm_unflatten_stream_end(lbm_unflatten_stream_t *s) {
+  lbm_unflatten_stream_t **p = &unflatten_streams;
+  while (*p) {
+    if (*p == s) {
+      *p = s->next;
+      break;
+    }
+    p = &(*p)->next;
+  }
+  s->stack = ENC_SYM_NIL;
+  s->array = ENC_SYM_NIL;
+}
+
+void lbm_unflatten_stream_ctx_done(lbm_cid cid) {
+  lbm_unflatten_stream_t **p = &unflatten_streams;
+  while (*p) {
+    lbm_unflatten_stream_t *s = *p;
+    if (s->owner == cid) {
+      *p = s->next;
+      s->stack = ENC_SYM_NIL;
+      s->array = ENC_SYM_NIL;
+    } else {
+      p = &s->next;
+    }
+  }
+}
+
+void lbm_unflatten_stream_gc_mark(void) {
+  for (lbm_unflatten_stream_t *s = unflatten_streams; s; s = s->next) {
+    lbm_value roots[2] = {s->stack, s->array};
+    lbm_gc_mark_roots(roots, 2);
+  }
+}
+
+// Size of an atom including the tag, or of the header of an array.
+// 0 if the size is not given by the tag.
+static lbm_uint stream_atom_size(uint8_t tag) {
+  switch (tag) {
+  case S_CONS:
+    return 1;
+  case S_BYTE_VALUE:
+    return 2;
+  case S_I28_VALUE: /* fall through */
+  case S_U28_VALUE:
+  case S_I32_VALUE:
+  case S_U32_VALUE:
+  case S_FLOAT_VALUE:
+  case S_LBM_ARRAY:
+  case S_LBM_LISP_ARRAY:
+    return 5;
+  case S_I56_VALUE: /* fall through */
+  case S_U56_VALUE:
+  case S_I64_VALUE:
+  case S_U64_VALUE:
+  case S_DOUBLE_VALUE:
+    return 9;
+  case S_SYM_VALUE: /* fall through */
+  case S_CONSTANT_REF:
+    return 1 + sizeof(lbm_uint);
+  default:
+    return 0;
+  }
+}
+
+static bool stream_atom_complete(lbm_unflatten_stream_t *s) {
+  if (s->atom_len == 0) return false;
+  if (s->atom[0] == S_SYM_STRING) {
+    return s->atom_len > 1 && s->atom[s->atom_len - 1] == 0;
+  }
+  return s->atom_len == stream_atom_size(s->atom[0]);
+}
+
+static uint32_t stream_atom_word(lbm_unflatten_stream_t *s) {
+  return
+    (uint32_t)s->atom[1] << 24 |
+    (uint32_t)s->atom[2] << 16 |
+    (uint32_t)s->atom[3] << 8 |
+    (uint32_t)s->atom[4];
+}
+
+// Store a complete value in the innermost open cons or array. Returns
+// true, with the value in *v, if that completes the whole value.
+static bool stream_deliver(lbm_unflatten_stream_t *s, lbm_value *v) {
+  lbm_value val = *v;
+  while (lbm_is_cons(s->stack)) {
+    lbm_value frame = lbm_car(s->stack);
+    lbm_value node = lbm_car(frame);
+    lbm_value rest = lbm_cdr(frame);
+    lbm_value tail = lbm_car(rest);
+    lbm_uint pos = lbm_dec_u(lbm_cdr(rest));
+    if (lbm_type_of(node) == LBM_TYPE_LISPARRAY) {
+      lbm_array_header_t *header = (lbm_array_header_t*)lbm_car(node);
+      lbm_value *arrdata = (lbm_value*)header->data;
+      arrdata[pos++] = val;
+      if (pos < header->size / sizeof(lbm_value)) {
+        lbm_set_cdr(rest, lbm_enc_u(pos));
+        return false;
+      }
+    } else if (pos == 0) {
+      lbm_set_car(tail, val);
+      lbm_set_cdr(rest, lbm_enc_u(1));
+      return false;
+    } else {
+      lbm_set_cdr(tail, val);
+    }
+    s->stack = lbm_cdr(s->stack);
+    val = node;
+  }
+  *v = val;
+  return true;
+}
+
+static bool stream_push(lbm_unflatten_stream_t *s, lbm_value node) {
+  lbm_value rest = lbm_cons(node, lbm_enc_u(0));
+  if (lbm_is_symbol_merror(rest)) return false;
+  lbm_value frame = lbm_cons(node, rest);
+  if (lbm_is_symbol_merror(frame)) return false;
+  lbm_value stack = lbm_cons(frame, s->stack);
+  if (lbm_is_symbol_merror(stack)) return false;
+  s->stack = stack;
+  return true;
+}
+
+// Act on a complete atom or header.
+static int stream_step(lbm_unflatten_stream_t *s, lbm_value *res) {
+  uint8_t tag = s->atom[0];
+  lbm_value val;
+
+  switch (tag) {
+  case S_CONS: {
+    lbm_value cell = lbm_cons(ENC_SYM_NIL, ENC_SYM_NIL);
+    if (lbm_is_symbol_merror(cell)) return UNFLATTEN_GC_RETRY;
+    if (lbm_is_cons(s->stack)) {
+      lbm_value frame = lbm_car(s->stack);
+      lbm_value rest = lbm_cdr(frame);
+      if (lbm_type_of(lbm_car(frame)) != LBM_TYPE_LISPARRAY &&
+          lbm_dec_u(lbm_cdr(rest)) == 1) {
+        // Next element of a list.
+        lbm_set_cdr(lbm_car(rest), cell);
+        lbm_set_car(rest, cell);
+        lbm_set_cdr(rest, lbm_enc_u(0));
+        return UNFLATTEN_MORE;
+      }
+    }
+    return stream_push(s, cell) ? UNFLATTEN_MORE : UNFLATTEN_GC_RETRY;
+  }
+  case S_LBM_LISP_ARRAY: {
+    uint32_t size = stream_atom_word(s);
+    if (!lbm_heap_allocate_lisp_array(&val, size)) return UNFLATTEN_GC_RETRY;
+    if (size > 0) {
+      return stream_push(s, val) ? UNFLATTEN_MORE : UNFLATTEN_GC_RETRY;
+    }
+  } break;
+  case S_LBM_ARRAY: {
+    uint32_t size = stream_atom_word(s);
+    if (!lbm_heap_allocate_array(&val, size)) return UNFLATTEN_GC_RETRY;
+    if (size > 0) {
+      s->array = val;
+      s->array_pos = 0;
+      return UNFLATTEN_MORE;
+    }
+  } break;
+  default: {
+    lbm_flat_value_t atom;
+    atom.buf = s->atom;
+    atom.buf_size = s->atom_len;
+    atom.buf_pos = 0;
+    int r = lbm_unflatten_value_atom(&atom, &val);
+    if (r != UNFLATTEN_OK) return r;
+  } break;
+  }
+  if (stream_deliver(s, &val)) {
+    *res = val;
+    return UNFLATTEN_OK;
+  }
+  return UNFLATTEN_MORE;
+}
+
+int lbm_unflatten_stream_feed(lbm_unflatten_stream_t *s, uint8_t *data, lbm_uint len, lbm_uint *consumed, lbm_value *res) {
+  lbm_uint i = 0;
+  int r = UNFLATTEN_MORE;
+
+  while (r == UNFLATTEN_MORE) {
+    if (s->array != ENC_SYM_NIL) {
+      lbm_array_header_t *header = (lbm_array_header_t*)lbm_car(s->array);
+      lbm_uint n = header->size - s->array_pos;
+      if (n > len - i) n = len - i;
+      memcpy((uint8_t*)header->data + s->array_pos, data + i, n);
+      s->array_pos += n;
+      i += n;
+      if (s->array_pos < header->size) break;
+      lbm_value val = s->array;
+      s->array = ENC_SYM_NIL;
+      if (stream_deliver(s, &val)) {
+        *res = val;
+        r = UNFLATTEN_OK;
+      }
+    } else if (stream_atom_complete(s)) {
+      r = stream_step(s, res);
+      if (r != UNFLATTEN_GC_RETRY) s->atom_len = 0;
+    } else if (i == len) {
+      break;
+    } else {
+      uint8_t b = data[i++];
+      if (s->atom_len == 0 &&
+          b != S_SYM_STRING &&
+          stream_atom_size(b) == 0) {
+        r = UNFLATTEN_MALFORMED;
+      } else if (s->atom_len == LBM_UNFLATTEN_STREAM_ATOM_SIZE) {
+        r = UNFLATTEN_MALFORMED;
+      } else {
+        s->atom[s->atom_len++] = b;
+      }
+    }
+  }
+  *consumed = i;
+  if (r == UNFLATTEN_OK || r == UNFLATTEN_MALFORMED) {
+    s->stack = ENC_SYM_NIL;
+    s->array = ENC_SYM_NIL;
+    s->atom_len = 0;
+  }
+  return r;
+}
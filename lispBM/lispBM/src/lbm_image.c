@@ -545,6 +545,190 @@ static bool image_flatten_value(lbm_value v) {
                         // trav_ok = no cycles in input value.
 }
 
+// ////////////////////////////////////////////////////////////
+// Copying values into the constant heap of the image.
+//
+// A binding whose value lives on the constant heap is stored as a
+// BINDING_CONST and is restored by boot without unflattening, the
+// cells are used in place from the image. This is the same deep copy
+// as move-to-flash performs, but done from C while saving the image.
+//
+// Only values that programs do not update in place are copied: boxed
+// numbers and closures that capture no environment and contain no byte
+// arrays. A string or array literal in a closure can be returned and
+// updated with bufset or setix, so a closure that has one stays
+// flattened, as do byte arrays, lists and arrays bound at the top level
+// and anything that would not fit in the image. Each binding gets its
+// own copy, so values shared between bindings are no longer shared
+// after boot.
+
+extern lbm_const_heap_t *lbm_const_heap_state;
+
+// Bound on the car (and array element) nesting that is copied.
+// The cdr direction is iterated and does not count.
+#define IMAGE_CONST_COPY_MAX_DEPTH 128
+
+static void const_copyable_node(lbm_value v, void *res) {
+  bool *acc = (bool*)res;
+  if (!lbm_is_ptr(v) || (v & LBM_PTR_TO_CONSTANT_BIT) || lbm_is_cons(v)) return;
+  switch (lbm_ref_cell(v)->cdr) {
+  case ENC_SYM_RAW_I_TYPE: /* fall through */
+  case ENC_SYM_RAW_U_TYPE:
+  case ENC_SYM_RAW_F_TYPE:
+  case ENC_SYM_IND_I_TYPE:
+  case ENC_SYM_IND_U_TYPE:
+  case ENC_SYM_IND_F_TYPE:
+    break;
+  default:
+    *acc = false;
+  }
+}
+
+static bool image_const_immutable(lbm_value v) {
+  if (lbm_is_cons(v)) {
+    // (closure params body env)
+    return (lbm_car(v) == ENC_SYM_CLOSURE &&
+            lbm_is_symbol_nil(lbm_car(lbm_cdr(lbm_cdr(lbm_cdr(v))))));
+  }
+  switch (lbm_ref_cell(v)->cdr) {
+  case ENC_SYM_RAW_I_TYPE: /* fall through */
+  case ENC_SYM_RAW_U_TYPE:
+  case ENC_SYM_RAW_F_TYPE:
+  case ENC_SYM_IND_I_TYPE:
+  case ENC_SYM_IND_U_TYPE:
+  case ENC_SYM_IND_F_TYPE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool image_const_copyable(lbm_value v) {
+  bool ok = true;
+  bool trav_ok = lbm_ptr_rev_trav(const_copyable_node, v, &ok);
+  return trav_ok && ok;
+}
+
+// Upper bound on the constant heap words that image_const_copy uses
+// for v. Counts a word of padding after every raw write, as a cell
+// allocated after an odd sized write skips a word.
+static bool image_const_words(lbm_value v, lbm_uint *words, int depth) {
+  if (depth > IMAGE_CONST_COPY_MAX_DEPTH) return false;
+  if (lbm_is_constant(v)) return true;
+
+  if (lbm_is_cons(v)) {
+    lbm_value curr = v;
+    while (lbm_is_cons(curr)) {
+      if (!image_const_words(lbm_car(curr), words, depth + 1)) return false;
+      *words += 2;
+      curr = lbm_cdr(curr);
+    }
+    return image_const_words(curr, words, depth + 1);
+  }
+
+  lbm_cons_t *ref = lbm_ref_cell(v);
+  switch (ref->cdr) {
+  case ENC_SYM_RAW_I_TYPE: /* fall through */
+  case ENC_SYM_RAW_U_TYPE:
+  case ENC_SYM_RAW_F_TYPE:
+    *words += 2;
+    return true;
+#ifndef LBM64
+  case ENC_SYM_IND_I_TYPE: /* fall through */
+  case ENC_SYM_IND_U_TYPE:
+  case ENC_SYM_IND_F_TYPE:
+    *words += 2 + 1 + 2;
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+// Words of the image below the constant heap that are used for the
+// BINDING_CONST entry and the constant heap index saved after it.
+#define IMAGE_CONST_BINDING_WORDS (1 + 2 * (sizeof(lbm_uint) / sizeof(uint32_t)) + 2)
+
+static bool image_const_fits(lbm_value v) {
+  lbm_uint words = 0;
+  if (!image_const_words(v, &words, 0)) return false;
+  return (lbm_const_heap_state &&
+          (lbm_const_heap_state->next + 1 + words + IMAGE_CONST_BINDING_WORDS) < (lbm_uint)write_index);
+}
+
+static bool image_const_copy(lbm_value v, lbm_value *res, int depth) {
+
+  if (depth > IMAGE_CONST_COPY_MAX_DEPTH) return false;
+
+  if (lbm_is_constant(v)) {
+    *res = v;
+    return true;
+  }
+
+  if (lbm_is_cons(v)) {
+    lbm_value fst = ENC_SYM_NIL;
+    lbm_value lst = ENC_SYM_NIL;
+    lbm_value curr = v;
+    while (lbm_is_cons(curr)) {
+      lbm_value elt;
+      lbm_value cell;
+      if (!image_const_copy(lbm_car(curr), &elt, depth + 1)) return false;
+      // Element first, then the cell that refers to it.
+      if (lbm_allocate_const_cell(&cell) != LBM_FLASH_WRITE_OK) return false;
+      if (lbm_is_symbol_nil(fst)) {
+        fst = cell;
+      } else if (write_const_cdr(lst, cell) != LBM_FLASH_WRITE_OK) {
+        return false;
+      }
+      if (write_const_car(cell, elt) != LBM_FLASH_WRITE_OK) return false;
+      lst = cell;
+      curr = lbm_cdr(curr);
+    }
+    lbm_value tail;
+    if (!image_const_copy(curr, &tail, depth + 1) ||
+        write_const_cdr(lst, tail) != LBM_FLASH_WRITE_OK) {
+      return false;
+    }
+    *res = fst;
+    return true;
+  }
+
+  lbm_cons_t *ref = lbm_ref_cell(v);
+  switch (ref->cdr) {
+  case ENC_SYM_RAW_I_TYPE: /* fall through */
+  case ENC_SYM_RAW_U_TYPE:
+  case ENC_SYM_RAW_F_TYPE: {
+    lbm_value cell;
+    if (request_flash_storage_cell(v, &cell) != LBM_FLASH_WRITE_OK ||
+        write_const_car(cell, ref->car) != LBM_FLASH_WRITE_OK ||
+        write_const_cdr(cell, ref->cdr) != LBM_FLASH_WRITE_OK) {
+      return false;
+    }
+    *res = cell;
+    return true;
+  }
+#ifndef LBM64
+  case ENC_SYM_IND_I_TYPE: /* fall through */
+  case ENC_SYM_IND_U_TYPE:
+  case ENC_SYM_IND_F_TYPE: {
+    // 64 bit values are in lbm mem on 32bit platforms.
+    lbm_uint data;
+    lbm_value cell;
+    if (lbm_write_const_raw((lbm_uint*)ref->car, 2, &data) != LBM_FLASH_WRITE_OK ||
+        request_flash_storage_cell(v, &cell) != LBM_FLASH_WRITE_OK ||
+        write_const_car(cell, data) != LBM_FLASH_WRITE_OK ||
+        write_const_cdr(cell, ref->cdr) != LBM_FLASH_WRITE_OK) {
+      return false;
+    }
+    *res = cell;
+    return true;
+  }
+#endif
+  default:
+    return false;
+  }
+}
+
 // ////////////////////////////////////////////////////////////
 //
 
@@ -627,15 +811,25 @@ lbm_uint *lbm_image_add_and_link_symbol(char *name, lbm_uint id, lbm_uint symlis
   return NULL;
 }
 
-bool lbm_image_save_global_env(void) {
+static bool image_save_global_env(bool const_copy) {
   lbm_value *env = lbm_get_global_env();
   if (env) {
-    for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+    for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
       lbm_value curr = env[i];
       while(lbm_is_cons(curr)) {
         lbm_value name_field = lbm_caar(curr);
         lbm_value val_field  = lbm_cdr(lbm_car(curr));
 
+        lbm_value const_val;
+        if (const_copy &&
+            !lbm_is_constant(val_field) &&
+            image_const_immutable(val_field) &&
+            image_const_copyable(val_field) &&
+            image_const_fits(val_field) &&
+            image_const_copy(val_field, &const_val, 0)) {
+          val_field = const_val;
+        }
+
         if (lbm_is_constant(val_field)) {
           write_u32(BINDING_CONST, &write_index, DOWNWARDS);
           write_lbm_value(name_field, &write_index, DOWNWARDS);
@@ -668,6 +862,14 @@ bool lbm_image_save_global_env(void) {
   return false;
 }
 
+bool lbm_image_save_global_env(void) {
+  return image_save_global_env(false);
+}
+
+bool lbm_image_save_global_env_const(void) {
+  return image_save_global_env(true);
+}
+
 // The extension table is created at system startup.
 // Extensions can also be added dynamically.
 // Dynamically added extensions have names starting with "ext-"
@@ -820,15 +1022,9 @@ bool lbm_image_boot(void) {
       lbm_uint bind_val = read_u32(pos-1);
       pos -= 2;
 #endif
-      lbm_uint ix_key  = lbm_dec_sym(bind_key) & GLOBAL_ENV_MASK;
-      lbm_value *global_env = lbm_get_global_env();
-      lbm_uint orig_env = global_env[ix_key];
-      lbm_value new_env = lbm_env_set(orig_env,bind_key,bind_val);
-
-      if (lbm_is_symbol(new_env)) {
+      if (lbm_global_env_set(bind_key, bind_val) != ENC_SYM_TRUE) {
         return false;
       }
-      global_env[ix_key] = new_env;
     } break;
     case BINDING_FLAT: {
       // on 64 bit           | on 32 bit
@@ -858,15 +1054,9 @@ bool lbm_image_boot(void) {
         lbm_unflatten_value(&fv, &unflattened);
       }
 
-      lbm_uint ix_key  = lbm_dec_sym(bind_key) & GLOBAL_ENV_MASK;
-      lbm_value *global_env = lbm_get_global_env();
-      lbm_uint orig_env = global_env[ix_key];
-      lbm_value new_env = lbm_env_set(orig_env,bind_key,unflattened);
-
-      if (lbm_is_symbol(new_env)) {
+      if (lbm_global_env_set(bind_key, unflattened) != ENC_SYM_TRUE) {
         return false;
       }
-      global_env[ix_key] = new_env;
       pos --;
     } break;
     case SYMBOL_ENTRY: {
@@ -51,6 +51,18 @@ static mutex_t lbm_mem_mutex;
 static bool    lbm_mem_mutex_initialized;
 static lbm_uint alloc_offset = 0;
 
+#if LBM_MEMORY_NUM_SIZE_CLASSES > 0
+/* Size class front end. Freed blocks of 1 to LBM_MEMORY_NUM_SIZE_CLASSES
+   words are kept in a per size free list and are handed out again
+   without scanning the bitmap. The blocks stay marked as allocated in
+   the bitmap while on a free list but are counted as free in
+   memory_num_free. The lists are flushed back into the bitmap when a
+   bitmap search fails and before the bitmap is inspected for
+   statistics. */
+static lbm_uint size_class_blocks[LBM_MEMORY_NUM_SIZE_CLASSES][LBM_MEMORY_SIZE_CLASS_BLOCKS];
+static lbm_uint size_class_num[LBM_MEMORY_NUM_SIZE_CLASSES];
+#endif
+
 int lbm_memory_init(lbm_uint *data, lbm_uint data_size,
                     lbm_uint *bits, lbm_uint bits_size) {
 
@@ -60,6 +72,11 @@ int lbm_memory_init(lbm_uint *data, lbm_uint data_size,
   }
 
   alloc_offset = 0;
+#if LBM_MEMORY_NUM_SIZE_CLASSES > 0
+  for (int i = 0; i < LBM_MEMORY_NUM_SIZE_CLASSES; i ++) {
+    size_class_num[i] = 0;
+  }
+#endif
 
   mutex_lock(&lbm_mem_mutex);
   int res = 0;
@@ -132,6 +149,30 @@ static inline lbm_uint *bitmap_ix_to_address(lbm_uint ix) {
 #define WORD_MOD_MASK 0x3F   // mod 64
 #define BITMAP_SIZE_SHIFT 5  // times 32, 32 statuses per bitmap word
 #endif
+#define STATUSES_PER_WORD ((lbm_uint)1 << BITMAP_SIZE_SHIFT)
+#define WORD_BITS ((lbm_uint)1 << WORD_IX_SHIFT)
+
+// Count trailing/leading zero bits of a non-zero bitmap word.
+#if defined(__GNUC__)
+#ifndef LBM64
+#define BITMAP_CTZ(x) ((lbm_uint)__builtin_ctz((unsigned int)(x)))
+#define BITMAP_CLZ(x) ((lbm_uint)__builtin_clz((unsigned int)(x)))
+#else
+#define BITMAP_CTZ(x) ((lbm_uint)__builtin_ctzll((unsigned long long)(x)))
+#define BITMAP_CLZ(x) ((lbm_uint)__builtin_clzll((unsigned long long)(x)))
+#endif
+#else
+static lbm_uint BITMAP_CTZ(lbm_uint x) {
+  lbm_uint n = 0;
+  while (!(x & 1)) { x >>= 1; n ++; }
+  return n;
+}
+static lbm_uint BITMAP_CLZ(lbm_uint x) {
+  lbm_uint n = 0;
+  while (!(x & ((lbm_uint)1 << (WORD_BITS - 1)))) { x <<= 1; n ++; }
+  return n;
+}
+#endif
 
 static inline lbm_uint status(lbm_uint i) {
 
@@ -158,6 +199,84 @@ static inline void set_status(lbm_uint i, lbm_uint status) {
   bitmap[word_ix] |= mask;
 }
 
+// Number of FREE_OR_USED statuses starting at i, up to the end of the
+// bitmap word that holds status i.
+static inline lbm_uint zero_run(lbm_uint i) {
+  lbm_uint ix = i << 1;
+  lbm_uint w = bitmap[ix >> WORD_IX_SHIFT] >> (ix & WORD_MOD_MASK);
+  if (w == 0) {
+    return STATUSES_PER_WORD - (i & (STATUSES_PER_WORD - 1));
+  }
+  return BITMAP_CTZ(w) >> 1;
+}
+
+// Number of FREE_OR_USED statuses ending at i-1, back to the start of
+// the bitmap word that holds status i-1.
+static inline lbm_uint zero_run_back(lbm_uint i) {
+  lbm_uint ix = (i - 1) << 1;
+  lbm_uint bit_ix = ix & WORD_MOD_MASK;
+  lbm_uint w = bitmap[ix >> WORD_IX_SHIFT] << (WORD_BITS - 2 - bit_ix);
+  if (w == 0) {
+    return (bit_ix >> 1) + 1;
+  }
+  return BITMAP_CLZ(w) >> 1;
+}
+
+#if LBM_MEMORY_NUM_SIZE_CLASSES > 0
+// Size of the allocated block starting at ix if it fits in a size
+// class and is wedged in between two other allocated blocks, otherwise
+// 0. A block next to free space is returned to the bitmap instead so
+// that it can merge with the free space around it.
+static lbm_uint small_block_size(lbm_uint ix) {
+  lbm_uint n = 0;
+  lbm_uint s = status(ix);
+  if (s == START_END) {
+    n = 1;
+  } else if (s == START) {
+    for (lbm_uint i = 1; i < LBM_MEMORY_NUM_SIZE_CLASSES; i ++) {
+      s = status(ix + i);
+      if (s == END) {
+        n = i + 1;
+        break;
+      }
+      if (s != FREE_OR_USED) return 0;
+    }
+    if (n == 0) return 0;
+  } else {
+    return 0;
+  }
+
+  if (ix > 0) {
+    s = status(ix - 1);
+    if (s != END && s != START_END) return 0;
+  }
+  if (ix + n < (bitmap_size << BITMAP_SIZE_SHIFT)) {
+    s = status(ix + n);
+    if (s != START && s != START_END) return 0;
+  }
+  return n;
+}
+
+static bool size_class_contains(lbm_uint c, lbm_uint ix) {
+  for (lbm_uint i = 0; i < size_class_num[c]; i ++) {
+    if (size_class_blocks[c][i] == ix) return true;
+  }
+  return false;
+}
+
+// Return all blocks on the size class free lists to the bitmap.
+static void size_class_flush(void) {
+  for (lbm_uint c = 0; c < LBM_MEMORY_NUM_SIZE_CLASSES; c ++) {
+    for (lbm_uint i = 0; i < size_class_num[c]; i ++) {
+      lbm_uint ix = size_class_blocks[c][i];
+      set_status(ix, FREE_OR_USED);
+      set_status(ix + c, FREE_OR_USED);
+    }
+    size_class_num[c] = 0;
+  }
+}
+#endif
+
 lbm_uint lbm_memory_num_words(void) {
   return memory_size;
 }
@@ -180,6 +299,9 @@ lbm_uint lbm_memory_longest_free(void) {
     return 0;
   }
   mutex_lock(&lbm_mem_mutex);
+#if LBM_MEMORY_NUM_SIZE_CLASSES > 0
+  size_class_flush();
+#endif
   unsigned int state = INIT;
   lbm_uint max_length = 0;
 
@@ -226,72 +348,91 @@ lbm_uint lbm_memory_longest_free(void) {
   return max_length;
 }
 
-static lbm_uint *lbm_memory_allocate_internal(lbm_uint num_words) {
-
-  if (memory == NULL || bitmap == NULL) {
-    return NULL;
-  }
-
-  mutex_lock(&lbm_mem_mutex);
-
+// First fit search of the bitmap starting at alloc_offset. Runs of
+// FREE_OR_USED statuses are handled a bitmap word at a time.
+static bool bitmap_search(lbm_uint num_words, lbm_uint *start, lbm_uint *end) {
   lbm_uint start_ix = 0;
-  lbm_uint end_ix = 0;
   lbm_uint free_length = 0;
   unsigned int state = INIT;
   lbm_uint loop_max = (bitmap_size << BITMAP_SIZE_SHIFT);
 
-  for (lbm_uint i = 0; i < loop_max; i ++) {
-    switch(status(alloc_offset)) {
-    case FREE_OR_USED:
-      switch (state) {
-      case INIT:
+  lbm_uint i = 0;
+  while (i < loop_max) {
+    lbm_uint n = zero_run(alloc_offset);
+    if (n > 0) {
+      if (state == INIT) {
         start_ix = alloc_offset;
-        if (num_words == 1) {
-          end_ix = alloc_offset;
-          state = ALLOC_DONE;
-        } else {
-          state = FREE_LENGTH_CHECK;
-          free_length = 1;
+        free_length = 0;
+        state = FREE_LENGTH_CHECK;
+      }
+      if (state == FREE_LENGTH_CHECK) {
+        if (free_length + n >= num_words) {
+          *start = start_ix;
+          *end = start_ix + num_words - 1;
+          alloc_offset = *end;
+          return true;
         }
+        free_length += n;
+      }
+    } else {
+      n = 1;
+      switch(status(alloc_offset)) {
+      case END:
+        state = INIT;
         break;
-      case FREE_LENGTH_CHECK:
-        free_length ++;
-        if (free_length == num_words) {
-          end_ix = alloc_offset;
-          state = ALLOC_DONE;
-        } else {
-          state = FREE_LENGTH_CHECK;
-        }
+      case START:
+        state = SKIP;
         break;
-      case SKIP:
+      case START_END:
+        state = INIT;
         break;
+      default: // error case
+        return false;
       }
-      break;
-    case END:
-      state = INIT;
-      break;
-    case START:
-      state = SKIP;
-      break;
-    case START_END:
-      state = INIT;
-      break;
-    default: // error case
-      mutex_unlock(&lbm_mem_mutex);
-      return NULL;
     }
 
-    if (state == ALLOC_DONE) break;
-
-    alloc_offset++;
+    i += n;
+    alloc_offset += n;
     if (alloc_offset == loop_max ) {
       free_length = 0;
       alloc_offset = 0;
       state = INIT;
     }
   }
+  return false;
+}
 
-  if (state == ALLOC_DONE) {
+static lbm_uint *lbm_memory_allocate_internal(lbm_uint num_words) {
+
+  if (memory == NULL || bitmap == NULL || num_words == 0) {
+    return NULL;
+  }
+
+  mutex_lock(&lbm_mem_mutex);
+
+#if LBM_MEMORY_NUM_SIZE_CLASSES > 0
+  if (num_words <= LBM_MEMORY_NUM_SIZE_CLASSES) {
+    lbm_uint c = num_words - 1;
+    if (size_class_num[c] > 0) {
+      size_class_num[c] --;
+      memory_num_free -= num_words;
+      mutex_unlock(&lbm_mem_mutex);
+      return bitmap_ix_to_address(size_class_blocks[c][size_class_num[c]]);
+    }
+  }
+#endif
+
+  lbm_uint start_ix = 0;
+  lbm_uint end_ix = 0;
+  bool found = bitmap_search(num_words, &start_ix, &end_ix);
+#if LBM_MEMORY_NUM_SIZE_CLASSES > 0
+  if (!found) {
+    size_class_flush();
+    found = bitmap_search(num_words, &start_ix, &end_ix);
+  }
+#endif
+
+  if (found) {
     if (start_ix == end_ix) {
       set_status(start_ix, START_END);
     } else {
@@ -320,19 +461,46 @@ int lbm_memory_free(lbm_uint *ptr) {
     mutex_lock(&lbm_mem_mutex);
     lbm_uint ix = address_to_bitmap_ix(ptr);
     lbm_uint count_freed = 0;
+#if LBM_MEMORY_NUM_SIZE_CLASSES > 0
+    lbm_uint n = small_block_size(ix);
+    if (n > 0) {
+      lbm_uint c = n - 1;
+      if (size_class_contains(c, ix)) {
+        // Already freed.
+        mutex_unlock(&lbm_mem_mutex);
+        return 0;
+      }
+      if (size_class_num[c] < LBM_MEMORY_SIZE_CLASS_BLOCKS) {
+        size_class_blocks[c][size_class_num[c]] = ix;
+        size_class_num[c] ++;
+        memory_num_free += n;
+        mutex_unlock(&lbm_mem_mutex);
+        return 1;
+      }
+    }
+#endif
     alloc_offset = ix;
     switch(status(ix)) {
-    case START:
+    case START: {
       set_status(ix, FREE_OR_USED);
-      for (lbm_uint i = ix; i < (bitmap_size << BITMAP_SIZE_SHIFT); i ++) {
+      lbm_uint i = ix;
+      lbm_uint loop_max = (bitmap_size << BITMAP_SIZE_SHIFT);
+      while (i < loop_max) {
+        lbm_uint z = zero_run(i);
+        if (z > 0) {
+          count_freed += z;
+          i += z;
+          continue;
+        }
         count_freed ++;
         if (status(i) == END) {
           set_status(i, FREE_OR_USED);
           r = 1;
           break;
         }
+        i ++;
       }
-      break;
+    } break;
     case START_END:
       set_status(ix, FREE_OR_USED);
       count_freed = 1;
@@ -342,8 +510,10 @@ int lbm_memory_free(lbm_uint *ptr) {
       break;
     }
     if (r) {
-      while (alloc_offset > 0 && status(alloc_offset - 1) == FREE_OR_USED) {
-        alloc_offset--;
+      while (alloc_offset > 0) {
+        lbm_uint z = zero_run_back(alloc_offset);
+        if (z == 0) break;
+        alloc_offset -= z;
       }
     }
     memory_num_free += count_freed;
@@ -15,7 +15,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
+
 #include "lbm_prof.h"
+#include "symrepr.h"
 #include "platform_mutex.h"
 
 static lbm_uint num_samples = 0;
@@ -29,6 +32,13 @@ extern volatile bool lbm_system_sleeping;
 static lbm_prof_t *prof_data;
 static lbm_uint    prof_data_num;
 
+static lbm_uint gc_pause_hist[LBM_PROF_GC_PAUSE_BUCKETS];
+static uint32_t gc_pause_max = 0;
+
+static lbm_prof_stack_t *prof_stacks = NULL;
+static lbm_uint          prof_stacks_num = 0;
+static lbm_uint          num_dropped_stacks = 0;
+
 #define TRUNC_SIZE(N) (((N) > LBM_PROF_MAX_NAME_SIZE -1) ? LBM_PROF_MAX_NAME_SIZE-1 : N)
 
 bool lbm_prof_init(lbm_prof_t *prof_data_buf,
@@ -37,6 +47,8 @@ bool lbm_prof_init(lbm_prof_t *prof_data_buf,
     num_samples = 0;
     num_system_samples = 0;
     num_sleep_samples = 0;
+    memset(gc_pause_hist, 0, sizeof(gc_pause_hist));
+    gc_pause_max = 0;
     prof_data_num = prof_data_buf_num;
     prof_data = prof_data_buf;
     for (lbm_uint i = 0; i < prof_data_num; i ++) {
@@ -61,6 +73,91 @@ lbm_uint lbm_prof_get_num_sleep_samples(void) {
   return num_sleep_samples;
 }
 
+void lbm_prof_init_stacks(lbm_prof_stack_t *stack_buf,
+                          lbm_uint stack_buf_num) {
+  if (!qmutex_initialized) return;
+  mutex_lock(&qmutex);
+  num_dropped_stacks = 0;
+  prof_stacks = stack_buf;
+  prof_stacks_num = stack_buf ? stack_buf_num : 0;
+  for (lbm_uint i = 0; i < prof_stacks_num; i ++) {
+    prof_stacks[i].cid = -1;
+    memset(prof_stacks[i].name, 0, LBM_PROF_MAX_NAME_SIZE);
+    prof_stacks[i].depth = 0;
+    prof_stacks[i].count = 0;
+  }
+  mutex_unlock(&qmutex);
+}
+
+lbm_uint lbm_prof_get_num_dropped_stacks(void) {
+  return num_dropped_stacks;
+}
+
+// Called with qmutex locked.
+static void sample_stack(eval_context_t *ctx, char *name, lbm_uint name_len) {
+  lbm_uint stack[LBM_PROF_STACK_DEPTH];
+  lbm_uint depth = lbm_get_prof_stack(ctx, stack, LBM_PROF_STACK_DEPTH);
+
+  // The leaf is the function about to be applied, if it is a
+  // built-in or has not been marked by the evaluator yet.
+  if (!ctx->app_cont && lbm_is_cons(ctx->curr_exp)) {
+    lbm_value h = lbm_ref_cell(ctx->curr_exp)->car;
+    if (lbm_is_symbol(h) &&
+        (h & ENC_SPECIAL_FORMS_MASK) != ENC_SPECIAL_FORMS_BIT) {
+      if (depth == LBM_PROF_STACK_DEPTH) {
+        memmove(stack, stack + 1, (LBM_PROF_STACK_DEPTH - 1) * sizeof(lbm_uint));
+        depth --;
+      }
+      stack[depth++] = lbm_dec_sym(h);
+    }
+  }
+
+  char pname[LBM_PROF_MAX_NAME_SIZE];
+  memset(pname, 0, LBM_PROF_MAX_NAME_SIZE);
+  if (name) {
+    memcpy(pname, name, TRUNC_SIZE(name_len));
+    pname[LBM_PROF_MAX_NAME_SIZE - 1] = 0;
+  }
+
+  for (lbm_uint i = 0; i < prof_stacks_num; i ++) {
+    lbm_prof_stack_t *s = &prof_stacks[i];
+    if (s->cid == -1) {
+      s->cid = ctx->id;
+      memcpy(s->name, pname, LBM_PROF_MAX_NAME_SIZE);
+      s->depth = depth;
+      memcpy(s->stack, stack, depth * sizeof(lbm_uint));
+      s->count = 1;
+      return;
+    }
+    if (s->cid == ctx->id &&
+        s->depth == depth &&
+        memcmp(s->stack, stack, depth * sizeof(lbm_uint)) == 0 &&
+        strncmp(s->name, pname, LBM_PROF_MAX_NAME_SIZE) == 0) {
+      s->count ++;
+      return;
+    }
+  }
+  num_dropped_stacks ++;
+}
+
+int lbm_prof_stack_folded(lbm_prof_stack_t *s, char *buf, lbm_uint buf_size) {
+  int n;
+  if (s->name[0]) {
+    n = snprintf(buf, buf_size, "%s", s->name);
+  } else {
+    n = snprintf(buf, buf_size, "cid-%d", (int)s->cid);
+  }
+  for (lbm_uint i = 0; i < s->depth; i ++) {
+    if (n < 0 || (lbm_uint)n >= buf_size) return -1;
+    const char *fun = lbm_get_name_by_symbol(s->stack[i]);
+    n += snprintf(buf + n, buf_size - (lbm_uint)n, ";%s", fun ? fun : "?");
+  }
+  if (n < 0 || (lbm_uint)n >= buf_size) return -1;
+  n += snprintf(buf + n, buf_size - (lbm_uint)n, " %u", (unsigned int)s->count);
+  if (n < 0 || (lbm_uint)n >= buf_size) return -1;
+  return n;
+}
+
 void lbm_prof_sample(void) {
   num_samples ++;
 
@@ -107,6 +204,9 @@ void lbm_prof_sample(void) {
         break;
       }
     }
+    if (prof_stacks_num > 0) {
+      sample_stack(curr, name, name_len);
+    }
   } else {
     if (lbm_system_sleeping) {
       num_sleep_samples ++;
@@ -116,3 +216,22 @@ void lbm_prof_sample(void) {
   }
   mutex_unlock(&qmutex);
 }
+
+void lbm_prof_gc_pause(uint32_t us) {
+  unsigned int b = 0;
+  while ((us >> (b + 1)) && b < (LBM_PROF_GC_PAUSE_BUCKETS - 1)) {
+    b ++;
+  }
+  gc_pause_hist[b] ++;
+  if (us > gc_pause_max) {
+    gc_pause_max = us;
+  }
+}
+
+void lbm_prof_get_gc_pause_hist(lbm_uint *hist) {
+  memcpy(hist, gc_pause_hist, sizeof(gc_pause_hist));
+}
+
+uint32_t lbm_prof_get_gc_pause_max(void) {
+  return gc_pause_max;
+}
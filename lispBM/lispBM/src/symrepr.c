@@ -35,6 +35,18 @@
 #define ID     1
 #define NEXT   2
 
+// The index holds one reference per symbol. Runtime symbols are
+// referenced by a pointer to their symbol list entry, which is word
+// aligned, so the two lowest bits are free to tag references into
+// the special symbol array and the extension table.
+#define SYM_INDEX_EMPTY      0
+#define SYM_INDEX_SPECIAL    1
+#define SYM_INDEX_EXTENSION  2
+#define SYM_INDEX_TAG(r)     ((r) & 3)
+#define SYM_INDEX_IX(r)      ((r) >> 2)
+#define SYM_INDEX_REF(ix, t) (((lbm_uint)(ix) << 2) | (t))
+#define SYM_INDEX_MAX_LOAD   ((sym_index_size * 3) / 4)
+
 typedef struct {
   const char *name;
   const lbm_uint id;
@@ -264,9 +276,135 @@ static lbm_uint symbol_table_size_list_flash = 0;
 static lbm_uint symbol_table_size_strings = 0;
 static lbm_uint symbol_table_size_strings_flash = 0;
 
+// Name to symbol hash index, in storage given by the application. Without
+// storage every lookup scans all symbols.
+static lbm_uint *sym_index = NULL;
+static lbm_uint sym_index_size = 0;
+static lbm_uint sym_index_num = 0;
+static bool sym_index_valid = false;
+static bool sym_index_complete = false;
+
+// FNV-1a
+static uint32_t sym_index_hash(const char *name) {
+  uint32_t h = 2166136261u;
+  while (*name) {
+    h ^= (uint8_t)*name++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static char *sym_index_name(lbm_uint ref) {
+  switch (SYM_INDEX_TAG(ref)) {
+  case SYM_INDEX_SPECIAL:
+    return (char *)special_symbols[SYM_INDEX_IX(ref)].name;
+  case SYM_INDEX_EXTENSION:
+    // NULL if the extension has been cleared.
+    return extension_table[SYM_INDEX_IX(ref)].name;
+  default:
+    return (char *)((lbm_uint *)ref)[NAME];
+  }
+}
+
+static lbm_uint sym_index_id(lbm_uint ref) {
+  switch (SYM_INDEX_TAG(ref)) {
+  case SYM_INDEX_SPECIAL:
+    return special_symbols[SYM_INDEX_IX(ref)].id;
+  case SYM_INDEX_EXTENSION:
+    return EXTENSION_SYMBOLS_START + SYM_INDEX_IX(ref);
+  default:
+    return ((lbm_uint *)ref)[ID];
+  }
+}
+
+// Linear probing without deletion. A name that is inserted more than
+// once resolves to the reference inserted first, which is the same
+// precedence as scanning special symbols, extensions and then the
+// symbol list.
+static void sym_index_insert(char *name, lbm_uint ref) {
+  if (!sym_index_valid || !sym_index) return;
+  if (sym_index_num >= SYM_INDEX_MAX_LOAD) {
+    // Out of space. Lookups that miss in the index fall back to
+    // scanning all symbols.
+    sym_index_complete = false;
+    return;
+  }
+  lbm_uint i = sym_index_hash(name) & (sym_index_size - 1);
+  while (sym_index[i] != SYM_INDEX_EMPTY) {
+    i = (i + 1) & (sym_index_size - 1);
+  }
+  sym_index[i] = ref;
+  sym_index_num ++;
+}
+
+static void sym_index_build(void) {
+  sym_index_num = 0;
+  sym_index_valid = true;
+  sym_index_complete = false;
+  if (!sym_index) return;
+
+  memset(sym_index, 0, sym_index_size * sizeof(lbm_uint));
+  sym_index_complete = true;
+
+  for (unsigned int i = 0; i < NUM_SPECIAL_SYMBOLS; i ++) {
+    sym_index_insert((char *)special_symbols[i].name, SYM_INDEX_REF(i, SYM_INDEX_SPECIAL));
+  }
+  for (lbm_uint i = 0; i < lbm_get_max_extensions(); i ++) {
+    if (extension_table[i].name) {
+      sym_index_insert(extension_table[i].name, SYM_INDEX_REF(i, SYM_INDEX_EXTENSION));
+    }
+  }
+  lbm_uint *curr = symlist;
+  while (curr) {
+    sym_index_insert((char *)curr[NAME], (lbm_uint)curr);
+    curr = (lbm_uint *)curr[NEXT];
+  }
+}
+
+static bool sym_index_lookup(char *name, lbm_uint *ref) {
+  if (!sym_index_valid) {
+    sym_index_build();
+  }
+  if (!sym_index) {
+    return false;
+  }
+  lbm_uint i = sym_index_hash(name) & (sym_index_size - 1);
+  while (sym_index[i] != SYM_INDEX_EMPTY) {
+    char *str = sym_index_name(sym_index[i]);
+    if (str && str_eq(name, str)) {
+      *ref = sym_index[i];
+      return true;
+    }
+    i = (i + 1) & (sym_index_size - 1);
+  }
+  return false;
+}
+
+int lbm_symrepr_init_index(lbm_uint *storage, lbm_uint size) {
+  sym_index_valid = false;
+  sym_index_complete = false;
+  if (storage == NULL || size < 4 || (size & (size - 1)) != 0) {
+    sym_index = NULL;
+    sym_index_size = 0;
+    return storage == NULL;
+  }
+  sym_index = storage;
+  sym_index_size = size;
+  return 1;
+}
+
+void lbm_symrepr_invalidate_index(void) {
+  sym_index_valid = false;
+}
+
+void lbm_symrepr_index_extension(lbm_uint ext_ix) {
+  sym_index_insert(extension_table[ext_ix].name, SYM_INDEX_REF(ext_ix, SYM_INDEX_EXTENSION));
+}
+
 // When rebooting an image...
 void lbm_symrepr_set_symlist(lbm_uint *ls) {
   symlist = ls;
+  sym_index_valid = false;
 }
 
 
@@ -285,6 +423,7 @@ int lbm_symrepr_init(void) {
   symbol_table_size_list_flash = 0;
   symbol_table_size_strings = 0;
   symbol_table_size_strings_flash = 0;
+  sym_index_valid = false;
   return 1;
 }
 
@@ -335,7 +474,7 @@ const char *lbm_get_name_by_symbol(lbm_uint id) {
   }
 }
 
-lbm_uint *lbm_get_symbol_list_entry_by_name(char *name) {
+static lbm_uint *get_symbol_list_entry_linear(char *name) {
   lbm_uint *curr = symlist;
   while (curr) {
     char *str = (char*)curr[NAME];
@@ -347,8 +486,22 @@ lbm_uint *lbm_get_symbol_list_entry_by_name(char *name) {
   return NULL;
 }
 
-// Lookup symbol id given symbol name
-int lbm_get_symbol_by_name(char *name, lbm_uint* id) {
+lbm_uint *lbm_get_symbol_list_entry_by_name(char *name) {
+  lbm_uint ref;
+  if (sym_index_lookup(name, &ref)) {
+    if (SYM_INDEX_TAG(ref) == SYM_INDEX_EMPTY) {
+      return (lbm_uint *)ref;
+    }
+    // Shadowed by a special symbol or an extension.
+    return get_symbol_list_entry_linear(name);
+  }
+  if (sym_index_complete) {
+    return NULL;
+  }
+  return get_symbol_list_entry_linear(name);
+}
+
+static int get_symbol_by_name_linear(char *name, lbm_uint* id) {
 
   // loop through special symbols
   for (unsigned int i = 0; i < NUM_SPECIAL_SYMBOLS; i ++) {
@@ -366,18 +519,27 @@ int lbm_get_symbol_by_name(char *name, lbm_uint* id) {
     }
   }
 
-  lbm_uint *curr = symlist;
-  while (curr) {
-    char *str = (char*)curr[NAME];
-    if (str_eq(name, str)) {
-      *id = curr[ID];
-      return 1;
-    }
-    curr = (lbm_uint*)curr[NEXT];
+  lbm_uint *curr = get_symbol_list_entry_linear(name);
+  if (curr) {
+    *id = curr[ID];
+    return 1;
   }
   return 0;
 }
 
+// Lookup symbol id given symbol name
+int lbm_get_symbol_by_name(char *name, lbm_uint* id) {
+  lbm_uint ref;
+  if (sym_index_lookup(name, &ref)) {
+    *id = sym_index_id(ref);
+    return 1;
+  }
+  if (sym_index_complete) {
+    return 0;
+  }
+  return get_symbol_by_name_linear(name, id);
+}
+
 extern lbm_flash_status lbm_write_const_array_padded(uint8_t *data, lbm_uint n, lbm_uint *res);
 
 bool store_symbol_name_flash(char *name, lbm_uint *res) {
@@ -425,6 +587,7 @@ int lbm_add_symbol_base(char *name, lbm_uint *id) {
     return 0;
   }
   symlist = new_symlist;
+  sym_index_insert((char *)symlist[NAME], (lbm_uint)symlist);
   *id = next_symbol_id ++;
   return 1;
 }
@@ -452,6 +615,7 @@ int lbm_add_symbol_const_base(char *name, lbm_uint* id, bool link) {
   }
   if (new_symlist) {
     symlist = new_symlist;
+    sym_index_insert((char *)symlist[NAME], (lbm_uint)symlist);
     *id = next_symbol_id ++;
     return 1;
   }
@@ -65,7 +65,7 @@ const char special_chars[NUM_SPECIAL_CHARS][2] =
    {'\\', '\\'},
    {'d', 127}};
 
-#define NUM_FIXED_SIZE_TOKENS 18
+#define NUM_FIXED_SIZE_TOKENS 17
 const matcher fixed_size_tokens[NUM_FIXED_SIZE_TOKENS] = {
   {"(", TOKOPENPAR, 1},
   {")", TOKCLOSEPAR, 1},
@@ -99,7 +99,52 @@ const matcher type_qual_table[NUM_TYPE_QUALIFIERS] = {
   {"b"  , TOKTYPEBYTE, 1}
 };
 
-static int tok_match_fixed_size_tokens(lbm_char_channel_t *chan, const matcher *m, unsigned int start_pos, unsigned int num, uint32_t *res) {
+/*
+  The tokenizer reads characters through a tok_src_t. For channels
+  backed by contiguous memory (string channels) the unread data is
+  accessed directly, otherwise each character is peeked through the
+  channel interface. A tok_src_t is only valid until the next read or
+  drop on the channel.
+*/
+typedef struct {
+  lbm_char_channel_t *chan;
+  const char *data;
+  unsigned int len;
+} tok_src_t;
+
+static inline void tok_src_init(tok_src_t *src, lbm_char_channel_t *chan) {
+  src->chan = chan;
+  src->data = lbm_channel_contiguous_data(chan, &src->len);
+}
+
+static inline int tok_peek(tok_src_t *src, unsigned int n, char *res) {
+  if (src->data) {
+    if (n < src->len) {
+      *res = src->data[n];
+      return CHANNEL_SUCCESS;
+    }
+    return CHANNEL_END;
+  }
+  return lbm_channel_peek(src->chan, n, res);
+}
+
+static int tok_match_fixed_size_tokens(tok_src_t *src, const matcher *m, unsigned int start_pos, unsigned int num, uint32_t *res) {
+
+  if (src->data) {
+    if (start_pos >= src->len) return TOKENIZER_NO_TOKEN;
+    const char *d = src->data + start_pos;
+    unsigned int avail = src->len - start_pos;
+    for (unsigned int i = 0; i < num; i ++) {
+      uint32_t tok_len = m[i].len;
+      if (d[0] == m[i].str[0] &&
+          tok_len <= avail &&
+          memcmp(d, m[i].str, tok_len) == 0) {
+        *res = m[i].token;
+        return (int)tok_len;
+      }
+    }
+    return TOKENIZER_NO_TOKEN;
+  }
 
   for (unsigned int i = 0; i < num; i ++) {
     uint32_t tok_len = m[i].len;
@@ -107,7 +152,7 @@ static int tok_match_fixed_size_tokens(lbm_char_channel_t *chan, const matcher *
     char c;
     int char_pos;
     for (char_pos = 0; char_pos < (int)tok_len; char_pos ++) {
-      int r = lbm_channel_peek(chan,(unsigned int)char_pos + start_pos, &c);
+      int r = tok_peek(src,(unsigned int)char_pos + start_pos, &c);
       if (r == CHANNEL_SUCCESS) {
         if (c != match_str[char_pos]) break;
       } else if (r == CHANNEL_MORE ) {
@@ -126,7 +171,9 @@ static int tok_match_fixed_size_tokens(lbm_char_channel_t *chan, const matcher *
 }
 
 int tok_syntax(lbm_char_channel_t *chan, uint32_t *res) {
-  return tok_match_fixed_size_tokens(chan, fixed_size_tokens, 0, NUM_FIXED_SIZE_TOKENS, res);
+  tok_src_t src;
+  tok_src_init(&src, chan);
+  return tok_match_fixed_size_tokens(&src, fixed_size_tokens, 0, NUM_FIXED_SIZE_TOKENS, res);
 }
 
 static bool alpha_char(char c) {
@@ -139,46 +186,45 @@ static bool num_char(char c) {
 }
 
 static bool symchar0(char c) {
-  const char *allowed = "+-*/=<>#!";
-
   if (alpha_char(c)) return true;
-  int i = 0;
-  while (allowed[i] != 0) {
-    if (c == allowed[i]) return true;
-    i ++;
+  switch (c) {
+  case '+': case '-': case '*': case '/': case '=':
+  case '<': case '>': case '#': case '!':
+    return true;
+  default:
+    return false;
   }
-  return false;
 }
 
 static bool symchar(char c) {
-  const char *allowed = "+-*/=<>!?_";
-
   if (alpha_char(c) || num_char(c)) return true;
-  int i = 0;
-  while (allowed[i] != 0) {
-    if (c == allowed[i]) return true;
-    i++;
+  switch (c) {
+  case '+': case '-': case '*': case '/': case '=':
+  case '<': case '>': case '!': case '?': case '_':
+    return true;
+  default:
+    return false;
   }
-  return false;
 }
 
 int tok_symbol(lbm_char_channel_t *chan) {
-
+  tok_src_t src;
+  tok_src_init(&src, chan);
   char c;
   int r = 0;
 
-  r = lbm_channel_peek(chan, 0, &c);
+  r = tok_peek(&src, 0, &c);
   if (r == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   if (r == CHANNEL_END)  return TOKENIZER_NO_TOKEN;
   if (r == CHANNEL_SUCCESS && !symchar0(c)) {
     return TOKENIZER_NO_TOKEN;
   }
-  memset(tokpar_sym_str,0,TOKENIZER_MAX_SYMBOL_AND_STRING_LENGTH+1);
+  // len < 255 so the terminator written below is within the buffer.
   tokpar_sym_str[0] = (char)tolower(c);
 
   int len = 1;
 
-  r = lbm_channel_peek(chan,(unsigned int)len, &c);
+  r = tok_peek(&src,(unsigned int)len, &c);
   while (r == CHANNEL_SUCCESS && symchar(c)) {
     if (len >= 255) return TOKENIZER_SYMBOL_ERROR;
     c = (char)tolower(c);
@@ -186,7 +232,7 @@ int tok_symbol(lbm_char_channel_t *chan) {
       tokpar_sym_str[len] = (char)c;
     }
     len ++;
-    r = lbm_channel_peek(chan,(unsigned int)len, &c);
+    r = tok_peek(&src,(unsigned int)len, &c);
   }
   if (r == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   tokpar_sym_str[len] = 0;
@@ -206,6 +252,8 @@ static char translate_escape_char(char c) {
 }
 
 int tok_string(lbm_char_channel_t *chan, unsigned int *string_len) {
+  tok_src_t src;
+  tok_src_init(&src, chan);
 
   unsigned int n = 0;
   unsigned int len = 0;
@@ -213,7 +261,7 @@ int tok_string(lbm_char_channel_t *chan, unsigned int *string_len) {
   int r = 0;
   bool encode = false;
 
-  r = lbm_channel_peek(chan,0,&c);
+  r = tok_peek(&src,0,&c);
   if (r == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   else if (r == CHANNEL_END) return TOKENIZER_NO_TOKEN;
 
@@ -223,7 +271,7 @@ int tok_string(lbm_char_channel_t *chan, unsigned int *string_len) {
   memset(tokpar_sym_str,0,TOKENIZER_MAX_SYMBOL_AND_STRING_LENGTH+1);
 
   // read string into buffer
-  r = lbm_channel_peek(chan,n,&c);
+  r = tok_peek(&src,n,&c);
   while (r == CHANNEL_SUCCESS && (c != '\"' || encode) &&
 	 len < TOKENIZER_MAX_SYMBOL_AND_STRING_LENGTH) {
     if (c == '\\' && !encode) {
@@ -234,7 +282,7 @@ int tok_string(lbm_char_channel_t *chan, unsigned int *string_len) {
       encode = false;
     }
     n ++;
-    r = lbm_channel_peek(chan, n, &c);
+    r = tok_peek(&src, n, &c);
   }
 
   if (r == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
@@ -246,28 +294,29 @@ int tok_string(lbm_char_channel_t *chan, unsigned int *string_len) {
 }
 
 int tok_char(lbm_char_channel_t *chan, char *res) {
-
+  tok_src_t src;
+  tok_src_init(&src, chan);
   char c;
   int r;
 
-  r = lbm_channel_peek(chan, 0, &c);
+  r = tok_peek(&src, 0, &c);
   if (r == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   if (r == CHANNEL_END)  return TOKENIZER_NO_TOKEN;
 
   if (c != '\\') return TOKENIZER_NO_TOKEN;
 
-  r = lbm_channel_peek(chan, 1, &c);
+  r = tok_peek(&src, 1, &c);
   if (r == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   if (r == CHANNEL_END)  return TOKENIZER_NO_TOKEN;
 
   if (c != '#') return TOKENIZER_NO_TOKEN;
 
-  r = lbm_channel_peek(chan, 2, &c);
+  r = tok_peek(&src, 2, &c);
   if (r == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   if (r == CHANNEL_END)  return TOKENIZER_NO_TOKEN;
 
   if (c == '\\') {
-    r = lbm_channel_peek(chan, 3, &c);
+    r = tok_peek(&src, 3, &c);
     if (r == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
     if (r == CHANNEL_END)  return TOKENIZER_NO_TOKEN;
 
@@ -289,6 +338,8 @@ int tok_char(lbm_char_channel_t *chan, char *res) {
 }
 
 int tok_double(lbm_char_channel_t *chan, token_float *result) {
+  tok_src_t src;
+  tok_src_init(&src, chan);
 
   unsigned int n = 0;
   char fbuf[128];
@@ -301,7 +352,7 @@ int tok_double(lbm_char_channel_t *chan, token_float *result) {
   result->type = TOKTYPEF32;
   result->negative = false;
 
-  res = lbm_channel_peek(chan, 0, &c);
+  res = tok_peek(&src, 0, &c);
   if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   else if (res == CHANNEL_END) return TOKENIZER_NO_TOKEN;
   if (c == '-') {
@@ -310,13 +361,13 @@ int tok_double(lbm_char_channel_t *chan, token_float *result) {
     result->negative = true;
   }
 
-  res = lbm_channel_peek(chan, n, &c);
+  res = tok_peek(&src, n, &c);
   if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   else if (res == CHANNEL_END) return TOKENIZER_NO_TOKEN;
   while (c >= '0' && c <= '9') {
     fbuf[n] = c;
     n++;
-    res = lbm_channel_peek(chan, n, &c);
+    res = tok_peek(&src, n, &c);
     if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
     if (res == CHANNEL_END) break;
   }
@@ -328,7 +379,7 @@ int tok_double(lbm_char_channel_t *chan, token_float *result) {
 
   else return TOKENIZER_NO_TOKEN;
 
-  res = lbm_channel_peek(chan,n, &c);
+  res = tok_peek(&src,n, &c);
   if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
   else if (res == CHANNEL_END) return TOKENIZER_NO_TOKEN;
   if (!(c >= '0' && c <= '9')) return TOKENIZER_NO_TOKEN;
@@ -336,7 +387,7 @@ int tok_double(lbm_char_channel_t *chan, token_float *result) {
   while (c >= '0' && c <= '9') {
     fbuf[n] = c;
     n++;
-    res = lbm_channel_peek(chan, n, &c);
+    res = tok_peek(&src, n, &c);
     if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
     if (res == CHANNEL_END) break;
   }
@@ -344,7 +395,7 @@ int tok_double(lbm_char_channel_t *chan, token_float *result) {
   if (c == 'e') {
     fbuf[n] = c;
     n++;
-    res = lbm_channel_peek(chan,n, &c);
+    res = tok_peek(&src,n, &c);
     if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
     else if (res == CHANNEL_END) return TOKENIZER_NO_TOKEN;
     if (!((c >= '0' && c <= '9') || c == '-')) return TOKENIZER_NO_TOKEN;
@@ -352,14 +403,14 @@ int tok_double(lbm_char_channel_t *chan, token_float *result) {
     while ((c >= '0' && c <= '9') || c == '-') {
       fbuf[n] = c;
       n++;
-      res = lbm_channel_peek(chan, n, &c);
+      res = tok_peek(&src, n, &c);
       if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
       if (res == CHANNEL_END) break;
     }
   }
 
   uint32_t tok_res;
-  int type_len = tok_match_fixed_size_tokens(chan, type_qual_table, n, NUM_TYPE_QUALIFIERS, &tok_res);
+  int type_len = tok_match_fixed_size_tokens(&src, type_qual_table, n, NUM_TYPE_QUALIFIERS, &tok_res);
 
   if (type_len == TOKENIZER_NEED_MORE) return type_len;
   if (type_len == TOKENIZER_NO_TOKEN) {
@@ -384,6 +435,28 @@ int tok_double(lbm_char_channel_t *chan, token_float *result) {
 
 bool tok_clean_whitespace(lbm_char_channel_t *chan) {
 
+  tok_src_t src;
+  tok_src_init(&src, chan);
+  if (src.data) {
+    // Find the end of the whitespace and comments and drop it all at once.
+    bool comment = lbm_channel_comment(chan);
+    unsigned int n = 0;
+    while (n < src.len) {
+      char c = src.data[n];
+      if (comment) {
+        if (c == '\n') comment = false;
+      } else if (c == ';') {
+        comment = true;
+      } else if (!isspace(c)) {
+        break;
+      }
+      n ++;
+    }
+    if (n > 0) lbm_channel_drop(chan, n);
+    lbm_channel_set_comment(chan, false);
+    return true;
+  }
+
   bool cleaning_whitespace = true;
   char c;
   int r;
@@ -432,6 +505,8 @@ bool tok_clean_whitespace(lbm_char_channel_t *chan) {
 }
 
 int tok_integer(lbm_char_channel_t *chan, token_int *result) {
+  tok_src_t src;
+  tok_src_init(&src, chan);
   uint64_t acc = 0;
   unsigned int n = 0;
   bool valid_num = false;
@@ -440,7 +515,7 @@ int tok_integer(lbm_char_channel_t *chan, token_int *result) {
 
   result->type = TOKTYPEI;
   result-> negative = false;
-  res = lbm_channel_peek(chan, 0, &c);
+  res = tok_peek(&src, 0, &c);
   if (res == CHANNEL_MORE) {
     return TOKENIZER_NEED_MORE;
   } else if (res == CHANNEL_END) {
@@ -452,9 +527,9 @@ int tok_integer(lbm_char_channel_t *chan, token_int *result) {
   }
 
   bool hex = false;
-  res = lbm_channel_peek(chan, n, &c);
+  res = tok_peek(&src, n, &c);
   if (res == CHANNEL_SUCCESS && c == '0') {
-    res = lbm_channel_peek(chan, n + 1, &c);
+    res = tok_peek(&src, n + 1, &c);
     if ( res == CHANNEL_SUCCESS && (c == 'x' || c == 'X')) {
       hex = true;
     } else if (res == CHANNEL_MORE) {
@@ -467,7 +542,7 @@ int tok_integer(lbm_char_channel_t *chan, token_int *result) {
   if (hex) {
     n += 2;
 
-    res = lbm_channel_peek(chan,n, &c);
+    res = tok_peek(&src,n, &c);
 
     if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
     else if (res == CHANNEL_END) return TOKENIZER_NO_TOKEN;
@@ -485,18 +560,18 @@ int tok_integer(lbm_char_channel_t *chan, token_int *result) {
       }
       acc = (acc * 0x10) + val;
       n++;
-      res = lbm_channel_peek(chan, n, &c);
+      res = tok_peek(&src, n, &c);
       if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
       if (res == CHANNEL_END) break;
 
     }
   } else {
-    res = lbm_channel_peek(chan, n, &c);
+    res = tok_peek(&src, n, &c);
     if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
     while (c >= '0' && c <= '9') {
       acc = (acc*10) + (uint32_t)(c - '0');
       n++;
-      res = lbm_channel_peek(chan, n, &c);
+      res = tok_peek(&src, n, &c);
       if (res == CHANNEL_MORE) return TOKENIZER_NEED_MORE;
       if (res == CHANNEL_END)  break;
     }
@@ -505,7 +580,7 @@ int tok_integer(lbm_char_channel_t *chan, token_int *result) {
   if (n == 0) return TOKENIZER_NO_TOKEN;
 
   uint32_t tok_res;
-  int type_len = tok_match_fixed_size_tokens(chan, type_qual_table, n, NUM_TYPE_QUALIFIERS, &tok_res);
+  int type_len = tok_match_fixed_size_tokens(&src, type_qual_table, n, NUM_TYPE_QUALIFIERS, &tok_res);
 
   if (type_len == TOKENIZER_NEED_MORE) return type_len;
   if (type_len != TOKENIZER_NO_TOKEN) {
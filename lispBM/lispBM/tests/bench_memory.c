@@ -0,0 +1,163 @@
+/* Allocation latency and fragmentation benchmark for lbm_memory.
+
+   A fixed number of slots are kept live. Each step frees a random
+   slot and allocates a new block in it, with sizes drawn from a mix
+   that is dominated by small blocks (array headers, short strings)
+   with the occasional large block (context stacks, flat values).
+
+   Usage: bench_memory [num_steps] [num_slots]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lbm_memory.h"
+
+#define MEMORY_SIZE   LBM_MEMORY_SIZE_16K
+#define BITMAP_SIZE   LBM_MEMORY_BITMAP_SIZE_16K
+#define MAX_SLOTS     256
+#define DEFAULT_SLOTS 128
+#define DEFAULT_STEPS 1000000
+
+static lbm_uint memory[MEMORY_SIZE];
+static lbm_uint bitmap[BITMAP_SIZE];
+
+static lbm_uint *slot_ptr[MAX_SLOTS];
+static lbm_uint slot_size[MAX_SLOTS];
+static unsigned int num_slots = DEFAULT_SLOTS;
+
+// lbm_memory requests GC from the evaluator when running low.
+void lbm_request_gc(void) {
+}
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static lbm_uint random_size(void) {
+  uint32_t r = rng() % 100;
+  if (r < 70) return 1 + rng() % 8;
+  if (r < 95) return 9 + rng() % 56;
+  return 65 + rng() % 192;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+// Fill each live block with its slot number and check that no other
+// allocation has written over it.
+static int check_slots(void) {
+  for (unsigned int i = 0; i < num_slots; i ++) {
+    for (lbm_uint j = 0; j < slot_size[i]; j ++) {
+      if (slot_ptr[i][j] != i) {
+        printf("Slot %u corrupted at word %u\n", i, (unsigned int)j);
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  unsigned long steps = DEFAULT_STEPS;
+  if (argc > 1) {
+    steps = strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    num_slots = (unsigned int)strtoul(argv[2], NULL, 10);
+    if (num_slots == 0 || num_slots > MAX_SLOTS) {
+      printf("num_slots must be between 1 and %d\n", MAX_SLOTS);
+      return 1;
+    }
+  }
+
+  if (!lbm_memory_init(memory, MEMORY_SIZE, bitmap, BITMAP_SIZE)) {
+    printf("Error initializing lbm_memory\n");
+    return 1;
+  }
+  lbm_memory_set_reserve(0);
+
+  memset(slot_ptr, 0, sizeof(slot_ptr));
+  memset(slot_size, 0, sizeof(slot_size));
+
+  unsigned long num_failed = 0;
+  uint64_t alloc_ns = 0;
+  uint64_t alloc_max_ns = 0;
+  uint64_t free_ns = 0;
+
+  uint64_t start = now_ns();
+  for (unsigned long s = 0; s < steps; s ++) {
+    unsigned int i = rng() % num_slots;
+    uint64_t t0 = now_ns();
+    if (slot_ptr[i]) {
+      lbm_memory_free(slot_ptr[i]);
+      slot_ptr[i] = NULL;
+      slot_size[i] = 0;
+    }
+    uint64_t t1 = now_ns();
+    lbm_uint n = random_size();
+    lbm_uint *p = lbm_memory_allocate(n);
+    uint64_t t2 = now_ns();
+
+    free_ns += t1 - t0;
+    alloc_ns += t2 - t1;
+    if (t2 - t1 > alloc_max_ns) alloc_max_ns = t2 - t1;
+
+    if (p) {
+      for (lbm_uint j = 0; j < n; j ++) p[j] = i;
+      slot_ptr[i] = p;
+      slot_size[i] = n;
+    } else {
+      num_failed ++;
+    }
+  }
+  uint64_t total = now_ns() - start;
+
+  if (!check_slots()) return 1;
+
+  lbm_uint live = 0;
+  for (unsigned int i = 0; i < num_slots; i ++) live += slot_size[i];
+  if (lbm_memory_num_free() != MEMORY_SIZE - live) {
+    printf("Free count mismatch: %u free, %u live\n",
+           (unsigned int)lbm_memory_num_free(), (unsigned int)live);
+    return 1;
+  }
+
+  printf("Steps:              %lu\n", steps);
+  printf("Live slots:         %u\n", num_slots);
+  printf("Failed allocations: %lu\n", num_failed);
+  printf("Total time:         %.3f s\n", (double)total / 1e9);
+  printf("Allocate avg:       %.1f ns\n", (double)alloc_ns / (double)steps);
+  printf("Allocate max:       %.1f us\n", (double)alloc_max_ns / 1e3);
+  printf("Free avg:           %.1f ns\n", (double)free_ns / (double)steps);
+
+  // Free every other slot to expose fragmentation.
+  for (unsigned int i = 0; i < num_slots; i += 2) {
+    if (slot_ptr[i]) {
+      lbm_memory_free(slot_ptr[i]);
+      slot_ptr[i] = NULL;
+      slot_size[i] = 0;
+    }
+  }
+  lbm_uint num_free = lbm_memory_num_free();
+  lbm_uint longest = lbm_memory_longest_free();
+  printf("Free words:         %u\n", (unsigned int)num_free);
+  printf("Longest free:       %u\n", (unsigned int)longest);
+  printf("Fragmentation:      %.1f %%\n",
+         100.0 * (1.0 - (double)longest / (double)num_free));
+
+  if (!check_slots()) return 1;
+  return 0;
+}
@@ -28,6 +28,7 @@
 
 #include "lispbm.h"
 #include "extensions/array_extensions.h"
+#include "extensions/vector_extensions.h"
 #include "extensions/math_extensions.h"
 #include "extensions/string_extensions.h"
 #include "extensions/runtime_extensions.h"
@@ -44,6 +45,7 @@
 #define GC_STACK_SIZE 96
 #define PRINT_STACK_SIZE 256
 #define EXTENSION_STORAGE_SIZE 200
+#define SYMBOL_INDEX_SIZE 1024
 #define CONSTANT_MEMORY_SIZE 4*1024 // in words
 
 
@@ -51,6 +53,7 @@
 #define SUCCESS 1
 
 lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
+lbm_uint symbol_index[SYMBOL_INDEX_SIZE];
 
 #define IMAGE_STORAGE_SIZE              (128 * 1024)
 #ifdef LBM64
@@ -443,6 +446,72 @@ LBM_EXTENSION(ext_flatten_depth, args, argn) {
   return res;
 }
 
+static uint8_t stream_out[32768];
+static lbm_uint stream_out_len = 0;
+
+static bool stream_out_sink(uint8_t *data, lbm_uint len, void *arg) {
+  lbm_uint *max_len = (lbm_uint*)arg;
+  if (len > *max_len || stream_out_len + len > sizeof(stream_out)) return false;
+  memcpy(stream_out + stream_out_len, data, len);
+  stream_out_len += len;
+  return true;
+}
+
+// (flatten-stream v chunk-size feed-size)
+// Flattens v through a chunk-size buffer and checks the result against
+// flatten. Then unflattens it feed-size bytes at a time with a GC
+// between every few feeds.
+LBM_EXTENSION(ext_flatten_stream, args, argn) {
+  if (argn != 3 || !lbm_is_number(args[1]) || !lbm_is_number(args[2])) {
+    return ENC_SYM_TERROR;
+  }
+  lbm_uint chunk_size = lbm_dec_as_u32(args[1]);
+  lbm_uint feed_size = lbm_dec_as_u32(args[2]);
+  uint8_t chunk[256];
+  if (chunk_size == 0 || chunk_size > sizeof(chunk) || feed_size == 0) return ENC_SYM_EERROR;
+
+  lbm_flat_stream_t fs;
+  stream_out_len = 0;
+  lbm_flat_stream_init(&fs, chunk, chunk_size, stream_out_sink, &chunk_size);
+  int r = lbm_flatten_value_stream(&fs, args[0]);
+  if (r != FLATTEN_VALUE_OK) return ENC_SYM_EERROR;
+  if (fs.total != stream_out_len) return ENC_SYM_NIL;
+
+  lbm_value flat = flatten_value(args[0]);
+  if (!lbm_is_array_r(flat)) return flat;
+  lbm_array_header_t *arr = lbm_dec_array_r(flat);
+  if (arr->size < stream_out_len ||
+      memcmp(arr->data, stream_out, stream_out_len) != 0) {
+    return ENC_SYM_NIL;
+  }
+
+  lbm_unflatten_stream_t us;
+  lbm_unflatten_stream_init(&us);
+  lbm_value res = ENC_SYM_NIL;
+  lbm_uint pos = 0;
+  lbm_uint feeds = 0;
+  r = UNFLATTEN_MORE;
+  while (r == UNFLATTEN_MORE || r == UNFLATTEN_GC_RETRY) {
+    if (r == UNFLATTEN_GC_RETRY || (feeds++ % 4) == 0) {
+      lbm_perform_gc();
+    }
+    lbm_uint n = stream_out_len - pos;
+    if (n > feed_size) n = feed_size;
+    lbm_uint consumed;
+    int prev = r;
+    r = lbm_unflatten_stream_feed(&us, stream_out + pos, n, &consumed, &res);
+    pos += consumed;
+    if (r == UNFLATTEN_MORE && pos == stream_out_len) break;
+    if (r == UNFLATTEN_GC_RETRY && prev == UNFLATTEN_GC_RETRY && consumed == 0) {
+      lbm_unflatten_stream_end(&us);
+      return ENC_SYM_MERROR;
+    }
+  }
+  lbm_unflatten_stream_end(&us);
+  if (r != UNFLATTEN_OK || pos != stream_out_len) return ENC_SYM_EERROR;
+  return res;
+}
+
 int main(int argc, char **argv) {
 
   int res = 0;
@@ -556,6 +625,8 @@ int main(int argc, char **argv) {
     return FAIL;
   }
 
+  lbm_symrepr_init_index(symbol_index, SYMBOL_INDEX_SIZE);
+
   if (lbm_init(heap_storage, heap_size,
                memory, LBM_MEMORY_SIZE_16K,
                bitmap, LBM_MEMORY_BITMAP_SIZE_16K,
@@ -592,6 +663,7 @@ int main(int argc, char **argv) {
   }
 
   lbm_array_extensions_init();
+  lbm_vector_extensions_init();
   lbm_math_extensions_init();
   lbm_string_extensions_init();
   lbm_runtime_extensions_init();
@@ -617,6 +689,7 @@ int main(int argc, char **argv) {
   lbm_add_extension("check", ext_check);
   lbm_add_extension("load-inc-i", ext_load_inc_i);
   lbm_add_extension("flatten-depth", ext_flatten_depth);
+  lbm_add_extension("flatten-stream", ext_flatten_stream);
 
   if (lbm_get_num_extensions() < lbm_get_max_extensions()) {
     printf("Extensions loaded successfully\n");
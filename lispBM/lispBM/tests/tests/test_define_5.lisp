@@ -0,0 +1,32 @@
+;; Enough globals to make the global environment grow a few times.
+
+(define n-syms 150)
+
+(define mk-sym (lambda (i) (str2sym (str-merge "glob-" (to-str i)))))
+
+(define def-all (lambda (i)
+  (if (< i n-syms)
+      (progn
+        (eval (list 'define (mk-sym i) i))
+        (def-all (+ i 1)))
+    t)))
+
+(define sum-all (lambda (i acc)
+  (if (< i n-syms)
+      (sum-all (+ i 1) (+ acc (eval (mk-sym i))))
+    acc)))
+
+(def-all 0)
+
+(define r1 (= (sum-all 0 0) 11175))
+
+(setq glob-10 1000)
+(define glob-20 2000)
+(undefine 'glob-30)
+
+(define r2 (and (= glob-10 1000) (= glob-20 2000) (= glob-149 149)))
+(define r3 (eq '(exit-error variable_not_bound) (trap glob-30)))
+(define glob-30 30)
+(define r4 (= (sum-all 0 0) (+ 11175 (- 1000 10) (- 2000 20))))
+
+(check (and r1 r2 r3 r4))
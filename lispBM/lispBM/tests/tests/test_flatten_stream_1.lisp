@@ -0,0 +1,20 @@
+
+(define vals (list 1 -2 3u 4i32 5u32 6.5f32 7i64 8u64 9.25 'apa "a string" [1 2 3]
+                   '(1 2u32 3i32 3.0)
+                   '(a (b (c d)) . e)
+                   [| 1 (2 3) [| 4 5 |] 'sym "str" |]
+                   (list [| |] nil t)))
+
+(defun test (v chunk feed)
+  (eq (flatten-stream v chunk feed) v))
+
+(defun test-all (vs)
+  (if (eq vs nil) t
+    (and (test (car vs) 1 1)
+         (test (car vs) 3 2)
+         (test (car vs) 7 5)
+         (test (car vs) 64 1)
+         (test (car vs) 1 64)
+         (test-all (cdr vs)))))
+
+(check (test-all vals))
@@ -0,0 +1,16 @@
+
+(define big (bufcreate 1000))
+(looprange i 0 1000 (bufset-u8 big i (mod (* i 7) 256)))
+
+(define long-list (range 200))
+
+(define r1 (eq (flatten-stream big 64 100) big))
+(define r2 (eq (flatten-stream big 7 3) big))
+(define r3 (eq (flatten-stream long-list 16 13) long-list))
+(define r4 (eq (flatten-stream (list big long-list) 32 1000) (list big long-list)))
+
+(flatten-depth 2)
+
+(define r5 (eq '(exit-error eval_error) (trap (flatten-stream (list (list (list 1 2 3))) 8 8))))
+
+(check (and r1 r2 r3 r4 r5))
@@ -0,0 +1,35 @@
+
+;; A long running application must let other contexts run.
+
+(define ticks 0)
+
+(defun ticker ()
+  (progn
+    (setq ticks (+ ticks 1))
+    (yield 10)
+    (ticker)))
+
+(defun fib (n)
+  (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+
+(defun count-to (n)
+  (let ((s 0))
+    (progn
+      (loop ((i 0)) (< i n)
+            (progn
+              (setq s (+ s 2))
+              (setq i (+ i 1))))
+      s)))
+
+(spawn ticker)
+
+(define t0 ticks)
+(define r1 (fib 22))
+(define t1 ticks)
+(define r2 (count-to 50000))
+(define t2 ticks)
+
+(check (and (= r1 17711)
+            (= r2 100000)
+            (> (- t1 t0) 10)
+            (> (- t2 t1) 10)))
@@ -0,0 +1,29 @@
+;; Create a lot of symbols through the reader and make sure every name
+;; still resolves to one and the same symbol.
+
+(defun mk-name (n) (str-join (list "sym-ix-" (str-from-n n))))
+
+(defun make-syms (n acc)
+  (if (= n 0)
+      acc
+    (make-syms (- n 1) (cons (read (mk-name n)) acc))))
+
+(defun all-same (n ls)
+  (if (eq ls nil)
+      t
+    (if (and (eq (car ls) (str2sym (mk-name n)))
+             (eq (sym2str (car ls)) (mk-name n)))
+        (all-same (+ n 1) (cdr ls))
+      nil)))
+
+(define syms (make-syms 200 nil))
+
+(define r1 (all-same 1 syms))
+(define r2 (not (eq (ix syms 0) (ix syms 1))))
+;; Special symbols, aliases and extensions
+(define r3 (eq (str2sym "first") 'car))
+(define r4 (eq (read "lambda") 'lambda))
+(define r5 (eq (read "ext-even") 'ext-even))
+(define r6 (eq (sym2str (str2sym "str-join")) "str-join"))
+
+(check (and r1 r2 r3 r4 r5 r6))
@@ -0,0 +1,16 @@
+(defun f32-vec (xs)
+  (let ((v (bufcreate (* 4 (length xs)))))
+    (progn
+      (looprange i 0 (length xs)
+                 (bufset-f32 v (* 4 i) (ix xs i) 'little-endian))
+      v)))
+
+(define a (f32-vec '(1.0 2.0 3.0 4.0 5.0)))
+(define b (f32-vec '(2.0 2.0 2.0 2.0 2.0)))
+
+(check (and (= (vec-sum-f32 a) 15.0)
+            (= (vec-mean-f32 a) 3.0)
+            (= (vec-min-f32 a) 1.0)
+            (= (vec-max-f32 a) 5.0)
+            (= (vec-dot-f32 a b) 30.0)
+            (eq (vec-mean-f32 (bufcreate 0)) nil)))
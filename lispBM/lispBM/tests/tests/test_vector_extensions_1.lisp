@@ -0,0 +1,15 @@
+(define v (bufcreate 8))
+(bufset-i16 v 0 -3 'little-endian)
+(bufset-i16 v 2 7 'little-endian)
+(bufset-i16 v 4 30000 'little-endian)
+(bufset-i16 v 6 1 'little-endian)
+
+(define d (bufcreate 8))
+(vec-add-i16 d v 10000)
+
+(check (and (= (vec-sum-i16 v) 30005)
+            (= (vec-min-i16 v) -3)
+            (= (vec-max-i16 v) 30000)
+            (= (vec-dot-i16 v v) 900000059)
+            (= (bufget-i16 d 0 'little-endian) 9997)
+            (= (bufget-i16 d 4 'little-endian) 32767)))
@@ -0,0 +1,18 @@
+(define raw (bufcreate 8))
+(bufset-i16 raw 0 100 'little-endian)
+(bufset-i16 raw 2 200 'little-endian)
+(bufset-i16 raw 4 300 'little-endian)
+(bufset-i16 raw 6 400 'little-endian)
+
+(define cur (bufcreate 16))
+(vec-i16-to-f32 cur raw 0.5 -10.0)
+(vec-mul-f32 cur cur cur)
+(vec-sub-f32 cur cur 1.0)
+
+(define back (bufcreate 8))
+(vec-f32-to-i16 back cur 0.01)
+
+(check (and (= (vec-sum-f32 cur) 65396.0)
+            (= (bufget-i16 back 0 'little-endian) 16)
+            (= (bufget-i16 back 6 'little-endian) 361)
+            (eq (trap (vec-i16-to-f32 raw raw)) '(exit-error eval_error))))
@@ -0,0 +1,29 @@
+(defun f32-vec (xs)
+  (let ((v (bufcreate (* 4 (length xs)))))
+    (progn
+      (looprange i 0 (length xs)
+                 (bufset-f32 v (* 4 i) (ix xs i) 'little-endian))
+      v)))
+
+(defun f32-list (v)
+  (map (lambda (i) (bufget-f32 v (* 4 i) 'little-endian)) (range (/ (buflen v) 4))))
+
+;; Moving sum over 3 samples, filtered in two blocks with history.
+(define taps (f32-vec '(1.0 1.0 1.0)))
+(define hist (f32-vec '(0.0 0.0)))
+(define out (bufcreate 12))
+
+(vec-fir-f32 out (f32-vec '(1.0 2.0 3.0)) taps hist)
+(define r1 (f32-list out))
+(vec-fir-f32 out (f32-vec '(4.0 5.0 6.0)) taps hist)
+(define r2 (f32-list out))
+
+;; Biquad that passes the input through with a one sample delay.
+(define bq (f32-vec '(0.0 1.0 0.0 0.0 0.0 0.0 0.0)))
+(define x (f32-vec '(1.0 2.0 3.0)))
+(vec-biquad-f32 x x bq)
+
+(check (and (eq r1 '(1.0f32 3.0f32 6.0f32))
+            (eq r2 '(9.0f32 12.0f32 15.0f32))
+            (eq (f32-list x) '(0.0f32 1.0f32 2.0f32))
+            (eq (f32-list hist) '(5.0f32 6.0f32))))
@@ -20,7 +20,9 @@ LISPBMSRC = $(LISPBM)/src/env.c \
             $(LISPBM)/src/lbm_prof.c \
             $(LISPBM)/src/lbm_defrag_mem.c \
             $(LISPBM)/src/lbm_image.c \
+            $(LISPBM)/src/lbm_bytecode.c \
             $(LISPBM)/src/extensions/array_extensions.c \
+            $(LISPBM)/src/extensions/vector_extensions.c \
             $(LISPBM)/src/extensions/math_extensions.c \
             $(LISPBM)/src/extensions/string_extensions.c \
             $(LISPBM)/src/extensions/mutex_extensions.c \
@@ -37,26 +37,42 @@
 #define LBM_MEMORY_BITMAP_SIZE_28K LBM_MEMORY_BITMAP_SIZE(448)
 
 #ifndef EXTENSION_STORAGE_SIZE
-#define EXTENSION_STORAGE_SIZE		304
+#define EXTENSION_STORAGE_SIZE		328
+#endif
+
+// Name to symbol hash index, one word per entry. The words are taken from the
+// lisp heap, so it is off by default and every symbol lookup is a linear scan.
+// A board with RAM to spare can enable it in the hwconf. It must be a power of
+// two with room for the about 500 built-in symbols at 3/4 load, e.g. 1024.
+#ifndef SYMBOL_INDEX_SIZE
+#define SYMBOL_INDEX_SIZE			0
 #endif
 
 #ifndef ADC_SAMPLE_MAX_LEN
 #define ADC_SAMPLE_MAX_LEN			1000 // 20 byte per sample
 #endif
 
-#define HEAP_SIZE					(((1024 * 24 + (1000 - ADC_SAMPLE_MAX_LEN) * 20) - (EXTENSION_STORAGE_SIZE * sizeof(lbm_extension_t))) / sizeof(lbm_cons_t))
+#define HEAP_SIZE					(((1024 * 24 + (1000 - ADC_SAMPLE_MAX_LEN) * 20) - (EXTENSION_STORAGE_SIZE * sizeof(lbm_extension_t)) - \
+									(SYMBOL_INDEX_SIZE * sizeof(lbm_uint))) / sizeof(lbm_cons_t))
 #define LISP_MEM_SIZE				LBM_MEMORY_SIZE_28K
 #define LISP_MEM_BITMAP_SIZE		LBM_MEMORY_BITMAP_SIZE_28K
 #define GC_STACK_SIZE				160
 #define PRINT_STACK_SIZE			128
 #define EXT_LOAD_CALLBACK_LEN		20
 #define PROF_DATA_NUM				30
+#define PROF_STACK_NUM				24
 
 __attribute__((section(".ram4"))) static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
 static uint32_t memory_array[LISP_MEM_SIZE];
 __attribute__((section(".ram4"))) static uint32_t bitmap_array[LISP_MEM_BITMAP_SIZE];
 __attribute__((section(".ram4"))) static lbm_extension_t extension_storage[EXTENSION_STORAGE_SIZE];
+#if SYMBOL_INDEX_SIZE > 0
+__attribute__((section(".ram4"))) static lbm_uint symbol_index[SYMBOL_INDEX_SIZE];
+#else
+#define symbol_index				0
+#endif
 __attribute__((section(".ram4"))) static lbm_prof_t prof_data[PROF_DATA_NUM];
+static lbm_prof_stack_t prof_stacks[PROF_STACK_NUM]; // Not in .ram4, the heap is sized to fill it
 static volatile bool prof_running = false;
 
 static lbm_string_channel_state_t string_tok_state;
@@ -249,7 +265,7 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 
 		if (pause_eval(0, 2000)) {
 			lbm_value *glob_env = lbm_get_global_env();
-			for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+			for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
 				if (ind > 300) {
 					break;
 				}
@@ -316,6 +332,9 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 				commands_printf_lisp(
 						":prof report\n"
 						"  Print profiler report");
+				commands_printf_lisp(
+						":prof folded\n"
+						"  Print profiled call stacks in folded format for flamegraph tools");
 				commands_printf_lisp(
 						":env\n"
 						"  Print current environment and variables");
@@ -374,9 +393,11 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 			} else if (strncmp(str, ":prof start", 11) == 0) {
 				if (prof_running) {
 					lbm_prof_init(prof_data, PROF_DATA_NUM);
+					lbm_prof_init_stacks(prof_stacks, PROF_STACK_NUM);
 					commands_printf_lisp("Profiler restarted\n");
 				} else {
 					lbm_prof_init(prof_data, PROF_DATA_NUM);
+					lbm_prof_init_stacks(prof_stacks, PROF_STACK_NUM);
 					prof_running = true;
 					if (lispif_spawn(prof_thd_wrapper, 1024, "LBM Profiler", NULL)) {
 						commands_printf_lisp("Profiler started\n");
@@ -408,11 +429,28 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 				commands_printf_lisp("System:\t%u\t%f%%\n", num_system, (double)(100.0 * ((float)num_system / (float)tot_samples)));
 				commands_printf_lisp("Sleep:\t%u\t%f%%\n", num_sleep, (double)(100.0 * ((float)num_sleep / (float)tot_samples)));
 				commands_printf_lisp("Total:\t%u samples\n", tot_samples);
+				lbm_uint gc_hist[LBM_PROF_GC_PAUSE_BUCKETS];
+				lbm_prof_get_gc_pause_hist(gc_hist);
+				commands_printf_lisp("GC pauses (us)\tCount");
+				for (int i = 0; i < LBM_PROF_GC_PAUSE_BUCKETS; i ++) {
+					if (gc_hist[i] == 0) continue;
+					commands_printf_lisp("%u-%u\t%u", i == 0 ? 0u : 1u << i, (2u << i) - 1, (unsigned int)gc_hist[i]);
+				}
+				commands_printf_lisp("Max:\t%u us\n", (unsigned int)lbm_prof_get_gc_pause_max());
+			} else if (strncmp(str, ":prof folded", 12) == 0) {
+				char line[128];
+				for (int i = 0; i < PROF_STACK_NUM; i ++) {
+					if (prof_stacks[i].cid == -1) break;
+					if (lbm_prof_stack_folded(&prof_stacks[i], line, sizeof(line)) > 0) {
+						commands_printf_lisp("%s", line);
+					}
+				}
+				commands_printf_lisp("Dropped:\t%u stacks\n", (unsigned int)lbm_prof_get_num_dropped_stacks());
 			} else if (strncmp(str, ":env", 4) == 0) {
 				if (pause_eval(0, 1000)) {
 					lbm_value *glob_env = lbm_get_global_env();
 					char output[128];
-					for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+					for (lbm_uint i = 0; i < lbm_get_global_env_roots(); i ++) {
 						lbm_value curr = glob_env[i];
 						while (lbm_type_of(curr) == LBM_TYPE_CONS) {
 							lbm_print_value(output, sizeof(output), lbm_car(curr));
@@ -718,6 +756,7 @@ bool lispif_restart(bool print, bool load_code, bool load_imports) {
 
 		uint32_t image_len = 128 * 256; // 128k, size in words
 
+		lbm_symrepr_init_index(symbol_index, SYMBOL_INDEX_SIZE);
 		lbm_init(heap, HEAP_SIZE,
 				memory_array, LISP_MEM_SIZE,
 				bitmap_array, LISP_MEM_BITMAP_SIZE,
@@ -23,6 +23,7 @@
 #include "lispif.h"
 #include "lispbm.h"
 #include "extensions/array_extensions.h"
+#include "extensions/vector_extensions.h"
 #include "extensions/math_extensions.h"
 #include "extensions/string_extensions.h"
 #include "extensions/mutex_extensions.h"
@@ -40,6 +41,7 @@
 #include "comm_can.h"
 #include "bms.h"
 #include "utils_math.h"
+#include "digital_filter.h"
 #include "utils_sys.h"
 #include "hw.h"
 #include "mcpwm_foc.h"
@@ -2501,34 +2503,24 @@ static int cmp_int (const void * a, const void * b) {
 static lbm_value ext_can_list_devs(lbm_value *args, lbm_uint argn) {
 	(void)args; (void)argn;
 
+	// Nodes that have not sent status 1 yet leave gaps in the table, so all
+	// entries are checked.
+	int devs[CAN_STATUS_MSGS_TO_STORE];
 	int dev_num = 0;
-	can_status_msg *msg = comm_can_get_status_msg_index(dev_num);
 
-	while (msg && msg->id >= 0) {
-		dev_num++;
-		msg = comm_can_get_status_msg_index(dev_num);
-	}
-
-	int devs[dev_num];
-
-	for (int i = 0;i < dev_num;i++) {
-		msg = comm_can_get_status_msg_index(i);
-		if (msg) {
-			devs[i] = msg->id;
-		} else {
-			devs[i] = -1;
+	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+		can_status_msg *msg = comm_can_get_status_msg_index(i);
+		if (!msg || msg->id < 0) {
+			continue;
 		}
+		devs[dev_num++] = msg->id;
 	}
 
 	qsort(devs, dev_num, sizeof(int), cmp_int);
 	lbm_value dev_list = ENC_SYM_NIL;
 
 	for (int i = (dev_num - 1);i >= 0;i--) {
-		if (devs[i] >= 0) {
-			dev_list = lbm_cons(lbm_enc_i(devs[i]), dev_list);
-		} else {
-			break;
-		}
+		dev_list = lbm_cons(lbm_enc_i(devs[i]), dev_list);
 	}
 
 	return dev_list;
@@ -2700,6 +2692,38 @@ static lbm_value ext_rand_max(lbm_value *args, lbm_uint argn) {
 	return lbm_enc_i32(RAND_MAX);
 }
 
+/*
+ * args[0]: Array of LBM_VEC_BIQUAD_SIZE floats to use with vec-biquad-f32
+ * args[1]: Cutoff frequency relative to the sample rate
+ * args[2]: Optional, highpass if true, lowpass otherwise
+ */
+static lbm_value ext_vec_biquad_config(lbm_value *args, lbm_uint argn) {
+	if ((argn != 2 && argn != 3) || !lbm_is_number(args[1])) {
+		return ENC_SYM_TERROR;
+	}
+
+	lbm_array_header_t *array = lbm_dec_array_rw(args[0]);
+	if (!array || array->size < LBM_VEC_BIQUAD_SIZE * sizeof(float)) {
+		return ENC_SYM_TERROR;
+	}
+
+	Biquad bq;
+	biquad_config(&bq, (argn == 3 && !lbm_is_symbol_nil(args[2])) ? BQ_HIGHPASS : BQ_LOWPASS,
+			lbm_dec_as_float(args[1]));
+	biquad_reset(&bq);
+
+	float *data = (float*)array->data;
+	data[0] = bq.a0;
+	data[1] = bq.a1;
+	data[2] = bq.a2;
+	data[3] = bq.b1;
+	data[4] = bq.b2;
+	data[5] = bq.z1;
+	data[6] = bq.z2;
+
+	return args[0];
+}
+
 // Bit operations
 
 /*
@@ -5302,7 +5326,9 @@ static lbm_value ext_pwm_set_duty(lbm_value *args, lbm_uint argn) {
 lbm_value ext_image_save(lbm_value *args, lbm_uint argn) {
 	(void)args; (void)argn;
 
-	bool r = lbm_image_save_global_env();
+	// Functions and numbers are copied into the constant heap of the image
+	// and are used in place after boot. Everything else is flattened.
+	bool r = lbm_image_save_global_env_const();
 	lbm_uint main_sym = ENC_SYM_NIL;
 	if (lbm_get_symbol_by_name("main", &main_sym)) {
 		lbm_value binding;
@@ -5558,6 +5584,7 @@ void lispif_load_vesc_extensions(bool main_found) {
 		lbm_add_extension("throttle-curve", ext_throttle_curve);
 		lbm_add_extension("rand", ext_rand);
 		lbm_add_extension("rand-max", ext_rand_max);
+		lbm_add_extension("vec-biquad-config", ext_vec_biquad_config);
 
 		// Bit operations
 		lbm_add_extension("bits-enc-int", ext_bits_enc_int);
@@ -5659,6 +5686,9 @@ void lispif_load_vesc_extensions(bool main_found) {
 
 		// Extension libraries
 		lbm_array_extensions_init();
+		if (!lbm_vector_extensions_init()) {
+			commands_printf_lisp("Extension storage full, vector extensions not loaded");
+		}
 		lbm_math_extensions_init();
 		lbm_string_extensions_init();
 		lbm_mutex_extensions_init();
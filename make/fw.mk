@@ -12,6 +12,9 @@ ifeq ($(USE_OPT),)
   USE_OPT += -DLBM_USE_DYN_FUNS -DLBM_USE_DYN_MACROS -DLBM_USE_DYN_LOOPS -DLBM_USE_TIME_QUOTA
   USE_OPT += -DLBM_USE_ERROR_LINENO
 #  USE_OPT += -DUSE_GC_PTR_REV
+#  USE_OPT += -DLBM_USE_IMMEDIATE_FLOAT
+#  USE_OPT += -DLBM_USE_BYTECODE
+#  USE_OPT += -DLBM_USE_PROF_STACK
   USE_OPT += -fsingle-precision-constant -Wdouble-promotion -specs=nosys.specs
 endif
 
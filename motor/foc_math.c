@@ -21,73 +21,84 @@
 #include "utils_math.h"
 #include <math.h>
 
-// See http://cas.ensmp.fr/~praly/Telechargement/Journaux/2010-IEEE_TPEL-Lee-Hong-Nam-Ortega-Praly-Astolfi.pdf
-void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
-		float dt, observer_state *state, float *phase, motor_all_state_t *motor) {
+// Parameters that are the same for every observer running on the same sample
+typedef struct {
+	float R;
+	float L;
+	float lambda;
+	float lambda_conf;
+	float sat_comp_l;
+	bool sat_comp_lambda;
+	bool saliency;
+	float saliency_half;
+	float saliency_term;
+	float gamma_half;
+} observer_params;
+
+static inline __attribute__((always_inline)) void observer_params_calc(observer_params *p,
+		motor_all_state_t *motor) {
+	const foc_hot_conf *hot = &motor->p_hot;
+
+	p->R = hot->r;
+	p->L = hot->l;
+	p->lambda = hot->lambda;
+	p->lambda_conf = p->lambda;
+
+	// Saturation compensation. The coefficients are 0 in the modes that do not use them.
+	const float i_abs = motor->m_motor_state.i_abs_filter;
+	const float comp_fact = hot->sat_comp_factor * i_abs;
+	p->L -= p->L * comp_fact;
+	p->lambda -= p->lambda * comp_fact;
+	p->sat_comp_l = hot->sat_comp_l * i_abs;
+	p->sat_comp_lambda = hot->sat_comp_lambda;
 
-	mc_configuration *conf_now = motor->m_conf;
+	float id = motor->m_motor_state.id;
+	float iq = motor->m_motor_state.iq;
 
-	float R = conf_now->foc_motor_r;
-	float L = conf_now->foc_motor_l;
-	float lambda = conf_now->foc_motor_flux_linkage;
+	// Adjust inductance for saliency. Without an Ld-Lq difference there is nothing
+	// to adjust, so the division is skipped.
+	p->saliency = hot->saliency && (fabsf(id) > 0.1 || fabsf(iq) > 0.1);
+	if (p->saliency) {
+		p->saliency_half = hot->ld_lq_diff_half;
+		p->saliency_term = hot->ld_lq_diff * SQ(iq) / (SQ(id) + SQ(iq));
+	}
+
+	p->gamma_half = motor->m_gamma_now * 0.5;
+}
 
-	// Saturation compensation
-	switch(conf_now->foc_sat_comp_mode) {
-	case SAT_COMP_LAMBDA:
+// See http://cas.ensmp.fr/~praly/Telechargement/Journaux/2010-IEEE_TPEL-Lee-Hong-Nam-Ortega-Praly-Astolfi.pdf
+static inline __attribute__((always_inline)) void observer_run(mc_foc_observer_type type, const observer_params *p,
+		float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float i_alpha_last, float i_beta_last, float dt,
+		float *x1, float *x2, float *lambda_est, float *phase) {
+	float L = p->L;
+	const float lambda = p->lambda;
+	const float gamma_half = p->gamma_half;
+
+	if (p->sat_comp_lambda) {
 		// Here we assume that the inductance drops by the same amount as the flux linkage. I have
 		// no idea if this is a valid or even a reasonable assumption.
-		if (conf_now->foc_observer_type >= FOC_OBSERVER_ORTEGA_LAMBDA_COMP ||
-				conf_now->foc_observer_type >= FOC_OBSERVER_MXLEMMING_LAMBDA_COMP ||
-				conf_now->foc_observer_type >= FOC_OBSERVER_MXV_LAMBDA_COMP ||
-				conf_now->foc_observer_type >= FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
-			L = L * (state->lambda_est / lambda);
-		}
-		break;
-
-	case SAT_COMP_FACTOR: {
-		const float comp_fact = conf_now->foc_sat_comp * (motor->m_motor_state.i_abs_filter / conf_now->l_current_max);
-		L -= L * comp_fact;
-		lambda -= lambda * comp_fact;
-	} break;
-
-	case SAT_COMP_LAMBDA_AND_FACTOR: {
-		if (conf_now->foc_observer_type >= FOC_OBSERVER_ORTEGA_LAMBDA_COMP ||
-				conf_now->foc_observer_type >= FOC_OBSERVER_MXLEMMING_LAMBDA_COMP ||
-				conf_now->foc_observer_type >= FOC_OBSERVER_MXV_LAMBDA_COMP ||
-				conf_now->foc_observer_type >= FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
-			L = L * (state->lambda_est / lambda);
+		if (type >= FOC_OBSERVER_ORTEGA_LAMBDA_COMP ||
+				type >= FOC_OBSERVER_MXLEMMING_LAMBDA_COMP ||
+				type >= FOC_OBSERVER_MXV_LAMBDA_COMP ||
+				type >= FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
+			L = L * (*lambda_est / p->lambda_conf);
 		}
-		const float comp_fact = conf_now->foc_sat_comp * (motor->m_motor_state.i_abs_filter / conf_now->l_current_max);
-		L -= L * comp_fact;
-	} break;
-
-	default:
-		break;
+		L -= L * p->sat_comp_l;
 	}
 
-	// Temperature compensation
-	if (conf_now->foc_temp_comp) {
-		R = motor->m_res_temp_comp;
-	}
-
-	float ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
-	float id = motor->m_motor_state.id;
-	float iq = motor->m_motor_state.iq;
-
-	// Adjust inductance for saliency.
-	if (fabsf(id) > 0.1 || fabsf(iq) > 0.1) {
-		L = L - ld_lq_diff / 2.0 + ld_lq_diff * SQ(iq) / (SQ(id) + SQ(iq));
+	if (p->saliency) {
+		L = L - p->saliency_half + p->saliency_term;
 	}
 
 	float L_ia = L * i_alpha;
 	float L_ib = L * i_beta;
-	const float R_ia = R * i_alpha;
-	const float R_ib = R * i_beta;
-	const float gamma_half = motor->m_gamma_now * 0.5;
+	const float R_ia = p->R * i_alpha;
+	const float R_ib = p->R * i_beta;
 
-	switch (conf_now->foc_observer_type) {
+	switch (type) {
 	case FOC_OBSERVER_ORTEGA_ORIGINAL: {
-		float err = SQ(lambda) - (SQ(state->x1 - L_ia) + SQ(state->x2 - L_ib));
+		float err = SQ(lambda) - (SQ(*x1 - L_ia) + SQ(*x2 - L_ib));
 
 		// Forcing this term to stay negative helps convergence according to
 		//
@@ -98,11 +109,11 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 			err = 0.0;
 		}
 
-		float x1_dot = v_alpha - R_ia + gamma_half * (state->x1 - L_ia) * err;
-		float x2_dot = v_beta - R_ib + gamma_half * (state->x2 - L_ib) * err;
+		float x1_dot = v_alpha - R_ia + gamma_half * (*x1 - L_ia) * err;
+		float x2_dot = v_beta - R_ib + gamma_half * (*x2 - L_ib) * err;
 
-		state->x1 += x1_dot * dt;
-		state->x2 += x2_dot * dt;
+		*x1 += x1_dot * dt;
+		*x2 += x2_dot * dt;
 	} break;
 
 	case FOC_OBSERVER_MXLEMMING:
@@ -117,19 +128,19 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 		// rearrangements in place of the original names I have chosen, and credit
 		// to David Molony as the original author must be noted.
 
-		state->x1 += (v_alpha - R_ia) * dt - L * (i_alpha - state->i_alpha_last);
-		state->x2 += (v_beta - R_ib) * dt - L * (i_beta - state->i_beta_last);
+		*x1 += (v_alpha - R_ia) * dt - L * (i_alpha - i_alpha_last);
+		*x2 += (v_beta - R_ib) * dt - L * (i_beta - i_beta_last);
 
-		if (conf_now->foc_observer_type == FOC_OBSERVER_MXLEMMING_LAMBDA_COMP) {
-			float err = SQ(state->lambda_est) - (SQ(state->x1) + SQ(state->x2));
-			state->lambda_est += 0.1 * gamma_half * state->lambda_est * -err * dt;
-			utils_truncate_number(&(state->lambda_est), lambda * 0.3, lambda * 2.5);
+		if (type == FOC_OBSERVER_MXLEMMING_LAMBDA_COMP) {
+			float err = SQ(*lambda_est) - (SQ(*x1) + SQ(*x2));
+			*lambda_est += 0.1 * gamma_half * *lambda_est * -err * dt;
+			utils_truncate_number(lambda_est, lambda * 0.3, lambda * 2.5);
 
-			utils_truncate_number_abs(&(state->x1), state->lambda_est);
-			utils_truncate_number_abs(&(state->x2), state->lambda_est);
+			utils_truncate_number_abs(x1, *lambda_est);
+			utils_truncate_number_abs(x2, *lambda_est);
 		} else {
-			utils_truncate_number_abs(&(state->x1), lambda);
-			utils_truncate_number_abs(&(state->x2), lambda);
+			utils_truncate_number_abs(x1, lambda);
+			utils_truncate_number_abs(x2, lambda);
 		}
 
 		// Set these to 0 to allow using the same atan2-code as for Ortega
@@ -138,59 +149,59 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 		break;
 
 	case FOC_OBSERVER_ORTEGA_LAMBDA_COMP: {
-		float err = SQ(state->lambda_est) - (SQ(state->x1 - L_ia) + SQ(state->x2 - L_ib));
+		float err = SQ(*lambda_est) - (SQ(*x1 - L_ia) + SQ(*x2 - L_ib));
 
 		// FLux linkage observer. See:
 		// https://cas.mines-paristech.fr/~praly/Telechargement/Conferences/2017_IFAC_Bernard-Praly.pdf
-		state->lambda_est += 0.2 * gamma_half * state->lambda_est * -err * dt;
+		*lambda_est += 0.2 * gamma_half * *lambda_est * -err * dt;
 
 		// Clamp the observed flux linkage (not sure if this is needed)
-		utils_truncate_number(&(state->lambda_est), lambda * 0.3, lambda * 2.5);
+		utils_truncate_number(lambda_est, lambda * 0.3, lambda * 2.5);
 
 		if (err > 0.0) {
 			err = 0.0;
 		}
 
-		float x1_dot = v_alpha - R_ia + gamma_half * (state->x1 - L_ia) * err;
-		float x2_dot = v_beta - R_ib + gamma_half * (state->x2 - L_ib) * err;
+		float x1_dot = v_alpha - R_ia + gamma_half * (*x1 - L_ia) * err;
+		float x2_dot = v_beta - R_ib + gamma_half * (*x2 - L_ib) * err;
 
-		state->x1 += x1_dot * dt;
-		state->x2 += x2_dot * dt;
+		*x1 += x1_dot * dt;
+		*x2 += x2_dot * dt;
 	} break;
 
 	case FOC_OBSERVER_MXV:
 	case FOC_OBSERVER_MXV_LAMBDA_COMP:
 	case FOC_OBSERVER_MXV_LAMBDA_COMP_LIN:
-		state->x1 += (v_alpha - R_ia) * dt;
-		state->x2 += (v_beta - R_ib) * dt;
-
-		if (conf_now->foc_observer_type == FOC_OBSERVER_MXV_LAMBDA_COMP ||
-				conf_now->foc_observer_type == FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
-			if (conf_now->foc_observer_type == FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
-				float mag = NORM2_f(state->x1 - L_ia, state->x2 - L_ib);
-				UTILS_LP_FAST(state->lambda_est, mag, 0.1 * gamma_half * dt * SQ(state->lambda_est));
-				utils_truncate_number(&(state->lambda_est), lambda * 0.3, lambda * 2.5);
-
-				if (mag > state->lambda_est) {
-					state->x1 = (state->x1 / mag) * state->lambda_est;
-					state->x2 = (state->x2 / mag) * state->lambda_est;
+		*x1 += (v_alpha - R_ia) * dt;
+		*x2 += (v_beta - R_ib) * dt;
+
+		if (type == FOC_OBSERVER_MXV_LAMBDA_COMP ||
+				type == FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
+			if (type == FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
+				float mag = NORM2_f(*x1 - L_ia, *x2 - L_ib);
+				UTILS_LP_FAST(*lambda_est, mag, 0.1 * gamma_half * dt * SQ(*lambda_est));
+				utils_truncate_number(lambda_est, lambda * 0.3, lambda * 2.5);
+
+				if (mag > *lambda_est) {
+					*x1 = (*x1 / mag) * *lambda_est;
+					*x2 = (*x2 / mag) * *lambda_est;
 				}
-			} else if (conf_now->foc_observer_type == FOC_OBSERVER_MXV_LAMBDA_COMP) {
-				float err = SQ(state->lambda_est) - (SQ(state->x1 - L_ia) + SQ(state->x2 - L_ib));
-				state->lambda_est += 0.2 * gamma_half * state->lambda_est * -err * dt;
-				utils_truncate_number(&(state->lambda_est), lambda * 0.3, lambda * 2.5);
-
-				float mag = NORM2_f(state->x1 - L_ia, state->x2 - L_ib);
-				if (mag > state->lambda_est) {
-					state->x1 = (state->x1 / mag) * state->lambda_est;
-					state->x2 = (state->x2 / mag) * state->lambda_est;
+			} else if (type == FOC_OBSERVER_MXV_LAMBDA_COMP) {
+				float err = SQ(*lambda_est) - (SQ(*x1 - L_ia) + SQ(*x2 - L_ib));
+				*lambda_est += 0.2 * gamma_half * *lambda_est * -err * dt;
+				utils_truncate_number(lambda_est, lambda * 0.3, lambda * 2.5);
+
+				float mag = NORM2_f(*x1 - L_ia, *x2 - L_ib);
+				if (mag > *lambda_est) {
+					*x1 = (*x1 / mag) * *lambda_est;
+					*x2 = (*x2 / mag) * *lambda_est;
 				}
 			}
 		} else {
-			float mag = NORM2_f(state->x1 - L_ia, state->x2 - L_ib);
+			float mag = NORM2_f(*x1 - L_ia, *x2 - L_ib);
 			if (mag > lambda) {
-				state->x1 = (state->x1 / mag) * lambda;
-				state->x2 = (state->x2 / mag) * lambda;
+				*x1 = (*x1 / mag) * lambda;
+				*x2 = (*x2 / mag) * lambda;
 			}
 		}
 		break;
@@ -199,21 +210,18 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 		break;
 	}
 
-	state->i_alpha_last = i_alpha;
-	state->i_beta_last = i_beta;
-
-	UTILS_NAN_ZERO(state->x1);
-	UTILS_NAN_ZERO(state->x2);
+	UTILS_NAN_ZERO(*x1);
+	UTILS_NAN_ZERO(*x2);
 
 	// Prevent the magnitude from getting too low, as that makes the angle very unstable.
-	float mag = NORM2_f(state->x1, state->x2);
+	float mag = NORM2_f(*x1, *x2);
 	if (mag < (lambda * 0.5)) {
-		state->x1 *= 1.1;
-		state->x2 *= 1.1;
+		*x1 *= 1.1;
+		*x2 *= 1.1;
 	}
 
 	if (phase) {
-		*phase = utils_fast_atan2(state->x2 - L_ib, state->x1 - L_ia);
+		*phase = utils_fast_atan2(*x2 - L_ib, *x1 - L_ia);
 	}
 
 	// Can we clamp the flux in dq with q flux = 0 and d flux is lambda
@@ -221,6 +229,137 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 	// The d flux each time would have a residual after transform from ab to dq. This can be used as an input to the flux estimator
 }
 
+/*
+ * The observer variants. With the type and the saturation compensation mode
+ * as constants, observer_run is reduced to the code of one observer.
+ */
+static inline __attribute__((always_inline)) void observer_update(mc_foc_observer_type type,
+		bool sat_comp_lambda, float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, observer_state *state, float *phase, motor_all_state_t *motor) {
+	observer_params p;
+	observer_params_calc(&p, motor);
+	p.sat_comp_lambda = sat_comp_lambda;
+
+	observer_run(type, &p, v_alpha, v_beta, i_alpha, i_beta,
+			state->i_alpha_last, state->i_beta_last, dt,
+			&state->x1, &state->x2, &state->lambda_est, phase);
+
+	state->i_alpha_last = i_alpha;
+	state->i_beta_last = i_beta;
+}
+
+#define OBSERVER_VARIANTS(name, type) \
+	static void name(float v_alpha, float v_beta, float i_alpha, float i_beta, \
+			float dt, observer_state *state, float *phase, motor_all_state_t *motor) { \
+		observer_update(type, false, v_alpha, v_beta, i_alpha, i_beta, dt, state, phase, motor); \
+	} \
+	static void name##_sat_lambda(float v_alpha, float v_beta, float i_alpha, float i_beta, \
+			float dt, observer_state *state, float *phase, motor_all_state_t *motor) { \
+		observer_update(type, true, v_alpha, v_beta, i_alpha, i_beta, dt, state, phase, motor); \
+	}
+
+OBSERVER_VARIANTS(observer_ortega, FOC_OBSERVER_ORTEGA_ORIGINAL)
+OBSERVER_VARIANTS(observer_mxlemming, FOC_OBSERVER_MXLEMMING)
+OBSERVER_VARIANTS(observer_ortega_lambda_comp, FOC_OBSERVER_ORTEGA_LAMBDA_COMP)
+OBSERVER_VARIANTS(observer_mxlemming_lambda_comp, FOC_OBSERVER_MXLEMMING_LAMBDA_COMP)
+OBSERVER_VARIANTS(observer_mxv, FOC_OBSERVER_MXV)
+OBSERVER_VARIANTS(observer_mxv_lambda_comp, FOC_OBSERVER_MXV_LAMBDA_COMP)
+OBSERVER_VARIANTS(observer_mxv_lambda_comp_lin, FOC_OBSERVER_MXV_LAMBDA_COMP_LIN)
+
+// Indexed by the observer type and then by sat_comp_lambda
+static const foc_observer_func observer_variants[][2] = {
+		{observer_ortega, observer_ortega_sat_lambda},
+		{observer_mxlemming, observer_mxlemming_sat_lambda},
+		{observer_ortega_lambda_comp, observer_ortega_lambda_comp_sat_lambda},
+		{observer_mxlemming_lambda_comp, observer_mxlemming_lambda_comp_sat_lambda},
+		{observer_mxv, observer_mxv_sat_lambda},
+		{observer_mxv_lambda_comp, observer_mxv_lambda_comp_sat_lambda},
+		{observer_mxv_lambda_comp_lin, observer_mxv_lambda_comp_lin_sat_lambda},
+};
+
+// For types without a variant
+static void observer_generic(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, observer_state *state, float *phase, motor_all_state_t *motor) {
+	observer_params p;
+	observer_params_calc(&p, motor);
+
+	observer_run(motor->p_hot.observer_type, &p, v_alpha, v_beta, i_alpha, i_beta,
+			state->i_alpha_last, state->i_beta_last, dt,
+			&state->x1, &state->x2, &state->lambda_est, phase);
+
+	state->i_alpha_last = i_alpha;
+	state->i_beta_last = i_beta;
+}
+
+/**
+ * Initialize a batch of observers that run next to the active one.
+ *
+ * @param batch
+ * The batch to initialize.
+ *
+ * @param types
+ * Observer type for each slot.
+ *
+ * @param num
+ * Number of observers, at most FOC_OBSERVER_BATCH_MAX.
+ *
+ * @param x1
+ * Start flux state, e.g. from the active observer.
+ *
+ * @param x2
+ * Start flux state, e.g. from the active observer.
+ *
+ * @param lambda
+ * Start flux linkage estimate.
+ */
+void foc_observer_batch_init(observer_batch_state *batch, const mc_foc_observer_type *types,
+		int num, float x1, float x2, float lambda) {
+	utils_truncate_number_int(&num, 0, FOC_OBSERVER_BATCH_MAX);
+	batch->num = num;
+
+	for (int i = 0;i < num;i++) {
+		batch->type[i] = types[i];
+		batch->x1[i] = x1;
+		batch->x2[i] = x2;
+		batch->lambda_est[i] = lambda;
+		batch->phase[i] = 0.0;
+		batch->angle_err[i] = 0.0;
+		batch->angle_err_abs[i] = 0.0;
+	}
+
+	batch->i_alpha_last = 0.0;
+	batch->i_beta_last = 0.0;
+}
+
+/**
+ * Advance all observers in a batch with the same sample. The parameters that
+ * do not depend on the observer state are only calculated once, and the state
+ * is stored as one array per variable.
+ *
+ * @param phase_ref
+ * Phase of the active observer, used to update the filtered angle errors.
+ */
+void foc_observer_batch_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, float phase_ref, observer_batch_state *batch, motor_all_state_t *motor) {
+	observer_params p;
+	observer_params_calc(&p, motor);
+
+	for (int i = 0;i < batch->num;i++) {
+		observer_run(batch->type[i], &p, v_alpha, v_beta, i_alpha, i_beta,
+				batch->i_alpha_last, batch->i_beta_last, dt,
+				&batch->x1[i], &batch->x2[i], &batch->lambda_est[i], &batch->phase[i]);
+	}
+
+	for (int i = 0;i < batch->num;i++) {
+		const float err = utils_angle_difference_rad(batch->phase[i], phase_ref);
+		UTILS_LP_FAST(batch->angle_err[i], err, 0.001);
+		UTILS_LP_FAST(batch->angle_err_abs[i], fabsf(err), 0.001);
+	}
+
+	batch->i_alpha_last = i_alpha;
+	batch->i_beta_last = i_beta;
+}
+
 void foc_pll_run(float phase, float dt, float *phase_var,
 					float *speed_var, mc_configuration *conf) {
 	UTILS_NAN_ZERO(*phase_var);
@@ -588,6 +727,32 @@ float foc_correct_encoder(float obs_angle, float enc_angle, float speed,
 	return motor->m_using_encoder ? enc_angle : obs_angle;
 }
 
+/**
+ * Move the encoder angle from the time it was sampled to the control instant.
+ *
+ * @param enc_angle
+ * Electrical angle from the encoder in radians.
+ *
+ * @param speed
+ * Electrical speed in rad/s.
+ *
+ * @param age
+ * Seconds from the encoder sample to the control instant. Negative ages and
+ * ages above FOC_ENC_SAMPLE_AGE_MAX leave the angle unchanged.
+ *
+ * @return
+ * The extrapolated angle in radians.
+ */
+float foc_extrapolate_encoder(float enc_angle, float speed, float age) {
+	if (age <= 0.0 || age > FOC_ENC_SAMPLE_AGE_MAX) {
+		return enc_angle;
+	}
+
+	float res = enc_angle + speed * age;
+	utils_norm_angle_rad(&res);
+	return res;
+}
+
 float foc_correct_hall(float angle, float dt, motor_all_state_t *motor, int hall_val) {
 	mc_configuration *conf_now = motor->m_conf;
 	motor->m_hall_dt_diff_now += dt;
@@ -764,3 +929,74 @@ void foc_precalc_values(motor_all_state_t *motor) {
 	motor->m_observer_state.lambda_est = conf_now->foc_motor_flux_linkage;
 	motor->p_duty_norm = TWO_BY_SQRT3 / conf_now->foc_overmod_factor;
 }
+
+/**
+ * Calculate the per-cycle configuration snapshot. The caller publishes it to
+ * the control interrupt, after foc_precalc_values, when the detection
+ * functions change the configuration in place and when the temperature
+ * compensation changes.
+ *
+ * @param motor
+ * The motor state. Uses p_lq and p_ld, so foc_precalc_values has to run first.
+ *
+ * @param hot
+ * The snapshot to fill in.
+ */
+void foc_hot_conf_calc(motor_all_state_t *motor, foc_hot_conf *hot) {
+	const mc_configuration *conf_now = motor->m_conf;
+
+	// Observer
+	hot->r = conf_now->foc_temp_comp ? motor->m_res_temp_comp : conf_now->foc_motor_r;
+	hot->l = conf_now->foc_motor_l;
+	hot->lambda = conf_now->foc_motor_flux_linkage;
+	hot->ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
+	hot->ld_lq_diff_half = conf_now->foc_motor_ld_lq_diff / 2.0;
+	hot->saliency = conf_now->foc_motor_ld_lq_diff != 0.0;
+
+	const SAT_COMP_MODE sat_mode = conf_now->foc_sat_comp_mode;
+	const float sat_comp = conf_now->foc_sat_comp / conf_now->l_current_max;
+	hot->sat_comp_factor = sat_mode == SAT_COMP_FACTOR ? sat_comp : 0.0;
+	hot->sat_comp_l = sat_mode == SAT_COMP_LAMBDA_AND_FACTOR ? sat_comp : 0.0;
+	hot->sat_comp_lambda = sat_mode == SAT_COMP_LAMBDA || sat_mode == SAT_COMP_LAMBDA_AND_FACTOR;
+
+	hot->observer_type = conf_now->foc_observer_type;
+	const int variant_num = sizeof(observer_variants) / sizeof(observer_variants[0]);
+	if ((int)hot->observer_type >= 0 && (int)hot->observer_type < variant_num) {
+		hot->observer = observer_variants[hot->observer_type][hot->sat_comp_lambda ? 1 : 0];
+	} else {
+		hot->observer = observer_generic;
+	}
+
+	// Current controller
+	hot->current_kp = conf_now->foc_current_kp;
+	hot->current_ki = conf_now->foc_temp_comp ? motor->m_current_ki_temp_comp : conf_now->foc_current_ki;
+	hot->current_filter_const = conf_now->foc_current_filter_const;
+
+	// With the scaling off, a slope of 0 and a limit of 1 keep the d-gain scale at 1
+	hot->d_gain_scale_start = conf_now->foc_d_gain_scale_start;
+	if (conf_now->foc_d_gain_scale_start < 0.99) {
+		hot->d_gain_scale_max_mod = conf_now->foc_d_gain_scale_max_mod;
+		hot->d_gain_scale_slope = (conf_now->foc_d_gain_scale_max_mod - 1.0) / (1.0 - conf_now->foc_d_gain_scale_start);
+	} else {
+		hot->d_gain_scale_max_mod = 1.0;
+		hot->d_gain_scale_slope = 0.0;
+	}
+
+	const mc_foc_cc_decoupling_mode dec = conf_now->foc_cc_decoupling;
+	const bool dec_cross = dec == FOC_CC_DECOUPLING_CROSS || dec == FOC_CC_DECOUPLING_CROSS_BEMF;
+	const bool dec_bemf = dec == FOC_CC_DECOUPLING_BEMF || dec == FOC_CC_DECOUPLING_CROSS_BEMF;
+	hot->dec_lq = dec_cross ? motor->p_lq : 0.0;
+	hot->dec_ld = dec_cross ? motor->p_ld : 0.0;
+	hot->dec_flux = dec_bemf ? conf_now->foc_motor_flux_linkage : 0.0;
+
+	hot->max_duty = conf_now->l_max_duty;
+	hot->max_v_mag_factor = ONE_BY_SQRT3 * conf_now->foc_overmod_factor;
+
+	const mc_foc_sensor_mode sensor_mode = conf_now->foc_sensor_mode;
+	hot->hfi = sensor_mode == FOC_SENSOR_MODE_HFI ||
+			sensor_mode == FOC_SENSOR_MODE_HFI_V2 ||
+			sensor_mode == FOC_SENSOR_MODE_HFI_V3 ||
+			sensor_mode == FOC_SENSOR_MODE_HFI_V4 ||
+			sensor_mode == FOC_SENSOR_MODE_HFI_V5;
+	hot->hfi_start = sensor_mode == FOC_SENSOR_MODE_HFI_START;
+}
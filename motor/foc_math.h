@@ -102,6 +102,25 @@ typedef struct {
 	float i_beta_last;
 } observer_state;
 
+#define FOC_OBSERVER_BATCH_MAX	3
+
+// Several observers evaluated on the same samples, one array per state variable
+typedef struct {
+	int num;
+	mc_foc_observer_type type[FOC_OBSERVER_BATCH_MAX];
+	float x1[FOC_OBSERVER_BATCH_MAX];
+	float x2[FOC_OBSERVER_BATCH_MAX];
+	float lambda_est[FOC_OBSERVER_BATCH_MAX];
+	float phase[FOC_OBSERVER_BATCH_MAX];
+	float angle_err[FOC_OBSERVER_BATCH_MAX]; // Filtered error against the active observer
+	float angle_err_abs[FOC_OBSERVER_BATCH_MAX]; // Filtered absolute error against the active observer
+	float i_alpha_last;
+	float i_beta_last;
+} observer_batch_state;
+
+// Encoder samples older than this are not extrapolated
+#define FOC_ENC_SAMPLE_AGE_MAX	0.001
+
 #define MC_AUDIO_CHANNELS	4
 
 typedef enum {
@@ -129,13 +148,59 @@ typedef struct {
 	float sample_voltage;
 } mc_audio_state;
 
+struct motor_all_state_s;
+
+// Observer update, specialised for one observer type and saturation compensation mode
+typedef void(*foc_observer_func)(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, observer_state *state, float *phase, struct motor_all_state_s *motor);
+
+/*
+ * The configuration values that the observer and the current controller use
+ * every control cycle, gathered by foc_hot_conf_calc so that they sit
+ * together instead of spread over mc_configuration. The temperature
+ * compensation is already applied. Mode selections become the observer
+ * function and coefficients that are 0 when the mode is off, so the
+ * interrupt does not branch on them. Only the HFI modes, which select
+ * different control paths, are kept as flags.
+ */
+typedef struct {
+	// Observer
+	foc_observer_func observer;
+	mc_foc_observer_type observer_type;
+	float r; // Temperature compensated when enabled
+	float l;
+	float lambda;
+	float ld_lq_diff;
+	float ld_lq_diff_half;
+	bool saliency; // Ld-Lq difference not 0
+	bool sat_comp_lambda; // SAT_COMP_LAMBDA or SAT_COMP_LAMBDA_AND_FACTOR
+	float sat_comp_factor; // foc_sat_comp / l_current_max with SAT_COMP_FACTOR, else 0
+	float sat_comp_l; // foc_sat_comp / l_current_max with SAT_COMP_LAMBDA_AND_FACTOR, else 0
+
+	// Current controller
+	float current_kp;
+	float current_ki; // Temperature compensated when enabled
+	float current_filter_const;
+	float d_gain_scale_start;
+	float d_gain_scale_max_mod; // 1 when the d-gain scaling is off
+	float d_gain_scale_slope; // Per modulation above d_gain_scale_start, 0 when off
+	float dec_lq; // p_lq with cross decoupling, else 0
+	float dec_ld; // p_ld with cross decoupling, else 0
+	float dec_flux; // Flux linkage with back-EMF decoupling, else 0
+	float max_duty;
+	float max_v_mag_factor; // ONE_BY_SQRT3 * foc_overmod_factor
+
+	bool hfi; // One of the HFI sensor modes, except HFI_START
+	bool hfi_start;
+} __attribute__((aligned(32))) foc_hot_conf;
+
 typedef enum {
 	FOC_PWM_DISABLED = 0,
 	FOC_PWM_ENABLED,
 	FOC_PWM_FULL_BRAKE
 } foc_pwm_mode;
 
-typedef struct {
+typedef struct motor_all_state_s {
 	mc_configuration *m_conf;
 	mc_state m_state;
 	mc_control_mode m_control_mode;
@@ -163,6 +228,8 @@ typedef struct {
 	float m_phase_now_encoder;
 	float m_phase_now_encoder_no_index;
 	observer_state m_observer_state;
+	observer_batch_state m_observer_batch;
+	bool m_observer_batch_en;
 	float m_pll_phase;
 	float m_pll_speed;
 	float m_speed_est_fast;
@@ -242,11 +309,23 @@ typedef struct {
 	float p_inv_ld_lq; // (1.0/lq - 1.0/ld)
 	float p_v2_v3_inv_avg_half; // (0.5/ld + 0.5/lq)
 	float p_duty_norm;
+	foc_hot_conf p_hot;
 } motor_all_state_t;
 
+/**
+ * Run the observer selected in the configuration. Calls the variant picked by
+ * foc_hot_conf_calc, so the snapshot must have been published.
+ */
+static inline void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, observer_state *state, float *phase, motor_all_state_t *motor) {
+	motor->p_hot.observer(v_alpha, v_beta, i_alpha, i_beta, dt, state, phase, motor);
+}
+
 // Functions
-void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
-		float dt, observer_state *state, float *phase, motor_all_state_t *motor);
+void foc_observer_batch_init(observer_batch_state *batch, const mc_foc_observer_type *types,
+		int num, float x1, float x2, float lambda);
+void foc_observer_batch_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, float phase_ref, observer_batch_state *batch, motor_all_state_t *motor);
 void foc_pll_run(float phase, float dt, float *phase_var,
 		float *speed_var, mc_configuration *conf);
 void foc_svm(float alpha, float beta, float max_mod, uint32_t PWMFullDutyCycle,
@@ -254,9 +333,11 @@ void foc_svm(float alpha, float beta, float max_mod, uint32_t PWMFullDutyCycle,
 void foc_run_pid_control_pos(bool index_found, float dt, motor_all_state_t *motor);
 void foc_run_pid_control_speed(bool index_found, float dt, motor_all_state_t *motor);
 float foc_correct_encoder(float obs_angle, float enc_angle, float speed, float sl_erpm, motor_all_state_t *motor);
+float foc_extrapolate_encoder(float enc_angle, float speed, float age);
 float foc_correct_hall(float angle, float dt, motor_all_state_t *motor, int hall_val);
 void foc_run_fw(motor_all_state_t *motor, float dt);
 void foc_hfi_adjust_angle(float ang_err, motor_all_state_t *motor, float dt);
 void foc_precalc_values(motor_all_state_t *motor);
+void foc_hot_conf_calc(motor_all_state_t *motor, foc_hot_conf *hot);
 
 #endif /* FOC_MATH_H_ */
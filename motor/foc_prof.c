@@ -0,0 +1,348 @@
+/*
+	Copyright 2025 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_prof.h"
+#include "ch.h"
+#include "hal.h"
+#include "datatypes.h"
+#include "buffer.h"
+#include "commands.h"
+#include "terminal.h"
+#include "mempools.h"
+
+#include <string.h>
+
+#ifdef HW_HAS_DUAL_MOTORS
+#define MOTOR_NUM		2
+#else
+#define MOTOR_NUM		1
+#endif
+
+static const char *m_stage_names[FOC_PROF_STAGE_NUM] = {
+		"adc", "encoder", "setpoint", "observer", "phase",
+		"control", "speed", "post", "total"
+};
+
+#if FOC_PROFILE_ENABLE
+// Statistics, written by the FOC interrupt
+static foc_prof_stats m_stats[MOTOR_NUM][FOC_PROF_STAGE_NUM];
+static float m_budget[MOTOR_NUM];
+
+// Marks of the running interrupt
+static uint32_t m_start;
+static uint32_t m_marks[FOC_PROF_STAGE_NUM];
+static uint32_t m_visited;
+
+// Private functions
+static void terminal_foc_prof(int argc, const char **argv);
+#endif
+
+void foc_prof_init(void) {
+#if FOC_PROFILE_ENABLE
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	foc_prof_reset();
+
+	terminal_register_command_callback(
+			"foc_prof",
+			"Print the cycles spent in the stages of the FOC interrupt.",
+			"[reset]",
+			terminal_foc_prof);
+#endif
+}
+
+#if FOC_PROFILE_ENABLE
+/*
+ * Histogram bin of a cycle count. Below 8 the bins are one cycle wide, above
+ * that every octave has 8 bins, so that a bin is at most 1/8 of its value
+ * wide. Counts of 2^16 and above go to the last bin.
+ */
+static inline int hist_bin(uint32_t cycles) {
+	if (cycles < 8) {
+		return cycles;
+	}
+
+	int octave = 31 - __builtin_clz(cycles);
+	int bin = (octave - 2) * 8 + ((cycles >> (octave - 3)) & 7);
+	return bin < FOC_PROF_HIST_BINS ? bin : FOC_PROF_HIST_BINS - 1;
+}
+
+// Largest cycle count that goes in a bin. The last bin has no top.
+static uint32_t hist_bin_top(int bin) {
+	if (bin < 8) {
+		return bin;
+	} else if (bin == FOC_PROF_HIST_BINS - 1) {
+		return UINT32_MAX;
+	}
+
+	int octave = bin / 8 + 2;
+	return ((uint32_t)(9 + bin % 8) << (octave - 3)) - 1;
+}
+
+static inline void stats_add(foc_prof_stats *s, uint32_t cycles) {
+	if (s->cnt == 0 || cycles < s->min) {
+		s->min = cycles;
+	}
+
+	if (cycles > s->max) {
+		s->max = cycles;
+	}
+
+	s->cnt++;
+	s->sum += cycles;
+	s->hist[hist_bin(cycles)]++;
+}
+
+void foc_prof_start(void) {
+	m_visited = 0;
+	m_start = DWT->CYCCNT;
+}
+
+void foc_prof_mark(foc_prof_stage stage) {
+	m_marks[stage] = DWT->CYCCNT;
+	m_visited |= 1 << stage;
+}
+
+/**
+ * Update the statistics with the marks of this interrupt. Must be called at
+ * the end of the interrupt, after the last mark.
+ *
+ * @param is_second_motor
+ * The motor the interrupt is for.
+ *
+ * @param dt
+ * Control period in seconds, used as the cycle budget.
+ */
+void foc_prof_end(bool is_second_motor, float dt) {
+	uint32_t end = DWT->CYCCNT;
+
+	int motor = 0;
+#ifdef HW_HAS_DUAL_MOTORS
+	motor = is_second_motor ? 1 : 0;
+#else
+	(void)is_second_motor;
+#endif
+
+	foc_prof_stats *st = m_stats[motor];
+
+	// A stage lasts from the previous mark, so that skipped stages do not
+	// lose their cycles to the next one.
+	uint32_t prev = m_start;
+	for (int i = 0;i < FOC_PROF_TOTAL;i++) {
+		if (m_visited & (1 << i)) {
+			stats_add(&st[i], m_marks[i] - prev);
+			prev = m_marks[i];
+		}
+	}
+
+	stats_add(&st[FOC_PROF_TOTAL], end - m_start);
+	m_budget[motor] = dt * (float)SYSTEM_CORE_CLOCK;
+}
+#endif
+
+/**
+ * Clear the statistics. One stage is cleared at a time with the system
+ * locked, so that the FOC interrupt is only held off briefly.
+ */
+void foc_prof_reset(void) {
+#if FOC_PROFILE_ENABLE
+	for (int m = 0;m < MOTOR_NUM;m++) {
+		for (int i = 0;i < FOC_PROF_STAGE_NUM;i++) {
+			chSysLock();
+			memset(&m_stats[m][i], 0, sizeof(foc_prof_stats));
+			chSysUnlock();
+		}
+	}
+#endif
+}
+
+/**
+ * Get the statistics of a stage.
+ *
+ * @param motor
+ * Motor, 1 or 2.
+ *
+ * @param stage
+ * The stage.
+ *
+ * @param res
+ * Summary in cycles. The 99th percentile is the top of its histogram bin,
+ * limited to the maximum, so it is at most 1/8 too high.
+ *
+ * @return
+ * False if profiling is disabled or the motor or stage does not exist.
+ */
+bool foc_prof_get_summary(int motor, foc_prof_stage stage, foc_prof_summary *res) {
+	memset(res, 0, sizeof(foc_prof_summary));
+
+#if FOC_PROFILE_ENABLE
+	if (motor < 1 || motor > MOTOR_NUM || (int)stage < 0 || stage >= FOC_PROF_STAGE_NUM) {
+		return false;
+	}
+
+	// Summarised with the system locked, so that the interrupt does not update
+	// the stage halfway. This avoids copying the histogram.
+	chSysLock();
+	const foc_prof_stats *s = &m_stats[motor - 1][stage];
+
+	if (s->cnt > 0) {
+		res->cnt = s->cnt;
+		res->min = s->min;
+		res->max = s->max;
+		res->avg = (float)s->sum / (float)s->cnt;
+
+		uint32_t target = s->cnt - s->cnt / 100;
+		uint32_t acc = 0;
+		for (int i = 0;i < FOC_PROF_HIST_BINS;i++) {
+			acc += s->hist[i];
+			if (acc >= target) {
+				res->p99 = hist_bin_top(i);
+				break;
+			}
+		}
+	}
+	chSysUnlock();
+
+	if (res->p99 > res->max) {
+		res->p99 = res->max;
+	}
+
+	if (res->p99 < res->min) {
+		res->p99 = res->min;
+	}
+
+	return true;
+#else
+	(void)motor;
+	(void)stage;
+	return false;
+#endif
+}
+
+/**
+ * Cycles in the last control period of a motor, 0 if it has not been
+ * measured.
+ */
+float foc_prof_get_budget(int motor) {
+#if FOC_PROFILE_ENABLE
+	if (motor >= 1 && motor <= MOTOR_NUM) {
+		return m_budget[motor - 1];
+	}
+#else
+	(void)motor;
+#endif
+	return 0.0;
+}
+
+const char *foc_prof_stage_name(foc_prof_stage stage) {
+	if ((int)stage < 0 || stage >= FOC_PROF_STAGE_NUM) {
+		return "";
+	}
+
+	return m_stage_names[stage];
+}
+
+/**
+ * Send the statistics of a motor as a COMM_FOC_PROFILE reply.
+ *
+ * uint8         Motor
+ * uint8         Number of stages, 0 when profiling is disabled
+ * float32_auto  Cycle budget of the control period
+ * Then for every stage: the name as a null-terminated string, uint32 count,
+ * uint32 min, float32_auto avg, uint32 max and uint32 p99, all in cycles.
+ *
+ * @param motor
+ * Motor, 1 or 2.
+ *
+ * @param reset
+ * Clear the statistics after they have been read.
+ *
+ * @param reply_func
+ * Function used to send the reply.
+ */
+void foc_prof_send(int motor, bool reset, void(*reply_func)(unsigned char *data, unsigned int len)) {
+	uint8_t *buffer = mempools_get_packet_buffer();
+	int32_t ind = 0;
+
+	buffer[ind++] = COMM_FOC_PROFILE;
+	buffer[ind++] = motor;
+	int32_t num_ind = ind++;
+	buffer_append_float32_auto(buffer, foc_prof_get_budget(motor), &ind);
+
+	int num = 0;
+	for (int i = 0;i < FOC_PROF_STAGE_NUM;i++) {
+		foc_prof_summary s;
+		if (!foc_prof_get_summary(motor, i, &s)) {
+			break;
+		}
+
+		strcpy((char*)buffer + ind, m_stage_names[i]);
+		ind += strlen(m_stage_names[i]) + 1;
+		buffer_append_uint32(buffer, s.cnt, &ind);
+		buffer_append_uint32(buffer, s.min, &ind);
+		buffer_append_float32_auto(buffer, s.avg, &ind);
+		buffer_append_uint32(buffer, s.max, &ind);
+		buffer_append_uint32(buffer, s.p99, &ind);
+		num++;
+	}
+
+	buffer[num_ind] = num;
+
+	if (reset) {
+		foc_prof_reset();
+	}
+
+	reply_func(buffer, ind);
+	mempools_free_packet_buffer(buffer);
+}
+
+#if FOC_PROFILE_ENABLE
+static void terminal_foc_prof(int argc, const char **argv) {
+	if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+		foc_prof_reset();
+		commands_printf("FOC profile cleared\n");
+		return;
+	}
+
+	const float cyc_per_us = (float)SYSTEM_CORE_CLOCK / 1e6;
+
+	for (int m = 1;m <= MOTOR_NUM;m++) {
+		float budget = foc_prof_get_budget(m);
+
+		commands_printf("Motor %d, budget %.0f cycles (%.1f us)", m,
+				(double)budget, (double)(budget / cyc_per_us));
+		commands_printf("  %-9s %9s %7s %9s %7s %7s %8s %6s",
+				"Stage", "Count", "Min", "Avg", "P99", "Max", "Max us", "Avg %");
+
+		for (int i = 0;i < FOC_PROF_STAGE_NUM;i++) {
+			foc_prof_summary s;
+			foc_prof_get_summary(m, i, &s);
+
+			commands_printf("  %-9s %9u %7u %9.1f %7u %7u %8.2f %6.1f",
+					m_stage_names[i], s.cnt, s.min, (double)s.avg, s.p99, s.max,
+					(double)((float)s.max / cyc_per_us),
+					(double)(budget > 0.0 ? 100.0 * s.avg / budget : 0.0));
+		}
+
+		commands_printf(" ");
+	}
+}
+#endif
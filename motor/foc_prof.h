@@ -0,0 +1,94 @@
+/*
+	Copyright 2025 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef FOC_PROF_H_
+#define FOC_PROF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "conf_general.h"
+
+/*
+ * Cycle profiler for mcpwm_foc_adc_int_handler, enabled with
+ * FOC_PROFILE_ENABLE. The handler marks the end of each stage with the DWT
+ * cycle counter. The marks only store the counter, the statistics are
+ * updated once at the end of the handler. When the motor is undriven the
+ * stages measure the back-EMF tracking of the same step instead. A stage
+ * that is not marked in an interrupt gets no sample and its cycles go to the
+ * next stage.
+ *
+ * When disabled the macros are empty, foc_prof_send replies with no stages
+ * and the terminal command is not registered.
+ */
+
+typedef enum {
+	FOC_PROF_ADC = 0,		// Interpolation and current samples
+	FOC_PROF_ENCODER,		// Encoder read
+	FOC_PROF_SETPOINT,		// Clarke transform and current setpoint
+	FOC_PROF_OBSERVER,		// Observer and batch observers
+	FOC_PROF_PHASE,			// Encoder, hall or HFI correction of the phase
+	FOC_PROF_CONTROL,		// Current controller
+	FOC_PROF_SPEED,			// PLL, speed estimates, tachometer and PIDs
+	FOC_PROF_POST,			// Telemetry and mc_interface
+	FOC_PROF_TOTAL,			// Whole handler
+	FOC_PROF_STAGE_NUM
+} foc_prof_stage;
+
+// Histogram bins, 8 per octave up to 2^16 cycles
+#define FOC_PROF_HIST_BINS		112
+
+typedef struct {
+	uint32_t cnt;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[FOC_PROF_HIST_BINS];
+} foc_prof_stats;
+
+typedef struct {
+	uint32_t cnt;
+	uint32_t min;
+	float avg;
+	uint32_t max;
+	uint32_t p99;
+} foc_prof_summary;
+
+#if FOC_PROFILE_ENABLE
+void foc_prof_start(void);
+void foc_prof_mark(foc_prof_stage stage);
+void foc_prof_end(bool is_second_motor, float dt);
+
+#define FOC_PROF_START()				foc_prof_start()
+#define FOC_PROF_MARK(stage)			foc_prof_mark(stage)
+#define FOC_PROF_END(second, dt)		foc_prof_end(second, dt)
+#else
+#define FOC_PROF_START()
+#define FOC_PROF_MARK(stage)
+#define FOC_PROF_END(second, dt)
+#endif
+
+// Functions
+void foc_prof_init(void);
+void foc_prof_reset(void);
+bool foc_prof_get_summary(int motor, foc_prof_stage stage, foc_prof_summary *res);
+float foc_prof_get_budget(int motor);
+const char *foc_prof_stage_name(foc_prof_stage stage);
+void foc_prof_send(int motor, bool reset, void(*reply_func)(unsigned char *data, unsigned int len));
+
+#endif /* FOC_PROF_H_ */
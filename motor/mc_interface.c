@@ -41,6 +41,8 @@
 #include "crc.h"
 #include "bms.h"
 #include "events.h"
+#include "telemetry.h"
+#include "foc_prof.h"
 
 #include <math.h>
 #include <stdlib.h>
@@ -193,6 +195,8 @@ void mc_interface_init(void) {
 	m_sample_is_second_motor = false;
 
 	mc_interface_stat_reset();
+	telemetry_init();
+	foc_prof_init();
 
 	// Start threads
 	chThdCreateStatic(timer_thread_wa, sizeof(timer_thread_wa), NORMALPRIO, timer_thread, NULL);
@@ -41,6 +41,8 @@
 #include <stdio.h>
 #include "virtual_motor.h"
 #include "foc_math.h"
+#include "telemetry.h"
+#include "foc_prof.h"
 
 // Private variables
 static volatile bool m_dccal_done = false;
@@ -59,8 +61,10 @@ static void stop_pwm_hw(motor_all_state_t *motor);
 static void start_pwm_hw(motor_all_state_t *motor);
 static void full_brake_hw(motor_all_state_t *motor);
 static void terminal_plot_hfi(int argc, const char **argv);
+static void terminal_observer_batch(int argc, const char **argv);
 static void timer_update(motor_all_state_t *motor, float dt);
 static void hfi_update(volatile motor_all_state_t *motor, float dt);
+static void register_telemetry_channels(void);
 
 // Threads
 static THD_WORKING_AREA(timer_thread_wa, 512);
@@ -164,6 +168,20 @@ static void update_hfi_samples(foc_hfi_samples samples, volatile motor_all_state
 	utils_sys_unlock_cnt();
 }
 
+/*
+ * Rebuild the configuration snapshot and publish it in one go, so that the
+ * interrupt never runs with a half-updated one. Counted lock, as
+ * mcpwm_foc_init gets here with the system already locked.
+ */
+static void update_hot_conf(volatile motor_all_state_t *motor) {
+	foc_hot_conf hot;
+	foc_hot_conf_calc((motor_all_state_t*)motor, &hot);
+
+	utils_sys_lock_cnt();
+	motor->p_hot = hot;
+	utils_sys_unlock_cnt();
+}
+
 #pragma GCC push_options
 #pragma GCC optimize ("Os")
 
@@ -373,6 +391,7 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 	m_motor_1.m_hall_dt_diff_now = 1.0;
 	m_motor_1.m_ang_hall_int_prev = -1;
 	foc_precalc_values((motor_all_state_t*)&m_motor_1);
+	update_hot_conf(&m_motor_1);
 	update_hfi_samples(m_motor_1.m_conf->foc_hfi_samples, &m_motor_1);
 	init_audio_state(&m_motor_1.m_audio);
 
@@ -385,6 +404,7 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 	m_motor_2.m_hall_dt_diff_now = 1.0;
 	m_motor_2.m_ang_hall_int_prev = -1;
 	foc_precalc_values((motor_all_state_t*)&m_motor_2);
+	update_hot_conf(&m_motor_2);
 	update_hfi_samples(m_motor_2.m_conf->foc_hfi_samples, &m_motor_2);
 	init_audio_state(&m_motor_2.m_audio);
 #endif
@@ -587,6 +607,14 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 			"[en]",
 			terminal_plot_hfi);
 
+	terminal_register_command_callback(
+			"foc_obs_batch",
+			"Run the Ortega, MXLemming and MXV observers next to the active one. 0: off, 1: on. Print errors without argument.",
+			"[en]",
+			terminal_observer_batch);
+
+	register_telemetry_channels();
+
 	m_init_done = true;
 }
 
@@ -636,6 +664,7 @@ bool mcpwm_foc_init_done(void) {
 void mcpwm_foc_set_configuration(mc_configuration *configuration) {
 	get_motor_now()->m_conf = configuration;
 	foc_precalc_values((motor_all_state_t*)get_motor_now());
+	update_hot_conf(get_motor_now());
 
 	// Below we check if anything in the configuration changed that requires stopping the motor.
 
@@ -1095,6 +1124,76 @@ void mcpwm_foc_get_observer_state(float *x1, float *x2) {
 	*x2 = motor->m_observer_state.x2;
 }
 
+/**
+ * Enable or disable running a batch of observers next to the active one. The
+ * batch runs the Ortega, MXLemming and MXV observers on the same samples so
+ * that they can be compared without changing the configuration.
+ *
+ * @param enable
+ * True to start the batch, false to stop it.
+ */
+void mcpwm_foc_set_observer_batch(bool enable) {
+	volatile motor_all_state_t *motor = get_motor_now();
+
+	motor->m_observer_batch_en = false;
+
+	if (enable) {
+		const mc_foc_observer_type types[FOC_OBSERVER_BATCH_MAX] = {
+				FOC_OBSERVER_ORTEGA_ORIGINAL,
+				FOC_OBSERVER_MXLEMMING,
+				FOC_OBSERVER_MXV
+		};
+
+		foc_observer_batch_init((observer_batch_state*)&motor->m_observer_batch, types, FOC_OBSERVER_BATCH_MAX,
+				motor->m_observer_state.x1, motor->m_observer_state.x2, motor->m_conf->foc_motor_flux_linkage);
+		motor->m_observer_batch_en = true;
+	}
+}
+
+bool mcpwm_foc_get_observer_batch_en(void) {
+	return get_motor_now()->m_observer_batch_en;
+}
+
+int mcpwm_foc_get_observer_batch_num(void) {
+	volatile motor_all_state_t *motor = get_motor_now();
+	return motor->m_observer_batch_en ? motor->m_observer_batch.num : 0;
+}
+
+void mcpwm_foc_get_observer_batch_state(int ind, float *x1, float *x2) {
+	volatile motor_all_state_t *motor = get_motor_now();
+	if (ind < 0 || ind >= motor->m_observer_batch.num) {
+		*x1 = 0.0;
+		*x2 = 0.0;
+		return;
+	}
+
+	*x1 = motor->m_observer_batch.x1[ind];
+	*x2 = motor->m_observer_batch.x2[ind];
+}
+
+/**
+ * Get the filtered angle error of one observer in the batch against the
+ * active observer.
+ *
+ * @param ind
+ * Index in the batch.
+ *
+ * @param abs_err
+ * Return the filtered absolute error instead of the filtered signed error.
+ *
+ * @return
+ * The error in degrees.
+ */
+float mcpwm_foc_get_observer_batch_angle_err(int ind, bool abs_err) {
+	volatile motor_all_state_t *motor = get_motor_now();
+	if (ind < 0 || ind >= motor->m_observer_batch.num) {
+		return 0.0;
+	}
+
+	return RAD2DEG_f(abs_err ? motor->m_observer_batch.angle_err_abs[ind] :
+			motor->m_observer_batch.angle_err[ind]);
+}
+
 /**
  * Set current off delay. Prevent the current controller from switching off modulation
  * for target currents < cc_min_current for this amount of time.
@@ -1510,6 +1609,7 @@ int mcpwm_foc_encoder_detect(float current, bool print, float *offset, float *ra
 	motor->m_conf->foc_encoder_inverted = false;
 	motor->m_conf->foc_encoder_ratio = 1.0;
 	motor->m_conf->foc_motor_ld_lq_diff = 0.0;
+	update_hot_conf(motor);
 
 	// Find index
 	int cnt = 0;
@@ -1730,6 +1830,7 @@ int mcpwm_foc_encoder_detect(float current, bool print, float *offset, float *ra
 	motor->m_conf->foc_encoder_offset = offset_old;
 	motor->m_conf->foc_encoder_ratio = ratio_old;
 	motor->m_conf->foc_motor_ld_lq_diff = ldiff_old;
+	update_hot_conf(motor);
 
 	// Enable timeout
 	timeout_configure(tout, tout_c, tout_ksw);
@@ -2279,6 +2380,7 @@ int mcpwm_foc_measure_res_ind(float *res, float *ind, float *ld_lq_diff) {
 
 	motor->m_conf->foc_current_kp = 0.001;
 	motor->m_conf->foc_current_ki = 1.0;
+	update_hot_conf(motor);
 
 	float i_last = 0.0;
 	for (float i = 2.0;i < (motor->m_conf->l_current_max / 2.0);i *= 1.5) {
@@ -2304,6 +2406,7 @@ int mcpwm_foc_measure_res_ind(float *res, float *ind, float *ld_lq_diff) {
 	fault = mcpwm_foc_measure_resistance(i_last, 200, true, res);
 	if (fault == FAULT_CODE_NONE && *res != 0.0) {
 		motor->m_conf->foc_motor_r = *res;
+		update_hot_conf(motor);
 		mcpwm_foc_set_current(0.0);
 		chThdSleepMilliseconds(10);
 		fault = mcpwm_foc_measure_inductance_current(i_last, 200, 0, ld_lq_diff, ind);
@@ -2313,6 +2416,7 @@ int mcpwm_foc_measure_res_ind(float *res, float *ind, float *ld_lq_diff) {
 	motor->m_conf->foc_current_kp = kp_old;
 	motor->m_conf->foc_current_ki = ki_old;
 	motor->m_conf->foc_motor_r = res_old;
+	update_hot_conf(motor);
 	return fault;
 }
 
@@ -2830,6 +2934,7 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 	(void)flags;
 
 	uint32_t t_start = timer_time_now();
+	FOC_PROF_START();
 
 	bool is_v7 = !(TIM1->CR1 & TIM_CR1_DIR);
 	bool is_second_motor = false;
@@ -2857,6 +2962,11 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 	mc_configuration *conf_now = motor_now->m_conf;
 	mc_configuration *conf_other = motor_other->m_conf;
 
+	// Start the encoder transfer at the same point in every PWM period
+	if (!is_v7 && !is_second_motor) {
+		encoder_trigger_isr();
+	}
+
 	bool skip_interpolation = motor_other->m_cc_was_hfi;
 
 	// Update modulation for V7 and collect current samples. This is used by the HFI.
@@ -3194,8 +3304,11 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 
 	UTILS_LP_FAST(motor_now->m_motor_state.v_bus, GET_INPUT_VOLTAGE(), 0.1);
 
+	FOC_PROF_MARK(FOC_PROF_ADC);
+
 	volatile float enc_ang = 0;
 	volatile bool encoder_is_being_used = false;
+	float enc_age = 0.0;
 
 	if (virtual_motor_is_connected()) {
 		if (conf_now->foc_sensor_mode == FOC_SENSOR_MODE_ENCODER ) {
@@ -3204,7 +3317,9 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		}
 	} else {
 		if (encoder_is_configured()) {
-			enc_ang = encoder_read_deg();
+			uint32_t enc_sample_time;
+			enc_ang = encoder_read_deg_sample(&enc_sample_time);
+			enc_age = timer_seconds_between(enc_sample_time, t_start);
 			encoder_is_being_used = true;
 		}
 	}
@@ -3217,9 +3332,14 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		phase_tmp *= conf_now->foc_encoder_ratio;
 		phase_tmp -= conf_now->foc_encoder_offset;
 		utils_norm_angle((float*)&phase_tmp);
-		motor_now->m_phase_now_encoder = DEG2RAD_f(phase_tmp);
+
+		// The currents were sampled at t_start, so move the encoder angle there
+		motor_now->m_phase_now_encoder = foc_extrapolate_encoder(
+				DEG2RAD_f(phase_tmp), motor_now->m_pll_speed, enc_age);
 	}
 
+	FOC_PROF_MARK(FOC_PROF_ENCODER);
+
 	if (motor_now->m_state == MC_STATE_RUNNING) {
 		if (full_clarke) {
 			// Full Clarke Transform
@@ -3372,6 +3492,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 			iq_set_tmp = -SIGN(speed_fast_now) * fabsf(iq_set_tmp);
 		}
 
+		FOC_PROF_MARK(FOC_PROF_SETPOINT);
+
 		// Set motor phase
 		{
 			if (!motor_now->m_phase_override) {
@@ -3379,12 +3501,20 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 						motor_now->m_motor_state.i_alpha, motor_now->m_motor_state.i_beta,
 						dt, &(motor_now->m_observer_state), &motor_now->m_phase_now_observer, motor_now);
 
+				if (motor_now->m_observer_batch_en) {
+					foc_observer_batch_update(motor_now->m_motor_state.v_alpha, motor_now->m_motor_state.v_beta,
+							motor_now->m_motor_state.i_alpha, motor_now->m_motor_state.i_beta,
+							dt, motor_now->m_phase_now_observer, &(motor_now->m_observer_batch), motor_now);
+				}
+
 				// Compensate from the phase lag caused by the switching frequency. This is important for motors
 				// that run on high ERPM compared to the switching frequency.
 				motor_now->m_phase_now_observer += motor_now->m_pll_speed * dt * (0.5 + conf_now->foc_observer_offset);
 				utils_norm_angle_rad((float*)&motor_now->m_phase_now_observer);
 			}
 
+			FOC_PROF_MARK(FOC_PROF_OBSERVER);
+
 			switch (conf_now->foc_sensor_mode) {
 			case FOC_SENSOR_MODE_ENCODER:
 				if (encoder_index_found() || virtual_motor_is_connected()) {
@@ -3545,6 +3675,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		}
 		motor_now->m_motor_state.iq_target = iq_set_tmp;
 
+		FOC_PROF_MARK(FOC_PROF_PHASE);
+
 		control_current(motor_now, dt);
 	} else {
 		// Motor is not running
@@ -3567,6 +3699,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		// Track back emf
 		update_valpha_vbeta(motor_now, 0.0, 0.0);
 
+		FOC_PROF_MARK(FOC_PROF_SETPOINT);
+
 		// Run observer
 		foc_observer_update(motor_now->m_motor_state.v_alpha, motor_now->m_motor_state.v_beta,
 						motor_now->m_motor_state.i_alpha, motor_now->m_motor_state.i_beta,
@@ -3574,6 +3708,12 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		motor_now->m_phase_now_observer = utils_fast_atan2(motor_now->m_x2_prev + motor_now->m_observer_state.x2,
 														   motor_now->m_x1_prev + motor_now->m_observer_state.x1);
 
+		if (motor_now->m_observer_batch_en) {
+			foc_observer_batch_update(motor_now->m_motor_state.v_alpha, motor_now->m_motor_state.v_beta,
+					motor_now->m_motor_state.i_alpha, motor_now->m_motor_state.i_beta,
+					dt, motor_now->m_phase_now_observer, &(motor_now->m_observer_batch), motor_now);
+		}
+
 		// The observer phase offset has to be added here as well, with 0.5 switching cycles offset
 		// compared to when running. Otherwise going from undriven to driven causes a current
 		// spike.
@@ -3583,6 +3723,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		motor_now->m_x1_prev = motor_now->m_observer_state.x1;
 		motor_now->m_x2_prev = motor_now->m_observer_state.x2;
 
+		FOC_PROF_MARK(FOC_PROF_OBSERVER);
+
 		// Set motor phase
 		{
 			switch (conf_now->foc_sensor_mode) {
@@ -3621,6 +3763,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 					(float*)&motor_now->m_motor_state.phase_cos);
 		}
 
+		FOC_PROF_MARK(FOC_PROF_PHASE);
+
 		// HFI Restore
 #ifdef HW_HAS_DUAL_MOTORS
 		if (is_second_motor) {
@@ -3677,6 +3821,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		utils_truncate_number_abs((float*)&motor_now->m_motor_state.mod_q_filter, 1.0);
 	}
 
+	FOC_PROF_MARK(FOC_PROF_CONTROL);
+
 	// Calculate duty cycle
 	motor_now->m_motor_state.duty_now = SIGN(motor_now->m_motor_state.vq) *
 			NORM2_f(motor_now->m_motor_state.mod_d, motor_now->m_motor_state.mod_q) *
@@ -3767,17 +3913,24 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		utils_norm_angle((float*)&motor_now->m_pos_pid_now);
 	}
 
+	FOC_PROF_MARK(FOC_PROF_SPEED);
+
 #ifdef AD2S1205_SAMPLE_GPIO
 	// Release sample in the AD2S1205 resolver IC.
 	palSetPad(AD2S1205_SAMPLE_GPIO, AD2S1205_SAMPLE_PIN);
 #endif
 
+	telemetry_sample_isr(is_second_motor);
+
 #ifdef HW_HAS_DUAL_MOTORS
 	mc_interface_mc_timer_isr(is_second_motor);
 #else
 	mc_interface_mc_timer_isr(false);
 #endif
 
+	FOC_PROF_MARK(FOC_PROF_POST);
+	FOC_PROF_END(is_second_motor, dt);
+
 	m_isr_motor = 0;
 	m_last_adc_isr_duration = timer_seconds_elapsed_since(t_start);
 }
@@ -3799,6 +3952,13 @@ static void timer_update(motor_all_state_t *motor, float dt) {
 		motor->m_current_ki_temp_comp = conf_now->foc_current_ki;
 	}
 
+	// Rebuild the snapshot for the ISR only when the compensated values changed
+	if (conf_now->foc_temp_comp &&
+			(motor->p_hot.r != motor->m_res_temp_comp ||
+			motor->p_hot.current_ki != motor->m_current_ki_temp_comp)) {
+		update_hot_conf(motor);
+	}
+
 	// Check if it is time to stop the modulation. Notice that modulation is kept on as long as there is
 	// field weakening current.
 	utils_sys_lock_cnt();
@@ -4428,18 +4588,15 @@ static THD_FUNCTION(pid_thread, arg) {
 static void control_current(motor_all_state_t *motor, float dt) {
 	volatile motor_state_t *state_m = &motor->m_motor_state;
 	volatile mc_configuration *conf_now = motor->m_conf;
+	const foc_hot_conf *hot = &motor->p_hot;
 
 	float s = state_m->phase_sin;
 	float c = state_m->phase_cos;
 
 	float abs_rpm = fabsf(RADPS2RPM_f(motor->m_speed_est_fast));
 
-	bool do_hfi = (conf_now->foc_sensor_mode == FOC_SENSOR_MODE_HFI ||
-			conf_now->foc_sensor_mode == FOC_SENSOR_MODE_HFI_V2 ||
-			conf_now->foc_sensor_mode == FOC_SENSOR_MODE_HFI_V3 ||
-			conf_now->foc_sensor_mode == FOC_SENSOR_MODE_HFI_V4 ||
-			conf_now->foc_sensor_mode == FOC_SENSOR_MODE_HFI_V5 ||
-			(conf_now->foc_sensor_mode == FOC_SENSOR_MODE_HFI_START &&
+	bool do_hfi = (hot->hfi ||
+			(hot->hfi_start &&
 					motor->m_control_mode != CONTROL_MODE_CURRENT_BRAKE &&
 					fabsf(state_m->iq_target) > conf_now->cc_min_current)) &&
 							!motor->m_phase_override &&
@@ -4451,7 +4608,7 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	// a short delay when starting.
 	if (do_hfi && !hfi_est_done) {
 		state_m->iq_target = 0.0;
-	} else if (conf_now->foc_sensor_mode == FOC_SENSOR_MODE_HFI_START) {
+	} else if (hot->hfi_start) {
 		do_hfi = false;
 	}
 
@@ -4468,75 +4625,59 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	motor->m_cc_was_hfi = do_hfi;
 
 	float max_duty = fabsf(state_m->max_duty);
-	utils_truncate_number(&max_duty, 0.0, conf_now->l_max_duty);
+	utils_truncate_number(&max_duty, 0.0, hot->max_duty);
 
 	// Park transform: transforms the currents from stator to the rotor reference frame
 	state_m->id = c * state_m->i_alpha + s * state_m->i_beta;
 	state_m->iq = c * state_m->i_beta  - s * state_m->i_alpha;
 
 	// Low passed currents are used for less time critical parts, not for the feedback
-	UTILS_LP_FAST(state_m->id_filter, state_m->id, conf_now->foc_current_filter_const);
-	UTILS_LP_FAST(state_m->iq_filter, state_m->iq, conf_now->foc_current_filter_const);
+	UTILS_LP_FAST(state_m->id_filter, state_m->id, hot->current_filter_const);
+	UTILS_LP_FAST(state_m->iq_filter, state_m->iq, hot->current_filter_const);
 
+	// With the scaling off the slope is 0 and the limit 1, so the scale stays at 1.
+	// Compare against the start before dividing, as the modulation is below it most
+	// of the time.
 	float d_gain_scale = 1.0;
-	if (conf_now->foc_d_gain_scale_start < 0.99) {
-		float max_mod_norm = fabsf(state_m->duty_now / max_duty);
-		if (max_duty < 0.01) {
-			max_mod_norm = 1.0;
+	const float duty_abs = fabsf(state_m->duty_now);
+	if (max_duty < 0.01 || duty_abs > hot->d_gain_scale_start * max_duty) {
+		float max_mod_norm = 1.0;
+		if (max_duty >= 0.01) {
+			max_mod_norm = duty_abs / max_duty;
 		}
-		if (max_mod_norm > conf_now->foc_d_gain_scale_start) {
-			d_gain_scale = utils_map(max_mod_norm, conf_now->foc_d_gain_scale_start, 1.0,
-					1.0, conf_now->foc_d_gain_scale_max_mod);
-			if (d_gain_scale < conf_now->foc_d_gain_scale_max_mod) {
-				d_gain_scale = conf_now->foc_d_gain_scale_max_mod;
-			}
+		d_gain_scale = 1.0 + (max_mod_norm - hot->d_gain_scale_start) * hot->d_gain_scale_slope;
+		if (d_gain_scale < hot->d_gain_scale_max_mod) {
+			d_gain_scale = hot->d_gain_scale_max_mod;
 		}
 	}
 
 	float Ierr_d = state_m->id_target - state_m->id;
 	float Ierr_q = state_m->iq_target - state_m->iq;
 
-	float ki = conf_now->foc_current_ki;
-	if (conf_now->foc_temp_comp) {
-		ki = motor->m_current_ki_temp_comp;
-	}
+	// Temperature compensated when enabled
+	const float ki = hot->current_ki;
 
 	state_m->vd_int += Ierr_d * (ki * d_gain_scale * dt);
 	state_m->vq_int += Ierr_q * (ki * dt);
 
 	// Feedback (PI controller). No D action needed because the plant is a first order system (tf = 1/(Ls+R))
-	state_m->vd = state_m->vd_int + Ierr_d * conf_now->foc_current_kp * d_gain_scale;
-	state_m->vq = state_m->vq_int + Ierr_q * conf_now->foc_current_kp;
+	state_m->vd = state_m->vd_int + Ierr_d * hot->current_kp * d_gain_scale;
+	state_m->vq = state_m->vq_int + Ierr_q * hot->current_kp;
 
 	// Decoupling. Using feedforward this compensates for the fact that the equations of a PMSM
 	// are not really decoupled (the d axis current has impact on q axis voltage and visa-versa):
 	//      Resistance  Inductance   Cross terms   Back-EMF   (see www.mathworks.com/help/physmod/sps/ref/pmsm.html)
 	// vd = Rs*id   +   Ld*did/dt −  ωe*iq*Lq
 	// vq = Rs*iq   +   Lq*diq/dt +  ωe*id*Ld     + ωe*ψm
+	// The coefficients are 0 for the decoupling terms that are off.
 	float dec_vd = 0.0;
 	float dec_vq = 0.0;
 	float dec_bemf = 0.0;
 
-	if (motor->m_control_mode < CONTROL_MODE_HANDBRAKE && conf_now->foc_cc_decoupling != FOC_CC_DECOUPLING_DISABLED) {
-		switch (conf_now->foc_cc_decoupling) {
-		case FOC_CC_DECOUPLING_CROSS:
-			dec_vd = state_m->iq_filter * motor->m_speed_est_fast * motor->p_lq; // m_speed_est_fast is ωe in [rad/s]
-			dec_vq = state_m->id_filter * motor->m_speed_est_fast * motor->p_ld;
-			break;
-
-		case FOC_CC_DECOUPLING_BEMF:
-			dec_bemf = motor->m_speed_est_fast * conf_now->foc_motor_flux_linkage;
-			break;
-
-		case FOC_CC_DECOUPLING_CROSS_BEMF:
-			dec_vd = state_m->iq_filter * motor->m_speed_est_fast * motor->p_lq;
-			dec_vq = state_m->id_filter * motor->m_speed_est_fast * motor->p_ld;
-			dec_bemf = motor->m_speed_est_fast * conf_now->foc_motor_flux_linkage;
-			break;
-
-		default:
-			break;
-		}
+	if (motor->m_control_mode < CONTROL_MODE_HANDBRAKE) {
+		dec_vd = state_m->iq_filter * motor->m_speed_est_fast * hot->dec_lq; // m_speed_est_fast is ωe in [rad/s]
+		dec_vq = state_m->id_filter * motor->m_speed_est_fast * hot->dec_ld;
+		dec_bemf = motor->m_speed_est_fast * hot->dec_flux;
 	}
 
 	state_m->vd -= dec_vd; //Negative sign as in the PMSM equations
@@ -4544,7 +4685,7 @@ static void control_current(motor_all_state_t *motor, float dt) {
 
 	// Calculate the max length of the voltage space vector without overmodulation.
 	// Is simply 1/sqrt(3) * v_bus. See https://microchipdeveloper.com/mct5001:start. Adds margin with max_duty.
-	float max_v_mag = ONE_BY_SQRT3 * max_duty * state_m->v_bus * conf_now->foc_overmod_factor;
+	float max_v_mag = max_duty * state_m->v_bus * hot->max_v_mag_factor;
 
 	// Saturation and anti-windup. Notice that the d-axis has priority as it controls field
 	// weakening and the efficiency.
@@ -5286,3 +5427,69 @@ static void terminal_plot_hfi(int argc, const char **argv) {
 		commands_printf("This command requires one argument.\n");
 	}
 }
+
+static void terminal_observer_batch(int argc, const char **argv) {
+	if (argc == 2) {
+		int d = -1;
+		sscanf(argv[1], "%d", &d);
+
+		if (d == 0 || d == 1) {
+			mcpwm_foc_set_observer_batch(d);
+			commands_printf(d ? "Observer batch enabled\n" : "Observer batch disabled\n");
+		} else {
+			commands_printf("Invalid Argument. en has to be 0 or 1.\n");
+		}
+	} else if (argc == 1) {
+		int num = mcpwm_foc_get_observer_batch_num();
+		if (num == 0) {
+			commands_printf("Observer batch not running\n");
+			return;
+		}
+
+		volatile motor_all_state_t *motor = get_motor_now();
+		commands_printf("Active observer: %d", motor->m_conf->foc_observer_type);
+		for (int i = 0;i < num;i++) {
+			commands_printf("Observer %d: err %.2f deg, abs err %.2f deg, lambda %.3f mWb",
+					motor->m_observer_batch.type[i],
+					(double)mcpwm_foc_get_observer_batch_angle_err(i, false),
+					(double)mcpwm_foc_get_observer_batch_angle_err(i, true),
+					(double)(motor->m_observer_batch.lambda_est[i] * 1e3));
+		}
+		commands_printf(" ");
+	} else {
+		commands_printf("This command takes zero or one argument.\n");
+	}
+}
+
+static void register_telemetry_channels(void) {
+#ifdef HW_HAS_DUAL_MOTORS
+	volatile motor_all_state_t *m2 = &m_motor_2;
+#define TELEMETRY_REG(name, field, scale) \
+	telemetry_register_channel(name, &m_motor_1.field, &m2->field, scale)
+#else
+#define TELEMETRY_REG(name, field, scale) \
+	telemetry_register_channel(name, &m_motor_1.field, NULL, scale)
+#endif
+
+	TELEMETRY_REG("id", m_motor_state.id, 50.0);
+	TELEMETRY_REG("iq", m_motor_state.iq, 50.0);
+	TELEMETRY_REG("id_target", m_motor_state.id_target, 50.0);
+	TELEMETRY_REG("iq_target", m_motor_state.iq_target, 50.0);
+	TELEMETRY_REG("vd", m_motor_state.vd, 100.0);
+	TELEMETRY_REG("vq", m_motor_state.vq, 100.0);
+	TELEMETRY_REG("mod_d", m_motor_state.mod_d, 10000.0);
+	TELEMETRY_REG("mod_q", m_motor_state.mod_q, 10000.0);
+	TELEMETRY_REG("duty", m_motor_state.duty_now, 10000.0);
+	TELEMETRY_REG("v_bus", m_motor_state.v_bus, 100.0);
+	TELEMETRY_REG("i_abs", m_motor_state.i_abs, 50.0);
+	TELEMETRY_REG("phase", m_motor_state.phase, 5000.0);
+	TELEMETRY_REG("phase_obs", m_phase_now_observer, 5000.0);
+	TELEMETRY_REG("phase_enc", m_phase_now_encoder, 5000.0);
+	TELEMETRY_REG("obs_x1", m_observer_state.x1, 0.0);
+	TELEMETRY_REG("obs_x2", m_observer_state.x2, 0.0);
+	TELEMETRY_REG("pll_phase", m_pll_phase, 5000.0);
+	TELEMETRY_REG("pll_speed", m_pll_speed, 0.0);
+	TELEMETRY_REG("speed_fast", m_speed_est_fast, 0.0);
+
+#undef TELEMETRY_REG
+}
@@ -135,6 +135,11 @@ void mcpwm_foc_get_currents_adc(
 float mcpwm_foc_get_ts(void);
 bool mcpwm_foc_is_using_encoder(void);
 void mcpwm_foc_get_observer_state(float *x1, float *x2);
+void mcpwm_foc_set_observer_batch(bool enable);
+bool mcpwm_foc_get_observer_batch_en(void);
+int mcpwm_foc_get_observer_batch_num(void);
+void mcpwm_foc_get_observer_batch_state(int ind, float *x1, float *x2);
+float mcpwm_foc_get_observer_batch_angle_err(int ind, bool abs_err);
 void mcpwm_foc_set_current_off_delay(float delay_sec);
 
 // Functions where the motor can be selected
@@ -3,6 +3,8 @@ CSRC += \
 	motor/mc_interface.c \
 	motor/mcpwm.c \
 	motor/mcpwm_foc.c \
+	motor/telemetry.c \
+	motor/foc_prof.c \
 	motor/virtual_motor.c
 	
 INCDIR += motor
@@ -0,0 +1,398 @@
+/*
+	Copyright 2025 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "telemetry.h"
+#include "ch.h"
+#include "hal.h"
+#include "datatypes.h"
+#include "buffer.h"
+#include "commands.h"
+#include "terminal.h"
+#include "utils_math.h"
+#include "utils_sys.h"
+
+#include <string.h>
+
+#define RING_MASK		(TELEMETRY_RING_SIZE - 1)
+
+typedef union {
+	float f;
+	uint32_t u;
+} ring_word;
+
+// Channel registry
+static telemetry_channel m_channels[TELEMETRY_CHANNELS_MAX];
+static int m_channel_num = 0;
+static mutex_t m_mtx;
+
+// Ring. The FOC interrupt is the only writer and the sender thread the only
+// reader.
+static ring_word m_ring[TELEMETRY_RING_SIZE];
+static uint32_t m_ring_write = 0;
+static uint32_t m_ring_read = 0;
+
+// Frame buffer of the sender thread, static as it is too large for its stack
+static uint8_t m_frame[TELEMETRY_FRAME_MAX];
+
+// Stream. This is only changed while the system is locked and m_active is
+// false, so the interrupt sees a consistent stream.
+static volatile bool m_active = false;
+static bool m_second_motor = false;
+static volatile float *m_src[TELEMETRY_SELECT_MAX];
+static float m_scale[TELEMETRY_SELECT_MAX];
+static int m_ch_num = 0;
+static int m_decimation = 1;
+static int m_dec_cnt = 0;
+static uint32_t m_sample_cnt = 0;
+static volatile uint32_t m_overrun_cnt = 0;
+static unsigned int m_high_water = 0;
+static uint32_t m_frame_cnt = 0;
+static systime_t m_start_time = 0;
+static float m_duration = 0.0;
+static void(* volatile m_send_func)(unsigned char *data, unsigned int len) = 0;
+
+// Threads
+static THD_WORKING_AREA(sender_thread_wa, 512);
+static THD_FUNCTION(sender_thread, arg);
+
+// Private functions
+static void stream_stop(void);
+static void send_frames(void);
+static void terminal_telemetry(int argc, const char **argv);
+
+void telemetry_init(void) {
+	chMtxObjectInit(&m_mtx);
+	memset(m_channels, 0, sizeof(m_channels));
+	m_channel_num = 0;
+
+	chThdCreateStatic(sender_thread_wa, sizeof(sender_thread_wa), NORMALPRIO - 1, sender_thread, NULL);
+
+	terminal_register_command_callback(
+			"telemetry",
+			"Print the telemetry channels and the state of the stream.",
+			0,
+			terminal_telemetry);
+}
+
+/**
+ * Register a channel, or update the pointers of a channel with the same name.
+ *
+ * @param name
+ * Name of the channel, at most TELEMETRY_NAME_MAX characters are used.
+ *
+ * @param value_m1
+ * Value for motor 1. Must stay valid.
+ *
+ * @param value_m2
+ * Value for motor 2, or NULL to use value_m1 for both motors.
+ *
+ * @param scale
+ * Values are sent as int16 of value * scale, saturated. 0 sends them as
+ * float32.
+ *
+ * @return
+ * The channel id, or -1 if the registry is full.
+ */
+int telemetry_register_channel(const char *name, volatile float *value_m1,
+		volatile float *value_m2, float scale) {
+	chMtxLock(&m_mtx);
+
+	int id = -1;
+	for (int i = 0;i < m_channel_num;i++) {
+		if (strncmp(m_channels[i].name, name, TELEMETRY_NAME_MAX) == 0) {
+			id = i;
+			break;
+		}
+	}
+
+	if (id < 0 && m_channel_num < TELEMETRY_CHANNELS_MAX) {
+		id = m_channel_num++;
+	}
+
+	if (id >= 0) {
+		telemetry_channel *ch = &m_channels[id];
+		strncpy(ch->name, name, TELEMETRY_NAME_MAX);
+		ch->name[TELEMETRY_NAME_MAX] = '\0';
+		ch->value[0] = value_m1;
+		ch->value[1] = value_m2 ? value_m2 : value_m1;
+		ch->scale = scale;
+	}
+
+	chMtxUnlock(&m_mtx);
+
+	return id;
+}
+
+int telemetry_channel_count(void) {
+	return m_channel_num;
+}
+
+const telemetry_channel *telemetry_get_channel(int id) {
+	if (id < 0 || id >= m_channel_num) {
+		return 0;
+	}
+
+	return &m_channels[id];
+}
+
+/**
+ * Start a stream, replacing the current one.
+ *
+ * @param ids
+ * Channel ids to send. Unknown ids are skipped and at most
+ * TELEMETRY_SELECT_MAX channels are used.
+ *
+ * @param num
+ * Number of ids. 0 stops the stream.
+ *
+ * @param decimation
+ * Take every decimation:th interrupt.
+ *
+ * @param duration
+ * Stop the stream after this many seconds. 0 runs until it is stopped.
+ *
+ * @param second_motor
+ * Sample in the interrupt of the second motor.
+ *
+ * @param reply_func
+ * Function used to send the frames.
+ *
+ * @return
+ * Number of channels in the stream.
+ */
+int telemetry_start(const uint8_t *ids, int num, int decimation, float duration, bool second_motor,
+		void(*reply_func)(unsigned char *data, unsigned int len)) {
+	chMtxLock(&m_mtx);
+
+	stream_stop();
+
+	int ch_num = 0;
+	for (int i = 0;i < num && ch_num < TELEMETRY_SELECT_MAX;i++) {
+		if (ids[i] >= m_channel_num) {
+			continue;
+		}
+
+		telemetry_channel *ch = &m_channels[ids[i]];
+		m_src[ch_num] = ch->value[second_motor ? 1 : 0];
+		m_scale[ch_num] = ch->scale;
+		ch_num++;
+	}
+
+	if (decimation < 1) {
+		decimation = 1;
+	}
+
+	m_ch_num = ch_num;
+	m_decimation = decimation;
+	m_dec_cnt = 0;
+	m_second_motor = second_motor;
+	m_sample_cnt = 0;
+	m_overrun_cnt = 0;
+	m_high_water = 0;
+	m_frame_cnt = 0;
+	m_ring_write = 0;
+	m_ring_read = 0;
+	m_duration = duration;
+	m_start_time = chVTGetSystemTimeX();
+	m_send_func = reply_func;
+
+	if (ch_num > 0) {
+		chSysLock();
+		m_active = true;
+		chSysUnlock();
+	}
+
+	chMtxUnlock(&m_mtx);
+
+	return ch_num;
+}
+
+void telemetry_stop(void) {
+	chMtxLock(&m_mtx);
+	stream_stop();
+	chMtxUnlock(&m_mtx);
+}
+
+void telemetry_get_stats(telemetry_stats *stats) {
+	stats->active = m_active;
+	stats->second_motor = m_second_motor;
+	stats->decimation = m_decimation;
+	stats->ch_num = m_ch_num;
+	stats->sample_cnt = m_sample_cnt;
+	stats->overrun_cnt = m_overrun_cnt;
+	stats->frame_cnt = m_frame_cnt;
+	stats->ring_high_water = m_high_water;
+}
+
+/**
+ * Copy the selected channels into the ring. Called at the end of the FOC
+ * interrupt, after the control update.
+ *
+ * @param is_second_motor
+ * The motor the interrupt is for.
+ */
+void telemetry_sample_isr(bool is_second_motor) {
+	if (!m_active || m_second_motor != is_second_motor) {
+		return;
+	}
+
+	m_dec_cnt++;
+	if (m_dec_cnt < m_decimation) {
+		return;
+	}
+	m_dec_cnt = 0;
+
+	uint32_t sample = m_sample_cnt++;
+	uint32_t words = m_ch_num + 1;
+	uint32_t write = m_ring_write;
+	uint32_t read = __atomic_load_n(&m_ring_read, __ATOMIC_ACQUIRE);
+
+	if ((TELEMETRY_RING_SIZE - (write - read)) < words) {
+		m_overrun_cnt++;
+		return;
+	}
+
+	m_ring[write & RING_MASK].u = sample;
+	for (int i = 0;i < m_ch_num;i++) {
+		m_ring[(write + 1 + i) & RING_MASK].f = *m_src[i];
+	}
+
+	__atomic_store_n(&m_ring_write, write + words, __ATOMIC_RELEASE);
+
+	if ((write + words - read) > m_high_water) {
+		m_high_water = write + words - read;
+	}
+}
+
+// Must be called with m_mtx locked
+static void stream_stop(void) {
+	chSysLock();
+	m_active = false;
+	chSysUnlock();
+}
+
+/*
+ * Send what is in the ring. The end is taken once, so that a fast stream
+ * cannot keep this thread busy. Frames end at gaps in the sample index.
+ * Must be called with m_mtx locked.
+ */
+static void send_frames(void) {
+	void(*send_func)(unsigned char *data, unsigned int len) = m_send_func;
+	if (!send_func || m_ch_num == 0) {
+		return;
+	}
+
+	int sample_bytes = 0;
+	for (int i = 0;i < m_ch_num;i++) {
+		sample_bytes += m_scale[i] != 0.0 ? 2 : 4;
+	}
+
+	int samples_max = (TELEMETRY_FRAME_MAX - 10) / sample_bytes;
+	if (samples_max > 255) {
+		samples_max = 255;
+	}
+
+	uint32_t words = m_ch_num + 1;
+	uint32_t read = m_ring_read;
+	uint32_t write = __atomic_load_n(&m_ring_write, __ATOMIC_ACQUIRE);
+	uint8_t *buffer = m_frame;
+
+	while (read != write) {
+		int32_t ind = 0;
+		uint32_t first = m_ring[read & RING_MASK].u;
+
+		buffer[ind++] = COMM_TELEMETRY_DATA;
+		buffer_append_uint32(buffer, first, &ind);
+		buffer_append_uint32(buffer, m_overrun_cnt, &ind);
+		int32_t num_ind = ind++;
+
+		int num = 0;
+		while (read != write && num < samples_max &&
+				m_ring[read & RING_MASK].u == (first + num)) {
+			for (int i = 0;i < m_ch_num;i++) {
+				float val = m_ring[(read + 1 + i) & RING_MASK].f;
+
+				if (m_scale[i] != 0.0) {
+					val *= m_scale[i];
+					utils_truncate_number(&val, -32768.0, 32767.0);
+					buffer_append_int16(buffer, (int16_t)val, &ind);
+				} else {
+					buffer_append_float32_auto(buffer, val, &ind);
+				}
+			}
+
+			read += words;
+			num++;
+		}
+
+		__atomic_store_n(&m_ring_read, read, __ATOMIC_RELEASE);
+
+		buffer[num_ind] = num;
+		send_func(buffer, ind);
+		m_frame_cnt++;
+	}
+}
+
+static THD_FUNCTION(sender_thread, arg) {
+	(void)arg;
+
+	chRegSetThreadName("Telemetry");
+
+	for(;;) {
+		chMtxLock(&m_mtx);
+
+		if (m_active && m_duration > 0.0 && UTILS_AGE_S(m_start_time) > m_duration) {
+			stream_stop();
+		}
+
+		// Also after a stop, so that the last samples are sent
+		send_frames();
+
+		chMtxUnlock(&m_mtx);
+
+		chThdSleepMilliseconds(2);
+	}
+}
+
+static void terminal_telemetry(int argc, const char **argv) {
+	(void)argc;
+	(void)argv;
+
+	commands_printf("Channels:");
+	for (int i = 0;i < m_channel_num;i++) {
+		if (m_channels[i].scale != 0.0) {
+			commands_printf("  %2d %-15s int16, scale %.1f", i, m_channels[i].name, (double)m_channels[i].scale);
+		} else {
+			commands_printf("  %2d %-15s float32", i, m_channels[i].name);
+		}
+	}
+
+	telemetry_stats s;
+	telemetry_get_stats(&s);
+
+	commands_printf("Stream:      %s", s.active ? "Active" : "Stopped");
+	commands_printf("Motor:       %d", s.second_motor ? 2 : 1);
+	commands_printf("Channels:    %d", s.ch_num);
+	commands_printf("Decimation:  %d", s.decimation);
+	commands_printf("Samples:     %u", s.sample_cnt);
+	commands_printf("Overruns:    %u", s.overrun_cnt);
+	commands_printf("Frames:      %u", s.frame_cnt);
+	commands_printf("Ring max:    %u / %u words", s.ring_high_water, TELEMETRY_RING_SIZE);
+	commands_printf(" ");
+}
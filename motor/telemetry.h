@@ -0,0 +1,87 @@
+/*
+	Copyright 2025 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Continuous streaming of internal signals at the control interrupt rate.
+ *
+ * Signals are registered as channels with a pointer to a float for each
+ * motor. A stream selects up to TELEMETRY_SELECT_MAX channels and a
+ * decimation. The FOC interrupt copies the selected values into a lock-free
+ * ring and a sender thread packs them into COMM_TELEMETRY_DATA frames. When
+ * the ring is full the sample is dropped and counted as an overrun.
+ *
+ * COMM_TELEMETRY_DATA layout:
+ * uint32  Index of the first sample in the frame, counted from the start
+ * uint32  Total number of overruns since the start
+ * uint8   Number of samples
+ * Then the samples, each with the selected channels in order. Channels with
+ * a scale are sent as int16 of value * scale, the others as float32_auto.
+ * The sample index is contiguous within a frame.
+ */
+
+#define TELEMETRY_CHANNELS_MAX		32
+#define TELEMETRY_SELECT_MAX		8
+#define TELEMETRY_NAME_MAX			15
+
+// Ring size in 32-bit words, must be a power of two. Every sample takes one
+// word for the index and one per selected channel.
+#ifndef TELEMETRY_RING_SIZE
+#define TELEMETRY_RING_SIZE			1024
+#endif
+
+#ifndef TELEMETRY_FRAME_MAX
+#define TELEMETRY_FRAME_MAX			400
+#endif
+
+typedef struct {
+	char name[TELEMETRY_NAME_MAX + 1];
+	volatile float *value[2];
+	float scale;
+} telemetry_channel;
+
+typedef struct {
+	bool active;
+	bool second_motor;
+	int decimation;
+	int ch_num;
+	uint32_t sample_cnt;
+	uint32_t overrun_cnt;
+	uint32_t frame_cnt;
+	unsigned int ring_high_water;
+} telemetry_stats;
+
+// Functions
+void telemetry_init(void);
+int telemetry_register_channel(const char *name, volatile float *value_m1,
+		volatile float *value_m2, float scale);
+int telemetry_channel_count(void);
+const telemetry_channel *telemetry_get_channel(int id);
+int telemetry_start(const uint8_t *ids, int num, int decimation, float duration, bool second_motor,
+		void(*reply_func)(unsigned char *data, unsigned int len));
+void telemetry_stop(void);
+void telemetry_get_stats(telemetry_stats *stats);
+void telemetry_sample_isr(bool is_second_motor);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,35 @@
+/*
+ * Minimal stand-in for the ChibiOS HAL, only the CAN frame type is needed.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+
+typedef struct {
+	struct {
+		uint8_t FMI;
+		uint16_t TIME;
+	};
+	struct {
+		uint8_t DLC:4;
+		uint8_t RTR:1;
+		uint8_t IDE:1;
+	};
+	union {
+		struct {
+			uint32_t SID:11;
+		};
+		struct {
+			uint32_t EID:29;
+		};
+	};
+	union {
+		uint8_t data8[8];
+		uint16_t data16[4];
+		uint32_t data32[2];
+	};
+} CANRxFrame;
+
+#endif /* HAL_H_ */
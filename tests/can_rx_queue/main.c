@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "can_rx_queue.h"
+
+static can_rx_queue queue;
+static volatile bool producer_done = false;
+static unsigned int frames_to_send = 0;
+static unsigned int consumer_delay = 0;
+
+// Result from the consumer
+static unsigned int rx_frames = 0;
+static unsigned int rx_errors = 0;
+
+// Mutex-protected ring like the one the queue replaced, for comparison
+static pthread_mutex_t ring_mtx = PTHREAD_MUTEX_INITIALIZER;
+static CANRxFrame ring_frames[CAN_RX_QUEUE_SIZE];
+static volatile unsigned int ring_read = 0;
+static volatile unsigned int ring_write = 0;
+
+static double time_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void make_frame(CANRxFrame *f, uint32_t seq) {
+	memset(f, 0, sizeof(CANRxFrame));
+	f->IDE = 1;
+	f->EID = seq & 0x1FFFFFFF;
+	f->DLC = 8;
+	f->data32[0] = seq;
+	f->data32[1] = ~seq * 2654435761u;
+}
+
+static bool check_frame(const CANRxFrame *f, uint32_t *last_seq, bool first) {
+	uint32_t seq = f->data32[0];
+	bool ok = f->EID == (seq & 0x1FFFFFFF) && f->DLC == 8 &&
+			f->data32[1] == ~seq * 2654435761u;
+
+	// Frames may be dropped, but never reordered or repeated
+	if (!first && seq <= *last_seq) {
+		ok = false;
+	}
+
+	*last_seq = seq;
+	return ok;
+}
+
+static void spin(unsigned int n) {
+	for (volatile unsigned int i = 0;i < n;i++) {}
+}
+
+static void *producer_thd(void *arg) {
+	(void)arg;
+	CANRxFrame f;
+	for (unsigned int i = 0;i < frames_to_send;i++) {
+		make_frame(&f, i);
+		while (consumer_delay == 0 && !can_rx_queue_push(&queue, &f)) {
+			// Lossless mode: wait for space. The failed pushes are counted
+			// as drops, so undo that here.
+			queue.drop_cnt--;
+			sched_yield();
+		}
+		if (consumer_delay != 0) {
+			// Bursts that are longer than the queue
+			can_rx_queue_push(&queue, &f);
+			if ((i % 100) == 99) {
+				sched_yield();
+			}
+		}
+	}
+	producer_done = true;
+	return 0;
+}
+
+static void *consumer_thd(void *arg) {
+	(void)arg;
+	CANRxFrame f;
+	uint32_t last_seq = 0;
+	bool first = true;
+
+	for (;;) {
+		bool done = producer_done;
+		while (can_rx_queue_pop(&queue, &f)) {
+			rx_errors += !check_frame(&f, &last_seq, first);
+			first = false;
+			rx_frames++;
+			spin(consumer_delay);
+		}
+
+		if (done) {
+			break;
+		}
+
+		sched_yield();
+	}
+	return 0;
+}
+
+static void *producer_mtx_thd(void *arg) {
+	(void)arg;
+	CANRxFrame f;
+	for (unsigned int i = 0;i < frames_to_send;i++) {
+		make_frame(&f, i);
+		for (;;) {
+			pthread_mutex_lock(&ring_mtx);
+			bool full = (ring_write + 1) % CAN_RX_QUEUE_SIZE == ring_read;
+			if (!full) {
+				ring_frames[ring_write] = f;
+				ring_write = (ring_write + 1) % CAN_RX_QUEUE_SIZE;
+			}
+			pthread_mutex_unlock(&ring_mtx);
+			if (!full) {
+				break;
+			}
+			sched_yield();
+		}
+	}
+	producer_done = true;
+	return 0;
+}
+
+static void *consumer_mtx_thd(void *arg) {
+	(void)arg;
+	CANRxFrame f;
+	uint32_t last_seq = 0;
+	bool first = true;
+
+	for (;;) {
+		bool done = producer_done;
+		for (;;) {
+			bool got = false;
+			pthread_mutex_lock(&ring_mtx);
+			if (ring_read != ring_write) {
+				f = ring_frames[ring_read];
+				ring_read = (ring_read + 1) % CAN_RX_QUEUE_SIZE;
+				got = true;
+			}
+			pthread_mutex_unlock(&ring_mtx);
+			if (!got) {
+				break;
+			}
+			rx_errors += !check_frame(&f, &last_seq, first);
+			first = false;
+			rx_frames++;
+		}
+
+		if (done) {
+			break;
+		}
+
+		sched_yield();
+	}
+	return 0;
+}
+
+static double run(void *(*prod)(void*), void *(*cons)(void*),
+		unsigned int frames, unsigned int delay) {
+	can_rx_queue_init(&queue);
+	producer_done = false;
+	frames_to_send = frames;
+	consumer_delay = delay;
+	rx_frames = 0;
+	rx_errors = 0;
+
+	pthread_t p, c;
+	double start = time_now();
+	pthread_create(&c, 0, cons, 0);
+	pthread_create(&p, 0, prod, 0);
+	pthread_join(p, 0);
+	pthread_join(c, 0);
+	return time_now() - start;
+}
+
+int main(void) {
+	int fails = 0;
+
+	// Single thread sanity check
+	can_rx_queue_init(&queue);
+	CANRxFrame f;
+	for (unsigned int i = 0;i < CAN_RX_QUEUE_SIZE + 10;i++) {
+		make_frame(&f, i);
+		can_rx_queue_push(&queue, &f);
+	}
+	bool ok = can_rx_queue_count(&queue) == CAN_RX_QUEUE_SIZE &&
+			queue.drop_cnt == 10 && queue.high_water == CAN_RX_QUEUE_SIZE;
+	for (unsigned int i = 0;i < CAN_RX_QUEUE_SIZE;i++) {
+		ok = ok && can_rx_queue_pop(&queue, &f) && f.data32[0] == i;
+	}
+	ok = ok && !can_rx_queue_pop(&queue, &f);
+	printf("Fill and drain: %s\r\n", ok ? "OK" : "FAILED");
+	fails += !ok;
+
+	// Lossless stress test
+	const unsigned int frames = 10000000;
+	double t = run(producer_thd, consumer_thd, frames, 0);
+	ok = rx_frames == frames && rx_errors == 0 && queue.drop_cnt == 0;
+	printf("Lossless: %u frames, %u errors, %.1f Mframes/s: %s\r\n",
+			rx_frames, rx_errors, (double)frames / t * 1e-6, ok ? "OK" : "FAILED");
+	fails += !ok;
+
+	// Slow consumer, frames have to be dropped and counted
+	t = run(producer_thd, consumer_thd, 2000000, 200);
+	ok = rx_frames + queue.drop_cnt == 2000000 && rx_errors == 0 &&
+			queue.drop_cnt > 0 && queue.rx_cnt == rx_frames;
+	printf("Overflow: %u received, %u dropped, %u errors: %s\r\n",
+			rx_frames, (unsigned int)queue.drop_cnt, rx_errors, ok ? "OK" : "FAILED");
+	fails += !ok;
+
+	// Same transfer through a mutex-protected ring
+	t = run(producer_mtx_thd, consumer_mtx_thd, frames, 0);
+	ok = rx_frames == frames && rx_errors == 0;
+	printf("Mutex ring: %u frames, %u errors, %.1f Mframes/s: %s\r\n",
+			rx_frames, rx_errors, (double)frames / t * 1e-6, ok ? "OK" : "FAILED");
+	fails += !ok;
+
+	return fails != 0;
+}
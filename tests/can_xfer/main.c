@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "can_xfer.h"
+
+#define BITRATE			500000.0
+#define TX_ID			1
+#define RX_ID			2
+#define BUS_LEN			2048
+
+typedef struct {
+	uint8_t to;
+	bool is_data;
+	unsigned int seq;
+	uint8_t data[8];
+	uint8_t len;
+	uint32_t eid;
+} sim_frame;
+
+// Transmit queue of one node
+typedef struct {
+	sim_frame frames[BUS_LEN];
+	unsigned int read;
+	unsigned int write;
+} sim_node;
+
+static sim_node nodes[2];
+static double now_us = 0.0;
+static double loss = 0.0;
+static bool rx_supported = true;
+
+static can_xfer_tx tx;
+static can_xfer_rx rx;
+static uint8_t rx_buffer[8192];
+static unsigned int rx_done_cnt = 0;
+
+static void bus_put(uint8_t to, bool is_data, unsigned int seq, uint8_t *data, uint8_t len) {
+	// The node that sends is the one that is not addressed
+	sim_node *n = &nodes[to == RX_ID ? 0 : 1];
+	sim_frame *f = &n->frames[n->write];
+	f->to = to;
+	f->is_data = is_data;
+	f->seq = seq;
+	f->len = len;
+	f->eid = to | (is_data ? (69 << 8) | (seq << 16) : (70 << 8));
+	memcpy(f->data, data, len);
+	n->write = (n->write + 1) % BUS_LEN;
+}
+
+static void bus_flush(void) {
+	memset(nodes, 0, sizeof(nodes));
+}
+
+static void send_ctrl(uint8_t id, uint8_t *data, uint8_t len) {
+	bus_put(id, false, 0, data, len);
+}
+
+static void send_data(uint8_t id, unsigned int seq, uint8_t *data, uint8_t len) {
+	bus_put(id, true, seq, data, len);
+}
+
+// Extended frame with worst case bit stuffing, including the inter-frame space
+static double frame_time_us(unsigned int len) {
+	unsigned int bits = 67 + 8 * len + (54 + 8 * len - 1) / 4;
+	return (double)bits / BITRATE * 1e6;
+}
+
+static bool rand_drop(void) {
+	return (double)rand() / (double)RAND_MAX < loss;
+}
+
+// Put one frame on the bus and deliver it. The frames at the head of the
+// node queues arbitrate, and the lowest id wins.
+static bool bus_step(void) {
+	sim_node *n = 0;
+	for (int i = 0;i < 2;i++) {
+		if (nodes[i].read != nodes[i].write && (!n ||
+				nodes[i].frames[nodes[i].read].eid < n->frames[n->read].eid)) {
+			n = &nodes[i];
+		}
+	}
+
+	if (!n) {
+		return false;
+	}
+
+	sim_frame *f = &n->frames[n->read];
+	n->read = (n->read + 1) % BUS_LEN;
+	now_us += frame_time_us(f->len);
+
+	if (rand_drop()) {
+		return true;
+	}
+
+	uint32_t now = (uint32_t)now_us;
+	if (f->to == RX_ID) {
+		if (!rx_supported) {
+			return true;
+		}
+
+		if (f->is_data) {
+			if (can_xfer_rx_process_data(&rx, f->seq, f->data, f->len, now)) {
+				rx_done_cnt++;
+			}
+		} else {
+			can_xfer_rx_process_ctrl(&rx, f->data, f->len, now);
+		}
+	} else if (f->to == TX_ID) {
+		can_xfer_tx_process_ctrl(&tx, f->data, f->len, now);
+	}
+
+	return true;
+}
+
+static CAN_XFER_STATE run_xfer(uint8_t *data, unsigned int len) {
+	bus_flush();
+	can_xfer_tx_start(&tx, RX_ID, 0, data, len, (uint32_t)now_us);
+
+	CAN_XFER_STATE state;
+	for (;;) {
+		state = can_xfer_tx_update(&tx, (uint32_t)now_us);
+		if (state != CAN_XFER_NEGOTIATING && state != CAN_XFER_RUNNING) {
+			break;
+		}
+
+		if (!bus_step()) {
+			now_us += 100.0;
+		}
+	}
+
+	// Let the receiver see what is left on the bus
+	while (bus_step()) {}
+
+	return state;
+}
+
+// Time of the FILL_RX_BUFFER protocol in comm_can_send_buffer. A single lost
+// frame makes the whole buffer fail, so it is sent again until it gets through.
+static double run_legacy(unsigned int len, unsigned int *attempts) {
+	double t = 0.0;
+	*attempts = 0;
+
+	for (;;) {
+		bool ok = true;
+		(*attempts)++;
+
+		unsigned int end_a = 0;
+		for (unsigned int i = 0;i < len;i += 7) {
+			if (i > 255) {
+				break;
+			}
+			end_a = i + 7;
+			t += frame_time_us(1 + ((i + 7) <= len ? 7 : len - i));
+			ok = ok && !rand_drop();
+		}
+
+		for (unsigned int i = end_a;i < len;i += 6) {
+			t += frame_time_us(2 + ((i + 6) <= len ? 6 : len - i));
+			ok = ok && !rand_drop();
+		}
+
+		t += frame_time_us(6);
+		ok = ok && !rand_drop();
+
+		if (ok || *attempts >= 1000) {
+			return t;
+		}
+	}
+}
+
+int main(void) {
+	int fails = 0;
+	srand(101);
+
+	can_xfer_tx_init(&tx, TX_ID, 10000, 30000, send_ctrl, send_data);
+	can_xfer_rx_init(&rx, RX_ID, rx_buffer, sizeof(rx_buffer), 100000, send_ctrl);
+
+	// Receiver without support
+	uint8_t data[8192];
+	rx_supported = false;
+	CAN_XFER_STATE state = run_xfer(data, 100);
+	printf("Unsupported receiver: %s\r\n", state == CAN_XFER_UNSUPPORTED ? "OK" : "FAILED");
+	fails += state != CAN_XFER_UNSUPPORTED;
+	rx_supported = true;
+
+	unsigned int sizes[] = {64, 512, 4096};
+	double losses[] = {0.0, 0.001, 0.01, 0.05};
+	const int runs = 200;
+
+	printf("\r\n%6s %6s | %14s %8s | %14s %8s %8s\r\n", "Bytes", "Loss",
+			"Legacy kbit/s", "Tries", "Window kbit/s", "Resent", "Failed");
+
+	for (unsigned int s = 0;s < sizeof(sizes) / sizeof(sizes[0]);s++) {
+		for (unsigned int l = 0;l < sizeof(losses) / sizeof(losses[0]);l++) {
+			unsigned int len = sizes[s];
+			loss = losses[l];
+
+			double t_legacy = 0.0;
+			unsigned int tries_legacy = 0;
+			double t_xfer = 0.0;
+			unsigned int resent = 0;
+			unsigned int sent = 0;
+			int failed = 0;
+
+			for (int r = 0;r < runs;r++) {
+				unsigned int attempts;
+				t_legacy += run_legacy(len, &attempts);
+				tries_legacy += attempts;
+
+				for (unsigned int i = 0;i < len;i++) {
+					data[i] = rand();
+				}
+
+				unsigned int done_before = rx_done_cnt;
+				double start = now_us;
+				state = run_xfer(data, len);
+				t_xfer += now_us - start;
+				resent += tx.frames_resent;
+				sent += tx.frames_sent;
+
+				bool ok = state == CAN_XFER_DONE && rx_done_cnt == done_before + 1 &&
+						rx.len == len && memcmp(rx_buffer, data, len) == 0;
+				failed += !ok;
+			}
+
+			printf("%6u %5.1f%% | %14.1f %8.2f | %14.1f %7.1f%% %8d\r\n",
+					len, loss * 100.0,
+					(double)(len * 8 * runs) / t_legacy * 1e3,
+					(double)tries_legacy / (double)runs,
+					(double)(len * 8 * runs) / t_xfer * 1e3,
+					100.0 * (double)resent / (double)sent,
+					failed);
+
+			fails += failed;
+		}
+	}
+
+	return fails != 0;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "crc.h"
+#include "utils_math.h"
+
+// Bitwise reference implementations
+static unsigned short ref_crc16(unsigned short cksum, const uint8_t *buf, unsigned int len) {
+	for (unsigned int i = 0;i < len;i++) {
+		cksum ^= (unsigned short)buf[i] << 8;
+		for (int j = 0;j < 8;j++) {
+			cksum = (cksum & 0x8000) ? (cksum << 1) ^ 0x1021 : (cksum << 1);
+		}
+	}
+	return cksum;
+}
+
+static uint32_t ref_crc32_reflected(uint32_t poly, uint32_t cksum, const uint8_t *buf, uint32_t len) {
+	cksum = ~cksum;
+	for (uint32_t i = 0;i < len;i++) {
+		cksum ^= buf[i];
+		for (int j = 0;j < 8;j++) {
+			uint32_t mask = -(cksum & 1);
+			cksum = (cksum >> 1) ^ (poly & mask);
+		}
+	}
+	return ~cksum;
+}
+
+static uint8_t buffer[70000];
+
+static double time_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool test_equivalence(void) {
+	bool ok = true;
+
+	// Known check values for "123456789"
+	uint8_t check[] = "123456789";
+	if (crc16(check, 9) != 0x31C3) {
+		printf("crc16 check value wrong: 0x%04X\r\n", crc16(check, 9));
+		ok = false;
+	}
+	if (crc32_with_init(check, 9, 0) != 0xCBF43926) {
+		printf("crc32 check value wrong: 0x%08X\r\n", crc32_with_init(check, 9, 0));
+		ok = false;
+	}
+	if (crc32c(check, 9) != 0xE3069283 || utils_crc32c(check, 9) != 0xE3069283) {
+		printf("crc32c check value wrong: 0x%08X 0x%08X\r\n", crc32c(check, 9), utils_crc32c(check, 9));
+		ok = false;
+	}
+
+	// Random data at all small lengths and alignments, also rolled in two parts
+	for (int ofs = 0;ofs < 8;ofs++) {
+		for (unsigned int len = 0;len < 300;len++) {
+			const uint8_t *b = buffer + ofs;
+			unsigned int split = len / 3;
+
+			unsigned short c16 = ref_crc16(0, b, len);
+			unsigned short c16_roll = crc16_rolling(crc16_rolling(0, (uint8_t*)b, split), (uint8_t*)b + split, len - split);
+			if (crc16((uint8_t*)b, len) != c16 || c16_roll != c16) {
+				printf("crc16 mismatch at ofs %d len %u\r\n", ofs, len);
+				ok = false;
+			}
+
+			uint32_t c32 = ref_crc32_reflected(0xEDB88320, 0, b, len);
+			uint32_t c32_roll = crc32_with_init(b + split, len - split, crc32_with_init(b, split, 0));
+			if (crc32_with_init(b, len, 0) != c32 || c32_roll != c32) {
+				printf("crc32 mismatch at ofs %d len %u\r\n", ofs, len);
+				ok = false;
+			}
+
+			uint32_t c32c = ref_crc32_reflected(0x82F63B78, 0, b, len);
+			uint32_t c32c_roll = crc32c_with_init(b + split, len - split, crc32c_with_init(b, split, 0));
+			if (crc32c(b, len) != c32c || c32c_roll != c32c || utils_crc32c((uint8_t*)b, len) != c32c) {
+				printf("crc32c mismatch at ofs %d len %u\r\n", ofs, len);
+				ok = false;
+			}
+		}
+	}
+
+	// One large buffer
+	if (crc16(buffer, sizeof(buffer)) != ref_crc16(0, buffer, sizeof(buffer)) ||
+			crc32_with_init(buffer, sizeof(buffer), 0x12345678) !=
+					ref_crc32_reflected(0xEDB88320, 0x12345678, buffer, sizeof(buffer))) {
+		printf("Large buffer mismatch\r\n");
+		ok = false;
+	}
+
+	return ok;
+}
+
+static void bench(void) {
+	const unsigned int len = 4096;
+	const int runs = 20000;
+	volatile uint32_t sink = 0;
+	double start, t_ref, t_tab;
+
+	printf("\r\nPerformance (%u byte buffer, slice by %d)\r\n", len, CRC_SLICE_BY);
+
+	start = time_s();
+	for (int i = 0;i < runs / 10;i++) {
+		sink += ref_crc16(0, buffer, len);
+	}
+	t_ref = (time_s() - start) * 10.0;
+	start = time_s();
+	for (int i = 0;i < runs;i++) {
+		sink += crc16(buffer, len);
+	}
+	t_tab = time_s() - start;
+	printf("crc16:  bitwise %7.1f MB/s, table %7.1f MB/s\r\n",
+			(double)len * runs / t_ref * 1e-6, (double)len * runs / t_tab * 1e-6);
+
+	start = time_s();
+	for (int i = 0;i < runs / 10;i++) {
+		sink += ref_crc32_reflected(0xEDB88320, 0, buffer, len);
+	}
+	t_ref = (time_s() - start) * 10.0;
+	start = time_s();
+	for (int i = 0;i < runs;i++) {
+		sink += crc32_with_init(buffer, len, 0);
+	}
+	t_tab = time_s() - start;
+	printf("crc32:  bitwise %7.1f MB/s, table %7.1f MB/s\r\n",
+			(double)len * runs / t_ref * 1e-6, (double)len * runs / t_tab * 1e-6);
+
+	start = time_s();
+	for (int i = 0;i < runs / 10;i++) {
+		sink += utils_crc32c(buffer, len);
+	}
+	t_ref = (time_s() - start) * 10.0;
+	start = time_s();
+	for (int i = 0;i < runs;i++) {
+		sink += crc32c(buffer, len);
+	}
+	t_tab = time_s() - start;
+	printf("crc32c: nibble  %7.1f MB/s, table %7.1f MB/s\r\n",
+			(double)len * runs / t_ref * 1e-6, (double)len * runs / t_tab * 1e-6);
+
+	(void)sink;
+}
+
+int main(void) {
+	srand(104);
+	for (unsigned int i = 0;i < sizeof(buffer);i++) {
+		buffer[i] = rand();
+	}
+
+	bool ok = test_equivalence();
+	printf("Equivalence test: %s\r\n", ok ? "OK" : "FAILED");
+
+	bench();
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#ifndef FLASH_HELPER_H_
+#define FLASH_HELPER_H_
+
+#include <stdint.h>
+
+// Provided by the flash simulation in main.c
+uint8_t* flash_helper_get_sector_address(uint32_t fsector);
+
+#endif
@@ -0,0 +1,629 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "eeprom.h"
+#include "eeprom_rec.h"
+
+/*
+ * Host test and benchmark for the record store in driver/eeprom_rec.c and
+ * the emulated EEPROM in driver/eeprom.c, which is used as reference and
+ * for the import.
+ *
+ * The two flash sectors are mapped at their address on the STM32F4, so
+ * that both drivers run unmodified. Programming can only clear bits and
+ * erasing sets the whole sector to 0xFF, as on NOR flash. A power loss is
+ * simulated by failing all flash operations after a given number of
+ * operations, where the half-word that is being programmed when the power
+ * is lost only gets some of its bits cleared.
+ */
+
+// Assumed flash timing for the time estimates, typical values at x16 parallelism
+#define T_PROGRAM_HW_US			16.0
+#define T_ERASE_SECTOR_MS		300.0
+
+#define REC_ID_MCCONF			0
+#define REC_ID_MCCONF_2			1
+#define REC_ID_APPCONF			2
+#define REC_ID_BACKUP			3
+#define REC_ID_HW				4
+
+#define EEPROM_BASE_MCCONF		1000
+#define EEPROM_BASE_APPCONF		2000
+#define EEPROM_BASE_HW			3000
+#define EEPROM_BASE_MCCONF_2	5000
+#define EEPROM_BASE_BACKUP		6000
+
+uint16_t VirtAddVarTab[NB_OF_VAR];
+PWR_TypeDef sim_pwr;
+
+static uint8_t *m_flash = NULL;
+static unsigned int m_program_cnt = 0;
+static unsigned int m_erase_cnt = 0;
+static int m_ops_left = -1; // Operations until power loss, -1 for no power loss, -2 after power loss
+static uint32_t m_rand_state = 1;
+
+static uint32_t rand_u32(void) {
+	m_rand_state ^= m_rand_state << 13;
+	m_rand_state ^= m_rand_state >> 17;
+	m_rand_state ^= m_rand_state << 5;
+	return m_rand_state;
+}
+
+static void rand_fill(void *data, unsigned int len) {
+	for (unsigned int i = 0;i < len;i++) {
+		((uint8_t*)data)[i] = rand_u32() & 0xFF;
+	}
+}
+
+static double time_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Returns false when the power is gone
+static bool power_step(void) {
+	if (m_ops_left == -1) {
+		return true;
+	}
+
+	if (m_ops_left <= 0) {
+		return false;
+	}
+
+	m_ops_left--;
+	return true;
+}
+
+FLASH_Status FLASH_ProgramHalfWord(uint32_t Address, uint16_t Data) {
+	if (Address < EEPROM_START_ADDRESS || Address >= (EEPROM_START_ADDRESS + 2 * PAGE_SIZE) || (Address & 1)) {
+		printf("Program outside of the sectors: 0x%08X\r\n", Address);
+		exit(1);
+	}
+
+	volatile uint16_t *hw = (volatile uint16_t*)(uintptr_t)Address;
+
+	if (!power_step()) {
+		if (m_ops_left == 0) {
+			// Interrupted while programming this half-word
+			*hw &= Data | (uint16_t)rand_u32();
+		}
+		m_ops_left = -2;
+		return FLASH_ERROR_PROGRAM;
+	}
+
+	*hw &= Data;
+	m_program_cnt++;
+	return FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_EraseSector(uint32_t FLASH_Sector, uint8_t VoltageRange) {
+	(void)VoltageRange;
+
+	if (!power_step()) {
+		m_ops_left = -2;
+		return FLASH_ERROR_OPERATION;
+	}
+
+	if (FLASH_Sector == FLASH_Sector_1) {
+		memset(m_flash, 0xFF, PAGE_SIZE);
+	} else if (FLASH_Sector == FLASH_Sector_2) {
+		memset(m_flash + PAGE_SIZE, 0xFF, PAGE_SIZE);
+	} else {
+		printf("Erase of unexpected sector %d\r\n", FLASH_Sector);
+		exit(1);
+	}
+
+	m_erase_cnt++;
+	return FLASH_COMPLETE;
+}
+
+uint8_t* flash_helper_get_sector_address(uint32_t fsector) {
+	return fsector == FLASH_Sector_1 ? m_flash : m_flash + PAGE_SIZE;
+}
+
+static void power_loss_after(int ops) {
+	m_ops_left = ops;
+}
+
+static void power_on(void) {
+	m_ops_left = -1;
+}
+
+static bool power_was_lost(void) {
+	return m_ops_left == -2;
+}
+
+static void flash_erase_all(void) {
+	memset(m_flash, 0xFF, 2 * PAGE_SIZE);
+}
+
+static void init_virt_addr(void) {
+	memset(VirtAddVarTab, 0, sizeof(VirtAddVarTab));
+
+	int ind = 0;
+	for (unsigned int i = 0;i < (sizeof(mc_configuration) / 2);i++) {
+		VirtAddVarTab[ind++] = EEPROM_BASE_MCCONF + i;
+	}
+
+	for (unsigned int i = 0;i < (sizeof(app_configuration) / 2);i++) {
+		VirtAddVarTab[ind++] = EEPROM_BASE_APPCONF + i;
+	}
+
+	for (unsigned int i = 0;i < (EEPROM_VARS_HW * 2);i++) {
+		VirtAddVarTab[ind++] = EEPROM_BASE_HW + i;
+	}
+
+	for (unsigned int i = 0;i < (sizeof(backup_data) / 2);i++) {
+		VirtAddVarTab[ind++] = EEPROM_BASE_BACKUP + i;
+	}
+}
+
+// Blobs in the format of conf_general before the record store
+static bool ee_write_blob(uint16_t base, const uint8_t *data, unsigned int size) {
+	for (unsigned int i = 0;i < (size / 2);i++) {
+		uint16_t var = (data[2 * i] << 8) & 0xFF00;
+		var |= data[2 * i + 1] & 0xFF;
+
+		if (EE_WriteVariable(base + i, var) != FLASH_COMPLETE) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool ee_read_blob(uint16_t base, uint8_t *data, unsigned int size) {
+	uint16_t var;
+
+	for (unsigned int i = 0;i < (size / 2);i++) {
+		if (EE_ReadVariable(base + i, &var) != 0) {
+			return false;
+		}
+
+		data[2 * i] = (var >> 8) & 0xFF;
+		data[2 * i + 1] = var & 0xFF;
+	}
+
+	return true;
+}
+
+// Same as import_ee_data in conf_general.c
+static void import_ee_data(void) {
+	static mc_configuration mcconf;
+	static app_configuration appconf;
+	backup_data backup;
+
+	if (ee_read_blob(EEPROM_BASE_MCCONF, (uint8_t*)&mcconf, sizeof(mcconf))) {
+		eeprom_rec_write(REC_ID_MCCONF, &mcconf, sizeof(mcconf));
+	}
+	if (ee_read_blob(EEPROM_BASE_MCCONF_2, (uint8_t*)&mcconf, sizeof(mcconf))) {
+		eeprom_rec_write(REC_ID_MCCONF_2, &mcconf, sizeof(mcconf));
+	}
+	if (ee_read_blob(EEPROM_BASE_APPCONF, (uint8_t*)&appconf, sizeof(appconf))) {
+		eeprom_rec_write(REC_ID_APPCONF, &appconf, sizeof(appconf));
+	}
+	if (ee_read_blob(EEPROM_BASE_BACKUP, (uint8_t*)&backup, sizeof(backup))) {
+		eeprom_rec_write(REC_ID_BACKUP, &backup, sizeof(backup));
+	}
+
+	for (int i = 0;i < EEPROM_VARS_HW;i++) {
+		uint16_t var0, var1;
+		if (EE_ReadVariable(EEPROM_BASE_HW + 2 * i, &var0) == 0 &&
+				EE_ReadVariable(EEPROM_BASE_HW + 2 * i + 1, &var1) == 0) {
+			eeprom_var v;
+			v.as_u32 = ((uint32_t)var0) << 16 | var1;
+			eeprom_rec_write(REC_ID_HW + i, &v, sizeof(v));
+		}
+	}
+}
+
+// Same sequence as conf_general_init
+static bool boot(void) {
+	if (!eeprom_rec_init()) {
+		EE_Init();
+		if (!eeprom_rec_import_begin()) {
+			return false;
+		}
+		import_ee_data();
+		return eeprom_rec_import_end();
+	}
+	return true;
+}
+
+static bool check_rec(uint16_t id, const void *expected, unsigned int len) {
+	static uint8_t buffer[PAGE_SIZE];
+	return eeprom_rec_read(id, buffer, len) && memcmp(buffer, expected, len) == 0;
+}
+
+static bool test_roundtrip(void) {
+	bool ok = true;
+	static uint8_t data[EEPROM_REC_IDS][64];
+	static uint8_t buffer[64];
+
+	flash_erase_all();
+	ok &= !eeprom_rec_init();
+	ok &= eeprom_rec_import_begin() && eeprom_rec_import_end();
+	ok &= eeprom_rec_init();
+
+	// Different lengths, including odd ones and zero
+	for (int i = 0;i < EEPROM_REC_IDS;i += 7) {
+		rand_fill(data[i], sizeof(data[i]));
+		ok &= eeprom_rec_write(i, data[i], i % 64);
+	}
+
+	for (int pass = 0;pass < 2;pass++) {
+		for (int i = 0;i < EEPROM_REC_IDS;i++) {
+			if ((i % 7) == 0) {
+				ok &= check_rec(i, data[i], i % 64);
+				ok &= !eeprom_rec_read(i, buffer, (i % 64) + 1);
+			} else {
+				ok &= !eeprom_rec_read(i, buffer, 4);
+			}
+		}
+		ok &= eeprom_rec_init();
+	}
+
+	ok &= !eeprom_rec_write(EEPROM_REC_IDS, data[0], 4);
+	ok &= !eeprom_rec_read(EEPROM_REC_IDS, buffer, 4);
+
+	// Writing the same content again does not use flash
+	unsigned int free_before = eeprom_rec_free_bytes();
+	unsigned int program_before = m_program_cnt;
+	ok &= eeprom_rec_write(7, data[7], 7);
+	ok &= free_before == eeprom_rec_free_bytes() && program_before == m_program_cnt;
+
+	// A corrupted record is skipped, the previous one is read instead
+	uint8_t v1[4] = {1, 2, 3, 4};
+	uint8_t v2[4] = {5, 6, 7, 8};
+	uint8_t *v2_flash = m_flash + (PAGE_SIZE - free_before) + 12 + 8;
+	ok &= eeprom_rec_write(1, v1, 4) && eeprom_rec_write(1, v2, 4);
+	ok &= memcmp(v2_flash, v2, 4) == 0;
+	v2_flash[1] &= 0xF0;
+	ok &= eeprom_rec_init() && check_rec(1, v1, 4);
+	ok &= eeprom_rec_write(1, v2, 4) && check_rec(1, v2, 4);
+
+	printf("Roundtrip: %s\r\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static bool test_compaction(void) {
+	bool ok = true;
+	static mc_configuration mcconf;
+	static mc_configuration mcconf_2;
+	static app_configuration appconf;
+	static eeprom_var vars[EEPROM_VARS_HW];
+
+	flash_erase_all();
+	ok &= eeprom_rec_import_begin() && eeprom_rec_import_end();
+
+	rand_fill(&mcconf, sizeof(mcconf));
+	rand_fill(&mcconf_2, sizeof(mcconf_2));
+	rand_fill(&appconf, sizeof(appconf));
+	rand_fill(vars, sizeof(vars));
+	ok &= eeprom_rec_write(REC_ID_MCCONF_2, &mcconf_2, sizeof(mcconf_2));
+	ok &= eeprom_rec_write(REC_ID_APPCONF, &appconf, sizeof(appconf));
+
+	unsigned int erase_before = m_erase_cnt;
+
+	for (int i = 0;i < 500 && ok;i++) {
+		mcconf.foc_motor_r = (float)i;
+		ok &= eeprom_rec_write(REC_ID_MCCONF, &mcconf, sizeof(mcconf));
+
+		int var = i % EEPROM_VARS_HW;
+		vars[var].as_u32++;
+		ok &= eeprom_rec_write(REC_ID_HW + var, &vars[var], sizeof(eeprom_var));
+
+		if ((i % 37) == 0) {
+			ok &= eeprom_rec_init();
+		}
+
+		ok &= check_rec(REC_ID_MCCONF, &mcconf, sizeof(mcconf));
+		ok &= check_rec(REC_ID_MCCONF_2, &mcconf_2, sizeof(mcconf_2));
+		ok &= check_rec(REC_ID_APPCONF, &appconf, sizeof(appconf));
+		for (int j = 0;j < EEPROM_VARS_HW && i >= EEPROM_VARS_HW;j++) {
+			ok &= check_rec(REC_ID_HW + j, &vars[j], sizeof(eeprom_var));
+		}
+	}
+
+	ok &= m_erase_cnt > erase_before;
+
+	printf("Compaction: %s, %u sector erases\r\n", ok ? "ok" : "FAILED", m_erase_cnt - erase_before);
+	return ok;
+}
+
+static bool test_import(void) {
+	bool ok = true;
+	static mc_configuration mcconf;
+	static app_configuration appconf;
+	static uint8_t flash_ee[2 * PAGE_SIZE];
+	backup_data backup;
+	eeprom_var var;
+
+	rand_fill(&mcconf, sizeof(mcconf));
+	rand_fill(&appconf, sizeof(appconf));
+	rand_fill(&backup, sizeof(backup));
+	var.as_u32 = 0x12345678;
+
+	// Data as stored by earlier firmware, with page transfers in between
+	flash_erase_all();
+	EE_Init();
+	for (int i = 0;i < 4;i++) {
+		mcconf.l_current_max = (float)i;
+		ok &= ee_write_blob(EEPROM_BASE_MCCONF, (uint8_t*)&mcconf, sizeof(mcconf));
+		ok &= ee_write_blob(EEPROM_BASE_APPCONF, (uint8_t*)&appconf, sizeof(appconf));
+	}
+	ok &= ee_write_blob(EEPROM_BASE_BACKUP, (uint8_t*)&backup, sizeof(backup));
+	ok &= EE_WriteVariable(EEPROM_BASE_HW + 2 * 3, var.as_u32 >> 16) == FLASH_COMPLETE;
+	ok &= EE_WriteVariable(EEPROM_BASE_HW + 2 * 3 + 1, var.as_u32 & 0xFFFF) == FLASH_COMPLETE;
+	memcpy(flash_ee, m_flash, sizeof(flash_ee));
+
+	// The odd last byte was never stored in the old format
+	if (sizeof(mcconf) & 1) {
+		((uint8_t*)&mcconf)[sizeof(mcconf) - 1] = 0;
+	}
+	if (sizeof(appconf) & 1) {
+		((uint8_t*)&appconf)[sizeof(appconf) - 1] = 0;
+	}
+
+	ok &= !eeprom_rec_init() && boot();
+	ok &= check_rec(REC_ID_MCCONF, &mcconf, sizeof(mcconf));
+	ok &= check_rec(REC_ID_APPCONF, &appconf, sizeof(appconf));
+	ok &= check_rec(REC_ID_BACKUP, &backup, sizeof(backup));
+	ok &= check_rec(REC_ID_HW + 3, &var, sizeof(var));
+	ok &= !eeprom_rec_read(REC_ID_MCCONF_2, &mcconf, sizeof(mcconf));
+	ok &= !eeprom_rec_read(REC_ID_HW + 2, &var, sizeof(var));
+	ok &= eeprom_rec_init();
+
+	// Power loss at every point of the import. The import has to be repeated or
+	// completed on the next boot.
+	unsigned int ops_needed = 0;
+	for (int cut = 0;ok;cut++) {
+		memcpy(m_flash, flash_ee, sizeof(flash_ee));
+		power_loss_after(cut);
+		bool done = boot();
+		bool lost = power_was_lost();
+		power_on();
+
+		ok &= done != lost;
+		ok &= boot();
+		ok &= check_rec(REC_ID_MCCONF, &mcconf, sizeof(mcconf));
+		ok &= check_rec(REC_ID_APPCONF, &appconf, sizeof(appconf));
+		ok &= check_rec(REC_ID_BACKUP, &backup, sizeof(backup));
+		ok &= check_rec(REC_ID_HW + 3, &var, sizeof(var));
+
+		if (!lost) {
+			ops_needed = cut;
+			break;
+		}
+	}
+
+	printf("Import: %s, power loss tested at %u points\r\n", ok ? "ok" : "FAILED", ops_needed);
+	return ok;
+}
+
+static bool test_power_loss(void) {
+	bool ok = true;
+	static mc_configuration mcconf_a;
+	static mc_configuration mcconf_b;
+	static app_configuration appconf_a;
+	static app_configuration appconf_b;
+	static uint8_t flash_a[2 * PAGE_SIZE];
+
+	rand_fill(&mcconf_a, sizeof(mcconf_a));
+	rand_fill(&appconf_a, sizeof(appconf_a));
+	mcconf_b = mcconf_a;
+	appconf_b = appconf_a;
+	mcconf_b.foc_motor_l = 1.0;
+	appconf_b.controller_id = 7;
+
+	// Fill the active sector to just below the point where the next write compacts
+	flash_erase_all();
+	ok &= eeprom_rec_import_begin() && eeprom_rec_import_end();
+	ok &= eeprom_rec_write(REC_ID_APPCONF, &appconf_a, sizeof(appconf_a));
+	for (int i = 0;eeprom_rec_free_bytes() >= 2 * (sizeof(mcconf_a) + 8);i++) {
+		mcconf_a.foc_motor_r = (float)i;
+		ok &= eeprom_rec_write(REC_ID_MCCONF, &mcconf_a, sizeof(mcconf_a));
+	}
+	mcconf_b.foc_motor_r = mcconf_a.foc_motor_r;
+	memcpy(flash_a, m_flash, sizeof(flash_a));
+
+	int points = 0;
+	for (int cut = 0;ok;cut++) {
+		memcpy(m_flash, flash_a, sizeof(flash_a));
+		ok &= eeprom_rec_init();
+
+		power_loss_after(cut);
+		bool done = eeprom_rec_write(REC_ID_MCCONF, &mcconf_b, sizeof(mcconf_b)) &&
+				eeprom_rec_write(REC_ID_APPCONF, &appconf_b, sizeof(appconf_b)) &&
+				eeprom_rec_write(REC_ID_MCCONF, &mcconf_a, sizeof(mcconf_a)) &&
+				eeprom_rec_write(REC_ID_MCCONF, &mcconf_b, sizeof(mcconf_b));
+		bool lost = power_was_lost();
+		power_on();
+		ok &= done != lost;
+
+		// Each record must have the old or the new content after the reboot
+		ok &= eeprom_rec_init();
+		ok &= check_rec(REC_ID_MCCONF, &mcconf_a, sizeof(mcconf_a)) ||
+				check_rec(REC_ID_MCCONF, &mcconf_b, sizeof(mcconf_b));
+		ok &= check_rec(REC_ID_APPCONF, &appconf_a, sizeof(appconf_a)) ||
+				check_rec(REC_ID_APPCONF, &appconf_b, sizeof(appconf_b));
+
+		// And the store must still be usable
+		ok &= eeprom_rec_write(REC_ID_MCCONF, &mcconf_b, sizeof(mcconf_b));
+		ok &= eeprom_rec_write(REC_ID_APPCONF, &appconf_b, sizeof(appconf_b));
+		ok &= eeprom_rec_init();
+		ok &= check_rec(REC_ID_MCCONF, &mcconf_b, sizeof(mcconf_b));
+		ok &= check_rec(REC_ID_APPCONF, &appconf_b, sizeof(appconf_b));
+
+		if (!ok) {
+			printf("Power loss after %d operations failed\r\n", cut);
+		}
+
+		points++;
+		if (!lost) {
+			break;
+		}
+	}
+
+	printf("Power loss: %s, tested at %d points\r\n", ok ? "ok" : "FAILED", points);
+	return ok;
+}
+
+typedef struct {
+	double host_us;
+	unsigned int program_cnt;
+	unsigned int erase_cnt;
+} bench_res;
+
+static void bench_print(const char *label, bench_res *res, int iterations) {
+	double program = (double)res->program_cnt / iterations;
+	double erase = (double)res->erase_cnt / iterations;
+	printf("  %-28s host %9.1f us, %8.1f program, %5.3f erase, flash est. %8.2f ms\r\n",
+			label, res->host_us / iterations, program, erase,
+			program * T_PROGRAM_HW_US / 1000.0 + erase * T_ERASE_SECTOR_MS);
+}
+
+static void bench_start(bench_res *res, double *t0) {
+	memset(res, 0, sizeof(bench_res));
+	res->program_cnt = m_program_cnt;
+	res->erase_cnt = m_erase_cnt;
+	*t0 = time_s();
+}
+
+static void bench_end(bench_res *res, double t0) {
+	res->host_us = (time_s() - t0) * 1e6;
+	res->program_cnt = m_program_cnt - res->program_cnt;
+	res->erase_cnt = m_erase_cnt - res->erase_cnt;
+}
+
+static void benchmark(void) {
+	static mc_configuration mcconf;
+	static app_configuration appconf;
+	backup_data backup;
+	eeprom_var var;
+	bench_res res;
+	double t0;
+	const int iterations = 200;
+
+	rand_fill(&mcconf, sizeof(mcconf));
+	rand_fill(&appconf, sizeof(appconf));
+	rand_fill(&backup, sizeof(backup));
+
+	printf("\r\nBenchmark, mc_configuration %u bytes, app_configuration %u bytes\r\n",
+			(unsigned int)sizeof(mcconf), (unsigned int)sizeof(appconf));
+
+	// Half-word variables
+	flash_erase_all();
+	EE_Init();
+	ee_write_blob(EEPROM_BASE_MCCONF, (uint8_t*)&mcconf, sizeof(mcconf));
+	ee_write_blob(EEPROM_BASE_APPCONF, (uint8_t*)&appconf, sizeof(appconf));
+	ee_write_blob(EEPROM_BASE_BACKUP, (uint8_t*)&backup, sizeof(backup));
+
+	printf("Half-word variables (EE_ReadVariable / EE_WriteVariable)\r\n");
+
+	bench_start(&res, &t0);
+	for (int i = 0;i < iterations;i++) {
+		ee_read_blob(EEPROM_BASE_MCCONF, (uint8_t*)&mcconf, sizeof(mcconf));
+		ee_read_blob(EEPROM_BASE_APPCONF, (uint8_t*)&appconf, sizeof(appconf));
+		ee_read_blob(EEPROM_BASE_BACKUP, (uint8_t*)&backup, sizeof(backup));
+	}
+	bench_end(&res, t0);
+	bench_print("boot read", &res, iterations);
+
+	bench_start(&res, &t0);
+	for (int i = 0;i < iterations;i++) {
+		mcconf.foc_motor_r = (float)i;
+		ee_write_blob(EEPROM_BASE_MCCONF, (uint8_t*)&mcconf, sizeof(mcconf));
+	}
+	bench_end(&res, t0);
+	bench_print("store mcconf, one change", &res, iterations);
+
+	bench_start(&res, &t0);
+	for (int i = 0;i < iterations;i++) {
+		rand_fill(&mcconf, sizeof(mcconf));
+		ee_write_blob(EEPROM_BASE_MCCONF, (uint8_t*)&mcconf, sizeof(mcconf));
+	}
+	bench_end(&res, t0);
+	bench_print("store mcconf, all changed", &res, iterations);
+
+	bench_start(&res, &t0);
+	for (int i = 0;i < iterations;i++) {
+		var.as_u32 = i;
+		EE_WriteVariable(EEPROM_BASE_HW + 2 * 5, var.as_u32 >> 16);
+		EE_WriteVariable(EEPROM_BASE_HW + 2 * 5 + 1, var.as_u32 & 0xFFFF);
+	}
+	bench_end(&res, t0);
+	bench_print("store eeprom_var", &res, iterations);
+
+	// Records
+	boot();
+
+	printf("Records (eeprom_rec_read / eeprom_rec_write)\r\n");
+
+	bench_start(&res, &t0);
+	for (int i = 0;i < iterations;i++) {
+		eeprom_rec_init();
+		eeprom_rec_read(REC_ID_MCCONF, &mcconf, sizeof(mcconf));
+		eeprom_rec_read(REC_ID_APPCONF, &appconf, sizeof(appconf));
+		eeprom_rec_read(REC_ID_BACKUP, &backup, sizeof(backup));
+	}
+	bench_end(&res, t0);
+	bench_print("boot read, with index scan", &res, iterations);
+
+	bench_start(&res, &t0);
+	for (int i = 0;i < iterations;i++) {
+		mcconf.foc_motor_r = (float)i;
+		eeprom_rec_write(REC_ID_MCCONF, &mcconf, sizeof(mcconf));
+	}
+	bench_end(&res, t0);
+	bench_print("store mcconf, one change", &res, iterations);
+
+	bench_start(&res, &t0);
+	for (int i = 0;i < iterations;i++) {
+		rand_fill(&mcconf, sizeof(mcconf));
+		eeprom_rec_write(REC_ID_MCCONF, &mcconf, sizeof(mcconf));
+	}
+	bench_end(&res, t0);
+	bench_print("store mcconf, all changed", &res, iterations);
+
+	bench_start(&res, &t0);
+	for (int i = 0;i < iterations;i++) {
+		var.as_u32 = i;
+		eeprom_rec_write(REC_ID_HW + 5, &var, sizeof(var));
+	}
+	bench_end(&res, t0);
+	bench_print("store eeprom_var", &res, iterations);
+}
+
+int main(int argc, char **argv) {
+	(void)argv;
+
+	m_flash = mmap((void*)EEPROM_START_ADDRESS, 2 * PAGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (m_flash != (uint8_t*)EEPROM_START_ADDRESS) {
+		printf("Could not map the flash sectors at 0x%08X\r\n", EEPROM_START_ADDRESS);
+		return 1;
+	}
+
+	init_virt_addr();
+
+	bool ok = true;
+	ok &= test_roundtrip();
+	ok &= test_compaction();
+	ok &= test_import();
+	ok &= test_power_loss();
+
+	// Any argument runs the benchmark
+	if (argc > 1) {
+		benchmark();
+	}
+
+	printf("%s\r\n", ok ? "All tests passed" : "Some tests FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#ifndef STM32F4XX_CONF_H
+#define STM32F4XX_CONF_H
+
+// Flash driver subset for the host flash simulation in main.c
+
+#include <stdint.h>
+
+#define __IO volatile
+
+typedef enum {
+	FLASH_BUSY = 1,
+	FLASH_ERROR_RD,
+	FLASH_ERROR_PGS,
+	FLASH_ERROR_PGP,
+	FLASH_ERROR_PGA,
+	FLASH_ERROR_WRP,
+	FLASH_ERROR_PROGRAM,
+	FLASH_ERROR_OPERATION,
+	FLASH_COMPLETE
+} FLASH_Status;
+
+#define FLASH_Sector_1			((uint16_t)0x0008)
+#define FLASH_Sector_2			((uint16_t)0x0010)
+#define VoltageRange_2			((uint8_t)0x01)
+#define VoltageRange_3			((uint8_t)0x02)
+
+typedef struct {
+	uint32_t CSR;
+} PWR_TypeDef;
+
+extern PWR_TypeDef sim_pwr;
+#define PWR						(&sim_pwr)
+#define PWR_CSR_PVDO			((uint32_t)0x00000004)
+
+FLASH_Status FLASH_ProgramHalfWord(uint32_t Address, uint16_t Data);
+FLASH_Status FLASH_EraseSector(uint32_t FLASH_Sector, uint8_t VoltageRange);
+
+#endif
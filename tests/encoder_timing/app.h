@@ -0,0 +1,10 @@
+#ifndef APP_H_
+#define APP_H_
+
+#include "datatypes.h"
+
+void app_set_configuration(app_configuration *conf);
+void conf_general_read_app_configuration(app_configuration *conf);
+bool conf_general_store_app_configuration(app_configuration *conf);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CH_H
+#define CH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef int systime_t;
+typedef uint32_t syssts_t;
+typedef uint64_t stkalign_t;
+typedef struct  {
+   uint32_t *p_stklimit;
+} thread_t;
+
+typedef struct {
+	struct {
+		void *next;
+		void *prev;
+	} queue;
+	void *owner;
+	void *next;
+} mutex_t;
+
+#define CH_CFG_ST_FREQUENCY		10000
+#define NORMALPRIO				128
+
+#define THD_WORKING_AREA(s, n)	uint8_t s[n]
+#define THD_FUNCTION(tname, arg)	void tname(void *arg)
+typedef void (*tfunc_t)(void *arg);
+
+// The simulation implements these in main.c
+void chSysLock(void);
+void chSysUnlock(void);
+void chSysLockFromISR(void);
+void chSysUnlockFromISR(void);
+syssts_t chSysGetStatusAndLockX(void);
+void chSysRestoreStatusX(syssts_t sts);
+thread_t *chThdCreateStatic(void *wsp, size_t size, int prio, tfunc_t pf, void *arg);
+void chThdSleep(systime_t time);
+
+#define chRegSetThreadName(name)	(void)(name)
+#define chMtxObjectInit(m)			(void)(m)
+#define __NOP()
+
+#endif  // CH_H
@@ -0,0 +1,82 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stddef.h>
+#include "ch.h"
+#include "stm32f4xx_conf.h"
+
+typedef struct {
+	uint32_t dummy;
+} stm32_gpio_t;
+
+typedef struct {
+	volatile uint32_t CNT;
+} TIM_TypeDef;
+
+typedef struct {
+	volatile uint32_t DR;
+} SPI_TypeDef;
+
+typedef struct {
+	uint32_t dummy;
+} SerialDriver;
+
+typedef struct {
+	uint32_t speed;
+	uint16_t cr1;
+	uint16_t cr2;
+	uint16_t cr3;
+} SerialConfig;
+
+typedef enum {
+	SPI_UNINIT = 0,
+	SPI_STOP = 1,
+	SPI_READY = 2,
+	SPI_ACTIVE = 3,
+	SPI_COMPLETE = 4
+} spistate_t;
+
+typedef struct SPIDriver SPIDriver;
+typedef void (*spicallback_t)(SPIDriver *spip);
+
+typedef struct {
+	spicallback_t end_cb;
+	stm32_gpio_t *ssport;
+	uint16_t sspad;
+	uint16_t cr1;
+} SPIConfig;
+
+struct SPIDriver {
+	spistate_t state;
+	const SPIConfig *config;
+	SPI_TypeDef *spi;
+	void *app_arg;
+	spicallback_t err_cb;
+};
+
+#define SPI_CR1_CPHA				0x0001
+#define SPI_CR1_CPOL				0x0002
+#define SPI_CR1_BR					0x0038
+#define SPI_CR1_DFF					0x0800
+
+#define PAL_MODE_INPUT_PULLUP		0
+#define PAL_MODE_OUTPUT_PUSHPULL	0
+#define PAL_MODE_ALTERNATE(n)		(n)
+#define PAL_STM32_OSPEED_HIGHEST	0
+
+#define palSetPadMode(port, pad, mode)	(void)(port)
+#define palSetPad(port, pad)			(void)(port)
+#define palClearPad(port, pad)			(void)(port)
+#define palReadPad(port, pad)			0
+
+#define nvicDisableVector(n)
+
+// The simulation implements these in main.c
+void spiStart(SPIDriver *spip, const SPIConfig *config);
+void spiStop(SPIDriver *spip);
+void spiSelectI(SPIDriver *spip);
+void spiUnselectI(SPIDriver *spip);
+void spiStartExchangeI(SPIDriver *spip, size_t n, const void *txbuf, void *rxbuf);
+void spiStartReceiveI(SPIDriver *spip, size_t n, void *rxbuf);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef HW_H_
+#define HW_H_
+
+#include "hal.h"
+
+extern stm32_gpio_t sim_gpio;
+extern TIM_TypeDef sim_tim;
+
+#define HW_ENC_EXTI_CH			0
+#define HW_ENC_TIM_ISR_CH		0
+#define HW_ENC_TIM				(&sim_tim)
+
+#define HW_HALL_ENC_GPIO1		(&sim_gpio)
+#define HW_HALL_ENC_PIN1		1
+#define HW_HALL_ENC_GPIO2		(&sim_gpio)
+#define HW_HALL_ENC_PIN2		2
+#define HW_HALL_ENC_GPIO3		(&sim_gpio)
+#define HW_HALL_ENC_PIN3		3
+
+#define SENSOR_PORT_5V()
+#define SENSOR_PORT_3V3()
+
+#endif
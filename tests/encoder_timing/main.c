@@ -0,0 +1,722 @@
+/*
+ * Host simulation of the SPI encoder acquisition.
+ *
+ * encoder.c and the AS504x, MT6816, AS5x47U and BiSS-C drivers run against
+ * a simulated SPI peripheral with DMA, a simulated TIM5 and a magnet that
+ * rotates and accelerates at a known rate. The routine thread runs on a
+ * simulated systick with jitter and the FOC interrupt is emulated at the PWM
+ * rate. Like mcpwm_foc.c it triggers the encoder, reads the angle with its
+ * sample time and extrapolates it to the start of the interrupt.
+ *
+ * For every read the test checks that the angle matches the magnet at the
+ * reported sample time, which is the latency model that the extrapolation
+ * relies on, and that the extrapolated angle matches the magnet at the
+ * control instant. The error without extrapolation is printed for reference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <setjmp.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "hw.h"
+#include "timer.h"
+#include "spi_bb.h"
+#include "encoder/encoder.h"
+#include "encoder/encoder_cfg.h"
+#include "foc_math.h"
+#include "utils_math.h"
+
+#define TIMER_HZ			14000000.0
+#define TICKS_US(us)		((uint64_t)((us) * TIMER_HZ / 1e6))
+#define SPI_CLOCK			42e6
+
+#define FOC_RATE			20000.0
+#define FOC_ISR_TIME_US		12.0
+#define THREAD_JITTER_US	20.0
+#define BB_BIT_TIME_US		1.0
+
+#define SIM_TIME			0.1
+#define SIM_WARMUP			0.015
+#define MAGNET_SPEED		60000.0 // deg/s, 10000 rpm
+#define MAGNET_ACCEL		60000.0 // deg/s^2
+
+// SPI CR1 baud rate bits
+#define SPI_BR_DIV4			(1 << 3)
+#define SPI_BR_DIV8			(2 << 3)
+#define SPI_BR_DIV32		(4 << 3)
+
+typedef enum {
+	DEV_NONE = 0,
+	DEV_AS504x,
+	DEV_MT6816,
+	DEV_AS5x47U,
+	DEV_BISSC,
+} sim_dev_t;
+
+typedef struct {
+	const char *name;
+	sim_dev_t dev;
+	sensor_port_mode port_mode;
+	bool trigger;
+	double lsb;
+} scenario_t;
+
+typedef struct {
+	int samples;
+	double age_sum;
+	double age_max;
+	double raw_err_sum;
+	double raw_err_max;
+	double ext_err_sum;
+	double ext_err_max;
+	double ts_err_max;
+} stats_t;
+
+// Simulated hardware
+stm32_gpio_t sim_gpio;
+TIM_TypeDef sim_tim;
+static SPI_TypeDef m_spi_regs;
+static SPIDriver m_spid;
+
+// Simulation state
+static uint64_t m_now = 0;
+static uint64_t m_start = 0;
+static sim_dev_t m_dev = DEV_NONE;
+static int m_lock = 0;
+static bool m_isr_ctx = false;
+static int m_lock_errors = 0;
+static int m_start_while_busy = 0;
+
+static bool m_foc_enabled = false;
+static bool m_foc_trigger = false;
+static uint64_t m_foc_next = 0;
+static uint64_t m_foc_period = 0;
+static uint64_t m_busy_until = 0;
+
+static bool m_xfer_active = false;
+static uint64_t m_xfer_end = 0;
+static uint8_t m_xfer_resp[8];
+static void *m_xfer_rx = 0;
+static size_t m_xfer_bytes = 0;
+
+static tfunc_t m_thd_fn = 0;
+static uint64_t m_thd_wake = 0;
+static jmp_buf m_thd_jmp;
+static uint64_t m_bb_ticks = 0;
+
+static uint16_t m_as5x47u_pending = 0x3FFF;
+static uint16_t m_mt6816_word = 0;
+static uint8_t m_bissc_crc_table[64];
+
+static stats_t m_stats;
+
+static void sim_advance_to(uint64_t t);
+
+// Magnet
+
+static double magnet_deg(uint64_t t) {
+	double s = (double)(t - m_start) / TIMER_HZ;
+	double a = fmod(MAGNET_SPEED * s + 0.5 * MAGNET_ACCEL * s * s, 360.0);
+	return a < 0.0 ? a + 360.0 : a;
+}
+
+static double magnet_speed(uint64_t t) {
+	double s = (double)(t - m_start) / TIMER_HZ;
+	return MAGNET_SPEED + MAGNET_ACCEL * s;
+}
+
+static uint32_t magnet_counts(uint64_t t, int bits) {
+	return (uint32_t)floor(magnet_deg(t) / 360.0 * (double)(1 << bits)) & ((1 << bits) - 1);
+}
+
+static double angle_diff(double a, double b) {
+	double d = fmod(a - b, 360.0);
+	if (d > 180.0) {
+		d -= 360.0;
+	} else if (d < -180.0) {
+		d += 360.0;
+	}
+	return d;
+}
+
+// Timer
+
+uint32_t timer_time_now(void) {
+	return (uint32_t)m_now;
+}
+
+float timer_seconds_elapsed_since(uint32_t time) {
+	uint32_t diff = (uint32_t)m_now - time;
+	return (float)diff / (float)TIMER_HZ;
+}
+
+float timer_seconds_between(uint32_t start, uint32_t end) {
+	return (float)((int32_t)(end - start)) / (float)TIMER_HZ;
+}
+
+// Kernel
+
+static void lock_check(bool ok) {
+	if (!ok) {
+		m_lock_errors++;
+	}
+}
+
+void chSysLock(void) {
+	lock_check(m_lock == 0 && !m_isr_ctx);
+	m_lock++;
+}
+
+void chSysUnlock(void) {
+	lock_check(m_lock == 1 && !m_isr_ctx);
+	m_lock--;
+}
+
+void chSysLockFromISR(void) {
+	lock_check(m_lock == 0 && m_isr_ctx);
+	m_lock++;
+}
+
+void chSysUnlockFromISR(void) {
+	lock_check(m_lock == 1 && m_isr_ctx);
+	m_lock--;
+}
+
+syssts_t chSysGetStatusAndLockX(void) {
+	syssts_t sts = m_lock;
+	if (m_lock == 0) {
+		m_lock++;
+	}
+	return sts;
+}
+
+void chSysRestoreStatusX(syssts_t sts) {
+	if (sts == 0) {
+		m_lock--;
+	}
+}
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, int prio, tfunc_t pf, void *arg) {
+	(void)wsp; (void)size; (void)prio; (void)arg;
+	m_thd_fn = pf;
+	m_thd_wake = m_now;
+	return 0;
+}
+
+// Wake up on a later systick, delayed by other threads and interrupts
+void chThdSleep(systime_t time) {
+	uint64_t tick = (uint64_t)(TIMER_HZ / CH_CFG_ST_FREQUENCY);
+	uint64_t wake = (m_now / tick + (uint64_t)time) * tick;
+	m_thd_wake = wake + TICKS_US(THREAD_JITTER_US * (double)rand() / RAND_MAX);
+	longjmp(m_thd_jmp, 1);
+}
+
+static void run_thread(void) {
+	if (!setjmp(m_thd_jmp)) {
+		m_thd_fn(NULL);
+	}
+}
+
+// Bit-banged SPI, used by the AS504x on the hall sensor pins
+
+void spi_bb_init(spi_bb_state *s) { (void)s; }
+void spi_bb_deinit(spi_bb_state *s) { (void)s; }
+void spi_bb_delay(void) { }
+void spi_bb_delay_short(void) { }
+
+bool spi_bb_check_parity(uint16_t x) {
+	x ^= x >> 8;
+	x ^= x >> 4;
+	x ^= x >> 2;
+	x ^= x >> 1;
+	return (~x) & 1;
+}
+
+static uint16_t as504x_word;
+
+static void bb_wait(uint64_t ticks) {
+	m_bb_ticks += ticks;
+	sim_advance_to(m_now + ticks);
+}
+
+// The AS504x latches the angle on the falling edge of NSS
+void spi_bb_begin(spi_bb_state *s) {
+	(void)s;
+	as504x_word = magnet_counts(m_now, 14);
+	if (!spi_bb_check_parity(as504x_word)) {
+		as504x_word |= 0x8000;
+	}
+	bb_wait(TICKS_US(0.5));
+}
+
+void spi_bb_end(spi_bb_state *s) {
+	(void)s;
+	bb_wait(TICKS_US(0.5));
+}
+
+void spi_bb_transfer_16(spi_bb_state *s, uint16_t *in_buf, const uint16_t *out_buf, int length) {
+	(void)s; (void)out_buf;
+	for (int i = 0;i < length;i++) {
+		bb_wait(TICKS_US(16 * BB_BIT_TIME_US));
+		if (in_buf) {
+			in_buf[i] = as504x_word;
+		}
+	}
+}
+
+// Sensors on the hardware SPI. The response is prepared when the transfer
+// starts, which is when the sensors latch the angle.
+
+static uint8_t as5x47u_crc8(const uint8_t *data, int len) {
+	uint8_t crc = 0xC4;
+	for (int i = 0;i < len;i++) {
+		crc ^= data[i];
+		for (int j = 0;j < 8;j++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x1D : crc << 1;
+		}
+	}
+	return crc ^ 0xFF;
+}
+
+static void dev_mt6816(const uint16_t *tx, uint16_t *resp) {
+	if (tx[0] == 0x8300) {
+		m_mt6816_word = magnet_counts(m_now, 14) << 2;
+		if (!spi_bb_check_parity(m_mt6816_word)) {
+			m_mt6816_word |= 1;
+		}
+		resp[0] = m_mt6816_word >> 8;
+	} else {
+		resp[0] = m_mt6816_word & 0xFF;
+	}
+}
+
+static void dev_as5x47u(const uint8_t *tx, uint8_t *resp) {
+	uint16_t val = 0;
+	switch (m_as5x47u_pending) {
+	case 0x3FFF: val = magnet_counts(m_now, 14); break;
+	case 0x3FFD: val = 0x0800; break; // Magnitude
+	case 0x3FF9: val = 0x0050; break; // AGC
+	default: val = 0; break; // DIAG and ERRFL
+	}
+
+	resp[0] = val >> 8;
+	resp[1] = val & 0xFF;
+	resp[2] = as5x47u_crc8(resp, 2);
+	m_as5x47u_pending = ((tx[0] << 8) | tx[1]) & 0x3FFF;
+}
+
+// Idle bit, ack, start bit, CDS, position, nE, nW and the inverted CRC
+static void dev_bissc(uint8_t *resp) {
+	uint32_t pos = (uint32_t)floor(magnet_deg(m_now) / 360.0 * (double)((1 << 22) - 1));
+	uint32_t data = (pos << 2) | 3;
+
+	uint8_t crc = 0;
+	crc = m_bissc_crc_table[((data >> 24) & 0x3F) ^ crc];
+	crc = m_bissc_crc_table[((data >> 18) & 0x3F) ^ crc];
+	crc = m_bissc_crc_table[((data >> 12) & 0x3F) ^ crc];
+	crc = m_bissc_crc_table[((data >> 6) & 0x3F) ^ crc];
+	crc = m_bissc_crc_table[((data >> 0) & 0x3F) ^ crc];
+	crc = 0x3F & ~crc;
+
+	uint64_t frame = 1ULL << 63;
+	frame |= 1ULL << 59;
+	frame |= (uint64_t)data << 34;
+	frame |= (uint64_t)crc << 28;
+
+	for (int i = 0;i < 8;i++) {
+		resp[i] = frame >> (56 - 8 * i);
+	}
+}
+
+void spiStart(SPIDriver *spip, const SPIConfig *config) {
+	spip->config = config;
+	spip->spi = &m_spi_regs;
+	spip->state = SPI_READY;
+}
+
+void spiStop(SPIDriver *spip) {
+	spip->state = SPI_STOP;
+}
+
+void spiSelectI(SPIDriver *spip) { (void)spip; }
+void spiUnselectI(SPIDriver *spip) { (void)spip; }
+
+void spiStartExchangeI(SPIDriver *spip, size_t n, const void *txbuf, void *rxbuf) {
+	// I-class, so the caller must hold the lock or run from an interrupt
+	lock_check(m_lock > 0 || m_isr_ctx);
+
+	// Starting the next frame from the end callback is allowed, as in ChibiOS
+	if (spip->state != SPI_READY && spip->state != SPI_COMPLETE) {
+		m_start_while_busy++;
+	}
+	spip->state = SPI_ACTIVE;
+
+	int frame_bits = (spip->config->cr1 & SPI_CR1_DFF) ? 16 : 8;
+	int br = (spip->config->cr1 & SPI_CR1_BR) >> 3;
+	double bit_time = (double)(2 << br) / SPI_CLOCK;
+
+	memset(m_xfer_resp, 0, sizeof(m_xfer_resp));
+	switch (m_dev) {
+	case DEV_MT6816: dev_mt6816(txbuf, (uint16_t*)m_xfer_resp); break;
+	case DEV_AS5x47U: dev_as5x47u(txbuf, m_xfer_resp); break;
+	case DEV_BISSC: dev_bissc(m_xfer_resp); break;
+	default: break;
+	}
+
+	m_xfer_rx = rxbuf;
+	m_xfer_bytes = n * frame_bits / 8;
+	m_xfer_end = m_now + TICKS_US(0.5) + (uint64_t)((double)(n * frame_bits) * bit_time * TIMER_HZ);
+	m_xfer_active = true;
+}
+
+void spiStartReceiveI(SPIDriver *spip, size_t n, void *rxbuf) {
+	spiStartExchangeI(spip, n, NULL, rxbuf);
+}
+
+static void spi_complete(void) {
+	m_xfer_active = false;
+	memcpy(m_xfer_rx, m_xfer_resp, m_xfer_bytes);
+
+	m_spid.state = SPI_COMPLETE;
+	m_isr_ctx = true;
+	if (m_spid.config->end_cb) {
+		m_spid.config->end_cb(&m_spid);
+	}
+	m_isr_ctx = false;
+	if (m_spid.state == SPI_COMPLETE) {
+		m_spid.state = SPI_READY;
+	}
+}
+
+// FOC interrupt, the encoder part of mcpwm_foc_adc_int_handler
+
+static void foc_isr(void) {
+	uint32_t t_start = timer_time_now();
+
+	m_isr_ctx = true;
+	if (m_foc_trigger) {
+		encoder_trigger_isr();
+	}
+
+	uint32_t sample_time;
+	float ang = encoder_read_deg_sample(&sample_time);
+	float age = timer_seconds_between(sample_time, t_start);
+	float ext = RAD2DEG_f(foc_extrapolate_encoder(DEG2RAD_f(ang),
+			DEG2RAD_f(magnet_speed(m_now)), age));
+	utils_norm_angle(&ext);
+	m_isr_ctx = false;
+
+	m_busy_until = m_now + TICKS_US(FOC_ISR_TIME_US);
+
+	if ((double)(m_now - m_start) < SIM_WARMUP * TIMER_HZ) {
+		return;
+	}
+
+	uint64_t sample_ticks = m_now - (uint32_t)(t_start - sample_time);
+	double ts_err = fabs(angle_diff(magnet_deg(sample_ticks), ang));
+	double raw_err = fabs(angle_diff(magnet_deg(m_now), ang));
+	double ext_err = fabs(angle_diff(magnet_deg(m_now), ext));
+
+	m_stats.samples++;
+	m_stats.age_sum += age;
+	m_stats.raw_err_sum += raw_err;
+	m_stats.ext_err_sum += ext_err;
+	if (age > m_stats.age_max) m_stats.age_max = age;
+	if (raw_err > m_stats.raw_err_max) m_stats.raw_err_max = raw_err;
+	if (ext_err > m_stats.ext_err_max) m_stats.ext_err_max = ext_err;
+	if (ts_err > m_stats.ts_err_max) m_stats.ts_err_max = ts_err;
+}
+
+// Run the interrupts up to time t. Completed transfers are processed when the
+// FOC interrupt is done, as the SPI interrupt has lower priority.
+static void sim_advance_to(uint64_t t) {
+	lock_check(m_lock == 0);
+
+	for (;;) {
+		uint64_t next = t;
+		int event = 0;
+
+		if (m_foc_enabled && m_foc_next <= next) {
+			next = m_foc_next;
+			event = 1;
+		}
+
+		if (m_xfer_active) {
+			uint64_t end = m_xfer_end > m_busy_until ? m_xfer_end : m_busy_until;
+			if (end < next || (end == next && event == 0 && end <= t)) {
+				next = end;
+				event = 2;
+			}
+		}
+
+		if (event == 0) {
+			if (t > m_now) {
+				m_now = t;
+			}
+			return;
+		}
+
+		if (next > m_now) {
+			m_now = next;
+		}
+
+		if (event == 1) {
+			foc_isr();
+			m_foc_next += m_foc_period;
+		} else {
+			spi_complete();
+		}
+	}
+}
+
+static void sim_run(double seconds) {
+	uint64_t end = m_now + (uint64_t)(seconds * TIMER_HZ);
+
+	while (m_now < end) {
+		uint64_t wake = m_thd_wake > m_busy_until ? m_thd_wake : m_busy_until;
+		if (wake >= end) {
+			sim_advance_to(end);
+			break;
+		}
+
+		sim_advance_to(wake);
+		run_thread();
+	}
+}
+
+// Encoder configurations, with the timing of encoder_cfg.c
+
+ABI_config_t encoder_cfg_ABI;
+AD2S1205_config_t encoder_cfg_ad2s1205;
+ENCSINCOS_config_t encoder_cfg_sincos;
+TLE5012_config_t encoder_cfg_tle5012;
+TS5700N8501_config_t encoder_cfg_TS5700N8501;
+
+void enc_as5x47u_spi_callback(SPIDriver *pspi);
+void enc_mt6816_spi_callback(SPIDriver *pspi);
+void compute_bissc_callback(SPIDriver *pspi);
+
+AS504x_config_t encoder_cfg_as504x = {
+		{
+				&sim_gpio, 3, // nss
+				&sim_gpio, 1, // sck
+				0, 0, // mosi
+				&sim_gpio, 2, // miso
+				{{NULL, NULL}, NULL, NULL} // Mutex
+		},
+		{0},
+};
+
+MT6816_config_t encoder_cfg_mt6816 = {
+		&m_spid,
+		{enc_mt6816_spi_callback, 0, 0, SPI_BR_DIV4 | SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_DFF},
+		0, &sim_gpio, 0, &sim_gpio, 0, &sim_gpio, 0, &sim_gpio, 0,
+		{0.0, 0.0, 0, 0.0, 0, 0, 0, 0, 0, 0, 0, {0}},
+};
+
+AS5x47U_config_t encoder_cfg_as5x47u = {
+		&m_spid,
+		{enc_as5x47u_spi_callback, 0, 0, SPI_BR_DIV8 | SPI_CR1_CPHA},
+		0, &sim_gpio, 0, &sim_gpio, 0, &sim_gpio, 0, &sim_gpio, 0,
+		{0},
+};
+
+BISSC_config_t encoder_cfg_bissc = {
+		&m_spid,
+		{compute_bissc_callback, 0, 0, SPI_BR_DIV32 | SPI_CR1_CPOL | SPI_CR1_CPHA},
+		0, &sim_gpio, 0, &sim_gpio, 0, &sim_gpio, 0, &sim_gpio, 0,
+		22,
+		{0},
+		{0.0, 0, 0.0, 0, 0.0, 0, 0, 0, 0, {0}},
+};
+
+// Other encoders and firmware functions used by encoder.c
+
+bool enc_abi_init(ABI_config_t *cfg) { (void)cfg; return false; }
+void enc_abi_deinit(ABI_config_t *cfg) { (void)cfg; }
+float enc_abi_read_deg(ABI_config_t *cfg) { (void)cfg; return 0.0; }
+void enc_abi_pin_isr(ABI_config_t *cfg) { (void)cfg; }
+bool enc_ad2s1205_init(AD2S1205_config_t *cfg) { (void)cfg; return false; }
+void enc_ad2s1205_deinit(AD2S1205_config_t *cfg) { (void)cfg; }
+void enc_ad2s1205_routine(AD2S1205_config_t *cfg) { (void)cfg; }
+void enc_ad2s1205_reset_errors(AD2S1205_config_t *cfg) { (void)cfg; }
+bool enc_sincos_init(ENCSINCOS_config_t *cfg) { (void)cfg; return false; }
+void enc_sincos_deinit(ENCSINCOS_config_t *cfg) { (void)cfg; }
+float enc_sincos_read_deg(ENCSINCOS_config_t *cfg) { (void)cfg; return 0.0; }
+bool enc_tle5012_init_sw_ssc(TLE5012_config_t *cfg) { (void)cfg; return false; }
+void enc_tle5012_deinit(TLE5012_config_t *cfg) { (void)cfg; }
+void enc_tle5012_routine(TLE5012_config_t *cfg) { (void)cfg; }
+tle5012_errortypes enc_tle5012_get_temperature(TLE5012_config_t *cfg, double *temperature) {
+	(void)cfg; (void)temperature; return NO_ERROR;
+}
+tle5012_errortypes enc_tle5012_get_magnet_magnitude(TLE5012_config_t *cfg, uint16_t *magnitude) {
+	(void)cfg; (void)magnitude; return NO_ERROR;
+}
+bool enc_ts5700n8501_init(TS5700N8501_config_t *cfg) { (void)cfg; return false; }
+void enc_ts5700n8501_deinit(TS5700N8501_config_t *cfg) { (void)cfg; }
+extern inline float enc_ts5700n8501_read_deg(TS5700N8501_config_t *cfg);
+extern inline uint8_t* enc_ts5700n8501_get_raw_status(TS5700N8501_config_t *cfg);
+extern inline int16_t enc_ts5700n8501_get_abm(TS5700N8501_config_t *cfg);
+extern inline void enc_ts5700n8501_reset_errors(TS5700N8501_config_t *cfg);
+extern inline void enc_ts5700n8501_reset_multiturn(TS5700N8501_config_t *cfg);
+bool enc_pwm_init(bool use_abi) { (void)use_abi; return false; }
+void enc_pwm_deinit(void) { }
+float enc_pwm_read_deg(void) { return 0.0; }
+uint32_t enc_pwm_update_cnt(void) { return 0; }
+
+void commands_printf(const char* format, ...) { (void)format; }
+
+static mc_configuration m_mcconf;
+const volatile mc_configuration *mc_interface_get_configuration(void) { return &m_mcconf; }
+void mc_interface_fault_stop(mc_fault_code fault, bool is_second_motor, bool is_isr) {
+	(void)fault; (void)is_second_motor; (void)is_isr;
+}
+bool mcpwm_foc_is_using_encoder(void) { return true; }
+app_configuration *mempools_alloc_appconf(void) { return 0; }
+void mempools_free_appconf(app_configuration *conf) { (void)conf; }
+void app_set_configuration(app_configuration *conf) { (void)conf; }
+void conf_general_read_app_configuration(app_configuration *conf) { (void)conf; }
+bool conf_general_store_app_configuration(app_configuration *conf) { (void)conf; return true; }
+
+// Tests
+
+static int m_failures = 0;
+
+static void check(bool ok, const char *name, const char *what) {
+	if (!ok) {
+		printf("FAIL %s: %s\n", name, what);
+		m_failures++;
+	}
+}
+
+static void scenario_start(const scenario_t *s) {
+	m_dev = s->dev;
+	m_start = m_now;
+	m_as5x47u_pending = 0x3FFF;
+	memset(&m_stats, 0, sizeof(m_stats));
+
+	m_mcconf.m_sensor_port_mode = s->port_mode;
+	m_mcconf.m_encoder_counts = 22; // BiSS-C resolution
+	encoder_init(&m_mcconf);
+
+	m_foc_enabled = true;
+	m_foc_trigger = s->trigger;
+	m_foc_next = m_now + m_foc_period;
+	m_busy_until = m_now;
+}
+
+static void scenario_end(void) {
+	// Let the last transfer finish before the SPI is stopped
+	m_foc_enabled = false;
+	sim_run(0.001);
+	encoder_deinit();
+}
+
+static void run_scenario(const scenario_t *s) {
+	scenario_start(s);
+	m_bb_ticks = 0;
+	sim_run(SIM_TIME);
+
+	double busy = (double)m_bb_ticks / (SIM_TIME * TIMER_HZ) * 100.0;
+	printf("%-22s %6.1f %6.1f   %7.3f %7.3f   %7.4f %7.4f   %5.1f\n",
+			s->name,
+			m_stats.age_sum / m_stats.samples * 1e6, m_stats.age_max * 1e6,
+			m_stats.raw_err_sum / m_stats.samples, m_stats.raw_err_max,
+			m_stats.ext_err_sum / m_stats.samples, m_stats.ext_err_max,
+			busy);
+
+	// The angle must be the one of the magnet at the sample time, with the
+	// quantization of the sensor and the float resolution of the angle.
+	check(m_stats.ts_err_max <= s->lsb + 1e-4, s->name, "angle does not match sample time");
+
+	// Extrapolating the age with the speed removes the latency. What remains
+	// is quantization and the acceleration over the age.
+	check(m_stats.ext_err_max <= s->lsb + 0.005, s->name, "extrapolated angle error too large");
+
+	if (s->trigger) {
+		// One PWM period for the ISR to pick up the result, the BiSS-C trigger
+		// is limited to 10 kHz.
+		double age_lim = 1.0 / FOC_RATE + (s->dev == DEV_BISSC ? 1e-4 : 0.0) + 5e-6;
+		check(m_stats.age_max <= age_lim, s->name, "sample age above trigger period");
+	}
+
+	if (s->dev == DEV_BISSC) {
+		check(encoder_cfg_bissc.state.spi_comm_error_cnt == 0, s->name, "BiSS-C SPI busy");
+		check(encoder_cfg_bissc.state.spi_data_error_cnt == 0, s->name, "BiSS-C CRC errors");
+	}
+
+	scenario_end();
+}
+
+// When the FOC interrupt stops triggering, e.g. when the motor type is
+// changed, the routine thread has to take over.
+static void test_trigger_fallback(void) {
+	scenario_t s = {"MT6816 fallback", DEV_MT6816, SENSOR_PORT_MODE_MT6816_SPI_HW, true, 360.0 / 16384.0};
+	scenario_start(&s);
+	sim_run(0.02);
+
+	m_foc_trigger = false;
+	sim_run(0.02);
+
+	memset(&m_stats, 0, sizeof(m_stats));
+	sim_run(0.02);
+
+	check(m_stats.samples > 0, s.name, "no samples");
+	check(m_stats.age_max < 2.5 / CH_CFG_ST_FREQUENCY, s.name, "thread did not take over");
+	check(m_stats.ext_err_max <= s.lsb + 0.005, s.name, "extrapolated angle error too large");
+	printf("%-22s %6.1f %6.1f\n", s.name, m_stats.age_sum / m_stats.samples * 1e6, m_stats.age_max * 1e6);
+
+	scenario_end();
+}
+
+int main(void) {
+	srand(1);
+	m_foc_period = (uint64_t)(TIMER_HZ / FOC_RATE);
+
+	uint8_t poly = 0x43;
+	for (int i = 0;i < 64;i++) {
+		int crc = i;
+		for (int j = 0;j < 6;j++) {
+			crc = (crc & 0x20) ? (crc << 1) ^ poly : crc << 1;
+		}
+		m_bissc_crc_table[i] = crc;
+	}
+
+	const double lsb14 = 360.0 / 16384.0;
+	const double lsb22 = 360.0 / (double)((1 << 22) - 1);
+	scenario_t scenarios[] = {
+			{"AS504x bit-bang", DEV_AS504x, SENSOR_PORT_MODE_AS5047_SPI, false, lsb14},
+			{"MT6816 thread", DEV_MT6816, SENSOR_PORT_MODE_MT6816_SPI_HW, false, lsb14},
+			{"MT6816 triggered", DEV_MT6816, SENSOR_PORT_MODE_MT6816_SPI_HW, true, lsb14},
+			{"AS5x47U thread", DEV_AS5x47U, SENSOR_PORT_MODE_AS5x47U_SPI, false, lsb14},
+			{"AS5x47U triggered", DEV_AS5x47U, SENSOR_PORT_MODE_AS5x47U_SPI, true, lsb14},
+			{"BiSS-C thread", DEV_BISSC, SENSOR_PORT_MODE_BISSC, false, lsb22},
+			{"BiSS-C triggered", DEV_BISSC, SENSOR_PORT_MODE_BISSC, true, lsb22},
+	};
+
+	printf("PWM %.0f kHz, magnet %.0f rpm, %.0f rpm/s\n\n",
+			FOC_RATE / 1e3, MAGNET_SPEED / 6.0, MAGNET_ACCEL / 6.0);
+	printf("                       age [us]        raw err [deg]     extrap err [deg]  bit-bang\n");
+	printf("                       mean    max     mean    max       mean    max       [%% cpu]\n");
+
+	for (unsigned int i = 0;i < sizeof(scenarios) / sizeof(scenarios[0]);i++) {
+		run_scenario(&scenarios[i]);
+	}
+
+	test_trigger_fallback();
+
+	check(m_lock_errors == 0, "kernel", "lock used from the wrong context");
+	check(m_start_while_busy == 0, "spi", "transfer started while the SPI was busy");
+
+	if (m_failures) {
+		printf("\n%d checks failed\n", m_failures);
+		return 1;
+	}
+
+	printf("\nAll tests passed\n");
+	return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef MC_INTERFACE_H_
+#define MC_INTERFACE_H_
+
+#include "datatypes.h"
+#include "hw.h"
+
+const volatile mc_configuration *mc_interface_get_configuration(void);
+void mc_interface_fault_stop(mc_fault_code fault, bool is_second_motor, bool is_isr);
+
+#endif
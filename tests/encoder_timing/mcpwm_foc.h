@@ -0,0 +1,8 @@
+#ifndef MCPWM_FOC_H_
+#define MCPWM_FOC_H_
+
+#include <stdbool.h>
+
+bool mcpwm_foc_is_using_encoder(void);
+
+#endif
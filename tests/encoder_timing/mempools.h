@@ -0,0 +1,9 @@
+#ifndef MEMPOOLS_H_
+#define MEMPOOLS_H_
+
+#include "datatypes.h"
+
+app_configuration *mempools_alloc_appconf(void);
+void mempools_free_appconf(app_configuration *conf);
+
+#endif
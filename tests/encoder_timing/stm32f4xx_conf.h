@@ -0,0 +1,7 @@
+#ifndef STM32F4XX_CONF_H
+#define STM32F4XX_CONF_H
+
+#define TIM_DeInit(tim)
+#define TIM_SetAutoreload(tim, val)
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef TERMINAL_H_
+#define TERMINAL_H_
+
+#define terminal_register_command_callback(command, help, arg_names, cbf)	(void)(cbf)
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef UTILS_H_
+#define UTILS_H_
+
+#include "utils_math.h"
+
+#define utils_is_func_valid(f)		((f) != 0)
+#define utils_byte_to_binary(x, b)	(void)(b)
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * Stand-in for ChibiOS. The test runs in one thread, so locking does nothing.
+ */
+
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint32_t systime_t;
+
+#define chSysLock()
+#define chSysUnlock()
+
+#endif  // CH_H
@@ -0,0 +1,11 @@
+#ifndef CONF_GENERAL_H_
+#define CONF_GENERAL_H_
+
+#define SYSTEM_CORE_CLOCK			168000000
+#define HW_HAS_DUAL_MOTORS
+
+#ifndef FOC_PROFILE_ENABLE
+#define FOC_PROFILE_ENABLE			1
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * The DWT and CoreDebug registers are plain variables, so that the test can
+ * set the cycle counter.
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include "ch.h"
+
+typedef struct {
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_core_debug;
+
+#define DWT							(&sim_dwt)
+#define CoreDebug					(&sim_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk		(1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk	(1UL << 24)
+
+#endif
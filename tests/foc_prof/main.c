@@ -0,0 +1,239 @@
+/*
+ * Test of the FOC interrupt profiler.
+ *
+ * The DWT cycle counter is a variable here, so interrupts with known stage
+ * lengths can be replayed through the marks. Checks the stage attribution,
+ * skipped stages, counter wrap, the motors, the 99th percentile against an
+ * exact one and the COMM_FOC_PROFILE reply.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "foc_prof.h"
+#include "hal.h"
+#include "datatypes.h"
+#include "buffer.h"
+
+DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+
+static uint8_t m_packet_buffer[512];
+static uint8_t m_reply[512];
+static unsigned int m_reply_len;
+static int m_failures = 0;
+
+uint8_t *mempools_get_packet_buffer(void) {
+	return m_packet_buffer;
+}
+
+void mempools_free_packet_buffer(uint8_t *buffer) {
+	(void)buffer;
+}
+
+void commands_printf(const char* format, ...) {
+	(void)format;
+}
+
+static void reply_func(unsigned char *data, unsigned int len) {
+	memcpy(m_reply, data, len);
+	m_reply_len = len;
+}
+
+static void check(bool ok, const char *what) {
+	if (!ok) {
+		printf("FAIL: %s\n", what);
+		m_failures++;
+	}
+}
+
+/*
+ * Replay one interrupt. cycles[i] is the length of stage i, and a negative
+ * length skips the mark of that stage. tail is the time from the last mark to
+ * the end.
+ */
+static void run_isr(bool second, const int *cycles, uint32_t tail, float dt) {
+	foc_prof_start();
+	for (int i = 0;i < FOC_PROF_TOTAL;i++) {
+		if (cycles[i] >= 0) {
+			sim_dwt.CYCCNT += cycles[i];
+			foc_prof_mark(i);
+		}
+	}
+	sim_dwt.CYCCNT += tail;
+	foc_prof_end(second, dt);
+}
+
+static foc_prof_summary summary(int motor, foc_prof_stage stage) {
+	foc_prof_summary s;
+	foc_prof_get_summary(motor, stage, &s);
+	return s;
+}
+
+static void test_stages(void) {
+	foc_prof_reset();
+
+	const int a[FOC_PROF_TOTAL] = {400, 100, 300, 900, 200, 1200, 500, 150};
+	const int b[FOC_PROF_TOTAL] = {600, 120, 300, 1100, 250, 1400, 700, 170};
+
+	// Start close to the counter wrap
+	sim_dwt.CYCCNT = 0xFFFFF000;
+	run_isr(false, a, 10, 1.0 / 15000.0);
+	run_isr(false, b, 30, 1.0 / 15000.0);
+
+	for (int i = 0;i < FOC_PROF_TOTAL;i++) {
+		foc_prof_summary s = summary(1, i);
+		check(s.cnt == 2, "stage count");
+		check(s.min == (uint32_t)a[i] && s.max == (uint32_t)b[i], "stage min and max");
+		check(fabs(s.avg - (a[i] + b[i]) / 2.0) < 1e-3, "stage average");
+		check(s.p99 == (uint32_t)b[i], "p99 of two samples");
+	}
+
+	uint32_t sum_a = 10, sum_b = 30;
+	for (int i = 0;i < FOC_PROF_TOTAL;i++) {
+		sum_a += a[i];
+		sum_b += b[i];
+	}
+
+	foc_prof_summary t = summary(1, FOC_PROF_TOTAL);
+	check(t.min == sum_a && t.max == sum_b, "total");
+	check(fabs(foc_prof_get_budget(1) - 11200.0) < 1.0, "budget");
+
+	// The second motor is separate
+	check(summary(2, FOC_PROF_TOTAL).cnt == 0, "motor 2 untouched");
+	run_isr(true, a, 0, 1.0 / 30000.0);
+	check(summary(2, FOC_PROF_TOTAL).cnt == 1 && summary(1, FOC_PROF_TOTAL).cnt == 2, "motor 2 count");
+	check(fabs(foc_prof_get_budget(2) - 5600.0) < 1.0, "budget motor 2");
+
+	// A skipped stage gets no sample and its time goes to the next stage
+	const int skip[FOC_PROF_TOTAL] = {400, 100, 300, -1, 200, 1200, 500, 150};
+	foc_prof_reset();
+	run_isr(false, skip, 0, 1.0 / 15000.0);
+	check(summary(1, FOC_PROF_OBSERVER).cnt == 0, "skipped stage");
+	check(summary(1, FOC_PROF_PHASE).min == 200, "stage after a skipped one");
+	check(summary(1, FOC_PROF_TOTAL).min == 2850, "total with a skipped stage");
+
+	foc_prof_summary bad;
+	check(!foc_prof_get_summary(3, FOC_PROF_TOTAL, &bad), "unknown motor");
+	check(!foc_prof_get_summary(1, FOC_PROF_STAGE_NUM, &bad), "unknown stage");
+}
+
+static int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Compare the histogram percentile with the exact one
+static void test_p99(const char *name, uint32_t (*gen)(int i), int n) {
+	foc_prof_reset();
+
+	uint32_t *v = malloc(n * sizeof(uint32_t));
+	int cycles[FOC_PROF_TOTAL];
+
+	for (int i = 0;i < n;i++) {
+		v[i] = gen(i);
+		for (int j = 0;j < FOC_PROF_TOTAL;j++) {
+			cycles[j] = j == FOC_PROF_CONTROL ? (int)v[i] : 1;
+		}
+		run_isr(false, cycles, 0, 1.0 / 20000.0);
+	}
+
+	qsort(v, n, sizeof(uint32_t), cmp_u32);
+	uint32_t exact = v[(int)ceil(0.99 * n) - 1];
+
+	foc_prof_summary s = summary(1, FOC_PROF_CONTROL);
+	printf("%-24s exact p99 %6u  histogram p99 %6u  max %6u\n", name, exact, s.p99, s.max);
+
+	check(s.cnt == (uint32_t)n, "sample count");
+	check(s.min == v[0] && s.max == v[n - 1], "min and max");
+	check(s.p99 >= exact, "p99 below the exact value");
+	check(s.p99 <= exact + exact / 8 + 1, "p99 more than one bin above");
+
+	free(v);
+}
+
+static uint32_t gen_small(int i) {
+	return i % 7;
+}
+
+static uint32_t gen_uniform(int i) {
+	(void)i;
+	return 1000 + rand() % 3000;
+}
+
+// Mostly steady with rare long interrupts, like HFI or a config change
+static uint32_t gen_spikes(int i) {
+	(void)i;
+	uint32_t c = 3500 + rand() % 200;
+	if (rand() % 50 == 0) {
+		c += 2000 + rand() % 3000;
+	}
+	return c;
+}
+
+static uint32_t gen_huge(int i) {
+	return 60000 + (i % 100) * 100;
+}
+
+static void test_send(void) {
+	foc_prof_reset();
+	const int a[FOC_PROF_TOTAL] = {400, 100, 300, 900, 200, 1200, 500, 150};
+	for (int i = 0;i < 10;i++) {
+		run_isr(false, a, 0, 1.0 / 15000.0);
+	}
+
+	foc_prof_send(1, true, reply_func);
+
+	int32_t ind = 0;
+	check(m_reply[ind++] == COMM_FOC_PROFILE, "reply id");
+	check(m_reply[ind++] == 1, "reply motor");
+	int num = m_reply[ind++];
+	check(num == FOC_PROF_STAGE_NUM, "reply stage count");
+	check(fabs(buffer_get_float32_auto(m_reply, &ind) - 11200.0) < 1.0, "reply budget");
+
+	for (int i = 0;i < num;i++) {
+		const char *name = (const char*)m_reply + ind;
+		check(strcmp(name, foc_prof_stage_name(i)) == 0, "reply stage name");
+		ind += strlen(name) + 1;
+
+		uint32_t cnt = buffer_get_uint32(m_reply, &ind);
+		uint32_t min = buffer_get_uint32(m_reply, &ind);
+		float avg = buffer_get_float32_auto(m_reply, &ind);
+		uint32_t max = buffer_get_uint32(m_reply, &ind);
+		uint32_t p99 = buffer_get_uint32(m_reply, &ind);
+
+		uint32_t expected = i < FOC_PROF_TOTAL ? (uint32_t)a[i] : 3750;
+		check(cnt == 10 && min == expected && max == expected && p99 == expected &&
+				fabs(avg - expected) < 1e-3, "reply stage values");
+	}
+
+	check((unsigned int)ind == m_reply_len, "reply length");
+	check(summary(1, FOC_PROF_TOTAL).cnt == 0, "reset after send");
+
+	foc_prof_send(3, false, reply_func);
+	check(m_reply_len == 7 && m_reply[2] == 0, "reply for an unknown motor");
+}
+
+int main(void) {
+	foc_prof_init();
+	check(sim_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk, "cycle counter enabled");
+	check(sim_core_debug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk, "trace enabled");
+
+	srand(1);
+	test_stages();
+	test_p99("small counts", gen_small, 1000);
+	test_p99("uniform 1000-4000", gen_uniform, 20000);
+	test_p99("steady with 2% spikes", gen_spikes, 20000);
+	test_p99("beyond the last bin", gen_huge, 1000);
+	test_send();
+
+	if (m_failures) {
+		printf("\n%d checks failed\n", m_failures);
+		return 1;
+	}
+
+	printf("\nAll tests passed\n");
+	return 0;
+}
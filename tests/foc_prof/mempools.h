@@ -0,0 +1,9 @@
+#ifndef MEMPOOLS_H_
+#define MEMPOOLS_H_
+
+#include <stdint.h>
+
+uint8_t *mempools_get_packet_buffer(void);
+void mempools_free_packet_buffer(uint8_t *buffer);
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * The observer and the current controller as they were before the per-cycle
+ * configuration snapshot (foc_hot_conf), reading mc_configuration and
+ * recomputing the derived values every cycle. Used as the timing baseline and
+ * to check that the snapshot gives the same result.
+ */
+
+#include "conf_ref.h"
+#include "utils_math.h"
+#include <math.h>
+
+// Parameters that are the same for every observer running on the same sample
+typedef struct {
+	float R;
+	float L;
+	float lambda;
+	float lambda_conf;
+	float sat_comp_l;
+	bool sat_comp_lambda;
+	bool saliency;
+	float saliency_half;
+	float saliency_term;
+	float gamma_half;
+} observer_params;
+
+static inline void observer_params_calc(observer_params *p, motor_all_state_t *motor) {
+	mc_configuration *conf_now = motor->m_conf;
+
+	p->R = conf_now->foc_motor_r;
+	p->L = conf_now->foc_motor_l;
+	p->lambda = conf_now->foc_motor_flux_linkage;
+	p->lambda_conf = p->lambda;
+	p->sat_comp_l = 0.0;
+	p->sat_comp_lambda = false;
+
+	// Saturation compensation
+	switch(conf_now->foc_sat_comp_mode) {
+	case SAT_COMP_LAMBDA:
+		p->sat_comp_lambda = true;
+		break;
+
+	case SAT_COMP_FACTOR: {
+		const float comp_fact = conf_now->foc_sat_comp * (motor->m_motor_state.i_abs_filter / conf_now->l_current_max);
+		p->L -= p->L * comp_fact;
+		p->lambda -= p->lambda * comp_fact;
+	} break;
+
+	case SAT_COMP_LAMBDA_AND_FACTOR:
+		p->sat_comp_lambda = true;
+		p->sat_comp_l = conf_now->foc_sat_comp * (motor->m_motor_state.i_abs_filter / conf_now->l_current_max);
+		break;
+
+	default:
+		break;
+	}
+
+	// Temperature compensation
+	if (conf_now->foc_temp_comp) {
+		p->R = motor->m_res_temp_comp;
+	}
+
+	float ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
+	float id = motor->m_motor_state.id;
+	float iq = motor->m_motor_state.iq;
+
+	// Adjust inductance for saliency.
+	p->saliency = fabsf(id) > 0.1 || fabsf(iq) > 0.1;
+	if (p->saliency) {
+		p->saliency_half = ld_lq_diff / 2.0;
+		p->saliency_term = ld_lq_diff * SQ(iq) / (SQ(id) + SQ(iq));
+	}
+
+	p->gamma_half = motor->m_gamma_now * 0.5;
+}
+
+// See http://cas.ensmp.fr/~praly/Telechargement/Journaux/2010-IEEE_TPEL-Lee-Hong-Nam-Ortega-Praly-Astolfi.pdf
+static inline void observer_run(mc_foc_observer_type type, const observer_params *p,
+		float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float i_alpha_last, float i_beta_last, float dt,
+		float *x1, float *x2, float *lambda_est, float *phase) {
+	float L = p->L;
+	const float lambda = p->lambda;
+	const float gamma_half = p->gamma_half;
+
+	if (p->sat_comp_lambda) {
+		// Here we assume that the inductance drops by the same amount as the flux linkage. I have
+		// no idea if this is a valid or even a reasonable assumption.
+		if (type >= FOC_OBSERVER_ORTEGA_LAMBDA_COMP ||
+				type >= FOC_OBSERVER_MXLEMMING_LAMBDA_COMP ||
+				type >= FOC_OBSERVER_MXV_LAMBDA_COMP ||
+				type >= FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
+			L = L * (*lambda_est / p->lambda_conf);
+		}
+		L -= L * p->sat_comp_l;
+	}
+
+	if (p->saliency) {
+		L = L - p->saliency_half + p->saliency_term;
+	}
+
+	float L_ia = L * i_alpha;
+	float L_ib = L * i_beta;
+	const float R_ia = p->R * i_alpha;
+	const float R_ib = p->R * i_beta;
+
+	switch (type) {
+	case FOC_OBSERVER_ORTEGA_ORIGINAL: {
+		float err = SQ(lambda) - (SQ(*x1 - L_ia) + SQ(*x2 - L_ib));
+
+		// Forcing this term to stay negative helps convergence according to
+		//
+		// http://cas.ensmp.fr/Publications/Publications/Papers/ObserverPermanentMagnet.pdf
+		// and
+		// https://arxiv.org/pdf/1905.00833.pdf
+		if (err > 0.0) {
+			err = 0.0;
+		}
+
+		float x1_dot = v_alpha - R_ia + gamma_half * (*x1 - L_ia) * err;
+		float x2_dot = v_beta - R_ib + gamma_half * (*x2 - L_ib) * err;
+
+		*x1 += x1_dot * dt;
+		*x2 += x2_dot * dt;
+	} break;
+
+	case FOC_OBSERVER_MXLEMMING:
+	case FOC_OBSERVER_MXLEMMING_LAMBDA_COMP:
+		// LICENCE NOTE:
+		// This function deviates slightly from the BSD 3 clause licence.
+		// The work here is entirely original to the MESC FOC project, and not based
+		// on any appnotes, or borrowed from another project. This work is free to
+		// use, as granted in BSD 3 clause, with the exception that this note must
+		// be included in where this code is implemented/modified to use your
+		// variable names, structures containing variables or other minor
+		// rearrangements in place of the original names I have chosen, and credit
+		// to David Molony as the original author must be noted.
+
+		*x1 += (v_alpha - R_ia) * dt - L * (i_alpha - i_alpha_last);
+		*x2 += (v_beta - R_ib) * dt - L * (i_beta - i_beta_last);
+
+		if (type == FOC_OBSERVER_MXLEMMING_LAMBDA_COMP) {
+			float err = SQ(*lambda_est) - (SQ(*x1) + SQ(*x2));
+			*lambda_est += 0.1 * gamma_half * *lambda_est * -err * dt;
+			utils_truncate_number(lambda_est, lambda * 0.3, lambda * 2.5);
+
+			utils_truncate_number_abs(x1, *lambda_est);
+			utils_truncate_number_abs(x2, *lambda_est);
+		} else {
+			utils_truncate_number_abs(x1, lambda);
+			utils_truncate_number_abs(x2, lambda);
+		}
+
+		// Set these to 0 to allow using the same atan2-code as for Ortega
+		L_ia = 0.0;
+		L_ib = 0.0;
+		break;
+
+	case FOC_OBSERVER_ORTEGA_LAMBDA_COMP: {
+		float err = SQ(*lambda_est) - (SQ(*x1 - L_ia) + SQ(*x2 - L_ib));
+
+		// FLux linkage observer. See:
+		// https://cas.mines-paristech.fr/~praly/Telechargement/Conferences/2017_IFAC_Bernard-Praly.pdf
+		*lambda_est += 0.2 * gamma_half * *lambda_est * -err * dt;
+
+		// Clamp the observed flux linkage (not sure if this is needed)
+		utils_truncate_number(lambda_est, lambda * 0.3, lambda * 2.5);
+
+		if (err > 0.0) {
+			err = 0.0;
+		}
+
+		float x1_dot = v_alpha - R_ia + gamma_half * (*x1 - L_ia) * err;
+		float x2_dot = v_beta - R_ib + gamma_half * (*x2 - L_ib) * err;
+
+		*x1 += x1_dot * dt;
+		*x2 += x2_dot * dt;
+	} break;
+
+	case FOC_OBSERVER_MXV:
+	case FOC_OBSERVER_MXV_LAMBDA_COMP:
+	case FOC_OBSERVER_MXV_LAMBDA_COMP_LIN:
+		*x1 += (v_alpha - R_ia) * dt;
+		*x2 += (v_beta - R_ib) * dt;
+
+		if (type == FOC_OBSERVER_MXV_LAMBDA_COMP ||
+				type == FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
+			if (type == FOC_OBSERVER_MXV_LAMBDA_COMP_LIN) {
+				float mag = NORM2_f(*x1 - L_ia, *x2 - L_ib);
+				UTILS_LP_FAST(*lambda_est, mag, 0.1 * gamma_half * dt * SQ(*lambda_est));
+				utils_truncate_number(lambda_est, lambda * 0.3, lambda * 2.5);
+
+				if (mag > *lambda_est) {
+					*x1 = (*x1 / mag) * *lambda_est;
+					*x2 = (*x2 / mag) * *lambda_est;
+				}
+			} else if (type == FOC_OBSERVER_MXV_LAMBDA_COMP) {
+				float err = SQ(*lambda_est) - (SQ(*x1 - L_ia) + SQ(*x2 - L_ib));
+				*lambda_est += 0.2 * gamma_half * *lambda_est * -err * dt;
+				utils_truncate_number(lambda_est, lambda * 0.3, lambda * 2.5);
+
+				float mag = NORM2_f(*x1 - L_ia, *x2 - L_ib);
+				if (mag > *lambda_est) {
+					*x1 = (*x1 / mag) * *lambda_est;
+					*x2 = (*x2 / mag) * *lambda_est;
+				}
+			}
+		} else {
+			float mag = NORM2_f(*x1 - L_ia, *x2 - L_ib);
+			if (mag > lambda) {
+				*x1 = (*x1 / mag) * lambda;
+				*x2 = (*x2 / mag) * lambda;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	UTILS_NAN_ZERO(*x1);
+	UTILS_NAN_ZERO(*x2);
+
+	// Prevent the magnitude from getting too low, as that makes the angle very unstable.
+	float mag = NORM2_f(*x1, *x2);
+	if (mag < (lambda * 0.5)) {
+		*x1 *= 1.1;
+		*x2 *= 1.1;
+	}
+
+	if (phase) {
+		*phase = utils_fast_atan2(*x2 - L_ib, *x1 - L_ia);
+	}
+
+	// Can we clamp the flux in dq with q flux = 0 and d flux is lambda
+	// Then the state->x1 and state->x2 (which are the alpha and beta fluxes) are set as lambda*sin and lambda*cos
+	// The d flux each time would have a residual after transform from ab to dq. This can be used as an input to the flux estimator
+}
+
+
+void ref_observer_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, observer_state *state, float *phase, motor_all_state_t *motor) {
+	observer_params p;
+	observer_params_calc(&p, motor);
+
+	observer_run(motor->m_conf->foc_observer_type, &p, v_alpha, v_beta, i_alpha, i_beta,
+			state->i_alpha_last, state->i_beta_last, dt,
+			&state->x1, &state->x2, &state->lambda_est, phase);
+
+	state->i_alpha_last = i_alpha;
+	state->i_beta_last = i_beta;
+}
+
+void ref_control_current(motor_all_state_t *motor, float dt) {
+	volatile motor_state_t *state_m = &motor->m_motor_state;
+	volatile mc_configuration *conf_now = motor->m_conf;
+
+	float s = state_m->phase_sin;
+	float c = state_m->phase_cos;
+
+	float max_duty = fabsf(state_m->max_duty);
+	utils_truncate_number(&max_duty, 0.0, conf_now->l_max_duty);
+
+	state_m->id = c * state_m->i_alpha + s * state_m->i_beta;
+	state_m->iq = c * state_m->i_beta  - s * state_m->i_alpha;
+
+	UTILS_LP_FAST(state_m->id_filter, state_m->id, conf_now->foc_current_filter_const);
+	UTILS_LP_FAST(state_m->iq_filter, state_m->iq, conf_now->foc_current_filter_const);
+
+	float d_gain_scale = 1.0;
+	if (conf_now->foc_d_gain_scale_start < 0.99) {
+		float max_mod_norm = fabsf(state_m->duty_now / max_duty);
+		if (max_duty < 0.01) {
+			max_mod_norm = 1.0;
+		}
+		if (max_mod_norm > conf_now->foc_d_gain_scale_start) {
+			d_gain_scale = utils_map(max_mod_norm, conf_now->foc_d_gain_scale_start, 1.0,
+					1.0, conf_now->foc_d_gain_scale_max_mod);
+			if (d_gain_scale < conf_now->foc_d_gain_scale_max_mod) {
+				d_gain_scale = conf_now->foc_d_gain_scale_max_mod;
+			}
+		}
+	}
+
+	float Ierr_d = state_m->id_target - state_m->id;
+	float Ierr_q = state_m->iq_target - state_m->iq;
+
+	float ki = conf_now->foc_current_ki;
+	if (conf_now->foc_temp_comp) {
+		ki = motor->m_current_ki_temp_comp;
+	}
+
+	state_m->vd_int += Ierr_d * (ki * d_gain_scale * dt);
+	state_m->vq_int += Ierr_q * (ki * dt);
+
+	state_m->vd = state_m->vd_int + Ierr_d * conf_now->foc_current_kp * d_gain_scale;
+	state_m->vq = state_m->vq_int + Ierr_q * conf_now->foc_current_kp;
+
+	float dec_vd = 0.0;
+	float dec_vq = 0.0;
+	float dec_bemf = 0.0;
+
+	if (motor->m_control_mode < CONTROL_MODE_HANDBRAKE && conf_now->foc_cc_decoupling != FOC_CC_DECOUPLING_DISABLED) {
+		switch (conf_now->foc_cc_decoupling) {
+		case FOC_CC_DECOUPLING_CROSS:
+			dec_vd = state_m->iq_filter * motor->m_speed_est_fast * motor->p_lq;
+			dec_vq = state_m->id_filter * motor->m_speed_est_fast * motor->p_ld;
+			break;
+
+		case FOC_CC_DECOUPLING_BEMF:
+			dec_bemf = motor->m_speed_est_fast * conf_now->foc_motor_flux_linkage;
+			break;
+
+		case FOC_CC_DECOUPLING_CROSS_BEMF:
+			dec_vd = state_m->iq_filter * motor->m_speed_est_fast * motor->p_lq;
+			dec_vq = state_m->id_filter * motor->m_speed_est_fast * motor->p_ld;
+			dec_bemf = motor->m_speed_est_fast * conf_now->foc_motor_flux_linkage;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	state_m->vd -= dec_vd;
+	state_m->vq += dec_vq + dec_bemf;
+
+	float max_v_mag = ONE_BY_SQRT3 * max_duty * state_m->v_bus * conf_now->foc_overmod_factor;
+
+	float vd_presat = state_m->vd;
+	utils_truncate_number_abs((float*)&state_m->vd, max_v_mag);
+	state_m->vd_int += (state_m->vd - vd_presat);
+
+	float max_vq = sqrtf(SQ(max_v_mag) - SQ(state_m->vd));
+	float vq_presat = state_m->vq;
+	utils_truncate_number_abs((float*)&state_m->vq, max_vq);
+	state_m->vq_int += (state_m->vq - vq_presat);
+
+	utils_saturate_vector_2d((float*)&state_m->vd, (float*)&state_m->vq, max_v_mag);
+
+	const float voltage_normalize = 1.5 / state_m->v_bus;
+	state_m->mod_d = state_m->vd * voltage_normalize;
+	state_m->mod_q = state_m->vq * voltage_normalize;
+
+	state_m->i_abs = NORM2_f(state_m->id, state_m->iq);
+	state_m->i_abs_filter = NORM2_f(state_m->id_filter, state_m->iq_filter);
+
+	state_m->mod_alpha_raw = c * state_m->mod_d - s * state_m->mod_q;
+	state_m->mod_beta_raw  = c * state_m->mod_q + s * state_m->mod_d;
+}
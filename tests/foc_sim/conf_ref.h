@@ -0,0 +1,10 @@
+#ifndef CONF_REF_H_
+#define CONF_REF_H_
+
+#include "foc_math.h"
+
+void ref_observer_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, observer_state *state, float *phase, motor_all_state_t *motor);
+void ref_control_current(motor_all_state_t *motor, float dt);
+
+#endif /* CONF_REF_H_ */
@@ -0,0 +1,751 @@
+/*
+ * Closed-loop FOC simulation on the host. Runs the FOC building blocks from
+ * motor/foc_math.c against the PMSM model in sim_motor.c, reports how well
+ * the loop tracks and how long each stage takes per control cycle.
+ *
+ * Usage: ./test [-o observer] [-s erpm | -c iq] [-n iterations] [-l load_nm]
+ *               [-j inertia] [-v vbus] [-w fw_current] [-r R] [-L L]
+ *               [-f flux_linkage] [-p poles] [-b]
+ *
+ * With -b the Ortega, MXLemming and MXV observers also run as a batch next
+ * to the active one, and their errors against the plant angle are printed.
+ *
+ * The observer and the current controller are also timed against conf_ref.c,
+ * the versions that read the configuration every cycle, and checked to give
+ * the same result for all observer, saturation, temperature and decoupling
+ * modes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "datatypes.h"
+#include "mcconf_default.h"
+#include "foc_math.h"
+#include "utils_math.h"
+#include "sim_motor.h"
+#include "conf_ref.h"
+
+#define PWM_TOP				8400
+#define BENCH_RUNS			5
+
+typedef struct {
+	float v_alpha;
+	float v_beta;
+	float i_alpha;
+	float i_beta;
+	float gamma;
+	float id;
+	float iq;
+	float i_abs_filter;
+	float phase;
+	float mod_alpha;
+	float mod_beta;
+	float duty_abs;
+	float id_target;
+	float iq_target;
+	float speed_est;
+} trace_sample_t;
+
+static mc_configuration m_conf;
+static motor_all_state_t m_motor;
+static sim_motor_t m_plant;
+static trace_sample_t *m_trace;
+static bool m_batch_en = false;
+static const mc_foc_observer_type m_batch_types[FOC_OBSERVER_BATCH_MAX] = {
+		FOC_OBSERVER_ORTEGA_ORIGINAL,
+		FOC_OBSERVER_MXLEMMING,
+		FOC_OBSERVER_MXV
+};
+
+static void load_defaults(mc_configuration *conf) {
+	memset(conf, 0, sizeof(mc_configuration));
+
+	conf->l_current_max = MCCONF_L_CURRENT_MAX;
+	conf->l_current_min = MCCONF_L_CURRENT_MIN;
+	conf->lo_current_max = MCCONF_L_CURRENT_MAX;
+	conf->lo_current_min = MCCONF_L_CURRENT_MIN;
+	conf->l_current_max_scale = MCCONF_L_CURRENT_MAX_SCALE;
+	conf->l_min_erpm = MCCONF_L_RPM_MIN;
+	conf->l_max_erpm = MCCONF_L_RPM_MAX;
+	conf->l_max_duty = MCCONF_L_MAX_DUTY;
+	conf->cc_min_current = MCCONF_CC_MIN_CURRENT;
+	conf->s_pid_kp = MCCONF_S_PID_KP;
+	conf->s_pid_ki = MCCONF_S_PID_KI;
+	conf->s_pid_kd = MCCONF_S_PID_KD;
+	conf->s_pid_kd_filter = MCCONF_S_PID_KD_FILTER;
+	conf->s_pid_min_erpm = MCCONF_S_PID_MIN_RPM;
+	conf->s_pid_allow_braking = MCCONF_S_PID_ALLOW_BRAKING;
+	conf->s_pid_ramp_erpms_s = MCCONF_S_PID_RAMP_ERPMS_S;
+	conf->s_pid_speed_source = MCCONF_S_PID_SPEED_SOURCE;
+	conf->foc_current_kp = MCCONF_FOC_CURRENT_KP;
+	conf->foc_current_ki = MCCONF_FOC_CURRENT_KI;
+	conf->foc_f_zv = MCCONF_FOC_F_ZV;
+	conf->foc_pll_kp = MCCONF_FOC_PLL_KP;
+	conf->foc_pll_ki = MCCONF_FOC_PLL_KI;
+	conf->foc_motor_l = MCCONF_FOC_MOTOR_L;
+	conf->foc_motor_ld_lq_diff = MCCONF_FOC_MOTOR_LD_LQ_DIFF;
+	conf->foc_motor_r = MCCONF_FOC_MOTOR_R;
+	conf->foc_motor_flux_linkage = MCCONF_FOC_MOTOR_FLUX_LINKAGE;
+	conf->foc_observer_gain = MCCONF_FOC_OBSERVER_GAIN;
+	conf->foc_observer_gain_slow = MCCONF_FOC_OBSERVER_GAIN_SLOW;
+	conf->foc_openloop_rpm = MCCONF_FOC_OPENLOOP_RPM;
+	conf->foc_d_gain_scale_start = MCCONF_FOC_D_GAIN_SCALE_START;
+	conf->foc_d_gain_scale_max_mod = MCCONF_FOC_D_GAIN_SCALE_MAX_MOD;
+	conf->foc_sl_erpm = MCCONF_FOC_SL_ERPM;
+	conf->foc_current_filter_const = MCCONF_FOC_CURRENT_FILTER_CONST;
+	conf->foc_cc_decoupling = MCCONF_FOC_CC_DECOUPLING;
+	conf->foc_observer_type = MCCONF_FOC_OBSERVER_TYPE;
+	conf->foc_sat_comp_mode = MCCONF_FOC_SAT_COMP_MODE;
+	conf->foc_sat_comp = MCCONF_FOC_SAT_COMP;
+	conf->foc_temp_comp = MCCONF_FOC_TEMP_COMP;
+	conf->foc_fw_current_max = MCCONF_FOC_FW_CURRENT_MAX;
+	conf->foc_fw_duty_start = MCCONF_FOC_FW_DUTY_START;
+	conf->foc_fw_ramp_time = MCCONF_FOC_FW_RAMP_TIME;
+	conf->foc_overmod_factor = MCCONF_FOC_OVERMOD_FACTOR;
+	conf->si_motor_poles = MCCONF_SI_MOTOR_POLES;
+}
+
+static double time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/*
+ * Current controller from mcpwm_foc.c (control_current) without HFI, audio
+ * and dead time compensation.
+ */
+static void control_current(motor_all_state_t *motor, float dt) {
+	volatile motor_state_t *state_m = &motor->m_motor_state;
+	const foc_hot_conf *hot = &motor->p_hot;
+
+	float s = state_m->phase_sin;
+	float c = state_m->phase_cos;
+
+	float max_duty = fabsf(state_m->max_duty);
+	utils_truncate_number(&max_duty, 0.0, hot->max_duty);
+
+	state_m->id = c * state_m->i_alpha + s * state_m->i_beta;
+	state_m->iq = c * state_m->i_beta  - s * state_m->i_alpha;
+
+	UTILS_LP_FAST(state_m->id_filter, state_m->id, hot->current_filter_const);
+	UTILS_LP_FAST(state_m->iq_filter, state_m->iq, hot->current_filter_const);
+
+	// With the scaling off the slope is 0 and the limit 1, so the scale stays at 1.
+	// Compare against the start before dividing, as the modulation is below it most
+	// of the time.
+	float d_gain_scale = 1.0;
+	const float duty_abs = fabsf(state_m->duty_now);
+	if (max_duty < 0.01 || duty_abs > hot->d_gain_scale_start * max_duty) {
+		float max_mod_norm = 1.0;
+		if (max_duty >= 0.01) {
+			max_mod_norm = duty_abs / max_duty;
+		}
+		d_gain_scale = 1.0 + (max_mod_norm - hot->d_gain_scale_start) * hot->d_gain_scale_slope;
+		if (d_gain_scale < hot->d_gain_scale_max_mod) {
+			d_gain_scale = hot->d_gain_scale_max_mod;
+		}
+	}
+
+	float Ierr_d = state_m->id_target - state_m->id;
+	float Ierr_q = state_m->iq_target - state_m->iq;
+
+	const float ki = hot->current_ki;
+
+	state_m->vd_int += Ierr_d * (ki * d_gain_scale * dt);
+	state_m->vq_int += Ierr_q * (ki * dt);
+
+	state_m->vd = state_m->vd_int + Ierr_d * hot->current_kp * d_gain_scale;
+	state_m->vq = state_m->vq_int + Ierr_q * hot->current_kp;
+
+	// The coefficients are 0 for the decoupling terms that are off.
+	float dec_vd = 0.0;
+	float dec_vq = 0.0;
+	float dec_bemf = 0.0;
+
+	if (motor->m_control_mode < CONTROL_MODE_HANDBRAKE) {
+		dec_vd = state_m->iq_filter * motor->m_speed_est_fast * hot->dec_lq;
+		dec_vq = state_m->id_filter * motor->m_speed_est_fast * hot->dec_ld;
+		dec_bemf = motor->m_speed_est_fast * hot->dec_flux;
+	}
+
+	state_m->vd -= dec_vd;
+	state_m->vq += dec_vq + dec_bemf;
+
+	float max_v_mag = max_duty * state_m->v_bus * hot->max_v_mag_factor;
+
+	float vd_presat = state_m->vd;
+	utils_truncate_number_abs((float*)&state_m->vd, max_v_mag);
+	state_m->vd_int += (state_m->vd - vd_presat);
+
+	float max_vq = sqrtf(SQ(max_v_mag) - SQ(state_m->vd));
+	float vq_presat = state_m->vq;
+	utils_truncate_number_abs((float*)&state_m->vq, max_vq);
+	state_m->vq_int += (state_m->vq - vq_presat);
+
+	utils_saturate_vector_2d((float*)&state_m->vd, (float*)&state_m->vq, max_v_mag);
+
+	const float voltage_normalize = 1.5 / state_m->v_bus;
+	state_m->mod_d = state_m->vd * voltage_normalize;
+	state_m->mod_q = state_m->vq * voltage_normalize;
+
+	state_m->i_abs = NORM2_f(state_m->id, state_m->iq);
+	state_m->i_abs_filter = NORM2_f(state_m->id_filter, state_m->iq_filter);
+
+	state_m->mod_alpha_raw = c * state_m->mod_d - s * state_m->mod_q;
+	state_m->mod_beta_raw  = c * state_m->mod_q + s * state_m->mod_d;
+}
+
+/*
+ * Turn the modulation into phase voltages through the SVM, like the
+ * hardware would, and return the alpha/beta voltage seen by the motor.
+ */
+static void apply_modulation(motor_all_state_t *motor, float *v_alpha, float *v_beta) {
+	motor_state_t *state_m = &motor->m_motor_state;
+	uint32_t duty1, duty2, duty3;
+
+	foc_svm(state_m->mod_alpha_raw, state_m->mod_beta_raw, motor->m_conf->l_max_duty,
+			PWM_TOP, &duty1, &duty2, &duty3, &state_m->svm_sector);
+
+	float Va = ((float)duty1 / (float)PWM_TOP) * state_m->v_bus;
+	float Vb = ((float)duty2 / (float)PWM_TOP) * state_m->v_bus;
+	float Vc = ((float)duty3 / (float)PWM_TOP) * state_m->v_bus;
+
+	*v_alpha = (1.0 / 3.0) * (2.0 * Va - Vb - Vc);
+	*v_beta = ONE_BY_SQRT3 * (Vb - Vc);
+
+	state_m->va = Va;
+	state_m->vb = Vb;
+	state_m->vc = Vc;
+}
+
+static void update_gamma(motor_all_state_t *motor) {
+	mc_configuration *conf_now = motor->m_conf;
+
+	float gamma_tmp = utils_map(fabsf(motor->m_motor_state.duty_now),
+								0.0, 40.0 / motor->m_motor_state.v_bus,
+								0, conf_now->foc_observer_gain);
+	if (gamma_tmp < (conf_now->foc_observer_gain_slow * conf_now->foc_observer_gain)) {
+		gamma_tmp = conf_now->foc_observer_gain_slow * conf_now->foc_observer_gain;
+	}
+
+	motor->m_gamma_now = gamma_tmp * 4.0;
+}
+
+static void motor_init(motor_all_state_t *motor, mc_configuration *conf, float v_bus) {
+	memset(motor, 0, sizeof(motor_all_state_t));
+	motor->m_conf = conf;
+	motor->m_state = MC_STATE_RUNNING;
+	motor->m_motor_state.v_bus = v_bus;
+	motor->m_motor_state.max_duty = conf->l_max_duty;
+	motor->m_using_encoder = true;
+	foc_precalc_values(motor);
+	foc_hot_conf_calc(motor, &motor->p_hot);
+	update_gamma(motor);
+}
+
+typedef struct {
+	double angle_err_sq;
+	int angle_err_num;
+	double iq_err_sq;
+	double speed_err_sq;
+	int steady_num;
+	float angle_err_max;
+	double batch_err_sq[FOC_OBSERVER_BATCH_MAX];
+	bool diverged;
+} sim_result_t;
+
+static void run_closed_loop(int iterations, float speed_erpm, float iq_set, sim_result_t *res) {
+	motor_all_state_t *motor = &m_motor;
+	motor_state_t *state_m = &motor->m_motor_state;
+	const float dt = 1.0 / m_conf.foc_f_zv;
+	const int steady_start = iterations / 2;
+	float v_alpha = 0.0, v_beta = 0.0;
+
+	memset(res, 0, sizeof(sim_result_t));
+
+	for (int i = 0;i < iterations;i++) {
+		trace_sample_t *tr = &m_trace[i];
+
+		// Sample
+		state_m->i_alpha = m_plant.i_alpha;
+		state_m->i_beta = m_plant.i_beta;
+		state_m->v_alpha = v_alpha;
+		state_m->v_beta = v_beta;
+
+		tr->v_alpha = v_alpha;
+		tr->v_beta = v_beta;
+		tr->i_alpha = state_m->i_alpha;
+		tr->i_beta = state_m->i_beta;
+		tr->gamma = motor->m_gamma_now;
+		tr->id = state_m->id;
+		tr->iq = state_m->iq;
+		tr->i_abs_filter = state_m->i_abs_filter;
+
+		// Observer and angle selection. The plant angle takes the role of an encoder at low speed.
+		foc_observer_update(v_alpha, v_beta, state_m->i_alpha, state_m->i_beta,
+				dt, &motor->m_observer_state, &motor->m_phase_now_observer, motor);
+		if (m_batch_en) {
+			foc_observer_batch_update(v_alpha, v_beta, state_m->i_alpha, state_m->i_beta,
+					dt, m_plant.phi, &motor->m_observer_batch, motor);
+		}
+
+		state_m->phase = foc_correct_encoder(motor->m_phase_now_observer, m_plant.phi,
+				motor->m_speed_est_fast, m_conf.foc_sl_erpm, motor);
+		tr->phase = state_m->phase;
+
+		// Speed estimation
+		foc_pll_run(state_m->phase, dt, &motor->m_pll_phase, &motor->m_pll_speed, &m_conf);
+		float diff = utils_angle_difference_rad(state_m->phase, motor->m_phase_before_speed_est);
+		utils_truncate_number(&diff, -M_PI / 3.0, M_PI / 3.0);
+		UTILS_LP_FAST(motor->m_speed_est_fast, diff / dt, 0.01);
+		UTILS_LP_FAST(motor->m_speed_est_faster, diff / dt, 0.2);
+		motor->m_phase_before_speed_est = state_m->phase;
+
+		// Outer loops
+		if (motor->m_control_mode == CONTROL_MODE_SPEED) {
+			motor->m_speed_command_rpm = speed_erpm;
+			foc_run_pid_control_speed(true, dt, motor);
+		} else {
+			motor->m_iq_set = iq_set;
+		}
+
+		UTILS_LP_FAST(motor->m_duty_abs_filtered, fabsf(state_m->duty_now), 0.01);
+		tr->duty_abs = motor->m_duty_abs_filtered;
+		foc_run_fw(motor, dt);
+
+		state_m->id_target = -motor->m_i_fw_set;
+		state_m->iq_target = motor->m_iq_set;
+		utils_truncate_number(&state_m->iq_target, m_conf.lo_current_min, m_conf.lo_current_max);
+		tr->id_target = state_m->id_target;
+		tr->iq_target = state_m->iq_target;
+		tr->speed_est = motor->m_speed_est_fast;
+
+		// Current control and modulation
+		utils_fast_sincos_better(state_m->phase, &state_m->phase_sin, &state_m->phase_cos);
+		control_current(motor, dt);
+		tr->mod_alpha = state_m->mod_alpha_raw;
+		tr->mod_beta = state_m->mod_beta_raw;
+
+		apply_modulation(motor, &v_alpha, &v_beta);
+		state_m->duty_now = SIGN(state_m->vq) * NORM2_f(state_m->mod_d, state_m->mod_q) * motor->p_duty_norm;
+		update_gamma(motor);
+
+		// Tracking error against the plant
+		if (fabsf(sim_motor_erpm(&m_plant)) > m_conf.foc_sl_erpm) {
+			float err = utils_angle_difference_rad(motor->m_phase_now_observer, m_plant.phi);
+			res->angle_err_sq += SQ(err);
+			res->angle_err_num++;
+			if (fabsf(err) > res->angle_err_max) {
+				res->angle_err_max = fabsf(err);
+			}
+
+			for (int j = 0;j < motor->m_observer_batch.num;j++) {
+				res->batch_err_sq[j] += SQ(utils_angle_difference_rad(motor->m_observer_batch.phase[j], m_plant.phi));
+			}
+		}
+
+		if (i >= steady_start) {
+			res->iq_err_sq += SQ(state_m->iq_target - m_plant.iq);
+			res->speed_err_sq += SQ(motor->m_speed_pid_set_rpm - sim_motor_erpm(&m_plant));
+			res->steady_num++;
+		}
+
+		sim_motor_step(&m_plant, v_alpha, v_beta);
+
+		if (UTILS_IS_NAN(m_plant.iq) || UTILS_IS_NAN(state_m->vq)) {
+			res->diverged = true;
+			break;
+		}
+	}
+}
+
+static double bench_observer(void (*func)(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, observer_state *state, float *phase, motor_all_state_t *motor), int iterations) {
+	const float dt = 1.0 / m_conf.foc_f_zv;
+	double best = 1e30;
+
+	for (int run = 0;run < BENCH_RUNS;run++) {
+		observer_state obs = {0};
+		obs.lambda_est = m_conf.foc_motor_flux_linkage;
+		float phase = 0.0;
+
+		double start = time_ns();
+		for (int i = 0;i < iterations;i++) {
+			const trace_sample_t *tr = &m_trace[i];
+			m_motor.m_gamma_now = tr->gamma;
+			m_motor.m_motor_state.id = tr->id;
+			m_motor.m_motor_state.iq = tr->iq;
+			m_motor.m_motor_state.i_abs_filter = tr->i_abs_filter;
+			func(tr->v_alpha, tr->v_beta, tr->i_alpha, tr->i_beta,
+					dt, &obs, &phase, &m_motor);
+		}
+		double ns = (time_ns() - start) / iterations;
+		if (ns < best) {
+			best = ns;
+		}
+	}
+
+	return best;
+}
+
+static double bench_observer_batch(int iterations) {
+	const float dt = 1.0 / m_conf.foc_f_zv;
+	double best = 1e30;
+	observer_batch_state batch;
+
+	for (int run = 0;run < BENCH_RUNS;run++) {
+		foc_observer_batch_init(&batch, m_batch_types, FOC_OBSERVER_BATCH_MAX,
+				0.0, 0.0, m_conf.foc_motor_flux_linkage);
+
+		double start = time_ns();
+		for (int i = 0;i < iterations;i++) {
+			const trace_sample_t *tr = &m_trace[i];
+			m_motor.m_gamma_now = tr->gamma;
+			m_motor.m_motor_state.id = tr->id;
+			m_motor.m_motor_state.iq = tr->iq;
+			m_motor.m_motor_state.i_abs_filter = tr->i_abs_filter;
+			foc_observer_batch_update(tr->v_alpha, tr->v_beta, tr->i_alpha, tr->i_beta,
+					dt, tr->phase, &batch, &m_motor);
+		}
+		double ns = (time_ns() - start) / iterations;
+		if (ns < best) {
+			best = ns;
+		}
+	}
+
+	return best;
+}
+
+static double bench_pll(int iterations) {
+	const float dt = 1.0 / m_conf.foc_f_zv;
+	double best = 1e30;
+
+	for (int run = 0;run < BENCH_RUNS;run++) {
+		float pll_phase = 0.0, pll_speed = 0.0;
+
+		double start = time_ns();
+		for (int i = 0;i < iterations;i++) {
+			foc_pll_run(m_trace[i].phase, dt, &pll_phase, &pll_speed, &m_conf);
+		}
+		double ns = (time_ns() - start) / iterations;
+		if (ns < best) {
+			best = ns;
+		}
+	}
+
+	return best;
+}
+
+static double bench_svm(int iterations) {
+	double best = 1e30;
+	uint32_t duty1, duty2, duty3, sector;
+	volatile uint32_t sink = 0;
+
+	for (int run = 0;run < BENCH_RUNS;run++) {
+		double start = time_ns();
+		for (int i = 0;i < iterations;i++) {
+			foc_svm(m_trace[i].mod_alpha, m_trace[i].mod_beta, m_conf.l_max_duty,
+					PWM_TOP, &duty1, &duty2, &duty3, &sector);
+			sink += duty1;
+		}
+		double ns = (time_ns() - start) / iterations;
+		if (ns < best) {
+			best = ns;
+		}
+	}
+
+	(void)sink;
+	return best;
+}
+
+static double bench_fw(int iterations) {
+	const float dt = 1.0 / m_conf.foc_f_zv;
+	double best = 1e30;
+
+	for (int run = 0;run < BENCH_RUNS;run++) {
+		m_motor.m_i_fw_set = 0.0;
+
+		double start = time_ns();
+		for (int i = 0;i < iterations;i++) {
+			m_motor.m_duty_abs_filtered = m_trace[i].duty_abs;
+			foc_run_fw(&m_motor, dt);
+		}
+		double ns = (time_ns() - start) / iterations;
+		if (ns < best) {
+			best = ns;
+		}
+	}
+
+	return best;
+}
+
+static double bench_current(void (*func)(motor_all_state_t *motor, float dt), int iterations) {
+	const float dt = 1.0 / m_conf.foc_f_zv;
+	motor_state_t *state_m = &m_motor.m_motor_state;
+	double best = 1e30;
+
+	for (int run = 0;run < BENCH_RUNS;run++) {
+		state_m->vd_int = 0.0;
+		state_m->vq_int = 0.0;
+
+		double start = time_ns();
+		for (int i = 0;i < iterations;i++) {
+			const trace_sample_t *tr = &m_trace[i];
+			state_m->i_alpha = tr->i_alpha;
+			state_m->i_beta = tr->i_beta;
+			state_m->id_target = tr->id_target;
+			state_m->iq_target = tr->iq_target;
+			utils_fast_sincos_better(tr->phase, &state_m->phase_sin, &state_m->phase_cos);
+			func(&m_motor, dt);
+		}
+		double ns = (time_ns() - start) / iterations;
+		if (ns < best) {
+			best = ns;
+		}
+	}
+
+	return best;
+}
+
+typedef struct {
+	int combinations;
+	float phase_diff_max;
+	float mod_diff_max;
+} hot_conf_check_t;
+
+/*
+ * Run the snapshot and the configuration path side by side on the trace. The
+ * observer phase is compared for every observer type and saturation
+ * compensation mode and the current controller modulation for every
+ * decoupling mode, both with and without temperature compensation.
+ */
+static void check_hot_conf(int iterations, hot_conf_check_t *res) {
+	const float dt = 1.0 / m_conf.foc_f_zv;
+	const mc_configuration conf_old = m_conf;
+	static motor_all_state_t motor_hot, motor_ref;
+
+	memset(res, 0, sizeof(hot_conf_check_t));
+
+	m_conf.foc_sat_comp = 0.05;
+	m_motor.m_res_temp_comp = m_conf.foc_motor_r * 1.2;
+	m_motor.m_current_ki_temp_comp = m_conf.foc_current_ki * 1.2;
+
+	for (int temp_comp = 0;temp_comp < 2;temp_comp++) {
+		m_conf.foc_temp_comp = temp_comp;
+
+		for (int type = FOC_OBSERVER_ORTEGA_ORIGINAL;type <= FOC_OBSERVER_MXV_LAMBDA_COMP_LIN;type++) {
+			for (int sat = SAT_COMP_DISABLED;sat <= SAT_COMP_LAMBDA_AND_FACTOR;sat++) {
+				m_conf.foc_observer_type = type;
+				m_conf.foc_sat_comp_mode = sat;
+				foc_hot_conf_calc(&m_motor, &m_motor.p_hot);
+
+				observer_state obs = {0}, obs_ref = {0};
+				obs.lambda_est = m_conf.foc_motor_flux_linkage;
+				obs_ref.lambda_est = m_conf.foc_motor_flux_linkage;
+				float phase = 0.0, phase_ref = 0.0;
+
+				for (int i = 0;i < iterations;i++) {
+					const trace_sample_t *tr = &m_trace[i];
+					m_motor.m_gamma_now = tr->gamma;
+					m_motor.m_motor_state.id = tr->id;
+					m_motor.m_motor_state.iq = tr->iq;
+					m_motor.m_motor_state.i_abs_filter = tr->i_abs_filter;
+
+					foc_observer_update(tr->v_alpha, tr->v_beta, tr->i_alpha, tr->i_beta,
+							dt, &obs, &phase, &m_motor);
+					ref_observer_update(tr->v_alpha, tr->v_beta, tr->i_alpha, tr->i_beta,
+							dt, &obs_ref, &phase_ref, &m_motor);
+
+					float diff = fabsf(utils_angle_difference_rad(phase, phase_ref));
+					if (!(diff <= res->phase_diff_max)) {
+						res->phase_diff_max = diff;
+					}
+				}
+
+				res->combinations++;
+			}
+		}
+
+		for (int dec = FOC_CC_DECOUPLING_DISABLED;dec <= FOC_CC_DECOUPLING_CROSS_BEMF;dec++) {
+			m_conf.foc_cc_decoupling = dec;
+			foc_hot_conf_calc(&m_motor, &m_motor.p_hot);
+
+			motor_hot = m_motor;
+			motor_ref = m_motor;
+			motor_all_state_t *motors[2] = {&motor_hot, &motor_ref};
+
+			for (int i = 0;i < iterations;i++) {
+				const trace_sample_t *tr = &m_trace[i];
+
+				for (int j = 0;j < 2;j++) {
+					motor_state_t *state_m = &motors[j]->m_motor_state;
+					state_m->i_alpha = tr->i_alpha;
+					state_m->i_beta = tr->i_beta;
+					state_m->id_target = tr->id_target;
+					state_m->iq_target = tr->iq_target;
+					state_m->duty_now = tr->duty_abs;
+					motors[j]->m_speed_est_fast = tr->speed_est;
+					utils_fast_sincos_better(tr->phase, &state_m->phase_sin, &state_m->phase_cos);
+				}
+
+				control_current(&motor_hot, dt);
+				ref_control_current(&motor_ref, dt);
+
+				float diff = NORM2_f(motor_hot.m_motor_state.mod_alpha_raw - motor_ref.m_motor_state.mod_alpha_raw,
+						motor_hot.m_motor_state.mod_beta_raw - motor_ref.m_motor_state.mod_beta_raw);
+				if (!(diff <= res->mod_diff_max)) {
+					res->mod_diff_max = diff;
+				}
+			}
+
+			res->combinations++;
+		}
+	}
+
+	m_conf = conf_old;
+	foc_hot_conf_calc(&m_motor, &m_motor.p_hot);
+}
+
+static void print_usage(const char *name) {
+	printf("Usage: %s [-o observer] [-s erpm | -c iq] [-n iterations] [-l load_nm]\n"
+			"          [-j inertia] [-v vbus] [-w fw_current] [-r R] [-L L]\n"
+			"          [-f flux_linkage] [-p poles] [-b]\n", name);
+}
+
+int main(int argc, char **argv) {
+	int iterations = 100000;
+	float speed_erpm = 20000.0;
+	float iq_set = 0.0;
+	bool current_mode = false;
+	float load = 0.02;
+	float inertia = 0.0001;
+	float v_bus = 48.0;
+	int opt;
+
+	load_defaults(&m_conf);
+
+	while ((opt = getopt(argc, argv, "o:s:c:n:l:j:v:w:r:L:f:p:bh")) != -1) {
+		switch (opt) {
+		case 'o': m_conf.foc_observer_type = atoi(optarg); break;
+		case 's': speed_erpm = atof(optarg); break;
+		case 'c': iq_set = atof(optarg); current_mode = true; break;
+		case 'n': iterations = atoi(optarg); break;
+		case 'l': load = atof(optarg); break;
+		case 'j': inertia = atof(optarg); break;
+		case 'v': v_bus = atof(optarg); break;
+		case 'w': m_conf.foc_fw_current_max = atof(optarg); break;
+		case 'r': m_conf.foc_motor_r = atof(optarg); break;
+		case 'L': m_conf.foc_motor_l = atof(optarg); break;
+		case 'f': m_conf.foc_motor_flux_linkage = atof(optarg); break;
+		case 'p': m_conf.si_motor_poles = atoi(optarg); break;
+		case 'b': m_batch_en = true; break;
+		default:
+			print_usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (iterations < 1000) {
+		iterations = 1000;
+	}
+
+	m_trace = calloc(iterations, sizeof(trace_sample_t));
+	if (!m_trace) {
+		printf("Could not allocate trace\n");
+		return 1;
+	}
+
+	motor_init(&m_motor, &m_conf, v_bus);
+	m_motor.m_control_mode = current_mode ? CONTROL_MODE_CURRENT : CONTROL_MODE_SPEED;
+	sim_motor_init(&m_plant, &m_conf, inertia, load);
+
+	if (m_batch_en) {
+		foc_observer_batch_init(&m_motor.m_observer_batch, m_batch_types, FOC_OBSERVER_BATCH_MAX,
+				0.0, 0.0, m_conf.foc_motor_flux_linkage);
+	}
+
+	printf("Motor: R %.4f Ohm, L %.2f uH, lambda %.3f mWb, %d poles, fsw %.0f Hz\n",
+			(double)m_conf.foc_motor_r, (double)(m_conf.foc_motor_l * 1e6),
+			(double)(m_conf.foc_motor_flux_linkage * 1e3),
+			m_conf.si_motor_poles, (double)m_conf.foc_f_zv);
+	if (current_mode) {
+		printf("Mode: current %.1f A, observer %d, %d iterations\n",
+				(double)iq_set, m_conf.foc_observer_type, iterations);
+	} else {
+		printf("Mode: speed %.0f ERPM, observer %d, %d iterations\n",
+				(double)speed_erpm, m_conf.foc_observer_type, iterations);
+	}
+
+	sim_result_t res;
+	double start = time_ns();
+	run_closed_loop(iterations, speed_erpm, iq_set, &res);
+	double loop_ns = (time_ns() - start) / iterations;
+
+	if (res.diverged) {
+		printf("Simulation diverged\n");
+		free(m_trace);
+		return 1;
+	}
+
+	float angle_rms = res.angle_err_num > 0 ?
+			sqrt(res.angle_err_sq / res.angle_err_num) : 0.0;
+
+	printf("\r\nTracking\r\n");
+	printf("  Final speed:          %.1f ERPM\r\n", (double)sim_motor_erpm(&m_plant));
+	printf("  Observer angle RMS:   %.3f deg (max %.3f deg, %d samples)\r\n",
+			(double)RAD2DEG_f(angle_rms), (double)RAD2DEG_f(res.angle_err_max), res.angle_err_num);
+	for (int i = 0;i < m_motor.m_observer_batch.num && res.angle_err_num > 0;i++) {
+		printf("  Batch observer %d RMS: %.3f deg\r\n", m_motor.m_observer_batch.type[i],
+				(double)RAD2DEG_f(sqrt(res.batch_err_sq[i] / res.angle_err_num)));
+	}
+	printf("  Iq error RMS:         %.3f A\r\n", sqrt(res.iq_err_sq / res.steady_num));
+	if (!current_mode) {
+		printf("  Speed error RMS:      %.1f ERPM\r\n", sqrt(res.speed_err_sq / res.steady_num));
+	}
+
+	printf("\r\nTiming (ns per iteration)\r\n");
+	// The snapshot and the configuration path are timed in turns, so that
+	// frequency changes of the host affect both.
+	double obs_ns = 1e30, obs_ref_ns = 1e30;
+	double cc_ns = 1e30, cc_ref_ns = 1e30;
+	for (int i = 0;i < BENCH_RUNS;i++) {
+		obs_ns = fmin(obs_ns, bench_observer(foc_observer_update, iterations));
+		obs_ref_ns = fmin(obs_ref_ns, bench_observer(ref_observer_update, iterations));
+		cc_ns = fmin(cc_ns, bench_current(control_current, iterations));
+		cc_ref_ns = fmin(cc_ref_ns, bench_current(ref_control_current, iterations));
+	}
+
+	printf("  foc_observer_update:  %.1f (configuration path %.1f, %.0f%% saved)\r\n",
+			obs_ns, obs_ref_ns, 100.0 * (obs_ref_ns - obs_ns) / obs_ref_ns);
+	if (m_batch_en) {
+		printf("  Observer batch (%d):   %.1f\r\n", FOC_OBSERVER_BATCH_MAX, bench_observer_batch(iterations));
+	}
+	printf("  foc_pll_run:          %.1f\r\n", bench_pll(iterations));
+	printf("  foc_svm:              %.1f\r\n", bench_svm(iterations));
+	printf("  foc_run_fw:           %.1f\r\n", bench_fw(iterations));
+	printf("  control_current:      %.1f (configuration path %.1f, %.0f%% saved)\r\n",
+			cc_ns, cc_ref_ns, 100.0 * (cc_ref_ns - cc_ns) / cc_ref_ns);
+	printf("  Closed loop + plant:  %.1f\r\n", loop_ns);
+
+	hot_conf_check_t check;
+	check_hot_conf(iterations, &check);
+	bool check_ok = check.phase_diff_max < 1e-3 && check.mod_diff_max < 1e-4;
+
+	printf("\r\nConfiguration snapshot against the configuration path\r\n");
+	printf("  Mode combinations:    %d\r\n", check.combinations);
+	printf("  Max phase difference: %.2e rad\r\n", (double)check.phase_diff_max);
+	printf("  Max mod difference:   %.2e\r\n", (double)check.mod_diff_max);
+	printf("  Result:               %s\r\n", check_ok ? "Same" : "DIFFERENT");
+
+	free(m_trace);
+
+	// Fail when the observer lost track or the snapshot does not match, so
+	// that this can be used in scripts.
+	return (RAD2DEG_f(angle_rms) > 30.0 || !check_ok) ? 1 : 0;
+}
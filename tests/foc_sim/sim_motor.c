@@ -0,0 +1,86 @@
+/*
+	Copyright 2019 Maximiliano Cordoba	mcordoba@powerdesigns.ca
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "sim_motor.h"
+#include "utils_math.h"
+#include <math.h>
+#include <string.h>
+
+void sim_motor_init(sim_motor_t *m, const mc_configuration *conf, float J, float ml) {
+	memset(m, 0, sizeof(sim_motor_t));
+
+	m->Ts = 1.0 / conf->foc_f_zv;
+	m->substeps = 4;
+	m->J = J;
+	m->ml = ml;
+	m->pole_pairs = conf->si_motor_poles / 2;
+	m->km = 1.5 * m->pole_pairs;
+	m->r = conf->foc_motor_r;
+	m->lambda = conf->foc_motor_flux_linkage;
+
+	if (conf->foc_motor_ld_lq_diff > 0.0) {
+		m->lq = conf->foc_motor_l + conf->foc_motor_ld_lq_diff / 2;
+		m->ld = conf->foc_motor_l - conf->foc_motor_ld_lq_diff / 2;
+	} else {
+		m->lq = conf->foc_motor_l;
+		m->ld = conf->foc_motor_l;
+	}
+
+	m->cos_phi = 1.0;
+}
+
+/**
+ * Run the electrical and mechanical model for one sample period with the
+ * voltage vector that the controller applied at the previous step.
+ *
+ * vd = R*id + Ld*did/dt - we*Lq*iq
+ * vq = R*iq + Lq*diq/dt + we*(Ld*id + lambda)
+ *
+ * @param v_alpha	alpha axis Voltage in V
+ * @param v_beta	beta axis Voltage in V
+ */
+void sim_motor_step(sim_motor_t *m, float v_alpha, float v_beta) {
+	const float h = m->Ts / (float)m->substeps;
+
+	for (int i = 0;i < m->substeps;i++) {
+		const float vd = m->cos_phi * v_alpha + m->sin_phi * v_beta;
+		const float vq = m->cos_phi * v_beta - m->sin_phi * v_alpha;
+		const float we = m->wm * m->pole_pairs;
+
+		const float did = (vd - m->r * m->id + we * m->lq * m->iq) / m->ld;
+		const float diq = (vq - m->r * m->iq - we * (m->ld * m->id + m->lambda)) / m->lq;
+		m->id += did * h;
+		m->iq += diq * h;
+
+		m->me = m->km * (m->lambda + (m->ld - m->lq) * m->id) * m->iq;
+		m->wm += (h / m->J) * (m->me - m->ml);
+
+		m->phi += we * h;
+		utils_norm_angle_rad(&m->phi);
+		utils_fast_sincos_better(m->phi, &m->sin_phi, &m->cos_phi);
+	}
+
+	//	Park Inverse
+	m->i_alpha = m->cos_phi * m->id - m->sin_phi * m->iq;
+	m->i_beta  = m->cos_phi * m->iq + m->sin_phi * m->id;
+}
+
+float sim_motor_erpm(const sim_motor_t *m) {
+	return RADPS2RPM_f(m->wm * m->pole_pairs);
+}
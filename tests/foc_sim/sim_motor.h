@@ -0,0 +1,59 @@
+/*
+	Copyright 2019 Maximiliano Cordoba	mcordoba@powerdesigns.ca
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef SIM_MOTOR_H_
+#define SIM_MOTOR_H_
+
+#include "datatypes.h"
+
+/*
+ * Host port of the PMSM plant in motor/virtual_motor.c. The ADC, timer and
+ * terminal glue is left out, and the state lives in a struct so that several
+ * plants can run side by side.
+ */
+typedef struct {
+	//constant variables
+	float Ts;					//Sample Time in s
+	int substeps;				//Integration steps per sample
+	float J;					//Rotor/Load Inertia in Nm*s^2
+	int pole_pairs;				//number of pole pairs ( pole numbers / 2)
+	float km;					//constant = 1.5 * pole pairs
+	float r;					//phase resistance in Ohm
+	float ld;					//motor inductance in D axis in H
+	float lq;					//motor inductance in Q axis in H
+	float lambda;				//flux linkage in Wb
+	float ml;					//load torque in Nm
+
+	//non constant variables
+	float id;					//Current in d-Direction in Amps
+	float iq;					//Current in q-Direction in A
+	float me;					//Electrical Torque in Nm
+	float wm;					//Mechanical Angular Velocity in rad/s
+	float phi;					//Electrical Rotor Angle in rad
+	float sin_phi;
+	float cos_phi;
+	float i_alpha;				//alpha axis current in Amps
+	float i_beta;				//beta axis current in Amps
+} sim_motor_t;
+
+void sim_motor_init(sim_motor_t *m, const mc_configuration *conf, float J, float ml);
+void sim_motor_step(sim_motor_t *m, float v_alpha, float v_beta);
+float sim_motor_erpm(const sim_motor_t *m);
+
+#endif /* SIM_MOTOR_H_ */
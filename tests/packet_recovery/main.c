@@ -24,6 +24,50 @@ void process_packet_perf(unsigned char *data, unsigned int len) {
 	(void)len;
 }
 
+static unsigned int rx_cnt = 0;
+static uint32_t rx_hash = 0;
+
+void process_packet_hash(unsigned char *data, unsigned int len) {
+	rx_cnt++;
+	rx_hash = (rx_hash ^ len) * 16777619;
+	for (unsigned int i = 0;i < len;i++) {
+		rx_hash = (rx_hash ^ data[i]) * 16777619;
+	}
+}
+
+// Decode buffer[start:write] byte by byte and in random sized blocks, and
+// check that both give the same packets.
+static bool compare_bulk(unsigned int start, unsigned int max_chunk) {
+	packet_init(0, process_packet_hash, &state);
+	rx_cnt = 0;
+	rx_hash = 2166136261;
+	for (unsigned int i = start;i < write;i++) {
+		packet_process_byte(buffer[i], &state);
+	}
+	unsigned int cnt_byte = rx_cnt;
+	uint32_t hash_byte = rx_hash;
+
+	packet_init(0, process_packet_hash, &state);
+	rx_cnt = 0;
+	rx_hash = 2166136261;
+	unsigned int pos = start;
+	while (pos < write) {
+		unsigned int chunk = rand() % max_chunk + 1;
+		if (chunk > write - pos) {
+			chunk = write - pos;
+		}
+		packet_process_buffer(buffer + pos, chunk, &state);
+		pos += chunk;
+	}
+
+	bool ok = rx_cnt == cnt_byte && rx_hash == hash_byte;
+	if (!ok) {
+		printf("Mismatch from %d, chunk %d: %d vs %d packets\r\n",
+				start, max_chunk, cnt_byte, rx_cnt);
+	}
+	return ok;
+}
+
 int main(void) {
 	packet_init(send_packet, process_packet, &state);
 	
@@ -67,6 +111,43 @@ int main(void) {
 		packet_process_byte(buffer[i], &state);
 	}
 	
+	// Bulk decoding
+	printf("\r\nBulk Test\r\n");
+	unsigned int chunks[] = {1, 2, 7, 64, 600, 5000};
+	int fails = 0;
+	for (unsigned int c = 0;c < sizeof(chunks) / sizeof(int);c++) {
+		for (unsigned int ofs = 0;ofs < sizeof(offsets) / sizeof(int);ofs++) {
+			fails += !compare_bulk(offsets[ofs], chunks[c]);
+		}
+		fails += !compare_bulk(0, chunks[c]);
+	}
+
+	// Noisy link: random bytes between packets and random bit errors
+	packet_init(send_packet, 0, &state);
+	write = 0;
+	srand(105);
+	for (int i = 0;i < 200;i++) {
+		unsigned char pl[600];
+		unsigned int pl_len = rand() % (PACKET_MAX_PL_LEN - 1) + 1;
+		for (unsigned int j = 0;j < pl_len;j++) {
+			pl[j] = rand();
+		}
+		packet_send_packet(pl, pl_len, &state);
+
+		unsigned int noise = rand() % 40;
+		for (unsigned int j = 0;j < noise;j++) {
+			buffer[write++] = rand() % 6;
+		}
+
+		if (rand() % 10 == 0) {
+			buffer[write - noise - rand() % 20 - 1] ^= 1 << (rand() % 8);
+		}
+	}
+	for (unsigned int c = 0;c < sizeof(chunks) / sizeof(int);c++) {
+		fails += !compare_bulk(0, chunks[c]);
+	}
+	printf("Decoded %d packets, %d mismatches\r\n", rx_cnt, fails);
+
 	// Performance
 	printf("\r\nPerformance Test\r\n");
 	packet_init(send_packet, process_packet_perf, &state);
@@ -93,6 +174,45 @@ int main(void) {
 	cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
 	
 	printf("Time: %.3f s\r\n", cpu_time_used);
-	
-	return 0;
+
+	start = clock();
+	for (int i = 0;i < 1e6;i++) {
+		packet_send_packet(asd, sizeof(asd), &state);
+		packet_process_buffer(buffer, write, &state);
+		write = 0;
+	}
+	end = clock();
+	cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
+
+	printf("Time bulk: %.3f s\r\n", cpu_time_used);
+
+	// Performance on a noisy link, with all packets in one buffer
+	srand(106);
+	for (int i = 0;i < 400;i++) {
+		packet_send_packet(asd, sizeof(asd), &state);
+		unsigned int noise = rand() % 100;
+		for (unsigned int j = 0;j < noise;j++) {
+			buffer[write++] = rand();
+		}
+	}
+
+	start = clock();
+	for (int i = 0;i < 2500;i++) {
+		for (unsigned int j = 0;j < write;j++) {
+			packet_process_byte(buffer[j], &state);
+		}
+	}
+	end = clock();
+	cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
+	printf("Time noisy: %.3f s\r\n", cpu_time_used);
+
+	start = clock();
+	for (int i = 0;i < 2500;i++) {
+		packet_process_buffer(buffer, write, &state);
+	}
+	end = clock();
+	cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
+	printf("Time noisy bulk: %.3f s\r\n", cpu_time_used);
+
+	return fails != 0;
 }
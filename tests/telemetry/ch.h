@@ -0,0 +1,46 @@
+/*
+ * Stand-in for ChibiOS on top of pthreads. The system lock is a mutex that
+ * the emulated FOC interrupt also takes, so that it cannot run while the
+ * system is locked, as on the hardware.
+ */
+
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef uint32_t systime_t;
+typedef uint64_t stkalign_t;
+typedef struct  {
+   uint32_t *p_stklimit;
+} thread_t;
+
+typedef pthread_mutex_t mutex_t;
+typedef void (*tfunc_t)(void *arg);
+
+#define CH_CFG_ST_FREQUENCY			10000
+#define NORMALPRIO					128
+
+#define THD_WORKING_AREA(s, n)		uint8_t s[n]
+#define THD_FUNCTION(tname, arg)	void tname(void *arg)
+
+extern pthread_mutex_t sim_sys_mtx;
+
+#define chSysLock()					pthread_mutex_lock(&sim_sys_mtx)
+#define chSysUnlock()				pthread_mutex_unlock(&sim_sys_mtx)
+#define chMtxObjectInit(m)			pthread_mutex_init(m, NULL)
+#define chMtxLock(m)				pthread_mutex_lock(m)
+#define chMtxUnlock(m)				pthread_mutex_unlock(m)
+#define chRegSetThreadName(name)	(void)(name)
+#define chThdSleepMilliseconds(ms)	usleep((ms) * 1000)
+
+systime_t chVTGetSystemTimeX(void);
+#define chVTTimeElapsedSinceX(t)	(chVTGetSystemTimeX() - (t))
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, int prio, tfunc_t pf, void *arg);
+
+#endif  // CH_H
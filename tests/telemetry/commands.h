@@ -0,0 +1,6 @@
+#ifndef COMMANDS_H_
+#define COMMANDS_H_
+
+void commands_printf(const char* format, ...);
+
+#endif
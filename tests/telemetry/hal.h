@@ -0,0 +1,6 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include "ch.h"
+
+#endif
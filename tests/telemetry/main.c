@@ -0,0 +1,314 @@
+/*
+ * Test of the telemetry stream.
+ *
+ * A thread emulates the FOC interrupt of two motors at 20 kHz and calls
+ * telemetry_sample_isr after updating the channel values. The values are
+ * derived from the interrupt count, so the frames that the sender thread
+ * produces can be checked sample by sample: values, order, int16 scaling and
+ * saturation, and that every sample is either received or counted as an
+ * overrun.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "ch.h"
+#include "telemetry.h"
+#include "datatypes.h"
+#include "buffer.h"
+
+#define ISR_RATE			20000.0
+
+pthread_mutex_t sim_sys_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+// Channel values, written by the interrupt
+static volatile float m_count[2];
+static volatile float m_ramp[2];
+static volatile float m_big[2];
+static volatile float m_shared;
+
+// Interrupt
+static volatile bool m_isr_run = true;
+static volatile double m_isr_rate = ISR_RATE;
+static uint32_t m_isr_cnt[2];
+
+// Receiver
+typedef struct {
+	int ch_num;
+	int decimation;
+	int sign;
+	bool have_first;
+	double count_first;
+	uint32_t next;
+	uint32_t received;
+	uint32_t overruns;
+	uint32_t frames;
+	uint32_t errors;
+	int reply_delay_us;
+} receiver_t;
+
+static receiver_t m_rx;
+static pthread_mutex_t m_rx_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int m_failures = 0;
+
+static double time_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+systime_t chVTGetSystemTimeX(void) {
+	return (systime_t)(time_now() * CH_CFG_ST_FREQUENCY);
+}
+
+static void *thd_wrapper(void *arg) {
+	void **a = arg;
+	((tfunc_t)a[0])(a[1]);
+	return 0;
+}
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, int prio, tfunc_t pf, void *arg) {
+	(void)wsp; (void)size; (void)prio;
+	static void *args[2];
+	args[0] = (void*)pf;
+	args[1] = arg;
+	pthread_t thd;
+	pthread_create(&thd, NULL, thd_wrapper, args);
+	return 0;
+}
+
+void commands_printf(const char* format, ...) {
+	(void)format;
+}
+
+static void check(bool ok, const char *what) {
+	if (!ok) {
+		printf("FAIL: %s\n", what);
+		m_failures++;
+	}
+}
+
+static void *isr_thd(void *arg) {
+	(void)arg;
+
+	double next = time_now();
+	while (m_isr_run) {
+		double period = 1.0 / m_isr_rate;
+		while (time_now() < next) {}
+		next += period;
+
+		pthread_mutex_lock(&sim_sys_mtx);
+		for (int m = 0;m < 2;m++) {
+			uint32_t c = m_isr_cnt[m]++;
+			float sign = m ? -1.0 : 1.0;
+			m_count[m] = sign * (float)(c & 0xFFFFF);
+			m_ramp[m] = sign * (float)(c % 1000) * 0.01;
+			m_big[m] = sign * 1e6;
+			telemetry_sample_isr(m == 1);
+		}
+		pthread_mutex_unlock(&sim_sys_mtx);
+	}
+
+	return 0;
+}
+
+// Decode a frame. The selected channels in the tests are count (float32),
+// ramp (int16, scale 100) and big (int16, saturating), in the order given.
+static void reply_func(unsigned char *data, unsigned int len) {
+	pthread_mutex_lock(&m_rx_mtx);
+	receiver_t *r = &m_rx;
+
+	if (r->reply_delay_us) {
+		usleep(r->reply_delay_us);
+	}
+
+	int32_t ind = 0;
+	if (data[ind++] != COMM_TELEMETRY_DATA) {
+		pthread_mutex_unlock(&m_rx_mtx);
+		return;
+	}
+
+	uint32_t first = buffer_get_uint32(data, &ind);
+	uint32_t overruns = buffer_get_uint32(data, &ind);
+	int num = data[ind++];
+
+	if (len > TELEMETRY_FRAME_MAX) {
+		r->errors++;
+	}
+
+	// Samples before this frame that were not received must have been counted
+	// as overruns when the frame is sent.
+	if (first < r->next || overruns < r->overruns ||
+			first > (r->received + overruns)) {
+		r->errors++;
+	}
+	r->overruns = overruns;
+
+	for (int s = 0;s < num;s++) {
+		uint32_t idx = first + s;
+		double count = NAN;
+
+		for (int i = 0;i < r->ch_num;i++) {
+			if (i == 0) {
+				count = buffer_get_float32_auto(data, &ind) * r->sign;
+			} else if (i == 1) {
+				// Truncated like buffer_append_float16
+				int ramp = buffer_get_int16(data, &ind) * r->sign;
+				if (abs(ramp - (int)fmod(count, 1000.0)) > 1) {
+					r->errors++;
+				}
+			} else {
+				if (buffer_get_int16(data, &ind) != (r->sign > 0 ? 32767 : -32768)) {
+					r->errors++;
+				}
+			}
+		}
+
+		// The interrupt count advances by the decimation for every sample
+		if (!r->have_first) {
+			r->count_first = count - (double)idx * r->decimation;
+			r->have_first = true;
+		} else if (count != fmod(r->count_first + (double)idx * r->decimation, 1048576.0)) {
+			r->errors++;
+		}
+	}
+
+	if ((uint32_t)ind != len) {
+		r->errors++;
+	}
+
+	r->next = first + num;
+	r->received += num;
+	r->frames++;
+	pthread_mutex_unlock(&m_rx_mtx);
+}
+
+static void start_stream(int ch_num, int decimation, float duration, bool second_motor,
+		int reply_delay_us) {
+	const uint8_t ids[3] = {0, 1, 2};
+
+	telemetry_stop();
+	usleep(10000);
+
+	pthread_mutex_lock(&m_rx_mtx);
+	memset(&m_rx, 0, sizeof(m_rx));
+	m_rx.ch_num = ch_num;
+	m_rx.decimation = decimation;
+	m_rx.sign = second_motor ? -1 : 1;
+	m_rx.reply_delay_us = reply_delay_us;
+	pthread_mutex_unlock(&m_rx_mtx);
+
+	int started = telemetry_start(ids, ch_num, decimation, duration, second_motor, reply_func);
+	check(started == ch_num, "channels not started");
+}
+
+// Stop the stream and wait for the sender to flush the ring
+static void stop_stream(telemetry_stats *s) {
+	telemetry_stop();
+
+	uint32_t frames = 0;
+	do {
+		frames = s->frame_cnt;
+		usleep(100000);
+		telemetry_get_stats(s);
+	} while (s->frame_cnt != frames);
+}
+
+static void test_registry(void) {
+	check(telemetry_register_channel("count", &m_count[0], &m_count[1], 0.0) == 0, "register count");
+	check(telemetry_register_channel("ramp", &m_ramp[0], &m_ramp[1], 100.0) == 1, "register ramp");
+	check(telemetry_register_channel("big", &m_big[0], &m_big[1], 1.0) == 2, "register big");
+	check(telemetry_register_channel("shared", &m_shared, NULL, 0.0) == 3, "register shared");
+
+	// Registering again updates the channel
+	check(telemetry_register_channel("ramp", &m_ramp[0], &m_ramp[1], 100.0) == 1, "register again");
+	check(telemetry_channel_count() == 4, "channel count");
+	check(telemetry_get_channel(3)->value[1] == &m_shared, "motor 2 falls back to motor 1");
+	check(telemetry_get_channel(4) == 0, "unknown channel");
+
+	char name[16];
+	int added = 0;
+	for (int i = 0;i < TELEMETRY_CHANNELS_MAX;i++) {
+		snprintf(name, sizeof(name), "fill%d", i);
+		if (telemetry_register_channel(name, &m_shared, NULL, 0.0) >= 0) {
+			added++;
+		}
+	}
+	check(added == TELEMETRY_CHANNELS_MAX - 4, "registry limit");
+	check(telemetry_channel_count() == TELEMETRY_CHANNELS_MAX, "registry full");
+
+	// Unknown ids are skipped
+	const uint8_t ids[3] = {0, 200, 1};
+	check(telemetry_start(ids, 3, 1, 0.0, false, reply_func) == 2, "unknown id in stream");
+	telemetry_stop();
+}
+
+static void run_case(const char *name, int ch_num, int decimation, bool second_motor,
+		int reply_delay_us, double seconds, bool expect_overruns) {
+	start_stream(ch_num, decimation, 0.0, second_motor, reply_delay_us);
+	usleep((useconds_t)(seconds * 1e6));
+
+	telemetry_stats s = {0};
+	stop_stream(&s);
+
+	pthread_mutex_lock(&m_rx_mtx);
+	receiver_t r = m_rx;
+	pthread_mutex_unlock(&m_rx_mtx);
+
+	printf("%-28s samples %7u  received %7u  overruns %6u  frames %5u  ring max %4u\n",
+			name, s.sample_cnt, r.received, s.overrun_cnt, s.frame_cnt, s.ring_high_water);
+
+	check(r.errors == 0, "frame contents");
+	check(s.sample_cnt > 0 && r.received > 0, "no samples");
+	check(r.received + s.overrun_cnt == s.sample_cnt, "samples lost without overrun");
+	check(r.frames == s.frame_cnt, "frame count");
+	check((s.overrun_cnt > 0) == expect_overruns, "overrun count");
+
+	double expected = seconds * ISR_RATE / decimation;
+	check(s.sample_cnt > expected * 0.5 && s.sample_cnt < expected * 1.5, "sample rate");
+}
+
+static void test_duration(void) {
+	start_stream(2, 4, 0.1, false, 0);
+	usleep(300000);
+
+	telemetry_stats s;
+	telemetry_get_stats(&s);
+
+	pthread_mutex_lock(&m_rx_mtx);
+	receiver_t r = m_rx;
+	pthread_mutex_unlock(&m_rx_mtx);
+
+	check(!s.active, "stream did not stop after the duration");
+	check(r.errors == 0, "frame contents with duration");
+	check(r.received + s.overrun_cnt == s.sample_cnt, "samples lost at the end of the duration");
+	check(s.sample_cnt < 0.2 * ISR_RATE / 4, "stream ran too long");
+}
+
+int main(void) {
+	telemetry_init();
+	test_registry();
+
+	pthread_t isr;
+	pthread_create(&isr, NULL, isr_thd, NULL);
+
+	run_case("3 ch, motor 1", 3, 1, false, 0, 0.5, false);
+	run_case("3 ch, motor 2, decimation 3", 3, 3, true, 0, 0.5, false);
+	run_case("1 ch, decimation 10", 1, 10, false, 0, 0.5, false);
+	run_case("3 ch, slow link", 3, 1, false, 30000, 0.5, true);
+	test_duration();
+
+	m_isr_run = false;
+	pthread_join(isr, NULL);
+
+	if (m_failures) {
+		printf("\n%d checks failed\n", m_failures);
+		return 1;
+	}
+
+	printf("\nAll tests passed\n");
+	return 0;
+}
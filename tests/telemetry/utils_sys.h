@@ -0,0 +1,6 @@
+#ifndef UTILS_SYS_H_
+#define UTILS_SYS_H_
+
+#define UTILS_AGE_S(x)		((float)chVTTimeElapsedSinceX(x) / (float)CH_CFG_ST_FREQUENCY)
+
+#endif
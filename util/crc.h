@@ -22,6 +22,12 @@
 
 #include <stdint.h>
 
+// Bytes consumed per table lookup round. 1 uses only the classic 256-entry
+// tables, 4 and 8 add 3 or 7 more tables per CRC in exchange for speed.
+#ifndef CRC_SLICE_BY
+#define CRC_SLICE_BY		4
+#endif
+
 /*
  * Functions
  */
@@ -30,5 +36,7 @@ unsigned short crc16(unsigned char *buf, unsigned int len);
 uint32_t crc32(uint32_t *buf, uint32_t len);
 void crc32_reset(void);
 uint32_t crc32_with_init(const uint8_t *buf, uint32_t len, uint32_t cksum);
+uint32_t crc32c_with_init(const uint8_t *buf, uint32_t len, uint32_t cksum);
+uint32_t crc32c(const uint8_t *buf, uint32_t len);
 
 #endif /* CRC_H_ */
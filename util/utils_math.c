@@ -522,16 +522,21 @@ float utils_throttle_curve(float val, float curve_acc, float curve_brake, int mo
 }
 
 uint32_t utils_crc32c(uint8_t *data, uint32_t len) {
+	// Nibble table for the reflected CRC-32C polynomial 0x82F63B78. See crc32c in
+	// crc.c for a faster version with larger tables.
+	static const uint32_t tab[16] = {
+			0x00000000, 0x105EC76F, 0x20BD8EDE, 0x30E349B1,
+			0x417B1DBC, 0x5125DAD3, 0x61C69362, 0x7198540D,
+			0x82F63B78, 0x92A8FC17, 0xA24BB5A6, 0xB21572C9,
+			0xC38D26C4, 0xD3D3E1AB, 0xE330A81A, 0xF36E6F75
+	};
+
 	uint32_t crc = 0xFFFFFFFF;
 
 	for (uint32_t i = 0; i < len;i++) {
-		uint32_t byte = data[i];
-		crc = crc ^ byte;
-
-		for (int j = 7;j >= 0;j--) {
-			uint32_t mask = -(crc & 1);
-			crc = (crc >> 1) ^ (0x82F63B78 & mask);
-		}
+		crc ^= data[i];
+		crc = (crc >> 4) ^ tab[crc & 0x0F];
+		crc = (crc >> 4) ^ tab[crc & 0x0F];
 	}
 
 	return ~crc;